@@ -402,6 +402,7 @@ static void BGM_UpdateStream (void)
 	int	bufferSamples;
 	int	fileSamples;
 	int	fileBytes;
+	int	painted;
 	byte	raw[16384];
 
 	if (bgmstream->status != STREAM_PLAY)
@@ -412,12 +413,13 @@ static void BGM_UpdateStream (void)
 		return;
 
 	/* see how many samples should be copied into the raw buffer */
-	if (s_rawend < paintedtime)
-		s_rawend = paintedtime;
+	painted = S_GetPaintedTime ();
+	if (s_rawend < painted)
+		s_rawend = painted;
 
-	while (s_rawend < paintedtime + MAX_RAW_SAMPLES)
+	while (s_rawend < painted + MAX_RAW_SAMPLES)
 	{
-		bufferSamples = MAX_RAW_SAMPLES - (s_rawend - paintedtime);
+		bufferSamples = MAX_RAW_SAMPLES - (s_rawend - painted);
 
 		/* ramp up volume after stream was paused */
 		if (bgmstream->volume < 1.f)
@@ -22,6 +22,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 
 static void CL_FinishTimeDemo (void);
+static void CL_BenchmarkEndRun (int frames, float time);
+static void CL_DemoSeekClear (void);
 
 /*
 ==============================================================================
@@ -80,6 +82,49 @@ static struct
 	}				prev;
 }					demo_rewind;
 
+typedef struct
+{
+	qfileofs_t		fileofs;	// offset of the message containing svc_serverinfo
+	double			basetime;	// demo time at level start
+	double			firsttime;	// cl.mtime[0] when the level was fully connected, -1 if not yet
+} demolevel_t;
+
+typedef struct
+{
+	char			name[MAX_SCOREBOARDNAME];
+	float			entertime;
+	int				frags;
+	int				colors;
+} demoscore_t;
+
+typedef struct
+{
+	qfileofs_t		fileofs;	// offset of the next message
+	double			time;		// demo time
+	int				level;
+	int				num_entities;
+	entity_t		*entities;
+	demoscore_t		*scores;
+	cshift_t		cshift;
+	lightstyle_t	lightstyles[MAX_LIGHTSTYLES];
+	byte			*clstate;	// see CL_DemoSeekCopyState
+} demokeyframe_t;
+
+static struct
+{
+	demolevel_t		*levels;
+	demokeyframe_t	*keyframes;
+	int				spacing;	// in cl_demokeyframes units, doubles every time the keyframes are thinned
+	int				curlevel;	// -1 until svc_serverinfo
+	double			lasttime;	// last known demo time
+	qfileofs_t		msgofs;		// offset of the message being parsed
+	qboolean		pending;
+	qboolean		active;		// fast-forwarding, don't track rewind data
+	double			target;
+} demo_seek;
+
+cvar_t	cl_demokeyframes = {"cl_demokeyframes", "10", CVAR_NONE};	// seconds between demo seek keyframes, 0 disables
+
 /*
 ==============
 CL_ClearSignons
@@ -118,6 +163,8 @@ void CL_StopPlayback (void)
 	VEC_CLEAR (demo_rewind.pending_sounds);
 	demo_rewind.backstop = false;
 
+	CL_DemoSeekClear ();
+
 	if (cls.timedemo)
 		CL_FinishTimeDemo ();
 }
@@ -293,7 +340,17 @@ void CL_FinishDemoFrame (void)
 	size_t		i, len, numframes;
 	demoframe_t	*lastframe;
 
-	if (!cls.demoplayback || !cls.demospeed)
+	if (!cls.demoplayback)
+		return;
+
+	// No rewind tracking while demoseek is fast-forwarding
+	if (demo_seek.active)
+	{
+		Cbuf_Execute ();
+		return;
+	}
+
+	if (!cls.demospeed)
 		return;
 
 	// Flush any pending stuffcmds (such as v_chifts)
@@ -416,44 +473,27 @@ void CL_FinishDemoFrame (void)
 	}
 }
 
-static int CL_GetDemoMessage (void)
+/*
+====================
+CL_ReadDemoMessage
+
+Reads the next message from the demo file into net_message
+====================
+*/
+static qboolean CL_ReadDemoMessage (void)
 {
 	int		i;
 	float	f;
 
-	if (!cls.demospeed || demo_rewind.backstop)
-		return 0;
-
-	// decide if it is time to grab the next message
-	if (cls.signon == SIGNONS)	// always grab until fully connected
-	{
-		if (cls.timedemo)
-		{
-			if (host_framecount == cls.td_lastframe)
-				return 0;	// already read this frame's message
-			cls.td_lastframe = host_framecount;
-		// if this is the second frame, grab the real td_starttime
-		// so the bogus time on the first frame doesn't count
-			if (host_framecount == cls.td_startframe + 1)
-				cls.td_starttime = realtime;
-		}
-		else if (/* cl.time > 0 && */ cls.demospeed > 0.f ? cl.time <= cl.mtime[0] : cl.time >= cl.mtime[0])
-		{
-			return 0;	// don't need another message yet
-		}
-	}
-
-// get the next message
-	if (!CL_NextDemoFrame ())
-		return 0;
+	demo_seek.msgofs = QFS_Tell (cls.inpdemo);
 
 	if (QFS_ReadFile (cls.inpdemo, &net_message.cursize, 4) != 4)
-		goto readerror;
+		return false;
 	VectorCopy (cl.mviewangles[0], cl.mviewangles[1]);
 	for (i = 0 ; i < 3 ; i++)
 	{
 		if (QFS_ReadFile (cls.inpdemo, &f, 4) != 4)
-			goto readerror;
+			return false;
 		cl.mviewangles[0][i] = LittleFloat (f);
 	}
 
@@ -461,291 +501,846 @@ static int CL_GetDemoMessage (void)
 	if (net_message.cursize > MAX_MSGLEN)
 		Sys_Error ("Demo message > MAX_MSGLEN");
 	if (QFS_ReadFile (cls.inpdemo, net_message.data, net_message.cursize) != (size_t)net_message.cursize)
-	{
-	readerror:
-		CL_StopPlayback ();
-		return 0;
-	}
+		return false;
 
-	return 1;
+	return true;
 }
 
 /*
-====================
-CL_GetMessage
+==============================================================================
 
-Handles recording and playback of demos, on top of NET_ code
-====================
+DEMO SEEKING
+
+While a demo plays (or is fast-forwarded by demoseek) a keyframe of the
+client state is captured every cl_demokeyframes seconds of demo time,
+along with the file offset of the next message. The start of each level
+(the message containing svc_serverinfo) is indexed too, since keyframes
+can only be restored on top of the level they were taken in: precaches,
+models and static entities are reloaded by reparsing the serverinfo and
+signon messages instead.
+
+Demo time is cumulative across levels, so "demoseek 2400" means forty
+minutes into the demo, not into the current level. The indexed part of
+the demo is always contiguous from the start, since seeking past it
+parses every message in between (capturing keyframes on the way).
+
+Every keyframe holds a full copy of the entities, so their number is
+capped: when MAX_DEMO_KEYFRAMES is reached every other one is dropped and
+the spacing between new ones doubles. Long demos get coarser seeking
+instead of using more memory.
+==============================================================================
 */
-int CL_GetMessage (void)
-{
-	int	r;
 
-	if (cls.demoplayback)
-		return CL_GetDemoMessage ();
-
-	while (1)
-	{
-		r = NET_GetMessage (cls.netcon);
+#define MAX_DEMO_KEYFRAMES		128
 
-		if (r != 1 && r != 2)
-			return r;
 
-	// discard nop keepalive message
-		if (net_message.cursize == 1 && net_message.data[0] == svc_nop)
-			Con_Printf ("<-- server to client keepalive\n");
-		else
-			break;
-	}
+// The parts of client_state_t that change during a level and need to be
+// saved in a keyframe. cl.statss is skipped since it holds malloc'd strings.
+#define CL_STATE_RANGE1_BEGIN	offsetof (client_state_t, stats)
+#define CL_STATE_RANGE1_END		offsetof (client_state_t, statss)
+#define CL_STATE_RANGE2_BEGIN	offsetof (client_state_t, items)
+#define CL_STATE_RANGE2_END		offsetof (client_state_t, last_received_message)
+#define CL_STATE_SIZE			((CL_STATE_RANGE1_END - CL_STATE_RANGE1_BEGIN) + (CL_STATE_RANGE2_END - CL_STATE_RANGE2_BEGIN))
 
-	if (cls.demorecording)
-		CL_WriteDemoMessage ();
+/*
+===============
+CL_DemoSeekCopyState
+===============
+*/
+static void CL_DemoSeekCopyState (byte *data, qboolean save)
+{
+	byte	*base = (byte *) &cl;
+	size_t	len1 = CL_STATE_RANGE1_END - CL_STATE_RANGE1_BEGIN;
+	size_t	len2 = CL_STATE_RANGE2_END - CL_STATE_RANGE2_BEGIN;
 
-	if (cls.signon < 2)
+	if (save)
 	{
-	// record messages before full connection, so that a
-	// demo record can happen after connection is done
-		Vec_Append ((void**)&demo_head, 1, net_message.data, net_message.cursize);
-		VEC_PUSH (demo_head_sizes, net_message.cursize);
+		memcpy (data, base + CL_STATE_RANGE1_BEGIN, len1);
+		memcpy (data + len1, base + CL_STATE_RANGE2_BEGIN, len2);
+	}
+	else
+	{
+		memcpy (base + CL_STATE_RANGE1_BEGIN, data, len1);
+		memcpy (base + CL_STATE_RANGE2_BEGIN, data + len1, len2);
 	}
-
-	return r;
 }
 
-
 /*
-====================
-CL_Stop_f
-
-stop recording a demo
-====================
+===============
+CL_DemoSeekClear
+===============
 */
-void CL_Stop_f (void)
+static void CL_DemoSeekClear (void)
 {
-	if (cmd_source != src_command)
-		return;
+	size_t i;
 
-	if (!cls.demorecording)
+	for (i = 0; i < VEC_SIZE (demo_seek.keyframes); i++)
 	{
-		Con_Printf ("Not recording a demo.\n");
-		return;
+		demokeyframe_t *kf = &demo_seek.keyframes[i];
+		free (kf->entities);
+		free (kf->scores);
+		free (kf->clstate);
 	}
-
-// write a disconnect message to the demo file
-	SZ_Clear (&net_message);
-	MSG_WriteByte (&net_message, svc_disconnect);
-	CL_WriteDemoMessage ();
-
-// finish up
-	fclose (cls.outpdemo);
-	cls.outpdemo = NULL;
-	cls.demorecording = false;
-	Con_Printf ("Completed demo\n");
-	
-// ericw -- update demo tab-completion list
-	DemoList_Rebuild ();
+	VEC_FREE (demo_seek.keyframes);
+	VEC_FREE (demo_seek.levels);
+	memset (&demo_seek, 0, sizeof (demo_seek));
+	demo_seek.spacing = 1;
+	demo_seek.curlevel = -1;
 }
 
 /*
-====================
-CL_Record_f
+===============
+CL_DemoTime
 
-record <demoname> <map> [cd track]
-====================
+Demo time in seconds, cumulative across levels
+===============
 */
-void CL_Record_f (void)
+static double CL_DemoTime (void)
 {
-	int		c;
-	char	relname[MAX_OSPATH];
-	char	name[MAX_OSPATH];
-	int		track;
+	demolevel_t *level;
 
-	if (cmd_source != src_command)
-		return;
+	if ((size_t) demo_seek.curlevel >= VEC_SIZE (demo_seek.levels))
+		return 0.0;
 
-	if (cls.demoplayback)
-	{
-		Con_Printf ("Can't record during demo playback\n");
-		return;
-	}
+	level = &demo_seek.levels[demo_seek.curlevel];
+	if (level->firsttime < 0.0)
+		return level->basetime;
 
-	if (cls.demorecording)
-		CL_Stop_f();
+	return level->basetime + q_max (cl.mtime[0] - level->firsttime, 0.0);
+}
 
-	c = Cmd_Argc();
-	if (c != 2 && c != 3 && c != 4)
-	{
-		Con_Printf ("record <demoname> [<map> [cd track]]\n");
-		return;
-	}
+/*
+===============
+CL_DemoSeekNewLevel
 
-	if (strstr(Cmd_Argv(1), ".."))
-	{
-		Con_Printf ("Relative pathnames are not allowed.\n");
-		return;
-	}
+Called by CL_ParseServerInfo during demo playback
+===============
+*/
+void CL_DemoSeekNewLevel (void)
+{
+	demolevel_t	level;
+	size_t		i;
 
-	if (c == 2 && cls.state == ca_connected)
+	for (i = 0; i < VEC_SIZE (demo_seek.levels); i++)
 	{
-#if 0
-		Con_Printf("Can not record - already connected to server\nClient demo recording must be started before connecting\n");
-		return;
-#endif
-		if (cls.signon < 2)
+		if (demo_seek.levels[i].fileofs == demo_seek.msgofs)
 		{
-			Con_Printf("Can't record - try again when connected\n");
+			demo_seek.curlevel = i;
 			return;
 		}
 	}
 
-// write the forced cd track number, or -1
-	if (c == 4)
-	{
-		track = atoi(Cmd_Argv(3));
-		Con_Printf ("Forcing CD track to %i\n", cls.forcetrack);
-	}
-	else
-	{
-		track = -1;
-	}
+	// new levels can only be discovered past the end of the index
+	level.fileofs = demo_seek.msgofs;
+	level.basetime = demo_seek.lasttime;
+	level.firsttime = -1.0;
+	VEC_PUSH (demo_seek.levels, level);
+	demo_seek.curlevel = VEC_SIZE (demo_seek.levels) - 1;
+}
 
-	// save the demo name here, before potentially loading a new map (which would change argv[1])
-	q_strlcpy (relname, Cmd_Argv(1), sizeof(relname));
+/*
+===============
+CL_DemoSeekThin
 
-	// start the map up
-	if (c > 2)
+Drops every other keyframe, keeping the first one
+===============
+*/
+static void CL_DemoSeekThin (void)
+{
+	size_t	i, count;
+
+	count = VEC_SIZE (demo_seek.keyframes);
+	for (i = 1; i < count; i += 2)
 	{
-		Cmd_ExecuteString ( va("map %s", Cmd_Argv(2)), src_command);
-		if (cls.state != ca_connected)
-			return;
+		demokeyframe_t *kf = &demo_seek.keyframes[i];
+		free (kf->entities);
+		free (kf->scores);
+		free (kf->clstate);
 	}
+	for (i = 2; i < count; i += 2)
+		demo_seek.keyframes[i / 2] = demo_seek.keyframes[i];
+	VEC_POP_N (demo_seek.keyframes, count / 2);
 
-// open the demo file
-	COM_AddExtension (relname, ".dem", sizeof(relname));
-	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, relname);
+	demo_seek.spacing *= 2;
+}
 
-	Con_SafePrintf ("Recording to ");
-	Con_LinkPrintf (name, "%s", relname);
-	Con_SafePrintf (".\n");
+/*
+===============
+CL_DemoSeekCapture
 
-	cls.outpdemo = Sys_fopen (name, "wb");
-	if (!cls.outpdemo)
+Saves a keyframe with the current client state
+===============
+*/
+static void CL_DemoSeekCapture (qfileofs_t fileofs, double time)
+{
+	demokeyframe_t	kf;
+	int				i;
+
+	memset (&kf, 0, sizeof (kf));
+	kf.fileofs = fileofs;
+	kf.time = time;
+	kf.level = demo_seek.curlevel;
+	kf.num_entities = cl.num_entities;
+	kf.entities = (entity_t *) malloc (sizeof (entity_t) * q_max (cl.num_entities, 1));
+	kf.scores = (demoscore_t *) malloc (sizeof (demoscore_t) * q_max (cl.maxclients, 1));
+	kf.clstate = (byte *) malloc (CL_STATE_SIZE);
+	if (!kf.entities || !kf.scores || !kf.clstate)
+		Sys_Error ("CL_DemoSeekCapture: out of memory");
+
+	memcpy (kf.entities, cl_entities, sizeof (entity_t) * cl.num_entities);
+	for (i = 0; i < cl.maxclients; i++)
 	{
-		Con_Printf ("ERROR: couldn't create %s\n", relname);
-		return;
+		q_strlcpy (kf.scores[i].name, cl.scores[i].name, sizeof (kf.scores[i].name));
+		kf.scores[i].entertime = cl.scores[i].entertime;
+		kf.scores[i].frags = cl.scores[i].frags;
+		kf.scores[i].colors = cl.scores[i].colors;
 	}
+	memcpy (&kf.cshift, &cshift_empty, sizeof (cshift_t));
+	memcpy (kf.lightstyles, cl_lightstyle, sizeof (cl_lightstyle));
+	CL_DemoSeekCopyState (kf.clstate, true);
 
-	cls.forcetrack = track;
-	fprintf (cls.outpdemo, "%i\n", cls.forcetrack);
-	q_strlcpy (cls.demofilename, name, sizeof (cls.demofilename));
+	if (VEC_SIZE (demo_seek.keyframes) >= MAX_DEMO_KEYFRAMES)
+		CL_DemoSeekThin ();
+	VEC_PUSH (demo_seek.keyframes, kf);
+}
 
-	cls.demorecording = true;
+/*
+===============
+CL_DemoSeekRestore
 
-	// from ProQuake: initialize the demo file if we're already connected
-	if (c == 2 && cls.state == ca_connected)
-	{
-		static byte tmpbuf[NET_MAXMESSAGE];
-		byte *data = net_message.data;
-		int cursize = net_message.cursize;
-		int maxsize = net_message.maxsize;
-		int i, count;
+Restores a keyframe taken in the current level
+===============
+*/
+static void CL_DemoSeekRestore (const demokeyframe_t *kf)
+{
+	int i;
 
-		net_message.data = demo_head;
-		for (i = 0, count = VEC_SIZE (demo_head_sizes); i < count; i++)
-		{
-			net_message.cursize = demo_head_sizes[i];
-			CL_WriteDemoMessage ();
-			net_message.data += net_message.cursize;
-		}
+	SDL_assert (kf->level == demo_seek.curlevel);
 
-		net_message.data = tmpbuf;
-		net_message.maxsize = sizeof (tmpbuf);
-		SZ_Clear (&net_message);
+	QFS_Seek (cls.inpdemo, kf->fileofs, SEEK_SET);
 
-		// current names, colors, and frag counts
-		for (i = 0; i < cl.maxclients; i++)
-		{
-			MSG_WriteByte (&net_message, svc_updatename);
-			MSG_WriteByte (&net_message, i);
-			MSG_WriteString (&net_message, cl.scores[i].name);
-			MSG_WriteByte (&net_message, svc_updatefrags);
-			MSG_WriteByte (&net_message, i);
-			MSG_WriteShort (&net_message, cl.scores[i].frags);
-			MSG_WriteByte (&net_message, svc_updatecolors);
-			MSG_WriteByte (&net_message, i);
-			MSG_WriteByte (&net_message, cl.scores[i].colors);
-		}
+	// entities referenced for the first time after the keyframe keep their baseline only
+	for (i = kf->num_entities; i < cl.num_entities; i++)
+	{
+		entity_state_t baseline = cl_entities[i].baseline;
+		memset (&cl_entities[i], 0, sizeof (entity_t));
+		cl_entities[i].baseline = baseline;
+	}
+	memcpy (cl_entities, kf->entities, sizeof (entity_t) * kf->num_entities);
+	cl.num_entities = kf->num_entities;
+	for (i = 0; i < cl.num_entities; i++)
+	{
+		entity_t *ent = &cl_entities[i];
+		ent->lerpflags |= LERP_RESETMOVE|LERP_RESETANIM;
+		// scores are reallocated when the level is reparsed
+		if (ent->colormap != vid.colormap)
+			ent->colormap = (i >= 1 && i <= cl.maxclients) ? cl.scores[i-1].translations : vid.colormap;
+	}
 
-		// send all current light styles
-		for (i = 0; i < MAX_LIGHTSTYLES; i++)
+	for (i = 0; i < cl.maxclients; i++)
+	{
+		scoreboard_t *sb = &cl.scores[i];
+		q_strlcpy (sb->name, kf->scores[i].name, sizeof (sb->name));
+		sb->entertime = kf->scores[i].entertime;
+		sb->frags = kf->scores[i].frags;
+		if (sb->colors != kf->scores[i].colors)
 		{
-			MSG_WriteByte (&net_message, svc_lightstyle);
-			MSG_WriteByte (&net_message, i);
-			MSG_WriteString (&net_message, cl_lightstyle[i].map);
+			sb->colors = kf->scores[i].colors;
+			CL_NewTranslation (i);
 		}
+	}
 
-		//stats
-		for (i = 0; i < MAX_CL_STATS; i++)
-		{
-			if (!cl.stats[i] && !cl.statsf[i])
-				continue;
+	memcpy (&cshift_empty, &kf->cshift, sizeof (cshift_t));
+	memcpy (cl_lightstyle, kf->lightstyles, sizeof (cl_lightstyle));
+	CL_DemoSeekCopyState (kf->clstate, false);
 
-			if (net_message.cursize > 4096)
-			{	//periodically flush so that large maps don't need larger than vanilla limits
-				CL_WriteDemoMessage();
-				SZ_Clear (&net_message);
-			}
+	demo_seek.lasttime = kf->time;
+}
 
-			if ((double)cl.stats[i] != cl.statsf[i] && (unsigned int)cl.stats[i] <= 0x00ffffff)
-			{	//if the float representation seems to have more precision then use that, unless its getting huge in which case we're probably getting fpu truncation, so go back to more compatible ints
-				MSG_WriteByte (&net_message, svc_stufftext);
-				MSG_WriteString (&net_message, va ("//st %i %g\n", i, cl.statsf[i]));
-			}
-			else if (i >= MAX_CL_BASE_STATS)
-			{
-				MSG_WriteByte (&net_message, svc_stufftext);
-				MSG_WriteString (&net_message, va ("//st %i %i\n", i, cl.stats[i]));
-			}
-			else
-			{
-				MSG_WriteByte (&net_message, svc_updatestat);
-				MSG_WriteByte (&net_message, i);
-				MSG_WriteLong (&net_message, cl.stats[i]);
-			}
-		}
+/*
+===============
+CL_DemoSeekUpdate
 
-		// what about the CD track or SVC fog... future consideration.
-		MSG_WriteByte (&net_message, svc_updatestat);
-		MSG_WriteByte (&net_message, STAT_TOTALSECRETS);
-		MSG_WriteLong (&net_message, cl.stats[STAT_TOTALSECRETS]);
+Called before reading each demo message; keeps track of demo time
+and captures keyframes past the end of the index
+===============
+*/
+static void CL_DemoSeekUpdate (void)
+{
+	demolevel_t		*level;
+	demokeyframe_t	*last;
+	qfileofs_t		fileofs;
+	double			time;
 
-		MSG_WriteByte (&net_message, svc_updatestat);
-		MSG_WriteByte (&net_message, STAT_TOTALMONSTERS);
-		MSG_WriteLong (&net_message, cl.stats[STAT_TOTALMONSTERS]);
+	if (cls.signon != SIGNONS || (size_t) demo_seek.curlevel >= VEC_SIZE (demo_seek.levels))
+		return;
+
+	level = &demo_seek.levels[demo_seek.curlevel];
+	if (level->firsttime < 0.0)
+		level->firsttime = cl.mtime[0];
+
+	time = CL_DemoTime ();
+	demo_seek.lasttime = time;
+
+	if (cls.timedemo || cl_demokeyframes.value <= 0.f || cl.qcvm.progs)
+		return;
+
+	fileofs = QFS_Tell (cls.inpdemo);
+	last = VEC_SIZE (demo_seek.keyframes) ? &VEC_LAST (demo_seek.keyframes) : NULL;
+	if (last && (fileofs <= last->fileofs || time < last->time + cl_demokeyframes.value * demo_seek.spacing))
+		return;
+
+	CL_DemoSeekCapture (fileofs, time);
+}
+
+/*
+===============
+CL_DemoSeekParseNext
+
+Parses the next demo message without any timing,
+returns false when the demo ends
+===============
+*/
+static qboolean CL_DemoSeekParseNext (void)
+{
+	CL_DemoSeekUpdate ();
+
+	if (!CL_ReadDemoMessage ())
+	{
+		CL_StopPlayback ();
+		return false;
+	}
+
+	CL_ParseServerMessage ();
+	return cls.demoplayback;
+}
+
+/*
+===============
+CL_DemoSeekExecute
+
+Restores the closest keyframe before the target time (reloading
+its level if needed) then parses the remaining messages
+===============
+*/
+static void CL_DemoSeekExecute (void)
+{
+	double			target = demo_seek.target;
+	demokeyframe_t	*kf = NULL;
+	int				i, level = -1;
+	qboolean		fromcurrent;
+
+	demo_seek.pending = false;
+	demo_seek.active = true;
+
+	// latest keyframe and level start before the target
+	for (i = VEC_SIZE (demo_seek.keyframes) - 1; i >= 0; i--)
+	{
+		if (demo_seek.keyframes[i].time <= target)
+		{
+			kf = &demo_seek.keyframes[i];
+			break;
+		}
+	}
+	for (i = VEC_SIZE (demo_seek.levels) - 1; i >= 0; i--)
+	{
+		if (demo_seek.levels[i].basetime <= target || i == 0)
+		{
+			level = i;
+			break;
+		}
+	}
+	if (kf && kf->level < level)
+		kf = NULL;
+
+	// keep going from the current position if it's closer
+	fromcurrent = cls.signon == SIGNONS && demo_seek.curlevel >= level && CL_DemoTime () <= target;
+	if (fromcurrent && kf)
+		fromcurrent = demo_seek.curlevel > kf->level || QFS_Tell (cls.inpdemo) >= kf->fileofs;
+
+	if (!fromcurrent && level >= 0)
+	{
+		if (kf)
+			level = kf->level;
+		if (level != demo_seek.curlevel || cls.signon != SIGNONS || !kf)
+		{
+			// reparse the level's signon messages
+			QFS_Seek (cls.inpdemo, demo_seek.levels[level].fileofs, SEEK_SET);
+			demo_seek.curlevel = -1;
+			do
+			{
+				if (!CL_DemoSeekParseNext ())
+					goto done;
+			} while (demo_seek.curlevel != level || cls.signon != SIGNONS);
+		}
+		if (kf)
+			CL_DemoSeekRestore (kf);
+	}
+
+	while (cls.signon != SIGNONS || CL_DemoTime () < target)
+		if (!CL_DemoSeekParseNext ())
+			goto done;
+
+	// the rewind history doesn't carry over to the new position
+	VEC_CLEAR (demo_rewind.frames);
+	VEC_CLEAR (demo_rewind.frame_events);
+	VEC_CLEAR (demo_rewind.pending_sounds);
+	demo_rewind.backstop = false;
+
+	// drop transient effects spawned while fast-forwarding
+	memset (cl_dlights, 0, sizeof (cl_dlights));
+	memset (cl_temp_entities, 0, sizeof (cl_temp_entities));
+	memset (cl_beams, 0, sizeof (cl_beams));
+	R_ClearParticles ();
+	S_StopDynamicSounds ();
+
+	cl.time = cl.oldtime = cl.mtime[0];
+	cl.mtime[1] = cl.mtime[0];
+	VectorCopy (cl.mviewangles[0], cl.mviewangles[1]);
+
+done:
+	demo_seek.active = false;
+}
+
+/*
+====================
+CL_DemoSeekParseTime
+
+Parses [[hh:]mm:]ss[.frac]
+====================
+*/
+static qboolean CL_DemoSeekParseTime (const char *str, double *out)
+{
+	double	total = 0.0, part;
+	char	*end;
+	int		fields = 0;
+
+	while (1)
+	{
+		part = strtod (str, &end);
+		if (end == str || part < 0.0 || ++fields > 3)
+			return false;
+		total = total * 60.0 + part;
+		if (*end != ':')
+			break;
+		str = end + 1;
+	}
+
+	*out = total;
+	return *end == '\0';
+}
+
+/*
+====================
+CL_DemoSeek_f
+
+demoseek [[+|-][[hh:]mm:]ss]
+====================
+*/
+void CL_DemoSeek_f (void)
+{
+	const char	*arg;
+	double		time, now;
+	int			sign = 0;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (!cls.demoplayback || cls.timedemo)
+	{
+		Con_Printf ("Not playing a demo.\n");
+		return;
+	}
+
+	now = CL_DemoTime ();
+
+	if (Cmd_Argc () != 2)
+	{
+		Con_Printf ("demoseek [+|-]<[[hh:]mm:]ss> : seeks to a demo time (or relative to the current one)\n");
+		Con_Printf ("current time %d:%05.2f, %d keyframes over %d:%05.2f, %d level(s)\n",
+			(int) now / 60, fmod (now, 60.0), (int) VEC_SIZE (demo_seek.keyframes),
+			(int) demo_seek.lasttime / 60, fmod (demo_seek.lasttime, 60.0), (int) VEC_SIZE (demo_seek.levels));
+		return;
+	}
+
+	if (cl.qcvm.progs)
+	{
+		Con_Printf ("demoseek is not supported with CSQC.\n");
+		return;
+	}
+
+	arg = Cmd_Argv (1);
+	if (*arg == '+' || *arg == '-')
+		sign = *arg++ == '+' ? 1 : -1;
+
+	if (!CL_DemoSeekParseTime (arg, &time))
+	{
+		Con_Printf ("demoseek: invalid time \"%s\"\n", Cmd_Argv (1));
+		return;
+	}
+
+	if (sign)
+		time = now + sign * time;
+
+	// the seek happens on the next CL_GetDemoMessage call,
+	// so that stuffcmds can be executed between messages
+	demo_seek.target = q_max (time, 0.0);
+	demo_seek.pending = true;
+}
+
+static int CL_GetDemoMessage (void)
+{
+	if (demo_seek.pending)
+	{
+		CL_DemoSeekExecute ();
+		return 0;
+	}
+
+	if (!cls.demospeed || demo_rewind.backstop)
+		return 0;
+
+	// decide if it is time to grab the next message
+	if (cls.signon == SIGNONS)	// always grab until fully connected
+	{
+		if (cls.timedemo)
+		{
+			if (host_framecount == cls.td_lastframe)
+				return 0;	// already read this frame's message
+			cls.td_lastframe = host_framecount;
+		// if this is the second frame, grab the real td_starttime
+		// so the bogus time on the first frame doesn't count
+			if (host_framecount == cls.td_startframe + 1)
+				cls.td_starttime = realtime;
+		}
+		else if (/* cl.time > 0 && */ cls.demospeed > 0.f ? cl.time <= cl.mtime[0] : cl.time >= cl.mtime[0])
+		{
+			return 0;	// don't need another message yet
+		}
+	}
+
+	if (cls.demospeed > 0.f)
+		CL_DemoSeekUpdate ();
+
+// get the next message
+	if (!CL_NextDemoFrame ())
+		return 0;
+
+	if (!CL_ReadDemoMessage ())
+	{
+		CL_StopPlayback ();
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+====================
+CL_WriteDemoState
+
+Writes the signon messages and the current client state, so that a demo
+can start in the middle of a game
+====================
+*/
+static void CL_WriteDemoState (void)
+{
+	static byte tmpbuf[NET_MAXMESSAGE];
+	byte *data = net_message.data;
+	int cursize = net_message.cursize;
+	int maxsize = net_message.maxsize;
+	int i, count;
+
+	net_message.data = demo_head;
+	for (i = 0, count = VEC_SIZE (demo_head_sizes); i < count; i++)
+	{
+		net_message.cursize = demo_head_sizes[i];
+		CL_WriteDemoMessage ();
+		net_message.data += net_message.cursize;
+	}
+
+	net_message.data = tmpbuf;
+	net_message.maxsize = sizeof (tmpbuf);
+	SZ_Clear (&net_message);
+
+	// current names, colors, and frag counts
+	for (i = 0; i < cl.maxclients; i++)
+	{
+		MSG_WriteByte (&net_message, svc_updatename);
+		MSG_WriteByte (&net_message, i);
+		MSG_WriteString (&net_message, cl.scores[i].name);
+		MSG_WriteByte (&net_message, svc_updatefrags);
+		MSG_WriteByte (&net_message, i);
+		MSG_WriteShort (&net_message, cl.scores[i].frags);
+		MSG_WriteByte (&net_message, svc_updatecolors);
+		MSG_WriteByte (&net_message, i);
+		MSG_WriteByte (&net_message, cl.scores[i].colors);
+	}
+
+	// send all current light styles
+	for (i = 0; i < MAX_LIGHTSTYLES; i++)
+	{
+		MSG_WriteByte (&net_message, svc_lightstyle);
+		MSG_WriteByte (&net_message, i);
+		MSG_WriteString (&net_message, cl_lightstyle[i].map);
+	}
+
+	//stats
+	for (i = 0; i < MAX_CL_STATS; i++)
+	{
+		if (!cl.stats[i] && !cl.statsf[i])
+			continue;
+
+		if (net_message.cursize > 4096)
+		{	//periodically flush so that large maps don't need larger than vanilla limits
+			CL_WriteDemoMessage();
+			SZ_Clear (&net_message);
+		}
+
+		if ((double)cl.stats[i] != cl.statsf[i] && (unsigned int)cl.stats[i] <= 0x00ffffff)
+		{	//if the float representation seems to have more precision then use that, unless its getting huge in which case we're probably getting fpu truncation, so go back to more compatible ints
+			MSG_WriteByte (&net_message, svc_stufftext);
+			MSG_WriteString (&net_message, va ("//st %i %g\n", i, cl.statsf[i]));
+		}
+		else if (i >= MAX_CL_BASE_STATS)
+		{
+			MSG_WriteByte (&net_message, svc_stufftext);
+			MSG_WriteString (&net_message, va ("//st %i %i\n", i, cl.stats[i]));
+		}
+		else
+		{
+			MSG_WriteByte (&net_message, svc_updatestat);
+			MSG_WriteByte (&net_message, i);
+			MSG_WriteLong (&net_message, cl.stats[i]);
+		}
+	}
+
+	// what about the CD track or SVC fog... future consideration.
+	MSG_WriteByte (&net_message, svc_updatestat);
+	MSG_WriteByte (&net_message, STAT_TOTALSECRETS);
+	MSG_WriteLong (&net_message, cl.stats[STAT_TOTALSECRETS]);
+
+	MSG_WriteByte (&net_message, svc_updatestat);
+	MSG_WriteByte (&net_message, STAT_TOTALMONSTERS);
+	MSG_WriteLong (&net_message, cl.stats[STAT_TOTALMONSTERS]);
 
-		MSG_WriteByte (&net_message, svc_updatestat);
-		MSG_WriteByte (&net_message, STAT_SECRETS);
-		MSG_WriteLong (&net_message, cl.stats[STAT_SECRETS]);
+	MSG_WriteByte (&net_message, svc_updatestat);
+	MSG_WriteByte (&net_message, STAT_SECRETS);
+	MSG_WriteLong (&net_message, cl.stats[STAT_SECRETS]);
 
-		MSG_WriteByte (&net_message, svc_updatestat);
-		MSG_WriteByte (&net_message, STAT_MONSTERS);
-		MSG_WriteLong (&net_message, cl.stats[STAT_MONSTERS]);
+	MSG_WriteByte (&net_message, svc_updatestat);
+	MSG_WriteByte (&net_message, STAT_MONSTERS);
+	MSG_WriteLong (&net_message, cl.stats[STAT_MONSTERS]);
 
-		// view entity
-		MSG_WriteByte (&net_message, svc_setview);
-		MSG_WriteShort (&net_message, cl.viewentity);
+	// view entity
+	MSG_WriteByte (&net_message, svc_setview);
+	MSG_WriteShort (&net_message, cl.viewentity);
 
-		// signon
-		MSG_WriteByte (&net_message, svc_signonnum);
-		MSG_WriteByte (&net_message, 3);
+	// signon
+	MSG_WriteByte (&net_message, svc_signonnum);
+	MSG_WriteByte (&net_message, 3);
 
-		CL_WriteDemoMessage();
+	CL_WriteDemoMessage();
 
-		// restore net_message
-		net_message.data = data;
-		net_message.cursize = cursize;
-		net_message.maxsize = maxsize;
+	// restore net_message
+	net_message.data = data;
+	net_message.cursize = cursize;
+	net_message.maxsize = maxsize;
+}
+
+/*
+====================
+CL_GetMessage
+
+Handles recording and playback of demos, on top of NET_ code
+====================
+*/
+int CL_GetMessage (void)
+{
+	int	r;
+
+	if (cls.demoplayback)
+		return CL_GetDemoMessage ();
+
+	while (1)
+	{
+		r = NET_GetMessage (cls.netcon);
+
+		if (r != 1 && r != 2)
+			return r;
+
+	// discard nop keepalive message
+		if (net_message.cursize == 1 && net_message.data[0] == svc_nop)
+			Con_Printf ("<-- server to client keepalive\n");
+		else
+			break;
+	}
+
+	// the last update was a full one, so the server has stopped sending
+	// svc_snapshot and the demo can start
+	if (cls.demowaitfull && cls.signon == SIGNONS && !cl.snapshots)
+	{
+		cls.demowaitfull = false;
+		CL_WriteDemoState ();
+	}
+
+	if (cls.demorecording && !cls.demowaitfull)
+		CL_WriteDemoMessage ();
+
+	if (cls.signon < 2)
+	{
+	// record messages before full connection, so that a
+	// demo record can happen after connection is done
+		Vec_Append ((void**)&demo_head, 1, net_message.data, net_message.cursize);
+		VEC_PUSH (demo_head_sizes, net_message.cursize);
+	}
+
+	return r;
+}
+
+
+/*
+====================
+CL_Stop_f
+
+stop recording a demo
+====================
+*/
+void CL_Stop_f (void)
+{
+	if (cmd_source != src_command)
+		return;
+
+	if (!cls.demorecording)
+	{
+		Con_Printf ("Not recording a demo.\n");
+		return;
+	}
+
+// write a disconnect message to the demo file
+	SZ_Clear (&net_message);
+	MSG_WriteByte (&net_message, svc_disconnect);
+	CL_WriteDemoMessage ();
+
+// finish up
+	fclose (cls.outpdemo);
+	cls.outpdemo = NULL;
+	cls.demorecording = false;
+	cls.demowaitfull = false;
+	Con_Printf ("Completed demo\n");
+
+	CL_RequestSnapshots ();
+	
+// ericw -- update demo tab-completion list
+	DemoList_Rebuild ();
+}
+
+/*
+====================
+CL_Record_f
+
+record <demoname> <map> [cd track]
+====================
+*/
+void CL_Record_f (void)
+{
+	int		c;
+	char	relname[MAX_OSPATH];
+	char	name[MAX_OSPATH];
+	int		track;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (cls.demoplayback)
+	{
+		Con_Printf ("Can't record during demo playback\n");
+		return;
+	}
+
+	if (cls.demorecording)
+		CL_Stop_f();
+
+	c = Cmd_Argc();
+	if (c != 2 && c != 3 && c != 4)
+	{
+		Con_Printf ("record <demoname> [<map> [cd track]]\n");
+		return;
+	}
+
+	if (strstr(Cmd_Argv(1), ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	if (c == 2 && cls.state == ca_connected)
+	{
+#if 0
+		Con_Printf("Can not record - already connected to server\nClient demo recording must be started before connecting\n");
+		return;
+#endif
+		if (cls.signon < 2)
+		{
+			Con_Printf("Can't record - try again when connected\n");
+			return;
+		}
+	}
+
+// write the forced cd track number, or -1
+	if (c == 4)
+	{
+		track = atoi(Cmd_Argv(3));
+		Con_Printf ("Forcing CD track to %i\n", cls.forcetrack);
+	}
+	else
+	{
+		track = -1;
+	}
+
+	// save the demo name here, before potentially loading a new map (which would change argv[1])
+	q_strlcpy (relname, Cmd_Argv(1), sizeof(relname));
+
+	// start the map up
+	if (c > 2)
+	{
+		Cmd_ExecuteString ( va("map %s", Cmd_Argv(2)), src_command);
+		if (cls.state != ca_connected)
+			return;
+	}
+
+// open the demo file
+	COM_AddExtension (relname, ".dem", sizeof(relname));
+	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, relname);
+
+	Con_SafePrintf ("Recording to ");
+	Con_LinkPrintf (name, "%s", relname);
+	Con_SafePrintf (".\n");
+
+	cls.outpdemo = Sys_fopen (name, "wb");
+	if (!cls.outpdemo)
+	{
+		Con_Printf ("ERROR: couldn't create %s\n", relname);
+		return;
+	}
+
+	cls.forcetrack = track;
+	fprintf (cls.outpdemo, "%i\n", cls.forcetrack);
+	q_strlcpy (cls.demofilename, name, sizeof (cls.demofilename));
+
+	cls.demorecording = true;
+
+	// from ProQuake: initialize the demo file if we're already connected
+	// svc_snapshot deltas against frames the demo won't have, so if the
+	// server is sending those, wait until it has gone back to full updates
+	if (c == 2 && cls.state == ca_connected)
+	{
+		if (cl.snapshots)
+			cls.demowaitfull = true;
+		else
+			CL_WriteDemoState ();
 	}
+
+	CL_RequestSnapshots ();
 }
 
 
@@ -772,6 +1367,7 @@ void CL_PlayDemo_f (void)
 
 // disconnect from server
 	CL_Disconnect ();
+	CL_DemoSeekClear ();
 
 // open the demo file
 	q_strlcpy (name, Cmd_Argv(1), sizeof(name));
@@ -833,6 +1429,8 @@ static void CL_FinishTimeDemo (void)
 	if (!time)
 		time = 1;
 	Con_Printf ("%i frames %5.1f seconds %5.1f fps\n", frames, time, frames/time);
+
+	CL_BenchmarkEndRun (frames, time);
 }
 
 /*
@@ -865,3 +1463,566 @@ void CL_TimeDemo_f (void)
 	cls.td_lastframe = -1;	// get a new message this frame
 }
 
+
+/*
+==============================================================================
+
+BENCHMARK
+
+Plays a list of demos as timedemos a number of times each, recording
+per-frame host_speeds phase timings (server, gfx, snd), then writes
+min/avg/percentile/worst frame statistics to a JSON or CSV file.
+==============================================================================
+*/
+
+#define MAX_BENCH_DEMOS		64
+
+typedef enum
+{
+	BENCH_FRAME,
+	BENCH_SERVER,	// negative if the server didn't run this frame
+	BENCH_GFX,
+	BENCH_SND,
+	NUM_BENCH_PHASES
+} benchphase_t;
+
+typedef struct
+{
+	float			phases[NUM_BENCH_PHASES];	// in ms
+} benchframe_t;
+
+typedef struct
+{
+	int				demo;
+	int				run;
+	int				frames;
+	float			seconds;
+	qboolean		failed;
+	benchframe_t	*samples;
+} benchrun_t;
+
+typedef struct
+{
+	float			min, avg, p50, p95, p99, worst;
+	int				count;
+} benchstats_t;
+
+static struct
+{
+	qboolean		active;
+	qboolean		recording;
+	qboolean		quit;		// started with -benchmark, quit when done
+	int				numdemos;
+	int				numruns;
+	int				current;	// index into demos * runs
+	char			demos[MAX_BENCH_DEMOS][MAX_QPATH];
+	char			output[MAX_QPATH];
+	benchframe_t	*samples;	// current run
+	benchrun_t		*results;
+} bench;
+
+static const char *const bench_phases[NUM_BENCH_PHASES] = {"frame", "server", "gfx", "snd"};
+
+/*
+====================
+CL_BenchmarkFrame
+
+Called at the end of every host frame with the host_speeds phase timings
+====================
+*/
+void CL_BenchmarkFrame (double server, double gfx, double snd, qboolean ranserver)
+{
+	benchframe_t frame;
+
+	// skip the first frame, which includes the level load (see CL_FinishTimeDemo)
+	if (!bench.recording || !cls.timedemo || host_framecount <= cls.td_startframe)
+		return;
+
+	frame.phases[BENCH_FRAME] = (server + gfx + snd) * 1000.0;
+	frame.phases[BENCH_SERVER] = ranserver ? server * 1000.0 : -1.f;
+	frame.phases[BENCH_GFX] = gfx * 1000.0;
+	frame.phases[BENCH_SND] = snd * 1000.0;
+	VEC_PUSH (bench.samples, frame);
+}
+
+/*
+====================
+CL_BenchmarkCompareFloats
+====================
+*/
+static int CL_BenchmarkCompareFloats (const void *a, const void *b)
+{
+	float fa = *(const float *) a;
+	float fb = *(const float *) b;
+	return (fa > fb) - (fa < fb);
+}
+
+/*
+====================
+CL_BenchmarkPercentile
+
+Nearest-rank percentile of a sorted array
+====================
+*/
+static float CL_BenchmarkPercentile (const float *sorted, int count, float pct)
+{
+	int idx = (int) ceil (pct * 0.01f * count) - 1;
+	return sorted[CLAMP (0, idx, count - 1)];
+}
+
+/*
+====================
+CL_BenchmarkComputeStats
+
+Computes stats for one phase over all the samples of
+the given runs
+====================
+*/
+static void CL_BenchmarkComputeStats (const benchrun_t *runs, int numruns, int phase, benchstats_t *stats)
+{
+	float	*values = NULL;
+	double	sum = 0.0;
+	int		i, j, count;
+
+	memset (stats, 0, sizeof (*stats));
+
+	for (i = 0; i < numruns; i++)
+	{
+		for (j = 0; j < (int) VEC_SIZE (runs[i].samples); j++)
+		{
+			float f = runs[i].samples[j].phases[phase];
+			if (f < 0.f)
+				continue;
+			VEC_PUSH (values, f);
+			sum += f;
+		}
+	}
+
+	count = VEC_SIZE (values);
+	if (!count)
+		return;
+
+	qsort (values, count, sizeof (values[0]), CL_BenchmarkCompareFloats);
+
+	stats->count = count;
+	stats->min = values[0];
+	stats->avg = sum / count;
+	stats->p50 = CL_BenchmarkPercentile (values, count, 50.f);
+	stats->p95 = CL_BenchmarkPercentile (values, count, 95.f);
+	stats->p99 = CL_BenchmarkPercentile (values, count, 99.f);
+	stats->worst = values[count - 1];
+
+	VEC_FREE (values);
+}
+
+/*
+====================
+CL_BenchmarkWriteString
+
+Writes a quoted JSON string
+====================
+*/
+static void CL_BenchmarkWriteString (FILE *f, const char *str)
+{
+	fputc ('"', f);
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			fputc ('\\', f);
+		if ((unsigned char) *str >= 32)
+			fputc (*str, f);
+	}
+	fputc ('"', f);
+}
+
+/*
+====================
+CL_BenchmarkWriteRunJSON
+====================
+*/
+static void CL_BenchmarkWriteRunJSON (FILE *f, const benchrun_t *runs, int numruns, const char *indent)
+{
+	benchstats_t	stats;
+	int				i, frames = 0;
+	float			seconds = 0.f;
+
+	for (i = 0; i < numruns; i++)
+	{
+		frames += runs[i].frames;
+		seconds += runs[i].seconds;
+	}
+
+	fprintf (f, "{\n%s\t\"frames\": %d,\n%s\t\"seconds\": %.3f,\n%s\t\"fps\": %.2f",
+		indent, frames, indent, seconds, indent, seconds > 0.f ? frames / seconds : 0.f);
+
+	for (i = 0; i < (int) countof (bench_phases); i++)
+	{
+		CL_BenchmarkComputeStats (runs, numruns, i, &stats);
+		fprintf (f, ",\n%s\t\"%s\": { \"samples\": %d, \"min\": %.3f, \"avg\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"worst\": %.3f }",
+			indent, bench_phases[i], stats.count, stats.min, stats.avg, stats.p50, stats.p95, stats.p99, stats.worst);
+	}
+
+	fprintf (f, "\n%s}", indent);
+}
+
+/*
+====================
+CL_BenchmarkWriteJSON
+====================
+*/
+static void CL_BenchmarkWriteJSON (FILE *f)
+{
+	int i, j, first;
+
+	fprintf (f, "{\n\t\"engine\": {\n");
+	fprintf (f, "\t\t\"name\": \"ironwail\",\n");
+	fprintf (f, "\t\t\"version\": \"" IRONWAIL_VER_STRING "\",\n");
+	fprintf (f, "\t\t\"build\": \"" __DATE__ " " __TIME__ "\",\n");
+	fprintf (f, "\t\t\"platform\": "); CL_BenchmarkWriteString (f, SDL_GetPlatform ()); fprintf (f, ",\n");
+	fprintf (f, "\t\t\"bits\": %d,\n", (int) sizeof (void *) * 8);
+	fprintf (f, "\t\t\"sdl\": \"" Q_SDL_COMPILED_VERSION_STRING "\",\n");
+	fprintf (f, "\t\t\"cpus\": %d,\n", SDL_GetCPUCount ());
+	fprintf (f, "\t\t\"gl_vendor\": "); CL_BenchmarkWriteString (f, gl_vendor ? gl_vendor : ""); fprintf (f, ",\n");
+	fprintf (f, "\t\t\"gl_renderer\": "); CL_BenchmarkWriteString (f, gl_renderer ? gl_renderer : ""); fprintf (f, ",\n");
+	fprintf (f, "\t\t\"gl_version\": "); CL_BenchmarkWriteString (f, gl_version ? gl_version : ""); fprintf (f, ",\n");
+	fprintf (f, "\t\t\"resolution\": \"%dx%d\"\n", vid.width, vid.height);
+	fprintf (f, "\t},\n");
+	fprintf (f, "\t\"units\": \"ms\",\n");
+	fprintf (f, "\t\"runs\": %d,\n", bench.numruns);
+	fprintf (f, "\t\"demos\": [");
+
+	for (i = 0; i < bench.numdemos; i++)
+	{
+		benchrun_t	*runs = NULL;
+		qboolean	failed = false;
+
+		for (j = 0; j < (int) VEC_SIZE (bench.results); j++)
+		{
+			if (bench.results[j].demo != i)
+				continue;
+			if (bench.results[j].failed)
+				failed = true;
+			else
+				VEC_PUSH (runs, bench.results[j]);
+		}
+
+		fprintf (f, "%s\n\t\t{\n\t\t\t\"name\": ", i ? "," : "");
+		CL_BenchmarkWriteString (f, bench.demos[i]);
+		fprintf (f, ",\n\t\t\t\"failed\": %s,\n\t\t\t\"runs\": [", failed ? "true" : "false");
+		for (j = 0, first = 1; j < (int) VEC_SIZE (runs); j++, first = 0)
+		{
+			fprintf (f, "%s\n\t\t\t\t", first ? "" : ",");
+			CL_BenchmarkWriteRunJSON (f, &runs[j], 1, "\t\t\t\t");
+		}
+		fprintf (f, "\n\t\t\t],\n\t\t\t\"total\": ");
+		CL_BenchmarkWriteRunJSON (f, runs, VEC_SIZE (runs), "\t\t\t");
+		fprintf (f, "\n\t\t}");
+
+		VEC_FREE (runs);
+	}
+
+	fprintf (f, "\n\t]\n}\n");
+}
+
+/*
+====================
+CL_BenchmarkWriteCSVRow
+====================
+*/
+static void CL_BenchmarkWriteCSVRow (FILE *f, const char *demo, const char *run, const benchrun_t *runs, int numruns)
+{
+	benchstats_t	stats;
+	int				i, frames = 0;
+	float			seconds = 0.f;
+
+	for (i = 0; i < numruns; i++)
+	{
+		frames += runs[i].frames;
+		seconds += runs[i].seconds;
+	}
+
+	for (i = 0; i < (int) countof (bench_phases); i++)
+	{
+		CL_BenchmarkComputeStats (runs, numruns, i, &stats);
+		fprintf (f, "%s,%s,%d,%.3f,%.2f,%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+			demo, run, frames, seconds, seconds > 0.f ? frames / seconds : 0.f, bench_phases[i],
+			stats.count, stats.min, stats.avg, stats.p50, stats.p95, stats.p99, stats.worst);
+	}
+}
+
+/*
+====================
+CL_BenchmarkWriteCSV
+====================
+*/
+static void CL_BenchmarkWriteCSV (FILE *f)
+{
+	int i, j;
+
+	fprintf (f, "# ironwail " IRONWAIL_VER_STRING " (" __DATE__ " " __TIME__ ") %s %d-bit, SDL " Q_SDL_COMPILED_VERSION_STRING ", %d cpus\n",
+		SDL_GetPlatform (), (int) sizeof (void *) * 8, SDL_GetCPUCount ());
+	fprintf (f, "# %s / %s / %s, %dx%d\n", gl_vendor ? gl_vendor : "", gl_renderer ? gl_renderer : "",
+		gl_version ? gl_version : "", vid.width, vid.height);
+	fprintf (f, "demo,run,frames,seconds,fps,phase,samples,min_ms,avg_ms,p50_ms,p95_ms,p99_ms,worst_ms\n");
+
+	for (i = 0; i < bench.numdemos; i++)
+	{
+		benchrun_t *runs = NULL;
+
+		for (j = 0; j < (int) VEC_SIZE (bench.results); j++)
+		{
+			benchrun_t *r = &bench.results[j];
+			if (r->demo != i)
+				continue;
+			if (r->failed)
+				fprintf (f, "%s,%d,0,0,0,failed,0,0,0,0,0,0,0\n", bench.demos[i], r->run + 1);
+			else
+			{
+				CL_BenchmarkWriteCSVRow (f, bench.demos[i], va ("%d", r->run + 1), r, 1);
+				VEC_PUSH (runs, *r);
+			}
+		}
+		CL_BenchmarkWriteCSVRow (f, bench.demos[i], "all", runs, VEC_SIZE (runs));
+
+		VEC_FREE (runs);
+	}
+}
+
+/*
+====================
+CL_BenchmarkReset
+====================
+*/
+static void CL_BenchmarkReset (void)
+{
+	int i;
+
+	for (i = 0; i < (int) VEC_SIZE (bench.results); i++)
+		VEC_FREE (bench.results[i].samples);
+	VEC_FREE (bench.results);
+	VEC_FREE (bench.samples);
+	memset (&bench, 0, sizeof (bench));
+}
+
+/*
+====================
+CL_BenchmarkFinish
+
+Writes the results, and quits if the benchmark was started from the command line
+====================
+*/
+static void CL_BenchmarkFinish (void)
+{
+	char		path[MAX_OSPATH];
+	const char	*ext;
+	FILE		*f;
+	int			i, failed = 0;
+	qboolean	quit = bench.quit;
+
+	for (i = 0; i < (int) VEC_SIZE (bench.results); i++)
+		if (bench.results[i].failed)
+			failed++;
+
+	q_snprintf (path, sizeof (path), "%s/%s", com_gamedir, bench.output);
+	ext = COM_FileGetExtension (bench.output);
+	f = Sys_fopen (path, "w");
+	if (f)
+	{
+		if (!q_strcasecmp (ext, "csv"))
+			CL_BenchmarkWriteCSV (f);
+		else
+			CL_BenchmarkWriteJSON (f);
+		fclose (f);
+		Con_Printf ("Benchmark results written to %s\n", path);
+	}
+	else
+	{
+		Con_Printf ("Couldn't write %s\n", path);
+		failed = -1;
+	}
+
+	CL_BenchmarkReset ();
+
+	if (!quit)
+		return;
+
+	if (failed)
+		Sys_Error ("benchmark: %s", failed < 0 ? va ("couldn't write %s", path) : va ("%d demo run(s) failed", failed));
+
+	CL_Disconnect ();
+	Host_ShutdownServer (false);
+	Sys_Quit ();
+}
+
+/*
+====================
+CL_BenchmarkNext
+
+Starts the next timedemo run, or finishes the benchmark
+====================
+*/
+static void CL_BenchmarkNext (void)
+{
+	benchrun_t failed;
+
+	while (bench.current < bench.numdemos * bench.numruns)
+	{
+		int demo = bench.current / bench.numruns;
+		int run = bench.current % bench.numruns;
+
+		Con_Printf ("benchmark: %s, run %d/%d\n", bench.demos[demo], run + 1, bench.numruns);
+
+		VEC_CLEAR (bench.samples);
+		bench.recording = true;
+		Cmd_ExecuteString (va ("timedemo %s", bench.demos[demo]), src_command);
+		if (cls.timedemo)
+			return;
+
+		// couldn't start the demo
+		bench.recording = false;
+		memset (&failed, 0, sizeof (failed));
+		failed.demo = demo;
+		failed.run = run;
+		failed.failed = true;
+		VEC_PUSH (bench.results, failed);
+		bench.current++;
+	}
+
+	CL_BenchmarkFinish ();
+}
+
+/*
+====================
+CL_BenchmarkEndRun
+
+Called by CL_FinishTimeDemo
+====================
+*/
+static void CL_BenchmarkEndRun (int frames, float time)
+{
+	benchrun_t run;
+
+	if (!bench.active || !bench.recording)
+		return;
+
+	memset (&run, 0, sizeof (run));
+	run.demo = bench.current / bench.numruns;
+	run.run = bench.current % bench.numruns;
+	run.frames = frames;
+	run.seconds = time;
+	run.samples = bench.samples;
+	bench.samples = NULL;
+	VEC_PUSH (bench.results, run);
+
+	bench.recording = false;
+	bench.current++;
+
+	// we're inside CL_StopPlayback here, so start the next run on the next frame
+	Cbuf_AddText ("benchmark next\n");
+}
+
+/*
+====================
+CL_Benchmark_f
+
+benchmark [-runs <n>] [-out <file.json|file.csv>] <demo1> [demo2 ...]
+benchmark stop
+====================
+*/
+void CL_Benchmark_f (void)
+{
+	int i;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc () == 2 && !strcmp (Cmd_Argv (1), "next"))
+	{
+		if (bench.active && !bench.recording)
+			CL_BenchmarkNext ();
+		return;
+	}
+
+	if (Cmd_Argc () == 2 && !strcmp (Cmd_Argv (1), "stop"))
+	{
+		if (!bench.active)
+			return;
+		Con_Printf ("Benchmark aborted\n");
+		CL_BenchmarkReset ();
+		if (cls.demoplayback)
+			CL_Disconnect ();
+		return;
+	}
+
+	if (bench.active)
+	{
+		Con_Printf ("A benchmark is already running (use \"benchmark stop\")\n");
+		return;
+	}
+
+	CL_BenchmarkReset ();
+	bench.numruns = 1;
+	q_strlcpy (bench.output, "benchmark.json", sizeof (bench.output));
+
+	for (i = 1; i < Cmd_Argc (); i++)
+	{
+		const char *arg = Cmd_Argv (i);
+		if (!strcmp (arg, "-runs") && i + 1 < Cmd_Argc ())
+			bench.numruns = CLAMP (1, atoi (Cmd_Argv (++i)), 1000);
+		else if (!strcmp (arg, "-out") && i + 1 < Cmd_Argc ())
+			q_strlcpy (bench.output, Cmd_Argv (++i), sizeof (bench.output));
+		else if (!strcmp (arg, "-quit"))
+			bench.quit = true;
+		else if (bench.numdemos < MAX_BENCH_DEMOS)
+			q_strlcpy (bench.demos[bench.numdemos++], arg, sizeof (bench.demos[0]));
+		else
+			Con_Printf ("benchmark: too many demos, ignoring %s\n", arg);
+	}
+
+	if (!bench.numdemos)
+	{
+		Con_Printf ("benchmark [-runs <n>] [-out <file.json|file.csv>] [-quit] <demo1> [demo2 ...]\n");
+		Con_Printf ("benchmark stop\n");
+		return;
+	}
+
+	bench.active = true;
+	cls.demonum = -1;	// stop demo loop
+	CL_BenchmarkNext ();
+}
+
+/*
+====================
+CL_BenchmarkCommandLine
+
+-benchmark <demo1> [demo2 ...] [-benchruns <n>] [-benchout <file>]
+Runs the benchmark after startup and quits when done
+====================
+*/
+void CL_BenchmarkCommandLine (void)
+{
+	char	cmd[1024];
+	int		i;
+
+	i = COM_CheckParm ("-benchmark");
+	if (!i)
+		return;
+
+	q_strlcpy (cmd, "benchmark -quit", sizeof (cmd));
+	for (i++; i < com_argc && com_argv[i][0] != '-' && com_argv[i][0] != '+'; i++)
+	{
+		q_strlcat (cmd, " ", sizeof (cmd));
+		q_strlcat (cmd, com_argv[i], sizeof (cmd));
+	}
+
+	i = COM_CheckParm ("-benchruns");
+	if (i && i + 1 < com_argc)
+		q_strlcat (cmd, va (" -runs %s", com_argv[i + 1]), sizeof (cmd));
+
+	i = COM_CheckParm ("-benchout");
+	if (i && i + 1 < com_argc)
+		q_strlcat (cmd, va (" -out \"%s\"", com_argv[i + 1]), sizeof (cmd));
+
+	q_strlcat (cmd, "\n", sizeof (cmd));
+	Cbuf_AddText (cmd);
+}
@@ -432,6 +432,13 @@ void CL_SendMove (const usercmd_t *cmd)
 		in_impulse = 0;
 	}
 
+// tell the server which svc_snapshot it can delta from
+	if (cl.snapshots && cl.snapshotack)
+	{
+		MSG_WriteByte (&buf, clc_ackframe);
+		MSG_WriteLong (&buf, cl.snapshotack);
+	}
+
 //
 // deliver the message
 //
@@ -33,6 +33,7 @@ cvar_t	cl_color = {"_cl_color", "0", CVAR_ARCHIVE};
 
 cvar_t	cl_shownet = {"cl_shownet","0",CVAR_NONE};	// can be 0, 1, or 2
 cvar_t	cl_nolerp = {"cl_nolerp","0",CVAR_NONE};
+cvar_t	cl_deltasnapshots = {"cl_deltasnapshots","1",CVAR_ARCHIVE};
 
 cvar_t	cfg_unbindall = {"cfg_unbindall", "1", CVAR_ARCHIVE};
 
@@ -117,6 +118,42 @@ void CL_ClearState (void)
 	//johnfitz
 
 	memset (v_punchangles, 0, sizeof (v_punchangles));
+
+	CL_ClearSnapshots ();
+}
+
+/*
+=====================
+CL_RequestSnapshots
+
+Tells the server whether to send delta compressed svc_snapshot entities.
+Not worth it over loopback, and demos are kept in the classic protocol.
+=====================
+*/
+void CL_RequestSnapshots (void)
+{
+	qboolean	want;
+
+	if (cls.state != ca_connected || cls.demoplayback || cls.signon < 2)
+		return;
+
+	want = cl_deltasnapshots.value && !sv.active && !cls.demorecording && cl.protocol != PROTOCOL_NETQUAKE;
+	if (want == cl.snapshotrequest)
+		return;
+	cl.snapshotrequest = want;
+
+	MSG_WriteByte (&cls.message, clc_stringcmd);
+	MSG_WriteString (&cls.message, va ("deltasnapshots %i\n", want));
+}
+
+/*
+=====================
+CL_DeltaSnapshots_f -- called when cl_deltasnapshots changes
+=====================
+*/
+static void CL_DeltaSnapshots_f (cvar_t *var)
+{
+	CL_RequestSnapshots ();
 }
 
 /*
@@ -229,6 +266,8 @@ void CL_SignonReply (void)
 		MSG_WriteByte (&cls.message, clc_stringcmd);
 		MSG_WriteString (&cls.message, va("color %i %i\n", ((int)cl_color.value)>>4, ((int)cl_color.value)&15));
 
+		CL_RequestSnapshots ();
+
 		MSG_WriteByte (&cls.message, clc_stringcmd);
 		sprintf (str, "spawn %s", cls.spawnparms);
 		MSG_WriteString (&cls.message, str);
@@ -1017,6 +1056,8 @@ void CL_Init (void)
 	Cvar_RegisterVariable (&cl_anglespeedkey);
 	Cvar_RegisterVariable (&cl_shownet);
 	Cvar_RegisterVariable (&cl_nolerp);
+	Cvar_RegisterVariable (&cl_deltasnapshots);
+	Cvar_SetCallback (&cl_deltasnapshots, CL_DeltaSnapshots_f);
 	Cvar_RegisterVariable (&freelook);
 	Cvar_RegisterVariable (&lookspring);
 	Cvar_RegisterVariable (&lookstrafe);
@@ -1038,6 +1079,7 @@ void CL_Init (void)
 
 	Cvar_RegisterVariable (&cl_startdemos);
 	Cvar_RegisterVariable (&cl_confirmquit);
+	Cvar_RegisterVariable (&cl_demokeyframes);
 
 	Cmd_AddCommand ("entities", CL_PrintEntities_f);
 	Cmd_AddCommand ("disconnect", CL_Disconnect_f);
@@ -1045,6 +1087,8 @@ void CL_Init (void)
 	Cmd_AddCommand ("stop", CL_Stop_f);
 	Cmd_AddCommand ("playdemo", CL_PlayDemo_f);
 	Cmd_AddCommand ("timedemo", CL_TimeDemo_f);
+	Cmd_AddCommand ("benchmark", CL_Benchmark_f);
+	Cmd_AddCommand ("demoseek", CL_DemoSeek_f);
 
 	Cmd_AddCommand ("tracepos", CL_Tracepos_f); //johnfitz
 	cmd = Cmd_AddCommand ("viewpos", CL_Viewpos_f); //johnfitz
@@ -96,7 +96,8 @@ const char *svc_strings[] =
 	"svc_chat", // 53
 	"svc_levelcompleted", // 54
 	"svc_backtolobby", // 55
-	"svc_localsound" // 56
+	"svc_localsound", // 56
+	"svc_snapshot", // 57
 };
 #define NUM_SVC_STRINGS Q_COUNTOF(svc_strings)
 
@@ -295,7 +296,10 @@ void CL_ParseServerInfo (void)
 // ericw -- bring up loading plaque for map changes within a demo.
 //          it will be hidden in CL_SignonReply.
 	if (cls.demoplayback)
+	{
 		SCR_BeginLoadingPlaque();
+		CL_DemoSeekNewLevel ();
+	}
 
 //
 // wipe the client_state_t struct
@@ -401,6 +405,14 @@ void CL_ParseServerInfo (void)
 	// copy the naked name of the map file to the cl structure -- O.S
 	COM_StripExtension (COM_SkipPath(model_precache[1]), cl.mapname, sizeof(cl.mapname));
 
+	// sounds are decoded on worker threads while the models load
+	S_BeginPrecaching ();
+	for (i = 1; i < numsounds; i++)
+	{
+		cl.sound_precache[i] = S_PrecacheSound (sound_precache[i]);
+		CL_KeepaliveMessage ();
+	}
+
 	for (i = 1; i < nummodels; i++)
 	{
 		cl.model_precache[i] = Mod_ForName (model_precache[i], false);
@@ -411,12 +423,6 @@ void CL_ParseServerInfo (void)
 		CL_KeepaliveMessage ();
 	}
 
-	S_BeginPrecaching ();
-	for (i = 1; i < numsounds; i++)
-	{
-		cl.sound_precache[i] = S_PrecacheSound (sound_precache[i]);
-		CL_KeepaliveMessage ();
-	}
 	S_EndPrecaching ();
 
 // local state
@@ -443,51 +449,23 @@ void CL_ParseServerInfo (void)
 
 /*
 ==================
-CL_ParseUpdate
+CL_ApplyEntityUpdate
 
-Parse an entity update message from the server
+Makes an entity look like the update says
 If an entities model or origin changes from frame to frame, it must be
 relinked.  Other attributes can change without relinking.
 ==================
 */
-void CL_ParseUpdate (int bits)
+static void CL_ApplyEntityUpdate (const snapentity_t *update)
 {
-	int		i;
+	const entity_state_t	*state = &update->state;
 	qmodel_t	*model;
-	int		modnum;
 	qboolean	forcelink;
 	entity_t	*ent;
 	int		num;
-	int		skin;
 	int		prevframe;
 
-	if (cls.signon == SIGNONS - 1)
-	{	// first update is the final signon stage
-		cls.signon = SIGNONS;
-		CL_SignonReply ();
-	}
-
-	if (bits & U_MOREBITS)
-	{
-		i = MSG_ReadByte ();
-		bits |= (i<<8);
-	}
-
-	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_RMQ)
-	{
-		if (bits & U_EXTEND1)
-			bits |= MSG_ReadByte() << 16;
-		if (bits & U_EXTEND2)
-			bits |= MSG_ReadByte() << 24;
-	}
-	//johnfitz
-
-	if (bits & U_LONGENTITY)
-		num = MSG_ReadShort ();
-	else
-		num = MSG_ReadByte ();
-
+	num = update->num;
 	ent = CL_EntityNum (num);
 
 	if (ent->msgtime != cl.mtime[1])
@@ -502,81 +480,33 @@ void CL_ParseUpdate (int bits)
 
 	ent->msgtime = cl.mtime[0];
 
-	if (bits & U_MODEL)
-	{
-		modnum = MSG_ReadByte ();
-		if (modnum >= MAX_MODELS)
-			Host_Error ("CL_ParseModel: bad modnum");
-	}
-	else
-		modnum = ent->baseline.modelindex;
-
 	prevframe = ent->frame;
-	if (bits & U_FRAME)
-		ent->frame = MSG_ReadByte ();
-	else
-		ent->frame = ent->baseline.frame;
+	ent->frame = state->frame;
 
-	if (bits & U_COLORMAP)
-		i = MSG_ReadByte();
-	else
-		i = ent->baseline.colormap;
-	if (!i)
+	if (!state->colormap)
 		ent->colormap = vid.colormap;
 	else
 	{
-		if (i > cl.maxclients)
+		if (state->colormap > cl.maxclients)
 			Sys_Error ("i >= cl.maxclients");
-		ent->colormap = cl.scores[i-1].translations;
+		ent->colormap = cl.scores[state->colormap-1].translations;
 	}
-	if (bits & U_SKIN)
-		skin = MSG_ReadByte();
-	else
-		skin = ent->baseline.skin;
-	if (skin != ent->skinnum)
+	if (state->skin != ent->skinnum)
 	{
-		ent->skinnum = skin;
+		ent->skinnum = state->skin;
 		if (num > 0 && num <= cl.maxclients)
 			R_TranslateNewPlayerSkin (num - 1); //johnfitz -- was R_TranslatePlayerSkin
 	}
-	if (bits & U_EFFECTS)
-		ent->effects = MSG_ReadByte();
-	else
-		ent->effects = ent->baseline.effects;
+	ent->effects = state->effects;
 
 // shift the known values for interpolation
 	VectorCopy (ent->msg_origins[0], ent->msg_origins[1]);
 	VectorCopy (ent->msg_angles[0], ent->msg_angles[1]);
-
-	if (bits & U_ORIGIN1)
-		ent->msg_origins[0][0] = MSG_ReadCoord (cl.protocolflags);
-	else
-		ent->msg_origins[0][0] = ent->baseline.origin[0];
-	if (bits & U_ANGLE1)
-		ent->msg_angles[0][0] = MSG_ReadAngle(cl.protocolflags);
-	else
-		ent->msg_angles[0][0] = ent->baseline.angles[0];
-
-	if (bits & U_ORIGIN2)
-		ent->msg_origins[0][1] = MSG_ReadCoord (cl.protocolflags);
-	else
-		ent->msg_origins[0][1] = ent->baseline.origin[1];
-	if (bits & U_ANGLE2)
-		ent->msg_angles[0][1] = MSG_ReadAngle(cl.protocolflags);
-	else
-		ent->msg_angles[0][1] = ent->baseline.angles[1];
-
-	if (bits & U_ORIGIN3)
-		ent->msg_origins[0][2] = MSG_ReadCoord (cl.protocolflags);
-	else
-		ent->msg_origins[0][2] = ent->baseline.origin[2];
-	if (bits & U_ANGLE3)
-		ent->msg_angles[0][2] = MSG_ReadAngle(cl.protocolflags);
-	else
-		ent->msg_angles[0][2] = ent->baseline.angles[2];
+	VectorCopy (state->origin, ent->msg_origins[0]);
+	VectorCopy (state->angles, ent->msg_angles[0]);
 
 	//johnfitz -- lerping for movetype_step entities
-	if (bits & U_STEP)
+	if (update->step)
 	{
 		ent->lerpflags |= LERP_MOVESTEP;
 		ent->forcelink = true;
@@ -585,56 +515,24 @@ void CL_ParseUpdate (int bits)
 		ent->lerpflags &= ~LERP_MOVESTEP;
 	//johnfitz
 
-	//johnfitz -- PROTOCOL_FITZQUAKE and PROTOCOL_NEHAHRA
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_RMQ)
+	ent->alpha = state->alpha;
+	ent->scale = state->scale;
+
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (cl.protocol != PROTOCOL_NETQUAKE)
 	{
-		if (bits & U_ALPHA)
-			ent->alpha = MSG_ReadByte();
-		else
-			ent->alpha = ent->baseline.alpha;
-		if (bits & U_SCALE)
-			ent->scale = MSG_ReadByte();
-		else
-			ent->scale = ent->baseline.scale;
-		if (bits & U_FRAME2)
-			ent->frame = (ent->frame & 0x00FF) | (MSG_ReadByte() << 8);
-		if (bits & U_MODEL2)
-			modnum = (modnum & 0x00FF) | (MSG_ReadByte() << 8);
-		if (bits & U_LERPFINISH)
+		if (update->lerpfinish >= 0)
 		{
-			ent->lerpfinish = ent->msgtime + ((float)(MSG_ReadByte()) / 255);
+			ent->lerpfinish = ent->msgtime + ((float)update->lerpfinish / 255);
 			ent->lerpflags |= LERP_FINISH;
 		}
 		else
 			ent->lerpflags &= ~LERP_FINISH;
 	}
-	else if (cl.protocol == PROTOCOL_NETQUAKE)
-	{
-		//HACK: if this bit is set, assume this is PROTOCOL_NEHAHRA
-		if (bits & U_TRANS)
-		{
-			float a, b;
-
-			if (warn_about_nehahra_protocol)
-			{
-				Con_Warning ("nonstandard update bit, assuming Nehahra protocol\n");
-				warn_about_nehahra_protocol = false;
-			}
-
-			a = MSG_ReadFloat();
-			b = MSG_ReadFloat(); //alpha
-			if (a == 2)
-				MSG_ReadFloat(); //fullbright (not using this yet)
-			ent->alpha = ENTALPHA_ENCODE(b);
-		}
-		else
-			ent->alpha = ent->baseline.alpha;
-		ent->scale = ent->baseline.scale;
-	}
 	//johnfitz
 
 	//johnfitz -- moved here from above
-	model = cl.model_precache[modnum];
+	model = cl.model_precache[state->modelindex];
 	if (model != ent->model)
 	{
 		ent->model = model;
@@ -670,6 +568,299 @@ void CL_ParseUpdate (int bits)
 	}
 }
 
+/*
+==================
+CL_ReadEntityUpdate
+
+Reads the fields an update (or svc_snapshot record) carries on top of from
+==================
+*/
+static void CL_ReadEntityUpdate (int bits, const snapentity_t *from, snapentity_t *to)
+{
+	entity_state_t	*state = &to->state;
+	int		modnum;
+
+	*to = *from;
+
+	if (bits & U_MODEL)
+		state->modelindex = MSG_ReadByte ();
+	if (bits & U_FRAME)
+		state->frame = MSG_ReadByte ();
+	if (bits & U_COLORMAP)
+		state->colormap = MSG_ReadByte ();
+	if (bits & U_SKIN)
+		state->skin = MSG_ReadByte ();
+	if (bits & U_EFFECTS)
+		state->effects = MSG_ReadByte ();
+
+	if (bits & U_ORIGIN1)
+		state->origin[0] = MSG_ReadCoord (cl.protocolflags);
+	if (bits & U_ANGLE1)
+		state->angles[0] = MSG_ReadAngle (cl.protocolflags);
+	if (bits & U_ORIGIN2)
+		state->origin[1] = MSG_ReadCoord (cl.protocolflags);
+	if (bits & U_ANGLE2)
+		state->angles[1] = MSG_ReadAngle (cl.protocolflags);
+	if (bits & U_ORIGIN3)
+		state->origin[2] = MSG_ReadCoord (cl.protocolflags);
+	if (bits & U_ANGLE3)
+		state->angles[2] = MSG_ReadAngle (cl.protocolflags);
+
+	to->step = (bits & U_STEP) != 0;
+	to->lerpfinish = -1;
+
+	//johnfitz -- PROTOCOL_FITZQUAKE and PROTOCOL_NEHAHRA
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_RMQ)
+	{
+		if (bits & U_ALPHA)
+			state->alpha = MSG_ReadByte();
+		if (bits & U_SCALE)
+			state->scale = MSG_ReadByte();
+		if (bits & U_FRAME2)
+			state->frame = (state->frame & 0x00FF) | (MSG_ReadByte() << 8);
+		if (bits & U_MODEL2)
+			state->modelindex = (state->modelindex & 0x00FF) | (MSG_ReadByte() << 8);
+		if (bits & U_LERPFINISH)
+			to->lerpfinish = MSG_ReadByte();
+	}
+	else if (cl.protocol == PROTOCOL_NETQUAKE)
+	{
+		//HACK: if this bit is set, assume this is PROTOCOL_NEHAHRA
+		if (bits & U_TRANS)
+		{
+			float a, b;
+
+			if (warn_about_nehahra_protocol)
+			{
+				Con_Warning ("nonstandard update bit, assuming Nehahra protocol\n");
+				warn_about_nehahra_protocol = false;
+			}
+
+			a = MSG_ReadFloat();
+			b = MSG_ReadFloat(); //alpha
+			if (a == 2)
+				MSG_ReadFloat(); //fullbright (not using this yet)
+			state->alpha = ENTALPHA_ENCODE(b);
+		}
+	}
+	//johnfitz
+
+	modnum = state->modelindex;
+	if (modnum >= MAX_MODELS)
+		Host_Error ("CL_ParseModel: bad modnum");
+}
+
+/*
+==================
+CL_ParseUpdate
+
+Parse an entity update message from the server
+==================
+*/
+void CL_ParseUpdate (int bits)
+{
+	int		i;
+	entity_t	*ent;
+	snapentity_t	base, update;
+
+	if (cls.signon == SIGNONS - 1)
+	{	// first update is the final signon stage
+		cls.signon = SIGNONS;
+		CL_SignonReply ();
+	}
+
+	cl.snapshots = false;
+
+	if (bits & U_MOREBITS)
+	{
+		i = MSG_ReadByte ();
+		bits |= (i<<8);
+	}
+
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_RMQ)
+	{
+		if (bits & U_EXTEND1)
+			bits |= MSG_ReadByte() << 16;
+		if (bits & U_EXTEND2)
+			bits |= MSG_ReadByte() << 24;
+	}
+	//johnfitz
+
+	base.num = (bits & U_LONGENTITY) ? MSG_ReadShort () : MSG_ReadByte ();
+	ent = CL_EntityNum (base.num);
+	base.state = ent->baseline;
+	base.step = false;
+	base.lerpfinish = -1;
+
+	CL_ReadEntityUpdate (bits, &base, &update);
+	CL_ApplyEntityUpdate (&update);
+}
+
+/*
+==================
+CL_ParseSnapshot
+
+Parse an svc_snapshot: the entities that changed since the snapshot it
+names (or since the baselines), and the ones that went away.  Every
+entity in the reference snapshot that isn't mentioned is still there
+and unchanged.
+==================
+*/
+static snapframe_t	cl_snapshots[SNAPSHOT_FRAMES];
+static int			*cl_snapindex;		// entity number -> index + 1 in the reference snapshot
+static int			cl_snapindexsize;
+
+void CL_ClearSnapshots (void)
+{
+	int		i;
+
+	for (i = 0; i < SNAPSHOT_FRAMES; i++)
+	{
+		cl_snapshots[i].sequence = 0;
+		cl_snapshots[i].numents = 0;
+	}
+}
+
+static snapentity_t *CL_AddSnapEntity (snapframe_t *frame)
+{
+	if (frame->numents == frame->maxents)
+	{
+		frame->maxents = q_max (frame->maxents * 2, 256);
+		frame->ents = (snapentity_t *) realloc (frame->ents, frame->maxents * sizeof (frame->ents[0]));
+		if (!frame->ents)
+			Sys_Error ("CL_AddSnapEntity: realloc() failed on %d entities", frame->maxents);
+	}
+	return &frame->ents[frame->numents++];
+}
+
+static void CL_ParseSnapshot (void)
+{
+	unsigned int	sequence;
+	int				i, bits, num, delta, idx;
+	snapframe_t		*ref, *frame;
+	snapentity_t	base, *to;
+	const snapentity_t	*from;
+	entity_t		*ent;
+	qboolean		valid;
+
+	if (cls.signon == SIGNONS - 1)
+	{	// first update is the final signon stage
+		cls.signon = SIGNONS;
+		CL_SignonReply ();
+	}
+
+	sequence = MSG_ReadLong ();
+	delta = MSG_ReadByte ();
+
+	ref = NULL;
+	valid = true;
+	if (delta)
+	{
+		ref = &cl_snapshots[(sequence - delta) & (SNAPSHOT_FRAMES - 1)];
+		if (ref->sequence != sequence - delta)
+		{	// too old, or lost while we were waiting for the server to notice:
+			// parse it to get past it, but don't trust it
+			Con_DPrintf ("svc_snapshot %u: missing reference %u\n", sequence, sequence - delta);
+			ref = NULL;
+			valid = false;
+		}
+	}
+
+	frame = &cl_snapshots[sequence & (SNAPSHOT_FRAMES - 1)];
+	frame->sequence = 0;
+	frame->numents = 0;
+	if (frame == ref)
+		Host_Error ("CL_ParseSnapshot: snapshot %u deltas from itself", sequence);
+
+	if (ref)
+	{
+		if (cl_snapindexsize < cl_max_edicts)
+		{
+			cl_snapindex = (int *) realloc (cl_snapindex, cl_max_edicts * sizeof (cl_snapindex[0]));
+			if (!cl_snapindex)
+				Sys_Error ("CL_ParseSnapshot: realloc() failed on %d entities", cl_max_edicts);
+			memset (cl_snapindex + cl_snapindexsize, 0, (cl_max_edicts - cl_snapindexsize) * sizeof (cl_snapindex[0]));
+			cl_snapindexsize = cl_max_edicts;
+		}
+		for (i = 0; i < ref->numents; i++)
+		{
+			num = ref->ents[i].num;
+			if (num < cl_snapindexsize)
+				cl_snapindex[num] = i + 1;
+		}
+	}
+
+	while (1)
+	{
+		if (msg_badread)
+			Host_Error ("CL_ParseSnapshot: bad read");
+
+		bits = MSG_ReadByte ();
+		if (bits & U_MOREBITS)
+			bits |= MSG_ReadByte () << 8;
+		if (bits & U_EXTEND1)
+			bits |= MSG_ReadByte () << 16;
+		if (bits & U_EXTEND2)
+			bits |= MSG_ReadByte () << 24;
+		num = (bits & U_LONGENTITY) ? MSG_ReadShort () : MSG_ReadByte ();
+
+		if (bits & U_REMOVE)
+		{
+			if (!num)
+				break;
+			if (ref && num < cl_snapindexsize && (idx = cl_snapindex[num]) != 0)
+				cl_snapindex[num] = -idx;	// don't carry it over
+			continue;
+		}
+
+		idx = ref && num < cl_snapindexsize ? cl_snapindex[num] : 0;
+		if (idx > 0)
+		{
+			from = &ref->ents[idx - 1];
+			cl_snapindex[num] = -idx;		// replaced by this record
+		}
+		else
+		{
+			ent = CL_EntityNum (num);
+			base.num = num;
+			base.state = ent->baseline;
+			base.state.effects = 0;
+			base.step = false;
+			base.lerpfinish = -1;
+			from = &base;
+		}
+
+		to = CL_AddSnapEntity (frame);
+		CL_ReadEntityUpdate (bits, from, to);
+		to->num = num;
+	}
+
+// carry over everything the server didn't mention
+	if (ref)
+	{
+		for (i = 0; i < ref->numents; i++)
+		{
+			num = ref->ents[i].num;
+			if (num < cl_snapindexsize && cl_snapindex[num] > 0)
+				*CL_AddSnapEntity (frame) = ref->ents[i];
+			if (num < cl_snapindexsize)
+				cl_snapindex[num] = 0;
+		}
+	}
+
+	if (!valid)
+		return;
+
+	frame->sequence = sequence;
+	for (i = 0; i < frame->numents; i++)
+		CL_ApplyEntityUpdate (&frame->ents[i]);
+
+	cl.snapshots = true;
+	if (sequence > cl.snapshotack)
+		cl.snapshotack = sequence;
+}
+
 /*
 ==================
 CL_ParseBaseline
@@ -1382,6 +1573,10 @@ void CL_ParseServerMessage (void)
 		case svc_localsound:
 			CL_ParseLocalSound();
 			break;
+
+		case svc_snapshot:
+			CL_ParseSnapshot ();
+			break;
 		}
 
 		lastcmd = cmd; //johnfitz
@@ -119,6 +119,7 @@ typedef struct
 // entering a map (and clearing client_state_t)
 	qboolean	demorecording;
 	qboolean	demoplayback;
+	qboolean	demowaitfull;	// recording, but the server is still sending svc_snapshot
 
 // did the user pause demo playback? (separate from cl.paused because we don't
 // want a svc_setpause inside the demo to actually pause demo playback).
@@ -250,6 +251,10 @@ typedef struct
 
 	qboolean	sendprespawn;
 
+	qboolean	snapshotrequest;	// told the server we want svc_snapshot
+	qboolean	snapshots;			// last entity update was an svc_snapshot
+	unsigned int	snapshotack;	// last svc_snapshot sequence decoded
+
 	char		stuffcmdbuf[1024];	//comment-extensions are a thing with certain servers, make sure we can handle them properly without further hacks/breakages. there's also some server->client only console commands that we might as well try to handle a bit better, like reconnect
 
 	qcvm_t		qcvm;	//for csqc.
@@ -285,6 +290,7 @@ extern	cvar_t	cl_autofire;
 
 extern	cvar_t	cl_shownet;
 extern	cvar_t	cl_nolerp;
+extern	cvar_t	cl_deltasnapshots;
 
 extern	cvar_t	cfg_unbindall;
 
@@ -301,6 +307,7 @@ extern	cvar_t	m_side;
 
 extern	cvar_t	cl_startdemos;
 extern	cvar_t	cl_confirmquit;
+extern	cvar_t	cl_demokeyframes;
 
 
 #define	MAX_TEMP_ENTITIES	256		//johnfitz -- was 64
@@ -367,6 +374,7 @@ void CL_UpdateTEnts (void);
 
 void CL_FreeState(void);
 void CL_ClearState (void);
+void CL_RequestSnapshots (void);
 
 //
 // cl_demo.c
@@ -377,16 +385,22 @@ void CL_ClearSignons (void);
 void CL_AdvanceTime (void);
 void CL_FinishDemoFrame (void);
 void CL_AddDemoRewindSound (int entnum, int channel, sfx_t *sfx, vec3_t pos, int vol, float atten);
+void CL_DemoSeekNewLevel (void);
 
 void CL_Stop_f (void);
 void CL_Record_f (void);
 void CL_PlayDemo_f (void);
 void CL_TimeDemo_f (void);
+void CL_DemoSeek_f (void);
+void CL_Benchmark_f (void);
+void CL_BenchmarkFrame (double server, double gfx, double snd, qboolean ranserver);
+void CL_BenchmarkCommandLine (void);
 
 //
 // cl_parse.c
 //
 void CL_ParseServerMessage (void);
+void CL_ClearSnapshots (void);
 void CL_NewTranslation (int slot);
 
 //
@@ -33,16 +33,69 @@ void Cmd_ForwardToServer (void);
 typedef struct cmdalias_s
 {
 	struct cmdalias_s	*next;
+	struct cmdalias_s	*hash_next;
 	char	name[MAX_ALIAS_NAME];
 	char	*value;
 } cmdalias_t;
 
 cmdalias_t	*cmd_alias;
 
+// commands and aliases are also chained by case-insensitive name hash,
+// commands can be removed and can share a name across source types
+#define CMD_HASH_SIZE	1024
+#define CMD_HASH(name)	(COM_HashStringNoCase (name) & (CMD_HASH_SIZE - 1))
+
+static cmdalias_t	*cmd_alias_hash[CMD_HASH_SIZE];
+static hashstats_t	cmd_alias_stats = {"aliases"};
+
 qboolean	cmd_wait;
 
 //=============================================================================
 
+/*
+===============
+Cmd_FindAlias
+
+Case-insensitive unless exact is set
+===============
+*/
+static cmdalias_t *Cmd_FindAlias (const char *name, qboolean exact)
+{
+	cmdalias_t	*a;
+
+	cmd_alias_stats.lookups++;
+	for (a = cmd_alias_hash[CMD_HASH(name)]; a; a = a->hash_next)
+	{
+		cmd_alias_stats.probes++;
+		if (exact ? !strcmp (name, a->name) : !q_strcasecmp (name, a->name))
+		{
+			cmd_alias_stats.found++;
+			return a;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+===============
+Cmd_UnlinkAliasHash
+===============
+*/
+static void Cmd_UnlinkAliasHash (cmdalias_t *alias)
+{
+	cmdalias_t	**link;
+
+	for (link = &cmd_alias_hash[CMD_HASH(alias->name)]; *link; link = &(*link)->hash_next)
+	{
+		if (*link == alias)
+		{
+			*link = alias->hash_next;
+			return;
+		}
+	}
+}
+
 /*
 ============
 Cmd_Wait_f
@@ -378,9 +431,9 @@ void Cmd_Alias_f (void)
 			Con_SafePrintf ("no alias commands found\n");
 		break;
 	case 2: //output current alias string
-		for (a = cmd_alias ; a ; a=a->next)
-			if (!strcmp(Cmd_Argv(1), a->name))
-				Con_Printf ("   %s: %s", a->name, a->value);
+		a = Cmd_FindAlias (Cmd_Argv(1), true);
+		if (a)
+			Con_Printf ("   %s: %s", a->name, a->value);
 		break;
 	default: //set alias string
 		s = Cmd_Argv(1);
@@ -391,20 +444,17 @@ void Cmd_Alias_f (void)
 		}
 
 		// if the alias already exists, reuse it
-		for (a = cmd_alias ; a ; a=a->next)
-		{
-			if (!strcmp(s, a->name))
-			{
-				Z_Free (a->value);
-				break;
-			}
-		}
-
-		if (!a)
+		a = Cmd_FindAlias (s, true);
+		if (a)
+			Z_Free (a->value);
+		else
 		{
+			unsigned int h = CMD_HASH(s);
 			a = (cmdalias_t *) Z_Malloc (sizeof(cmdalias_t));
 			a->next = cmd_alias;
 			cmd_alias = a;
+			a->hash_next = cmd_alias_hash[h];
+			cmd_alias_hash[h] = a;
 		}
 		strcpy (a->name, s);
 
@@ -454,6 +504,7 @@ void Cmd_Unalias_f (void)
 					prev->next = a->next;
 				else
 					cmd_alias  = a->next;
+				Cmd_UnlinkAliasHash (a);
 
 				Z_Free (a->value);
 				Z_Free (a);
@@ -468,13 +519,7 @@ void Cmd_Unalias_f (void)
 
 qboolean Cmd_AliasExists (const char *aliasname)
 {
-	cmdalias_t *a;
-	for (a=cmd_alias ; a ; a=a->next)
-	{
-		if (!q_strcasecmp (aliasname, a->name))
-			return true;
-	}
-	return false;
+	return Cmd_FindAlias (aliasname, false) != NULL;
 }
 
 /*
@@ -493,6 +538,7 @@ void Cmd_Unaliasall_f (void)
 		Z_Free(cmd_alias);
 		cmd_alias = blah;
 	}
+	memset (cmd_alias_hash, 0, sizeof (cmd_alias_hash));
 }
 
 /*
@@ -517,6 +563,9 @@ cmd_source_t	cmd_source;
 cmd_function_t	*cmd_functions;		// possible commands to execute
 //johnfitz
 
+static cmd_function_t	*cmd_hash[CMD_HASH_SIZE];
+static hashstats_t	cmd_stats = {"commands"};
+
 /*
 ============
 Cmd_IsReservedName
@@ -651,6 +700,10 @@ void Cmd_Init (void)
 	Cmd_AddCommand ("find", Cmd_Apropos_f);
 
 	Cmd_AddCommand ("__cfgmarker", Cmd_CfgMarker_f);
+
+	Cmd_AddCommand ("hash_stats", COM_HashStats_f);
+	COM_AddHashStats (&cmd_stats);
+	COM_AddHashStats (&cmd_alias_stats);
 }
 
 /*
@@ -765,7 +818,7 @@ cmd_function_t *Cmd_AddCommand2 (const char *cmd_name, xcommand_t function, cmd_
 	}
 
 // fail if the command already exists
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	for (cmd=cmd_hash[CMD_HASH(cmd_name)] ; cmd ; cmd=cmd->hash_next)
 	{
 		if (!Q_strcmp (cmd_name, cmd->name) && cmd->srctype == srctype)
 		{
@@ -793,6 +846,9 @@ cmd_function_t *Cmd_AddCommand2 (const char *cmd_name, xcommand_t function, cmd_
 	cmd->srctype = srctype;
 	cmd->qcinterceptable = qcinterceptable;
 
+	cmd->hash_next = cmd_hash[CMD_HASH(cmd->name)];
+	cmd_hash[CMD_HASH(cmd->name)] = cmd;
+
 	//johnfitz -- insert each entry in alphabetical order
 	if (cmd_functions == NULL || strcmp(cmd->name, cmd_functions->name) < 0) //insert at front
 	{
@@ -818,6 +874,14 @@ cmd_function_t *Cmd_AddCommand2 (const char *cmd_name, xcommand_t function, cmd_
 void Cmd_RemoveCommand (cmd_function_t *cmd)
 {
 	cmd_function_t **link;
+	for (link = &cmd_hash[CMD_HASH(cmd->name)]; *link; link = &(*link)->hash_next)
+	{
+		if (*link == cmd)
+		{
+			*link = cmd->hash_next;
+			break;
+		}
+	}
 	for (link = &cmd_functions; *link; link = &(*link)->next)
 	{
 		if (*link == cmd)
@@ -839,9 +903,16 @@ cmd_function_t *Cmd_FindCommand (const char *cmd_name)
 {
 	cmd_function_t	*cmd;
 
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	cmd_stats.lookups++;
+	for (cmd=cmd_hash[CMD_HASH(cmd_name)] ; cmd ; cmd=cmd->hash_next)
+	{
+		cmd_stats.probes++;
 		if (!q_strcasecmp (cmd_name,cmd->name))
+		{
+			cmd_stats.found++;
 			return cmd;
+		}
+	}
 
 	return NULL;
 }
@@ -878,8 +949,10 @@ qboolean Cmd_ExecuteString (const char *text, cmd_source_t src)
 		return true;		// no tokens
 
 // check functions
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	cmd_stats.lookups++;
+	for (cmd=cmd_hash[CMD_HASH(cmd_argv[0])] ; cmd ; cmd=cmd->hash_next)
 	{
+		cmd_stats.probes++;
 		if (!q_strcasecmp (cmd_argv[0],cmd->name))
 		{
 			if (src == src_client && cmd->srctype != src_client)
@@ -892,6 +965,7 @@ qboolean Cmd_ExecuteString (const char *text, cmd_source_t src)
 				cmd->function ();
 			else
 				Con_Printf ("gamecode not running, cannot \"%s\"\n", Cmd_Argv(0));
+			cmd_stats.found++;
 			return true;
 		}
 	}
@@ -905,13 +979,11 @@ qboolean Cmd_ExecuteString (const char *text, cmd_source_t src)
 		return false;
 
 // check alias
-	for (a=cmd_alias ; a ; a=a->next)
+	a = Cmd_FindAlias (cmd_argv[0], false);
+	if (a)
 	{
-		if (!q_strcasecmp (cmd_argv[0], a->name))
-		{
-			Cbuf_InsertText (a->value);
-			return true;
-		}
+		Cbuf_InsertText (a->value);
+		return true;
 	}
 
 // check cvars
@@ -1834,17 +1834,13 @@ void COM_CreatePath (char *path)
 	}
 }
 
-byte *COM_LoadMallocFile_TextMode_OSPath (const char *path, long *len_out)
+static byte *COM_LoadMallocFileMode_OSPath (const char *path, const char *mode, long *len_out)
 {
 	FILE	*f;
 	byte	*data;
 	long	len, actuallen;
 
-	// ericw -- this is used by Host_Loadgame_f. Translate CRLF to LF on load games,
-	// othewise multiline messages have a garbage character at the end of each line.
-	// TODO: could handle in a way that allows loading CRLF savegames on mac/linux
-	// without the junk characters appearing.
-	f = Sys_fopen (path, "rt");
+	f = Sys_fopen (path, mode);
 	if (f == NULL)
 		return NULL;
 
@@ -1878,6 +1874,20 @@ byte *COM_LoadMallocFile_TextMode_OSPath (const char *path, long *len_out)
 	return data;
 }
 
+byte *COM_LoadMallocFile_TextMode_OSPath (const char *path, long *len_out)
+{
+	// ericw -- this is used by Host_Loadgame_f. Translate CRLF to LF on load games,
+	// othewise multiline messages have a garbage character at the end of each line.
+	// TODO: could handle in a way that allows loading CRLF savegames on mac/linux
+	// without the junk characters appearing.
+	return COM_LoadMallocFileMode_OSPath (path, "rt", len_out);
+}
+
+byte *COM_LoadMallocFile_OSPath (const char *path, long *len_out)
+{
+	return COM_LoadMallocFileMode_OSPath (path, "rb", len_out);
+}
+
 char *COM_NormalizeLineEndings (char *buffer)
 {
 	char *src, *dst;
@@ -2948,6 +2958,7 @@ COM_InitFilesystem
 */
 void COM_InitFilesystem (void) //johnfitz -- modified based on topaz's tutorial
 {
+	extern cvar_t fs_mmap;
 	int i;
 	const char *p, *startarg;
 
@@ -2955,6 +2966,8 @@ void COM_InitFilesystem (void) //johnfitz -- modified based on topaz's tutorial
 	Cvar_RegisterVariable (&cmdline);
 	Cmd_AddCommand ("path", COM_Path_f);
 	Cmd_AddCommand ("game", COM_Game_f); //johnfitz
+	Cmd_AddCommand ("fs_stats", QFS_Stats_f);
+	Cvar_RegisterVariable (&fs_mmap);
 
 	startarg = (com_argc == 2 && Sys_FileType (com_argv[1]) != FS_ENT_NONE) ? com_argv[1] : NULL;
 	if (startarg)
@@ -3069,6 +3082,23 @@ unsigned COM_HashString (const char *str)
 	return hash;
 }
 
+/*
+================
+COM_HashStringNoCase
+Same as COM_HashString, ignoring ASCII case
+================
+*/
+unsigned COM_HashStringNoCase (const char *str)
+{
+	unsigned hash = 0x811c9dc5u;
+	while (*str)
+	{
+		hash ^= q_tolower (*str++);
+		hash *= 0x01000193u;
+	}
+	return hash;
+}
+
 /*
 ================
 COM_HashBlock
@@ -3087,6 +3117,43 @@ unsigned COM_HashBlock (const void *data, size_t size)
 	return hash;
 }
 
+static hashstats_t *com_hashstats;
+
+/*
+================
+COM_AddHashStats
+================
+*/
+void COM_AddHashStats (hashstats_t *stats)
+{
+	hashstats_t **link;
+
+	for (link = &com_hashstats; *link; link = &(*link)->next)
+		if (*link == stats)
+			return;
+	stats->next = NULL;
+	*link = stats;
+}
+
+/*
+================
+COM_HashStats_f
+================
+*/
+void COM_HashStats_f (void)
+{
+	hashstats_t *stats;
+
+	for (stats = com_hashstats; stats; stats = stats->next)
+	{
+		Con_Printf ("%-10s %" SDL_PRIs64 " lookups (%" SDL_PRIs64 " found), %.2f compares per lookup\n",
+			stats->name, stats->lookups, stats->found,
+			stats->lookups ? (double) stats->probes / stats->lookups : 0.0);
+		if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv (1), "reset"))
+			stats->lookups = stats->found = stats->probes = 0;
+	}
+}
+
 static size_t mz_zip_file_read_func(void *opaque, mz_uint64 ofs, void *buf, size_t n)
 {
 	if (SDL_RWseek((SDL_RWops*)opaque, (Sint64)ofs, RW_SEEK_SET) < 0)
@@ -348,8 +348,22 @@ char *COM_TintSubstring (const char *in, const char *substr, char *out, size_t o
 char *COM_TintString (const char *in, char *out, size_t outsize);
 
 unsigned COM_HashString (const char *str);
+unsigned COM_HashStringNoCase (const char *str);
 unsigned COM_HashBlock (const void *data, size_t size);
 
+// lookup counters for the name indexes, printed by hash_stats
+typedef struct hashstats_s
+{
+	const char			*name;
+	int64_t				lookups;
+	int64_t				found;
+	int64_t				probes;		// entries compared
+	struct hashstats_s	*next;
+} hashstats_t;
+
+void COM_AddHashStats (hashstats_t *stats);
+void COM_HashStats_f (void);
+
 // localization support for 2021 rerelease version:
 void LOC_Init (void);
 void LOC_Shutdown (void);
@@ -405,6 +419,8 @@ qboolean COM_WriteFile_OSPath (const char *filename, const void *data, size_t le
 // Returns NULL on failure, or else a '\0'-terminated malloc'ed buffer.
 // Loads in "t" mode so CRLF to LF translation is performed on Windows.
 byte *COM_LoadMallocFile_TextMode_OSPath (const char *path, long *len_out);
+// Same, but loads in "b" mode.
+byte *COM_LoadMallocFile_OSPath (const char *path, long *len_out);
 
 // Replaces CR/CRLF with LF.
 char *COM_NormalizeLineEndings (char *buffer);
@@ -1547,6 +1547,7 @@ extern	cmd_function_t	*cmd_functions;
 typedef struct cmdalias_s
 {
 	struct cmdalias_s	*next;
+	struct cmdalias_s	*hash_next;
 	char	name[MAX_ALIAS_NAME];
 	char	*value;
 } cmdalias_t;
@@ -28,6 +28,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 static int			cvar_count;
 static cvar_t		*cvar_list[MAX_CVARS];
 static cvar_t		*cvar_hashmap[MAX_CVARS * 2];
+static hashstats_t	cvar_stats = {"cvars"};
 static char			cvar_null_string[] = "";
 
 /*
@@ -282,6 +283,8 @@ void Cvar_Init (void)
 	Cmd_AddCommand ("reset", Cvar_Reset_f);
 	Cmd_AddCommand ("resetall", Cvar_ResetAll_f);
 	Cmd_AddCommand ("resetcfg", Cvar_ResetCfg_f);
+
+	COM_AddHashStats (&cvar_stats);
 }
 
 //==============================================================================
@@ -305,14 +308,19 @@ cvar_t *Cvar_FindVar (const char *var_name)
 	capacity = Q_COUNTOF (cvar_hashmap);
 	pos = COM_HashString (var_name) % capacity;
 	end = pos;
+	cvar_stats.lookups++;
 
 	do
 	{
 		cvar_t *var = cvar_hashmap[pos];
 		if (!var)
 			return NULL;
+		cvar_stats.probes++;
 		if (0 == strcmp(var->name, var_name))
+		{
+			cvar_stats.found++;
 			return var;
+		}
 
 		++pos;
 		if (pos == capacity)
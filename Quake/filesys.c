@@ -66,6 +66,8 @@ typedef struct pack_s
 	char	filename[MAX_OSPATH];
 	int		numfiles;
 	packfile_t	*files;
+	int		hashsize;	// power of 2
+	int		*hash;		// file index + 1, or 0 for an empty slot
 	void* impl_data;
 	int pakver;
 	qfshandle_t* (*open_file)(struct pack_s* pack, int idx, qboolean reopen_pack);
@@ -88,6 +90,18 @@ typedef struct
 #define MAX_FILES_IN_PACK	2048
 #define MAX_PACK_FILES 32
 
+//QFS_FindFile statistics, reported by fs_stats
+static struct
+{
+	int64_t	lookups;
+	int64_t	found;
+	double	time;
+	int64_t	mapped;
+	int64_t	mappedbytes;
+} qfs_stats;
+
+cvar_t fs_mmap = {"fs_mmap", "1", CVAR_NONE};
+
 //Loaded pack files (.pak or .pk3)
 //Index 0 is just a placeholder so 0 can be used to indicate error. First pack is loaded at index 1.
 static pack_t* packs[1 + MAX_PACK_FILES] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
@@ -115,10 +129,63 @@ static void QFS_FreePackHandle (pack_t *pack)
 		}
 		if (pack->files)
 			free (pack->files);
+		if (pack->hash)
+			free (pack->hash);
 		free (pack);
 	}
 }
 
+static void* QFS_Alloc (size_t sz);
+
+/*
+=================
+QFS_BuildPackHash
+
+Build an open addressing table over the file names in the pack.
+When a name occurs more than once the first entry is found first,
+same as a linear search.
+=================
+*/
+static void QFS_BuildPackHash (pack_t *pack)
+{
+	int i, pos, mask;
+
+	pack->hashsize = 16;
+	while (pack->hashsize < pack->numfiles * 2)
+		pack->hashsize <<= 1;
+	pack->hash = (int *) QFS_Alloc (pack->hashsize * sizeof(int));
+	mask = pack->hashsize - 1;
+
+	for (i = 0; i < pack->numfiles; i++)
+	{
+		pos = COM_HashString (pack->files[i].name) & mask;
+		while (pack->hash[pos])
+			pos = (pos + 1) & mask;
+		pack->hash[pos] = i + 1;
+	}
+}
+
+/*
+=================
+QFS_FindInPack
+
+Returns the index of filename in the pack, or -1.
+hash is COM_HashString (filename).
+=================
+*/
+static int QFS_FindInPack (pack_t *pack, const char *filename, unsigned hash)
+{
+	int pos, idx, mask = pack->hashsize - 1;
+
+	for (pos = hash & mask; (idx = pack->hash[pos]) != 0; pos = (pos + 1) & mask)
+	{
+		if (strcmp (pack->files[idx - 1].name, filename) == 0)
+			return idx - 1;
+	}
+
+	return -1;
+}
+
 /*
 =================
 QFS_RegisterPack
@@ -130,6 +197,8 @@ is closed and freed.
 */
 static int QFS_RegisterPack (pack_t *pack)
 {
+	QFS_BuildPackHash (pack);
+
 	for (size_t i = 1; i < countof(packs); ++i)
 	{
 		if (packs[i] == NULL)
@@ -764,9 +833,15 @@ static qfileofs_t QFS_FindFile (const char *filename, qfshandle_t** file, qboole
 	char		netpath[MAX_OSPATH];
 	pack_t		*pak;
 	int			i;
+	unsigned	hash;
+	double		start;
 
 	if (file)
 		*file = NULL;
+
+	start = Sys_DoubleTime ();
+	hash = COM_HashString (filename);
+	qfs_stats.lookups++;
 //
 // search through the path, one element at a time
 //
@@ -778,11 +853,13 @@ static qfileofs_t QFS_FindFile (const char *filename, qfshandle_t** file, qboole
 			if (!pak)
 				Sys_Error ("QFS_FindFile: invalid pack id.");
 
-			for (i = 0; i < pak->numfiles; i++)
+			i = QFS_FindInPack (pak, filename, hash);
+			if (i >= 0)
 			{
-				if (strcmp(pak->files[i].name, filename) != 0)
-					continue;
 				// found it!
+				qfs_stats.found++;
+				qfs_stats.time += Sys_DoubleTime () - start;
+
 				if (path_id)
 					*path_id = search->path_id;
 
@@ -804,6 +881,9 @@ static qfileofs_t QFS_FindFile (const char *filename, qfshandle_t** file, qboole
 			if (! (Sys_FileType(netpath) & FS_ENT_FILE))
 				continue;
 
+			qfs_stats.found++;
+			qfs_stats.time += Sys_DoubleTime () - start;
+
 			if (path_id)
 				*path_id = search->path_id;
 			
@@ -821,6 +901,8 @@ static qfileofs_t QFS_FindFile (const char *filename, qfshandle_t** file, qboole
 		}
 	}
 
+	qfs_stats.time += Sys_DoubleTime () - start;
+
 	if (developer.value)
 	{
 		const char *ext = COM_FileGetExtension (filename);
@@ -847,7 +929,7 @@ typedef enum
 	LOADFILE_MALLOC
 } loadfile_alloc_t;
 
-byte *QFS_LoadFile (const char *path, loadfile_alloc_t method, unsigned int *path_id, size_t* ldsize)
+static byte *QFS_LoadFromHandle (qfshandle_t *h, const char *path, loadfile_alloc_t method, size_t* ldsize)
 {
 	byte	*buf;
 	char	base[32];
@@ -855,11 +937,6 @@ byte *QFS_LoadFile (const char *path, loadfile_alloc_t method, unsigned int *pat
 
 	buf = NULL;	// quiet compiler warning
 
-// look for it in the filesystem or pack files
-	qfshandle_t *h = QFS_OpenFile (path, path_id);
-	if (h == NULL)
-		return NULL;
-	
 	len = (size_t)QFS_FileSize (h);
 	if (ldsize)
 		*ldsize = len;
@@ -892,6 +969,16 @@ byte *QFS_LoadFile (const char *path, loadfile_alloc_t method, unsigned int *pat
 	return buf;
 }
 
+byte *QFS_LoadFile (const char *path, loadfile_alloc_t method, unsigned int *path_id, size_t* ldsize)
+{
+// look for it in the filesystem or pack files
+	qfshandle_t *h = QFS_OpenFile (path, path_id);
+	if (h == NULL)
+		return NULL;
+
+	return QFS_LoadFromHandle (h, path, method, ldsize);
+}
+
 byte *QFS_LoadHunkFile (const char *path, unsigned int *path_id, size_t* ldsize)
 {
 	return QFS_LoadFile (path, LOADFILE_HUNK, path_id, ldsize);
@@ -903,6 +990,50 @@ byte *QFS_LoadMallocFile (const char *path, unsigned int *path_id, size_t* ldsiz
 	return QFS_LoadFile (path, LOADFILE_MALLOC, path_id, ldsize);
 }
 
+byte *QFS_LoadMappedFile (const char *path, unsigned int *path_id, size_t* ldsize, sysmapping_t *map)
+{
+	qfshandle_t	*h;
+	pack_t		*pack;
+	byte		*buf;
+	size_t		len;
+
+	map->base = NULL;
+	map->size = 0;
+
+	h = QFS_OpenFile (path, path_id);
+	if (h == NULL)
+		return NULL;
+
+	// .pak entries and stored .pk3 entries are read straight from the pack,
+	// unless the directory points past the end of the pack file: touching
+	// those pages would fault, so let the regular loader report it instead
+	pack = (pack_t *)h->data;
+	len = (size_t)QFS_FileSize (h);
+	if (fs_mmap.value && h->read == &PAK_Read && h->pak_offset + (qfileofs_t)len <= Sys_filelength (pack->handle))
+	{
+		buf = (byte *) Sys_MapFile (pack->handle, h->pak_offset, len, map);
+		if (buf)
+		{
+			QFS_CloseFile (h);
+			qfs_stats.mapped++;
+			qfs_stats.mappedbytes += len;
+			if (ldsize)
+				*ldsize = len;
+			return buf;
+		}
+	}
+
+	return QFS_LoadFromHandle (h, path, LOADFILE_MALLOC, ldsize);
+}
+
+void QFS_FreeMappedFile (byte *buf, sysmapping_t *map)
+{
+	if (map->base)
+		Sys_UnmapFile (map);
+	else
+		free (buf);
+}
+
 qboolean QFS_FileExists (const char *filename, unsigned int *path_id)
 {
 	qfileofs_t ret = QFS_FindFile (filename, NULL, false, path_id);
@@ -1048,3 +1179,31 @@ size_t QFS_GetLine (qfshandle_t* handle, char *buf, size_t bufsz)
 	return o;
 }
 
+/*
+============
+QFS_Stats_f
+============
+*/
+void QFS_Stats_f (void)
+{
+	int i, numpacks = 0, numfiles = 0;
+
+	for (i = 1; i < (int)countof(packs); i++)
+	{
+		if (packs[i])
+		{
+			numpacks++;
+			numfiles += packs[i]->numfiles;
+		}
+	}
+
+	Con_Printf ("%d packs, %d files\n", numpacks, numfiles);
+	Con_Printf ("%" SDL_PRIs64 " lookups (%" SDL_PRIs64 " found), %.3f ms total, %.2f us average\n",
+		qfs_stats.lookups, qfs_stats.found, qfs_stats.time * 1000.0,
+		qfs_stats.lookups ? qfs_stats.time * 1e6 / qfs_stats.lookups : 0.0);
+	Con_Printf ("%" SDL_PRIs64 " files mapped (%.1f MB)\n",
+		qfs_stats.mapped, qfs_stats.mappedbytes / (1024.0 * 1024.0));
+
+	if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv (1), "reset"))
+		memset (&qfs_stats, 0, sizeof (qfs_stats));
+}
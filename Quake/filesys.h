@@ -149,6 +149,20 @@ byte *QFS_LoadHunkFile (const char *path, unsigned int *path_id, size_t* ldsize)
 byte *QFS_LoadMallocFile (const char *path, unsigned int *path_id, size_t* ldsize);
 	// allocates the buffer on the system mem (malloc).
 
+/*
+============
+QFS_LoadMappedFile
+
+Like QFS_LoadMallocFile, but files stored uncompressed in a pack are
+memory mapped instead of copied. The buffer may be modified, changes
+are private to the caller. Unlike the other loaders the buffer is not
+NUL-terminated, callers that need a terminator should use
+QFS_LoadMallocFile. It must be released with QFS_FreeMappedFile.
+============
+*/
+byte *QFS_LoadMappedFile (const char *path, unsigned int *path_id, size_t* ldsize, sysmapping_t *map);
+void QFS_FreeMappedFile (byte *buf, sysmapping_t *map);
+
 /*
 ============
 QFS_LoadPackFile
@@ -239,4 +253,14 @@ extract bufsz-1 characters.
 */
 size_t QFS_GetLine (qfshandle_t* handle, char *buf, size_t bufsz);
 
+/*
+============
+QFS_Stats_f
+
+Console command that prints the number of QFS_FindFile lookups and the
+time spent in them. "fs_stats reset" clears the counters afterwards.
+============
+*/
+void QFS_Stats_f (void);
+
 #endif 	/* QUAKE_FILESYSTEM_H */
@@ -47,9 +47,18 @@ static int	mod_novis_capacity;
 static byte	*mod_decompressed;
 static int	mod_decompressed_capacity;
 
+static byte	*mod_fatpvs;
+static int	mod_fatpvs_capacity;
+
+static void Mod_FlushPVSCache (void);
+static void Mod_PVSStats_f (void);
+static cvar_t	pvs_cachesize = {"pvs_cachesize", "8", CVAR_ARCHIVE}; // megabytes, 0 disables
+
 #define	MAX_MOD_KNOWN	4096 /*johnfitz -- was 512 */
 static qmodel_t	mod_known[MAX_MOD_KNOWN];
 static int		mod_numknown;
+static qmodel_t	*mod_hashmap[MAX_MOD_KNOWN * 2];
+static hashstats_t	mod_stats = {"models"};
 
 texture_t	*r_notexture_mip; //johnfitz -- moved here from r_main.c
 texture_t	*r_notexture_mip2; //johnfitz -- used for non-lightmapped surfs with a missing texture
@@ -100,6 +109,10 @@ void Mod_Init (void)
 
 	Cmd_AddCommand ("mcache", Mod_Print);
 
+	Cvar_RegisterVariable (&pvs_cachesize);
+	Cmd_AddCommand ("pvs_stats", Mod_PVSStats_f);
+	COM_AddHashStats (&mod_stats);
+
 	//johnfitz -- create notexture miptex
 	r_notexture_mip = (texture_t *) Hunk_AllocName (sizeof(texture_t), "r_notexture_mip");
 	strcpy (r_notexture_mip->name, "notexture");
@@ -227,11 +240,377 @@ static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
 	return mod_decompressed;
 }
 
+/*
+===============================================================================
+
+PVS CACHE
+
+Decompressed leaf PVS rows are kept in an LRU cache, so the server doesn't
+decompress the same rows for every client on every frame. Merged (fat) PVS
+results are cached too, keyed by the list of leafs that went into them.
+Everything here runs on the main thread only, and the returned rows are
+only valid until the next call, same as the old shared decompression buffer.
+
+===============================================================================
+*/
+
+#define MAX_FATPVS_CACHE		64
+#define MAX_FATPVS_CACHE_LEAFS	32		// don't cache merges of more leafs than this
+
+typedef struct
+{
+	uint32_t		key;
+	qboolean		used;
+	int				prev, next;			// LRU order, most recently used first
+	int				hashnext;
+} pvslruentry_t;
+
+typedef struct
+{
+	int				numentries;
+	int				hashmask;
+	int				*hash;				// first entry in each bucket, -1 if none
+	pvslruentry_t	*entries;
+	byte			*rows;				// numentries * rowbytes
+	int				head, tail;
+	uint64_t		hits, misses;
+} pvslru_t;
+
+typedef struct
+{
+	int				numleafs;
+	int				leafnums[MAX_FATPVS_CACHE_LEAFS];
+} fatpvskey_t;
+
+static struct
+{
+	qmodel_t		*model;
+	float			budget;				// pvs_cachesize value the cache was built with
+	int				rowbytes;			// aligned row size
+	pvslru_t		leafs;
+	pvslru_t		fat;
+	fatpvskey_t		*fatkeys;
+} pvscache;
+
+/*
+===================
+Mod_PVSLRU_Init
+===================
+*/
+static void Mod_PVSLRU_Init (pvslru_t *lru, int numentries, int rowbytes)
+{
+	int i;
+
+	memset (lru, 0, sizeof (*lru));
+	lru->numentries = numentries;
+	lru->hashmask = Q_nextPow2 (numentries * 2) - 1;
+	lru->hash = (int *) malloc ((lru->hashmask + 1) * sizeof (lru->hash[0]));
+	lru->entries = (pvslruentry_t *) calloc (numentries, sizeof (lru->entries[0]));
+	lru->rows = (byte *) malloc ((size_t) numentries * rowbytes);
+	if (!lru->hash || !lru->entries || !lru->rows)
+		Sys_Error ("Mod_PVSLRU_Init: out of memory for %d rows of %d bytes", numentries, rowbytes);
+
+	for (i = 0; i <= lru->hashmask; i++)
+		lru->hash[i] = -1;
+	for (i = 0; i < numentries; i++)
+	{
+		lru->entries[i].prev = i - 1;
+		lru->entries[i].next = i + 1 < numentries ? i + 1 : -1;
+		lru->entries[i].hashnext = -1;
+	}
+	lru->head = 0;
+	lru->tail = numentries - 1;
+}
+
+/*
+===================
+Mod_PVSLRU_Free
+===================
+*/
+static void Mod_PVSLRU_Free (pvslru_t *lru)
+{
+	free (lru->hash);
+	free (lru->entries);
+	free (lru->rows);
+	memset (lru, 0, sizeof (*lru));
+}
+
+/*
+===================
+Mod_PVSLRU_Touch
+
+Moves an entry to the front of the LRU list
+===================
+*/
+static void Mod_PVSLRU_Touch (pvslru_t *lru, int i)
+{
+	pvslruentry_t *e = &lru->entries[i];
+
+	if (lru->head == i)
+		return;
+
+	// unlink
+	lru->entries[e->prev].next = e->next;
+	if (e->next != -1)
+		lru->entries[e->next].prev = e->prev;
+	else
+		lru->tail = e->prev;
+
+	// insert at head
+	e->prev = -1;
+	e->next = lru->head;
+	lru->entries[lru->head].prev = i;
+	lru->head = i;
+}
+
+/*
+===================
+Mod_PVSLRU_Find
+===================
+*/
+static int Mod_PVSLRU_Find (pvslru_t *lru, uint32_t key)
+{
+	int i;
+
+	for (i = lru->hash[key & lru->hashmask]; i != -1; i = lru->entries[i].hashnext)
+		if (lru->entries[i].key == key)
+			return i;
+
+	return -1;
+}
+
+/*
+===================
+Mod_PVSLRU_Alloc
+
+Recycles the least recently used entry for a new key
+===================
+*/
+static int Mod_PVSLRU_Alloc (pvslru_t *lru, uint32_t key)
+{
+	int				i = lru->tail;
+	pvslruentry_t	*e = &lru->entries[i];
+	int				*link;
+
+	if (e->used)
+	{
+		for (link = &lru->hash[e->key & lru->hashmask]; *link != i; link = &lru->entries[*link].hashnext)
+			;
+		*link = e->hashnext;
+	}
+
+	e->used = true;
+	e->key = key;
+	e->hashnext = lru->hash[key & lru->hashmask];
+	lru->hash[key & lru->hashmask] = i;
+	Mod_PVSLRU_Touch (lru, i);
+
+	return i;
+}
+
+/*
+===================
+Mod_FlushPVSCache
+===================
+*/
+static void Mod_FlushPVSCache (void)
+{
+	Mod_PVSLRU_Free (&pvscache.leafs);
+	Mod_PVSLRU_Free (&pvscache.fat);
+	free (pvscache.fatkeys);
+	pvscache.fatkeys = NULL;
+	pvscache.model = NULL;
+}
+
+/*
+===================
+Mod_CheckPVSCache
+
+Returns true if the cache can be used for this model,
+(re)building it if the model or the budget changed
+===================
+*/
+static qboolean Mod_CheckPVSCache (qmodel_t *model)
+{
+	int		rowbytes;
+	size_t	budget;
+
+	if (pvscache.model == model && pvscache.budget == pvs_cachesize.value)
+		return true;
+
+	Mod_FlushPVSCache ();
+	pvscache.budget = pvs_cachesize.value;
+	if (pvs_cachesize.value <= 0.f)
+		return false;
+
+	rowbytes = (model->numleafs+7)>>3;
+	rowbytes = (rowbytes + VIS_ALIGN_MASK) & ~VIS_ALIGN_MASK;
+	budget = (size_t) (pvs_cachesize.value * 1024.f * 1024.f);
+
+	// 7/8 of the budget for leaf rows (no need for more than one per leaf), the rest for fat rows
+	Mod_PVSLRU_Init (&pvscache.leafs, (int) CLAMP (16, budget / 8 * 7 / rowbytes, (size_t) model->numleafs + 1), rowbytes);
+	Mod_PVSLRU_Init (&pvscache.fat, (int) CLAMP (4, budget / 8 / rowbytes, MAX_FATPVS_CACHE), rowbytes);
+	pvscache.fatkeys = (fatpvskey_t *) calloc (pvscache.fat.numentries, sizeof (fatpvskey_t));
+	if (!pvscache.fatkeys)
+		Sys_Error ("Mod_CheckPVSCache: out of memory");
+
+	pvscache.model = model;
+	pvscache.rowbytes = rowbytes;
+
+	return true;
+}
+
+/*
+===================
+Mod_PVSStats_f
+===================
+*/
+static void Mod_PVSLRU_Print (const char *name, const pvslru_t *lru)
+{
+	uint64_t total = lru->hits + lru->misses;
+	Con_Printf ("%-5s %5d rows  %5.1f%% hits (%" SDL_PRIu64 "/%" SDL_PRIu64 ")  %5.2f MB\n",
+		name, lru->numentries, total ? lru->hits * 100.0 / total : 0.0, lru->hits, total,
+		(double) lru->numentries * pvscache.rowbytes / (1024.0 * 1024.0));
+}
+
+static void Mod_PVSStats_f (void)
+{
+	if (!pvscache.model)
+	{
+		Con_Printf ("PVS cache is empty\n");
+		return;
+	}
+
+	Con_Printf ("PVS cache for %s (%d bytes per row)\n", pvscache.model->name, pvscache.rowbytes);
+	Mod_PVSLRU_Print ("leaf", &pvscache.leafs);
+	Mod_PVSLRU_Print ("fat", &pvscache.fat);
+
+	if (Cmd_Argc () >= 2 && !q_strcasecmp (Cmd_Argv (1), "reset"))
+	{
+		pvscache.leafs.hits = pvscache.leafs.misses = 0;
+		pvscache.fat.hits = pvscache.fat.misses = 0;
+	}
+}
+
+/*
+===================
+Mod_OrPVS
+
+Merges a row into another one, a word at a time.
+Both row sizes are multiples of VIS_ALIGN.
+===================
+*/
+static void Mod_OrPVS (byte *dst, const byte *src, int bytes)
+{
+	uint64_t	a, b;
+	int			i;
+
+	for (i = 0; i < bytes; i += sizeof (a))
+	{
+		memcpy (&a, dst + i, sizeof (a));
+		memcpy (&b, src + i, sizeof (b));
+		a |= b;
+		memcpy (dst + i, &a, sizeof (a));
+	}
+}
+
 byte *Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model)
 {
+	int		leafnum, i, row;
+	byte	*out;
+
 	if (leaf == model->leafs)
 		return Mod_NoVisPVS (model);
-	return Mod_DecompressVis (leaf->compressed_vis, model);
+	if (!Mod_CheckPVSCache (model))
+		return Mod_DecompressVis (leaf->compressed_vis, model);
+
+	leafnum = leaf - model->leafs;
+	i = Mod_PVSLRU_Find (&pvscache.leafs, leafnum);
+	if (i != -1)
+	{
+		pvscache.leafs.hits++;
+		Mod_PVSLRU_Touch (&pvscache.leafs, i);
+		return pvscache.leafs.rows + i * pvscache.rowbytes;
+	}
+
+	pvscache.leafs.misses++;
+	i = Mod_PVSLRU_Alloc (&pvscache.leafs, leafnum);
+	out = pvscache.leafs.rows + i * pvscache.rowbytes;
+	row = (model->numleafs+7)>>3;
+	memcpy (out, Mod_DecompressVis (leaf->compressed_vis, model), row);
+	memset (out + row, 0, pvscache.rowbytes - row);
+
+	return out;
+}
+
+/*
+===================
+Mod_FatPVS
+
+Returns the union of the PVS rows of the given leafs
+===================
+*/
+byte *Mod_FatPVS (qmodel_t *model, mleaf_t **leafs, int numleafs)
+{
+	int			i, slot, bytes;
+	uint32_t	key;
+	byte		*out;
+	fatpvskey_t	*fatkey;
+
+	bytes = (model->numleafs+7)>>3;
+	bytes = (bytes + VIS_ALIGN_MASK) & ~VIS_ALIGN_MASK;
+
+	slot = -1;
+	if (Mod_CheckPVSCache (model) && numleafs <= MAX_FATPVS_CACHE_LEAFS)
+	{
+		// FNV-1a over the leaf numbers, in traversal order
+		key = 2166136261u;
+		for (i = 0; i < numleafs; i++)
+			key = (key ^ (uint32_t)(leafs[i] - model->leafs)) * 16777619u;
+
+		slot = Mod_PVSLRU_Find (&pvscache.fat, key);
+		if (slot != -1)
+		{
+			fatkey = &pvscache.fatkeys[slot];
+			for (i = 0; i < numleafs && i < fatkey->numleafs; i++)
+				if (fatkey->leafnums[i] != leafs[i] - model->leafs)
+					break;
+			if (i == numleafs && i == fatkey->numleafs)
+			{
+				pvscache.fat.hits++;
+				Mod_PVSLRU_Touch (&pvscache.fat, slot);
+				return pvscache.fat.rows + slot * bytes;
+			}
+			// hash collision, overwrite the old entry
+			Mod_PVSLRU_Touch (&pvscache.fat, slot);
+		}
+		else
+			slot = Mod_PVSLRU_Alloc (&pvscache.fat, key);
+
+		pvscache.fat.misses++;
+		fatkey = &pvscache.fatkeys[slot];
+		fatkey->numleafs = numleafs;
+		for (i = 0; i < numleafs; i++)
+			fatkey->leafnums[i] = leafs[i] - model->leafs;
+		out = pvscache.fat.rows + slot * bytes;
+	}
+	else
+	{
+		if (mod_fatpvs == NULL || bytes > mod_fatpvs_capacity)
+		{
+			mod_fatpvs_capacity = bytes;
+			mod_fatpvs = (byte *) realloc (mod_fatpvs, mod_fatpvs_capacity);
+			if (!mod_fatpvs)
+				Sys_Error ("Mod_FatPVS: realloc() failed on %d bytes", mod_fatpvs_capacity);
+		}
+		out = mod_fatpvs;
+	}
+
+	memset (out, 0, bytes);
+	for (i = 0; i < numleafs; i++)
+		Mod_OrPVS (out, Mod_LeafPVS (leafs[i], model), bytes);
+
+	return out;
 }
 
 byte *Mod_NoVisPVS (qmodel_t *model)
@@ -287,6 +666,7 @@ void Mod_ResetAll (void)
 		memset(mod, 0, sizeof(qmodel_t));
 	}
 	mod_numknown = 0;
+	memset (mod_hashmap, 0, sizeof (mod_hashmap));
 }
 
 /*
@@ -297,7 +677,7 @@ Mod_FindName
 */
 static qmodel_t *Mod_FindName (const char *name)
 {
-	int		i;
+	size_t		capacity, pos;
 	qmodel_t	*mod;
 
 	if (!name[0])
@@ -306,21 +686,31 @@ static qmodel_t *Mod_FindName (const char *name)
 //
 // search the currently loaded models
 //
-	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
+	capacity = Q_COUNTOF (mod_hashmap);
+	pos = COM_HashString (name) % capacity;
+	mod_stats.lookups++;
+	while (mod_hashmap[pos])
 	{
-		if (!strcmp (mod->name, name) )
-			break;
-	}
+		mod_stats.probes++;
+		if (!strcmp (mod_hashmap[pos]->name, name))
+		{
+			mod_stats.found++;
+			return mod_hashmap[pos];
+		}
 
-	if (i == mod_numknown)
-	{
-		if (mod_numknown == MAX_MOD_KNOWN)
-			Sys_Error ("mod_numknown == MAX_MOD_KNOWN");
-		q_strlcpy (mod->name, name, MAX_QPATH);
-		mod->needload = true;
-		mod_numknown++;
+		++pos;
+		if (pos == capacity)
+			pos = 0;
 	}
 
+	if (mod_numknown == MAX_MOD_KNOWN)
+		Sys_Error ("mod_numknown == MAX_MOD_KNOWN");
+	mod = &mod_known[mod_numknown];
+	q_strlcpy (mod->name, name, MAX_QPATH);
+	mod->needload = true;
+	mod_numknown++;
+	mod_hashmap[pos] = mod;
+
 	return mod;
 }
 
@@ -354,6 +744,7 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 {
 	byte	*buf;
 	int		mod_type;
+	sysmapping_t	map;
 
 	if (!mod->needload)
 	{
@@ -377,7 +768,7 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 //
 // load the file
 //
-	buf = QFS_LoadMallocFile (mod->name, &mod->path_id, NULL);
+	buf = QFS_LoadMappedFile (mod->name, &mod->path_id, NULL, &map);
 	if (!buf)
 	{
 		if (crash)
@@ -415,7 +806,7 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 		break;
 	}
 
-	free (buf);
+	QFS_FreeMappedFile (buf, &map);
 
 	return mod;
 }
@@ -447,6 +838,29 @@ qmodel_t *Mod_ForName (const char *name, qboolean crash)
 
 static byte	*mod_base;
 
+// Lumps that don't depend on each other are decoded by worker threads.
+// Loaders allocate their output on the hunk in a fixed order on the main
+// thread and only hand the decoding loop to a task, so the hunk layout
+// doesn't depend on timing. Tasks never call Host_Error/Con_Printf,
+// problems are reported after Task_Wait instead.
+static taskgroup_t	mod_lumptasks;
+static int			mod_missingtextures;
+static SDL_atomic_t	mod_badclipnodes;
+static SDL_atomic_t	mod_badextents;
+
+/*
+=================
+Mod_SyncLoadTasks
+
+Waits for lump decoding tasks that are still running, e.g. when
+Host_Error aborts a map load
+=================
+*/
+void Mod_SyncLoadTasks (void)
+{
+	Task_Wait (&mod_lumptasks);
+}
+
 /*
 =================
 Mod_CheckFullbrights -- johnfitz
@@ -925,6 +1339,12 @@ static void Mod_LoadLighting (lump_t *l)
 Mod_LoadVisibility
 =================
 */
+static void Mod_CopyVisibility (void *data)
+{
+	lump_t *l = (lump_t *) data;
+	memcpy (loadmodel->visdata, mod_base + l->fileofs, l->filelen);
+}
+
 static void Mod_LoadVisibility (lump_t *l)
 {
 	loadmodel->viswarn = false;
@@ -934,7 +1354,7 @@ static void Mod_LoadVisibility (lump_t *l)
 		return;
 	}
 	loadmodel->visdata = (byte *) Hunk_AllocNameNoFill ( l->filelen, loadname);
-	memcpy (loadmodel->visdata, mod_base + l->fileofs, l->filelen);
+	Task_Submit (&mod_lumptasks, Mod_CopyVisibility, l);
 }
 
 
@@ -1007,11 +1427,26 @@ _load_embedded:
 Mod_LoadVertexes
 =================
 */
+static void Mod_DecodeVertexes (void *data)
+{
+	lump_t		*l = (lump_t *) data;
+	dvertex_t	*in = (dvertex_t *)(mod_base + l->fileofs);
+	mvertex_t	*out = loadmodel->vertexes;
+	int			i;
+
+	for (i=0 ; i<loadmodel->numvertexes ; i++, in++, out++)
+	{
+		out->position[0] = LittleFloat (in->point[0]);
+		out->position[1] = LittleFloat (in->point[1]);
+		out->position[2] = LittleFloat (in->point[2]);
+	}
+}
+
 static void Mod_LoadVertexes (lump_t *l)
 {
 	dvertex_t	*in;
 	mvertex_t	*out;
-	int			i, count;
+	int			count;
 
 	in = (dvertex_t *)(mod_base + l->fileofs);
 	if (l->filelen % sizeof(*in))
@@ -1022,12 +1457,7 @@ static void Mod_LoadVertexes (lump_t *l)
 	loadmodel->vertexes = out;
 	loadmodel->numvertexes = count;
 
-	for (i=0 ; i<count ; i++, in++, out++)
-	{
-		out->position[0] = LittleFloat (in->point[0]);
-		out->position[1] = LittleFloat (in->point[1]);
-		out->position[2] = LittleFloat (in->point[2]);
-	}
+	Task_Submit (&mod_lumptasks, Mod_DecodeVertexes, l);
 }
 
 /*
@@ -1035,49 +1465,50 @@ static void Mod_LoadVertexes (lump_t *l)
 Mod_LoadEdges
 =================
 */
-static void Mod_LoadEdges (lump_t *l, int bsp2)
+static void Mod_DecodeEdgesL (void *data)
 {
-	medge_t *out;
-	int 	i, count;
+	lump_t		*l = (lump_t *) data;
+	dledge_t	*in = (dledge_t *)(mod_base + l->fileofs);
+	medge_t		*out = loadmodel->edges;
+	int			i;
 
-	if (bsp2)
+	for (i=0 ; i<loadmodel->numedges ; i++, in++, out++)
 	{
-		dledge_t *in = (dledge_t *)(mod_base + l->fileofs);
-
-		if (l->filelen % sizeof(*in))
-			Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
-
-		count = l->filelen / sizeof(*in);
-		out = (medge_t *) Hunk_AllocNameNoFill ( (count + 1) * sizeof(*out), loadname);
+		out->v[0] = LittleLong(in->v[0]);
+		out->v[1] = LittleLong(in->v[1]);
+	}
+}
 
-		loadmodel->edges = out;
-		loadmodel->numedges = count;
+static void Mod_DecodeEdgesS (void *data)
+{
+	lump_t		*l = (lump_t *) data;
+	dsedge_t	*in = (dsedge_t *)(mod_base + l->fileofs);
+	medge_t		*out = loadmodel->edges;
+	int			i;
 
-		for (i=0 ; i<count ; i++, in++, out++)
-		{
-			out->v[0] = LittleLong(in->v[0]);
-			out->v[1] = LittleLong(in->v[1]);
-		}
-	}
-	else
+	for (i=0 ; i<loadmodel->numedges ; i++, in++, out++)
 	{
-		dsedge_t *in = (dsedge_t *)(mod_base + l->fileofs);
+		out->v[0] = (unsigned short)LittleShort(in->v[0]);
+		out->v[1] = (unsigned short)LittleShort(in->v[1]);
+	}
+}
 
-		if (l->filelen % sizeof(*in))
-			Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
+static void Mod_LoadEdges (lump_t *l, int bsp2)
+{
+	medge_t *out;
+	int 	count;
+	size_t	insize = bsp2 ? sizeof(dledge_t) : sizeof(dsedge_t);
 
-		count = l->filelen / sizeof(*in);
-		out = (medge_t *) Hunk_AllocNameNoFill ( (count + 1) * sizeof(*out), loadname);
+	if (l->filelen % insize)
+		Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
 
-		loadmodel->edges = out;
-		loadmodel->numedges = count;
+	count = l->filelen / insize;
+	out = (medge_t *) Hunk_AllocNameNoFill ( (count + 1) * sizeof(*out), loadname);
 
-		for (i=0 ; i<count ; i++, in++, out++)
-		{
-			out->v[0] = (unsigned short)LittleShort(in->v[0]);
-			out->v[1] = (unsigned short)LittleShort(in->v[1]);
-		}
-	}
+	loadmodel->edges = out;
+	loadmodel->numedges = count;
+
+	Task_Submit (&mod_lumptasks, bsp2 ? Mod_DecodeEdgesL : Mod_DecodeEdgesS, l);
 }
 
 /*
@@ -1085,23 +1516,15 @@ static void Mod_LoadEdges (lump_t *l, int bsp2)
 Mod_LoadTexinfo
 =================
 */
-static void Mod_LoadTexinfo (lump_t *l)
+static void Mod_DecodeTexinfo (void *data)
 {
-	texinfo_t *in;
-	mtexinfo_t *out;
-	int	i, j, count, miptex;
+	lump_t		*l = (lump_t *) data;
+	texinfo_t	*in = (texinfo_t *)(mod_base + l->fileofs);
+	mtexinfo_t	*out = loadmodel->texinfo;
+	int	i, j, miptex;
 	int missing = 0; //johnfitz
 
-	in = (texinfo_t *)(mod_base + l->fileofs);
-	if (l->filelen % sizeof(*in))
-		Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
-	count = l->filelen / sizeof(*in);
-	out = (mtexinfo_t *) Hunk_AllocNameNoFill ( count*sizeof(*out), loadname);
-
-	loadmodel->texinfo = out;
-	loadmodel->numtexinfo = count;
-
-	for (i=0 ; i<count ; i++, in++, out++)
+	for (i=0 ; i<loadmodel->numtexinfo ; i++, in++, out++)
 	{
 		for (j=0 ; j<4 ; j++)
 		{
@@ -1129,10 +1552,26 @@ static void Mod_LoadTexinfo (lump_t *l)
 		//johnfitz
 	}
 
-	//johnfitz: report missing textures
-	if (missing && loadmodel->numtextures > 1)
-		Con_Printf ("Mod_LoadTexinfo: %d texture(s) missing from BSP file\n", missing);
-	//johnfitz
+	mod_missingtextures = missing;
+}
+
+static void Mod_LoadTexinfo (lump_t *l)
+{
+	texinfo_t *in;
+	mtexinfo_t *out;
+	int	count;
+
+	in = (texinfo_t *)(mod_base + l->fileofs);
+	if (l->filelen % sizeof(*in))
+		Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
+	count = l->filelen / sizeof(*in);
+	out = (mtexinfo_t *) Hunk_AllocNameNoFill ( count*sizeof(*out), loadname);
+
+	loadmodel->texinfo = out;
+	loadmodel->numtexinfo = count;
+
+	// the missing texture count is reported after the task is done
+	Task_Submit (&mod_lumptasks, Mod_DecodeTexinfo, l);
 }
 
 /*
@@ -1140,9 +1579,10 @@ static void Mod_LoadTexinfo (lump_t *l)
 CalcSurfaceExtents
 
 Fills in s->texturemins[] and s->extents[]
+Returns false if the extents are too large
 ================
 */
-static void CalcSurfaceExtents (msurface_t *s)
+static qboolean CalcSurfaceExtents (msurface_t *s)
 {
 	float	mins[2], maxs[2], val;
 	int		i,j, e;
@@ -1223,8 +1663,10 @@ static void CalcSurfaceExtents (msurface_t *s)
 		s->extents[i] = bmax - bmin;
 
 		if ( !(tex->flags & TEX_SPECIAL) && s->extents[i] > 2000) //johnfitz -- was 512 in glquake, 256 in winquake
-			Sys_Error ("Bad surface extents");
+			return false;
 	}
+
+	return true;
 }
 
 /*
@@ -1263,29 +1705,128 @@ void Mod_CalcSurfaceBounds (msurface_t *s)
 Mod_LoadFaces
 =================
 */
-static void Mod_LoadFaces (lump_t *l, qboolean bsp2)
+typedef struct
 {
 	dsface_t	*ins;
 	dlface_t	*inl;
-	msurface_t 	*out;
-	int			i, count, surfnum, lofs;
+} faceinput_t;
+
+static void Mod_DecodeFace (int surfnum, void *data)
+{
+	faceinput_t	*input = (faceinput_t *) data;
+	msurface_t	*out = loadmodel->surfaces + surfnum;
+	texture_t	*texture;
+	int			i, lofs;
 	int			planenum, side, texinfon;
 
+	if (input->inl)
+	{
+		dlface_t *inl = input->inl + surfnum;
+		out->firstedge = LittleLong(inl->firstedge);
+		out->numedges = LittleLong(inl->numedges);
+		planenum = LittleLong(inl->planenum);
+		side = LittleLong(inl->side);
+		texinfon = LittleLong (inl->texinfo);
+		for (i=0 ; i<MAXLIGHTMAPS ; i++)
+			out->styles[i] = inl->styles[i];
+		lofs = LittleLong(inl->lightofs);
+	}
+	else
+	{
+		dsface_t *ins = input->ins + surfnum;
+		out->firstedge = LittleLong(ins->firstedge);
+		out->numedges = LittleShort(ins->numedges);
+		planenum = LittleShort(ins->planenum);
+		side = LittleShort(ins->side);
+		texinfon = LittleShort (ins->texinfo);
+		for (i=0 ; i<MAXLIGHTMAPS ; i++)
+			out->styles[i] = ins->styles[i];
+		lofs = LittleLong(ins->lightofs);
+	}
+
+	out->flags = 0;
+
+	if (side)
+		out->flags |= SURF_PLANEBACK;
+
+	out->plane = loadmodel->planes + planenum;
+
+	out->texinfo = loadmodel->texinfo + texinfon;
+
+	if (!CalcSurfaceExtents (out))
+		SDL_AtomicSet (&mod_badextents, 1);
+
+	Mod_CalcSurfaceBounds (out); //johnfitz -- for per-surface frustum culling
+
+// lighting info
+	if (loadmodel->bspversion == BSPVERSION_QUAKE64)
+		lofs /= 2; // Q64 samples are 16bits instead 8 in normal Quake 
+
+	if (lofs == -1)
+		out->samples = NULL;
+	else
+		out->samples = loadmodel->lightdata + (lofs * 3); //johnfitz -- lit support via lordhavoc (was "+ i")
+
+	texture = loadmodel->textures[out->texinfo->texnum];
+
+	if (texture->type == TEXTYPE_SKY)
+	{
+		out->flags |= (SURF_DRAWSKY | SURF_DRAWTILED);
+	}
+	else if (TEXTYPE_ISLIQUID (texture->type))
+	{
+		out->flags |= SURF_DRAWTURB;
+		if (out->texinfo->flags & TEX_SPECIAL)
+			out->flags |= SURF_DRAWTILED;
+
+		if (texture->type == TEXTYPE_LAVA)
+			out->flags |= SURF_DRAWLAVA;
+		else if (texture->type == TEXTYPE_SLIME)
+			out->flags |= SURF_DRAWSLIME;
+		else if (texture->type == TEXTYPE_TELE)
+			out->flags |= SURF_DRAWTELE;
+		else
+			out->flags |= SURF_DRAWWATER;
+	}
+	else if (texture->type == TEXTYPE_CUTOUT)
+	{
+		out->flags |= SURF_DRAWFENCE;
+	}
+	else if (out->texinfo->flags & TEX_MISSING)
+	{
+		if (out->samples) //lightmapped
+		{
+			out->flags |= SURF_NOTEXTURE;
+		}
+		else // not lightmapped
+		{
+			out->flags |= (SURF_NOTEXTURE | SURF_DRAWTILED);
+		}
+	}
+	//johnfitz
+}
+
+static void Mod_LoadFaces (lump_t *l, qboolean bsp2)
+{
+	faceinput_t	input;
+	msurface_t 	*out;
+	int			count, surfnum;
+
 	if (bsp2)
 	{
-		ins = NULL;
-		inl = (dlface_t *)(mod_base + l->fileofs);
-		if (l->filelen % sizeof(*inl))
+		input.ins = NULL;
+		input.inl = (dlface_t *)(mod_base + l->fileofs);
+		if (l->filelen % sizeof(*input.inl))
 			Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
-		count = l->filelen / sizeof(*inl);
+		count = l->filelen / sizeof(*input.inl);
 	}
 	else
 	{
-		ins = (dsface_t *)(mod_base + l->fileofs);
-		inl = NULL;
-		if (l->filelen % sizeof(*ins))
+		input.ins = (dsface_t *)(mod_base + l->fileofs);
+		input.inl = NULL;
+		if (l->filelen % sizeof(*input.ins))
 			Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
-		count = l->filelen / sizeof(*ins);
+		count = l->filelen / sizeof(*input.ins);
 	}
 	out = (msurface_t *)Hunk_AllocName ( count*sizeof(*out), loadname);
 
@@ -1297,100 +1838,21 @@ static void Mod_LoadFaces (lump_t *l, qboolean bsp2)
 	loadmodel->surfaces = out;
 	loadmodel->numsurfaces = count;
 
+	SDL_AtomicSet (&mod_badextents, 0);
+	Task_ParallelFor (count, 256, Mod_DecodeFace, &input);
+	if (SDL_AtomicGet (&mod_badextents))
+		Sys_Error ("Bad surface extents");
+
 	for (surfnum=0 ; surfnum<count ; surfnum++, out++)
 	{
-		texture_t *texture;
-		if (bsp2)
-		{
-			out->firstedge = LittleLong(inl->firstedge);
-			out->numedges = LittleLong(inl->numedges);
-			planenum = LittleLong(inl->planenum);
-			side = LittleLong(inl->side);
-			texinfon = LittleLong (inl->texinfo);
-			for (i=0 ; i<MAXLIGHTMAPS ; i++)
-				out->styles[i] = inl->styles[i];
-			lofs = LittleLong(inl->lightofs);
-			inl++;
-		}
-		else
-		{
-			out->firstedge = LittleLong(ins->firstedge);
-			out->numedges = LittleShort(ins->numedges);
-			planenum = LittleShort(ins->planenum);
-			side = LittleShort(ins->side);
-			texinfon = LittleShort (ins->texinfo);
-			for (i=0 ; i<MAXLIGHTMAPS ; i++)
-				out->styles[i] = ins->styles[i];
-			lofs = LittleLong(ins->lightofs);
-			ins++;
-		}
-
-		out->flags = 0;
 		if (out->numedges < 3)
 			Con_Warning("surfnum %d: bad numedges %d\n", surfnum, out->numedges);
 
-		if (side)
-			out->flags |= SURF_PLANEBACK;
-
-		out->plane = loadmodel->planes + planenum;
-
-		out->texinfo = loadmodel->texinfo + texinfon;
-
-		CalcSurfaceExtents (out);
-
-		Mod_CalcSurfaceBounds (out); //johnfitz -- for per-surface frustum culling
-
-	// lighting info
-		if (loadmodel->bspversion == BSPVERSION_QUAKE64)
-			lofs /= 2; // Q64 samples are 16bits instead 8 in normal Quake 
-
-		if (lofs == -1)
-			out->samples = NULL;
-		else
-			out->samples = loadmodel->lightdata + (lofs * 3); //johnfitz -- lit support via lordhavoc (was "+ i")
-
-		texture = loadmodel->textures[out->texinfo->texnum];
-
-		if (texture->type == TEXTYPE_SKY)
-		{
-			out->flags |= (SURF_DRAWSKY | SURF_DRAWTILED);
-		}
-		else if (TEXTYPE_ISLIQUID (texture->type))
-		{
-			out->flags |= SURF_DRAWTURB;
-			if (out->texinfo->flags & TEX_SPECIAL)
-				out->flags |= SURF_DRAWTILED;
-			else if (out->samples && !loadmodel->haslitwater)
-			{
-				Con_DPrintf ("Map has lit water\n");
-				loadmodel->haslitwater = true;
-			}
-
-			if (texture->type == TEXTYPE_LAVA)
-				out->flags |= SURF_DRAWLAVA;
-			else if (texture->type == TEXTYPE_SLIME)
-				out->flags |= SURF_DRAWSLIME;
-			else if (texture->type == TEXTYPE_TELE)
-				out->flags |= SURF_DRAWTELE;
-			else
-				out->flags |= SURF_DRAWWATER;
-		}
-		else if (texture->type == TEXTYPE_CUTOUT)
-		{
-			out->flags |= SURF_DRAWFENCE;
-		}
-		else if (out->texinfo->flags & TEX_MISSING)
+		if ((out->flags & (SURF_DRAWTURB | SURF_DRAWTILED)) == SURF_DRAWTURB && out->samples && !loadmodel->haslitwater)
 		{
-			if (out->samples) //lightmapped
-			{
-				out->flags |= SURF_NOTEXTURE;
-			}
-			else // not lightmapped
-			{
-				out->flags |= (SURF_NOTEXTURE | SURF_DRAWTILED);
-			}
+			Con_DPrintf ("Map has lit water\n");
+			loadmodel->haslitwater = true;
 		}
-		//johnfitz
 	}
 }
 
@@ -1896,13 +2358,63 @@ static void Mod_FindUsedTextures (qmodel_t *mod)
 Mod_LoadClipnodes
 =================
 */
+static void Mod_DecodeClipnodesL (void *data)
+{
+	lump_t		*l = (lump_t *) data;
+	dlclipnode_t *inl = (dlclipnode_t *)(mod_base + l->fileofs);
+	mclipnode_t *out = loadmodel->clipnodes;
+	int			i;
+
+	for (i=0 ; i<loadmodel->numclipnodes ; i++, out++, inl++)
+	{
+		out->planenum = LittleLong(inl->planenum);
+
+		//johnfitz -- bounds check
+		if (out->planenum < 0 || out->planenum >= loadmodel->numplanes)
+			SDL_AtomicSet (&mod_badclipnodes, 1);
+		//johnfitz
+
+		out->children[0] = LittleLong(inl->children[0]);
+		out->children[1] = LittleLong(inl->children[1]);
+		//Spike: FIXME: bounds check
+	}
+}
+
+static void Mod_DecodeClipnodesS (void *data)
+{
+	lump_t		*l = (lump_t *) data;
+	dsclipnode_t *ins = (dsclipnode_t *)(mod_base + l->fileofs);
+	mclipnode_t *out = loadmodel->clipnodes;
+	int			i, count = loadmodel->numclipnodes;
+
+	for (i=0 ; i<count ; i++, out++, ins++)
+	{
+		out->planenum = LittleLong(ins->planenum);
+
+		//johnfitz -- bounds check
+		if (out->planenum < 0 || out->planenum >= loadmodel->numplanes)
+			SDL_AtomicSet (&mod_badclipnodes, 1);
+		//johnfitz
+
+		//johnfitz -- support clipnodes > 32k
+		out->children[0] = (unsigned short)LittleShort(ins->children[0]);
+		out->children[1] = (unsigned short)LittleShort(ins->children[1]);
+
+		if (out->children[0] >= count)
+			out->children[0] -= 65536;
+		if (out->children[1] >= count)
+			out->children[1] -= 65536;
+		//johnfitz
+	}
+}
+
 static void Mod_LoadClipnodes (lump_t *l, qboolean bsp2)
 {
 	dsclipnode_t *ins;
 	dlclipnode_t *inl;
 
 	mclipnode_t *out; //johnfitz -- was dclipnode_t
-	int			i, count;
+	int			count;
 	hull_t		*hull;
 
 	if (bsp2)
@@ -1957,44 +2469,8 @@ static void Mod_LoadClipnodes (lump_t *l, qboolean bsp2)
 	hull->clip_maxs[1] = 32;
 	hull->clip_maxs[2] = 64;
 
-	if (bsp2)
-	{
-		for (i=0 ; i<count ; i++, out++, inl++)
-		{
-			out->planenum = LittleLong(inl->planenum);
-
-			//johnfitz -- bounds check
-			if (out->planenum < 0 || out->planenum >= loadmodel->numplanes)
-				Host_Error ("Mod_LoadClipnodes: planenum out of bounds");
-			//johnfitz
-
-			out->children[0] = LittleLong(inl->children[0]);
-			out->children[1] = LittleLong(inl->children[1]);
-			//Spike: FIXME: bounds check
-		}
-	}
-	else
-	{
-		for (i=0 ; i<count ; i++, out++, ins++)
-		{
-			out->planenum = LittleLong(ins->planenum);
-
-			//johnfitz -- bounds check
-			if (out->planenum < 0 || out->planenum >= loadmodel->numplanes)
-				Host_Error ("Mod_LoadClipnodes: planenum out of bounds");
-			//johnfitz
-
-			//johnfitz -- support clipnodes > 32k
-			out->children[0] = (unsigned short)LittleShort(ins->children[0]);
-			out->children[1] = (unsigned short)LittleShort(ins->children[1]);
-
-			if (out->children[0] >= count)
-				out->children[0] -= 65536;
-			if (out->children[1] >= count)
-				out->children[1] -= 65536;
-			//johnfitz
-		}
-	}
+	SDL_AtomicSet (&mod_badclipnodes, 0);
+	Task_Submit (&mod_lumptasks, bsp2 ? Mod_DecodeClipnodesL : Mod_DecodeClipnodesS, l);
 }
 
 /*
@@ -2099,9 +2575,20 @@ static void Mod_LoadMarksurfaces (lump_t *l, int bsp2)
 Mod_LoadSurfedges
 =================
 */
+static void Mod_DecodeSurfedges (void *data)
+{
+	lump_t	*l = (lump_t *) data;
+	int		*in = (int *)(mod_base + l->fileofs);
+	int		*out = loadmodel->surfedges;
+	int		i;
+
+	for (i=0 ; i<loadmodel->numsurfedges ; i++)
+		out[i] = LittleLong (in[i]);
+}
+
 static void Mod_LoadSurfedges (lump_t *l)
 {
-	int		i, count;
+	int		count;
 	int		*in, *out;
 
 	in = (int *)(mod_base + l->fileofs);
@@ -2113,8 +2600,7 @@ static void Mod_LoadSurfedges (lump_t *l)
 	loadmodel->surfedges = out;
 	loadmodel->numsurfedges = count;
 
-	for (i=0 ; i<count ; i++)
-		out[i] = LittleLong (in[i]);
+	Task_Submit (&mod_lumptasks, Mod_DecodeSurfedges, l);
 }
 
 
@@ -2123,24 +2609,15 @@ static void Mod_LoadSurfedges (lump_t *l)
 Mod_LoadPlanes
 =================
 */
-static void Mod_LoadPlanes (lump_t *l)
+static void Mod_DecodePlanes (void *data)
 {
+	lump_t		*l = (lump_t *) data;
+	dplane_t 	*in = (dplane_t *)(mod_base + l->fileofs);
+	mplane_t	*out = loadmodel->planes;
 	int			i, j;
-	mplane_t	*out;
-	dplane_t 	*in;
-	int			count;
 	int			bits;
 
-	in = (dplane_t *)(mod_base + l->fileofs);
-	if (l->filelen % sizeof(*in))
-		Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
-	count = l->filelen / sizeof(*in);
-	out = (mplane_t *) Hunk_AllocNameNoFill ( count*sizeof(*out), loadname);
-
-	loadmodel->planes = out;
-	loadmodel->numplanes = count;
-
-	for (i=0 ; i<count ; i++, in++, out++)
+	for (i=0 ; i<loadmodel->numplanes ; i++, in++, out++)
 	{
 		bits = 0;
 		for (j=0 ; j<3 ; j++)
@@ -2157,6 +2634,24 @@ static void Mod_LoadPlanes (lump_t *l)
 	}
 }
 
+static void Mod_LoadPlanes (lump_t *l)
+{
+	mplane_t	*out;
+	dplane_t 	*in;
+	int			count;
+
+	in = (dplane_t *)(mod_base + l->fileofs);
+	if (l->filelen % sizeof(*in))
+		Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
+	count = l->filelen / sizeof(*in);
+	out = (mplane_t *) Hunk_AllocNameNoFill ( count*sizeof(*out), loadname);
+
+	loadmodel->planes = out;
+	loadmodel->numplanes = count;
+
+	Task_Submit (&mod_lumptasks, Mod_DecodePlanes, l);
+}
+
 /*
 =================
 RadiusFromBounds
@@ -2395,6 +2890,9 @@ static void Mod_LoadBrushModel (qmodel_t *mod, void *buffer)
 	dmodel_t 	*bm;
 	float		radius; //johnfitz
 
+	// leaf numbers in the PVS cache might refer to an older map in the same slot
+	Mod_FlushPVSCache ();
+
 	loadmodel->type = mod_brush;
 
 	header = (dheader_t *)buffer;
@@ -2427,14 +2925,22 @@ static void Mod_LoadBrushModel (qmodel_t *mod, void *buffer)
 		((int *)header)[i] = LittleLong ( ((int *)header)[i]);
 
 // load into heap
+// the geometry lumps are decoded by tasks while textures and lighting load
 
 	Mod_LoadVertexes (&header->lumps[LUMP_VERTEXES]);
 	Mod_LoadEdges (&header->lumps[LUMP_EDGES], bsp2);
 	Mod_LoadSurfedges (&header->lumps[LUMP_SURFEDGES]);
-	Mod_LoadTextures (&header->lumps[LUMP_TEXTURES]);
-	Mod_LoadLighting (&header->lumps[LUMP_LIGHTING]);
 	Mod_LoadPlanes (&header->lumps[LUMP_PLANES]);
+	Mod_LoadTextures (&header->lumps[LUMP_TEXTURES]);
 	Mod_LoadTexinfo (&header->lumps[LUMP_TEXINFO]);
+	Mod_LoadLighting (&header->lumps[LUMP_LIGHTING]);
+	Task_Wait (&mod_lumptasks);
+
+	//johnfitz: report missing textures
+	if (mod_missingtextures && loadmodel->numtextures > 1)
+		Con_Printf ("Mod_LoadTexinfo: %d texture(s) missing from BSP file\n", mod_missingtextures);
+	//johnfitz
+
 	Mod_LoadFaces (&header->lumps[LUMP_FACES], bsp2);
 	Mod_LoadMarksurfaces (&header->lumps[LUMP_MARKSURFACES], bsp2);
 
@@ -2471,6 +2977,10 @@ visdone:
 
 	Mod_MakeHull0 ();
 
+	Task_Wait (&mod_lumptasks);
+	if (SDL_AtomicGet (&mod_badclipnodes))
+		Host_Error ("Mod_LoadClipnodes: planenum out of bounds");
+
 	mod->numframes = 2;		// regular and alternate animation
 
 	Mod_CheckWaterVis ();
@@ -525,9 +525,11 @@ void	Mod_TouchModel (const char *name);
 
 mleaf_t *Mod_PointInLeaf (vec3_t p, qmodel_t *model);
 byte	*Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model);
+byte	*Mod_FatPVS (qmodel_t *model, mleaf_t **leafs, int numleafs);
 byte	*Mod_NoVisPVS (qmodel_t *model);
 
 void Mod_SetExtraFlags (qmodel_t *mod);
+void Mod_SyncLoadTasks (void);
 size_t Mod_SanitizeMapDescription (char *dst, size_t dstsize, const char *src);
 qboolean Mod_LoadMapDescription (char *desc, size_t maxchars, const char *map);
 
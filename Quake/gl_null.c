@@ -0,0 +1,333 @@
+/*
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// gl_null.c -- null OpenGL implementation for headless builds
+
+#include "quakedef.h"
+
+#ifdef USE_NULLGL
+
+#if defined(SDL_FRAMEWORK) || defined(NO_SDL_CONFIG)
+#include <SDL2/SDL.h>
+#else
+#include "SDL.h"
+#endif
+#include "gl_null.h"
+
+/*
+==============================================================================
+
+Everything the client does on the CPU still runs: demo parsing, entity
+relinking, particles, culling, lightmap building, sound mixing, etc.
+Draw calls, uploads and state changes are dropped. Objects get unique
+names, shaders always compile, syncs are always signaled and no
+extensions are reported, so the renderer takes its simplest paths
+(no persistent buffer mapping, no bindless textures).
+
+==============================================================================
+*/
+
+static GLuint	glnull_lastname;
+static int		glnull_attribs[SDL_GL_CONTEXT_RELEASE_BEHAVIOR + 1];
+
+static void GLNull_GenNames (GLsizei n, GLuint *names)
+{
+	while (n-- > 0)
+		*names++ = ++glnull_lastname;
+}
+
+//==============================================================================
+//
+// SDL GL context replacements
+//
+//==============================================================================
+
+SDL_GLContext GLNull_CreateContext (SDL_Window *window)
+{
+	static int dummy;
+	return &dummy;
+}
+
+void GLNull_DeleteContext (SDL_GLContext context)
+{
+}
+
+int GLNull_SetAttribute (SDL_GLattr attr, int value)
+{
+	if ((unsigned) attr < countof (glnull_attribs))
+		glnull_attribs[attr] = value;
+	return 0;
+}
+
+int GLNull_GetAttribute (SDL_GLattr attr, int *value)
+{
+	*value = (unsigned) attr < countof (glnull_attribs) ? glnull_attribs[attr] : 0;
+	return 0;
+}
+
+void GLNull_ResetAttributes (void)
+{
+	memset (glnull_attribs, 0, sizeof (glnull_attribs));
+}
+
+int GLNull_SetSwapInterval (int interval)
+{
+	return 0;
+}
+
+void GLNull_SwapWindow (SDL_Window *window)
+{
+}
+
+//==============================================================================
+//
+// OpenGL 1.x entry points (normally linked from the system GL library)
+//
+//==============================================================================
+
+const GLubyte * APIENTRY glGetString (GLenum name)
+{
+	switch (name)
+	{
+	case GL_VENDOR:		return (const GLubyte *) "ironwail";
+	case GL_RENDERER:	return (const GLubyte *) "null renderer";
+	case GL_VERSION:	return (const GLubyte *) "4.3 (null)";
+	default:			return (const GLubyte *) "";
+	}
+}
+
+void APIENTRY glGetIntegerv (GLenum pname, GLint *params)
+{
+	switch (pname)
+	{
+	case GL_MAX_TEXTURE_SIZE:
+		*params = 16384;
+		break;
+	case GL_MAX_COLOR_TEXTURE_SAMPLES:
+	case GL_MAX_DEPTH_TEXTURE_SAMPLES:
+		*params = 8;
+		break;
+	case GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT:
+	case GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT:
+		*params = 256;
+		break;
+	case GL_NUM_PROGRAM_BINARY_FORMATS:
+		*params = 0;	// nothing to cache, programs are never compiled
+		break;
+	default:
+		*params = 0;
+		break;
+	}
+}
+
+void APIENTRY glGetFloatv (GLenum pname, GLfloat *params) { *params = 0.f; }
+void APIENTRY glGetTexParameterfv (GLenum target, GLenum pname, GLfloat *params) { *params = 0.f; }
+GLenum APIENTRY glGetError (void) { return GL_NO_ERROR; }
+void APIENTRY glGenTextures (GLsizei n, GLuint *textures) { GLNull_GenNames (n, textures); }
+void APIENTRY glDeleteTextures (GLsizei n, const GLuint *textures) {}
+void APIENTRY glBindTexture (GLenum target, GLuint texture) {}
+void APIENTRY glTexImage2D (GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels) {}
+void APIENTRY glGetTexImage (GLenum target, GLint level, GLenum format, GLenum type, GLvoid *pixels) {}
+void APIENTRY glTexParameteri (GLenum target, GLenum pname, GLint param) {}
+void APIENTRY glTexParameterf (GLenum target, GLenum pname, GLfloat param) {}
+void APIENTRY glPixelStorei (GLenum pname, GLint param) {}
+void APIENTRY glReadPixels (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid *pixels)
+{
+	if (type == GL_UNSIGNED_BYTE && (format == GL_RGB || format == GL_RGBA))
+		memset (pixels, 0, (size_t) width * height * (format == GL_RGB ? 3 : 4));
+}
+void APIENTRY glEnable (GLenum cap) {}
+void APIENTRY glDisable (GLenum cap) {}
+void APIENTRY glViewport (GLint x, GLint y, GLsizei width, GLsizei height) {}
+void APIENTRY glScissor (GLint x, GLint y, GLsizei width, GLsizei height) {}
+void APIENTRY glFinish (void) {}
+void APIENTRY glClear (GLbitfield mask) {}
+void APIENTRY glClearColor (GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {}
+void APIENTRY glClearDepth (GLclampd depth) {}
+void APIENTRY glDrawArrays (GLenum mode, GLint first, GLsizei count) {}
+void APIENTRY glDrawElements (GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) {}
+void APIENTRY glDepthRange (GLclampd near_val, GLclampd far_val) {}
+void APIENTRY glDepthFunc (GLenum func) {}
+void APIENTRY glDepthMask (GLboolean flag) {}
+void APIENTRY glStencilOp (GLenum fail, GLenum zfail, GLenum zpass) {}
+void APIENTRY glStencilFunc (GLenum func, GLint ref, GLuint mask) {}
+void APIENTRY glStencilMask (GLuint mask) {}
+void APIENTRY glPolygonMode (GLenum face, GLenum mode) {}
+void APIENTRY glPolygonOffset (GLfloat factor, GLfloat units) {}
+void APIENTRY glBlendFunc (GLenum sfactor, GLenum dfactor) {}
+void APIENTRY glColorMask (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {}
+void APIENTRY glCullFace (GLenum mode) {}
+void APIENTRY glFrontFace (GLenum mode) {}
+
+//==============================================================================
+//
+// Entry points loaded through GL_InitFunctions
+//
+//==============================================================================
+
+// buffers
+static void APIENTRY GLNull_GenBuffers (GLsizei n, GLuint *buffers) { GLNull_GenNames (n, buffers); }
+static void APIENTRY GLNull_DeleteBuffers (GLsizei n, const GLuint *buffers) {}
+static void APIENTRY GLNull_BindBuffer (GLenum target, GLuint buffer) {}
+static void APIENTRY GLNull_BindBufferRange (GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {}
+static void APIENTRY GLNull_BufferData (GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) {}
+static void APIENTRY GLNull_BufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data) {}
+static GLvoid * APIENTRY GLNull_MapBuffer (GLenum target, GLenum access) { return NULL; }
+static GLboolean APIENTRY GLNull_UnmapBuffer (GLenum target) { return GL_TRUE; }
+static void * APIENTRY GLNull_MapBufferRange (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) { return NULL; }
+static void APIENTRY GLNull_FlushMappedBufferRange (GLenum target, GLintptr offset, GLsizeiptr length) {}
+static void APIENTRY GLNull_BufferStorage (GLenum target, GLsizeiptr size, const void *data, GLbitfield flags) {}
+static void APIENTRY GLNull_BindBuffersRange (GLenum target, GLuint first, GLsizei count, const GLuint *buffers, const GLintptr *offsets, const GLsizeiptr *sizes) {}
+
+// vertex arrays and draws
+static void APIENTRY GLNull_GenVertexArrays (GLsizei n, GLuint *arrays) { GLNull_GenNames (n, arrays); }
+static void APIENTRY GLNull_DeleteVertexArrays (GLsizei n, const GLuint *arrays) {}
+static void APIENTRY GLNull_BindVertexArray (GLuint array) {}
+static void APIENTRY GLNull_EnableVertexAttribArray (GLuint index) {}
+static void APIENTRY GLNull_DisableVertexAttribArray (GLuint index) {}
+static void APIENTRY GLNull_VertexAttribPointer (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer) {}
+static void APIENTRY GLNull_VertexAttribIPointer (GLuint index, GLint size, GLenum type, GLsizei stride, const GLvoid *pointer) {}
+static void APIENTRY GLNull_VertexAttribDivisor (GLuint index, GLuint divisor) {}
+static void APIENTRY GLNull_DrawArraysInstanced (GLenum mode, GLint first, GLsizei count, GLsizei primcount) {}
+static void APIENTRY GLNull_DrawElementsInstanced (GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount) {}
+static void APIENTRY GLNull_DrawElementsIndirect (GLenum mode, GLenum type, const void *indirect) {}
+static void APIENTRY GLNull_MultiDrawElementsIndirect (GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride) {}
+static void APIENTRY GLNull_DispatchCompute (GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z) {}
+static void APIENTRY GLNull_MemoryBarrier (GLbitfield barriers) {}
+
+// syncs
+static GLsync APIENTRY GLNull_FenceSync (GLenum condition, GLbitfield flags) { static int dummy; return (GLsync) &dummy; }
+static void APIENTRY GLNull_DeleteSync (GLsync sync) {}
+static GLenum APIENTRY GLNull_ClientWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout) { return GL_ALREADY_SIGNALED; }
+static void APIENTRY GLNull_WaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout) {}
+
+// shaders
+static GLuint APIENTRY GLNull_CreateProgram (void) { return ++glnull_lastname; }
+static void APIENTRY GLNull_DeleteProgram (GLuint program) {}
+static void APIENTRY GLNull_UseProgram (GLuint program) {}
+static void APIENTRY GLNull_LinkProgram (GLuint program) {}
+static void APIENTRY GLNull_GetProgramiv (GLuint program, GLenum pname, GLint *params) { *params = pname == GL_LINK_STATUS ? GL_TRUE : 0; }
+static void APIENTRY GLNull_ProgramParameteri (GLuint program, GLenum pname, GLint value) {}
+static void APIENTRY GLNull_GetProgramBinary (GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary) { if (length) *length = 0; *binaryFormat = 0; }
+static void APIENTRY GLNull_ProgramBinary (GLuint program, GLenum binaryFormat, const void *binary, GLsizei length) {}
+static void APIENTRY GLNull_GetProgramInfoLog (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog) { if (length) *length = 0; if (bufSize > 0) *infoLog = 0; }
+static GLuint APIENTRY GLNull_CreateShader (GLenum type) { return ++glnull_lastname; }
+static void APIENTRY GLNull_DeleteShader (GLuint shader) {}
+static void APIENTRY GLNull_ShaderSource (GLuint shader, GLsizei count, const GLchar* const *string, const GLint *length) {}
+static void APIENTRY GLNull_CompileShader (GLuint shader) {}
+static void APIENTRY GLNull_MaxShaderCompilerThreadsKHR (GLuint count) {}
+static void APIENTRY GLNull_GetShaderiv (GLuint shader, GLenum pname, GLint *params) { *params = pname == GL_COMPILE_STATUS ? GL_TRUE : 0; }
+static void APIENTRY GLNull_GetShaderInfoLog (GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog) { if (length) *length = 0; if (bufSize > 0) *infoLog = 0; }
+static void APIENTRY GLNull_AttachShader (GLuint program, GLuint shader) {}
+static void APIENTRY GLNull_DetachShader (GLuint program, GLuint shader) {}
+static void APIENTRY GLNull_BindAttribLocation (GLuint program, GLuint index, const GLchar *name) {}
+static GLint APIENTRY GLNull_GetUniformLocation (GLuint program, const GLchar *name) { return 0; }
+static void APIENTRY GLNull_GetActiveUniform (GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLint *size, GLenum *type, GLchar *name) { if (length) *length = 0; if (bufSize > 0) *name = 0; *size = 0; *type = 0; }
+static void APIENTRY GLNull_Uniform1i (GLint location, GLint v0) {}
+static void APIENTRY GLNull_Uniform1f (GLint location, GLfloat v0) {}
+static void APIENTRY GLNull_Uniform2f (GLint location, GLfloat v0, GLfloat v1) {}
+static void APIENTRY GLNull_Uniform3f (GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {}
+static void APIENTRY GLNull_Uniform4f (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) {}
+static void APIENTRY GLNull_Uniform3fv (GLint location, GLsizei count, const GLfloat *value) {}
+static void APIENTRY GLNull_Uniform4fv (GLint location, GLsizei count, const GLfloat *value) {}
+static void APIENTRY GLNull_UniformMatrix4fv (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {}
+
+// textures and samplers
+static void APIENTRY GLNull_ActiveTexture (GLenum texture) {}
+static void APIENTRY GLNull_GenerateMipmap (GLenum target) {}
+static void APIENTRY GLNull_TexStorage2D (GLenum target, GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height) {}
+static void APIENTRY GLNull_TexStorage3D (GLenum target, GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height, GLsizei depth) {}
+static void APIENTRY GLNull_TexStorage2DMultisample (GLenum target, GLsizei samples, GLenum internalFormat, GLsizei width, GLsizei height, GLboolean fixedsamplelocations) {}
+static void APIENTRY GLNull_TexImage3D (GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid *pixels) {}
+static void APIENTRY GLNull_TexSubImage3D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels) {}
+static void APIENTRY GLNull_BindImageTexture (GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format) {}
+static void APIENTRY GLNull_BindTextures (GLuint first, GLsizei count, const GLuint *textures) {}
+static void APIENTRY GLNull_BindImageTextures (GLuint first, GLsizei count, const GLuint *textures) {}
+static void APIENTRY GLNull_GenSamplers (GLsizei n, GLuint *samplers) { GLNull_GenNames (n, samplers); }
+static void APIENTRY GLNull_DeleteSamplers (GLsizei n, const GLuint *samplers) {}
+static void APIENTRY GLNull_SamplerParameteri (GLuint sampler, GLenum pname, GLint param) {}
+static void APIENTRY GLNull_SamplerParameterf (GLuint sampler, GLenum pname, GLfloat param) {}
+static void APIENTRY GLNull_BindSampler (GLuint unit, GLuint sampler) {}
+static void APIENTRY GLNull_BindSamplers (GLuint first, GLsizei count, const GLuint *samplers) {}
+static GLuint64 APIENTRY GLNull_GetTextureHandleARB (GLuint texture) { return texture; }
+static GLuint64 APIENTRY GLNull_GetTextureSamplerHandleARB (GLuint texture, GLuint sampler) { return texture; }
+static void APIENTRY GLNull_MakeTextureHandleResidentARB (GLuint64 handle) {}
+static void APIENTRY GLNull_MakeTextureHandleNonResidentARB (GLuint64 handle) {}
+
+// framebuffers and state
+static void APIENTRY GLNull_BindFramebuffer (GLenum target, GLuint framebuffer) {}
+static void APIENTRY GLNull_GenFramebuffers (GLsizei n, GLuint *framebuffers) { GLNull_GenNames (n, framebuffers); }
+static void APIENTRY GLNull_DeleteFramebuffers (GLsizei n, const GLuint *framebuffers) {}
+static void APIENTRY GLNull_FramebufferTexture2D (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) {}
+static GLenum APIENTRY GLNull_CheckFramebufferStatus (GLenum target) { return GL_FRAMEBUFFER_COMPLETE; }
+static void APIENTRY GLNull_BlitFramebuffer (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter) {}
+static void APIENTRY GLNull_DrawBuffers (GLsizei n, const GLenum *bufs) {}
+static void APIENTRY GLNull_ClearBufferfv (GLenum buffer, GLint drawbuffer, const GLfloat *value) {}
+static void APIENTRY GLNull_BlendFunci (GLuint buf, GLenum sfactor, GLenum dfactor) {}
+static void APIENTRY GLNull_MinSampleShading (GLfloat value) {}
+static void APIENTRY GLNull_ClipControl (GLenum origin, GLenum depth) {}
+
+// debugging
+static void APIENTRY GLNull_DebugMessageCallback (GLDEBUGPROC callback, const void *userParam) {}
+static void APIENTRY GLNull_ObjectLabel (GLenum identifier, GLuint name, GLsizei length, const GLchar *label) {}
+static void APIENTRY GLNull_PushDebugGroup (GLenum source, GLuint id, GLsizei length, const char *message) {}
+static void APIENTRY GLNull_PopDebugGroup (void) {}
+static const GLubyte * APIENTRY GLNull_GetStringi (GLenum name, GLuint index) { return (const GLubyte *) ""; }
+
+// queries
+static void APIENTRY GLNull_GenQueries (GLsizei n, GLuint *ids) { GLNull_GenNames (n, ids); }
+static void APIENTRY GLNull_DeleteQueries (GLsizei n, const GLuint *ids) {}
+static void APIENTRY GLNull_BeginQuery (GLenum target, GLuint id) {}
+static void APIENTRY GLNull_EndQuery (GLenum target) {}
+static void APIENTRY GLNull_QueryCounter (GLuint id, GLenum target) {}
+static void APIENTRY GLNull_GetQueryiv (GLenum target, GLenum pname, GLint *params) { *params = 0; }
+static void APIENTRY GLNull_GetQueryObjectiv (GLuint id, GLenum pname, GLint *params) { *params = pname == GL_QUERY_RESULT_AVAILABLE; }
+static void APIENTRY GLNull_GetQueryObjectuiv (GLuint id, GLenum pname, GLuint *params) { *params = pname == GL_QUERY_RESULT_AVAILABLE; }
+static void APIENTRY GLNull_GetQueryObjecti64v (GLuint id, GLenum pname, GLint64 *params) { *params = pname == GL_QUERY_RESULT_AVAILABLE; }
+static void APIENTRY GLNull_GetQueryObjectui64v (GLuint id, GLenum pname, GLuint64 *params) { *params = pname == GL_QUERY_RESULT_AVAILABLE; }
+
+typedef struct
+{
+	const char	*name;
+	void		*func;
+} glnullfunc_t;
+
+#define QGL_NULL_FUNC(ret, name, args) { "gl" #name, (void *) GLNull_##name },
+static const glnullfunc_t glnull_functions[] =
+{
+	QGL_ALL_FUNCTIONS(QGL_NULL_FUNC)
+};
+#undef QGL_NULL_FUNC
+
+/*
+===============
+GLNull_GetProcAddress
+===============
+*/
+void *GLNull_GetProcAddress (const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < countof (glnull_functions); i++)
+		if (!strcmp (glnull_functions[i].name, name))
+			return glnull_functions[i].func;
+
+	return NULL;
+}
+
+#endif /* USE_NULLGL */
@@ -0,0 +1,49 @@
+/*
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _GL_NULL_H_
+#define _GL_NULL_H_
+
+// Null renderer for headless builds (USE_NULLGL): every GL entry point
+// the engine uses is a stub, and the SDL GL context functions used by
+// gl_vidsdl.c are redirected here so no GL context is ever created.
+
+#ifdef USE_NULLGL
+
+SDL_GLContext GLNull_CreateContext (SDL_Window *window);
+void GLNull_DeleteContext (SDL_GLContext context);
+int GLNull_SetAttribute (SDL_GLattr attr, int value);
+int GLNull_GetAttribute (SDL_GLattr attr, int *value);
+void GLNull_ResetAttributes (void);
+int GLNull_SetSwapInterval (int interval);
+void GLNull_SwapWindow (SDL_Window *window);
+void *GLNull_GetProcAddress (const char *name);
+
+#define SDL_GL_CreateContext		GLNull_CreateContext
+#define SDL_GL_DeleteContext		GLNull_DeleteContext
+#define SDL_GL_SetAttribute			GLNull_SetAttribute
+#define SDL_GL_GetAttribute			GLNull_GetAttribute
+#define SDL_GL_ResetAttributes		GLNull_ResetAttributes
+#define SDL_GL_SetSwapInterval		GLNull_SetSwapInterval
+#define SDL_GL_SwapWindow			GLNull_SwapWindow
+#define SDL_GL_GetProcAddress		GLNull_GetProcAddress
+
+#endif /* USE_NULLGL */
+
+#endif /* _GL_NULL_H_ */
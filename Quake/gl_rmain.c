@@ -1895,24 +1895,39 @@ R_RenderScene
 */
 void R_RenderScene (void)
 {
+	TRACE_BEGIN ("R_RenderScene");
+
+	TRACE_BEGIN ("R_SetupScene");
 	R_SetupScene (); //johnfitz -- this does everything that should be done once per call to RenderScene
 
 	R_Clear ();
 
 	Fog_EnableGFog (); //johnfitz
+	TRACE_END ();
 
+	TRACE_BEGIN ("R_DrawViewModel");
 	R_DrawViewModel (); //johnfitz -- moved here from R_RenderView
+	TRACE_END ();
 
 	S_ExtraUpdate (); // don't let sound get messed up if going slow
 
+	TRACE_BEGIN ("Opaque entities");
 	R_DrawEntitiesOnList (false); //johnfitz -- false means this is the pass for nonalpha entities
+	TRACE_END ();
 
+	TRACE_BEGIN ("Opaque particles");
 	R_DrawParticles (false);
+	TRACE_END ();
 
+	TRACE_BEGIN ("Sky_DrawSky");
 	Sky_DrawSky (); //johnfitz
+	TRACE_END ();
 
+	TRACE_BEGIN ("Opaque water");
 	R_DrawWater (false);
+	TRACE_END ();
 
+	TRACE_BEGIN ("Translucency");
 	R_BeginTranslucency ();
 
 	R_DrawWater (true);
@@ -1922,12 +1937,17 @@ void R_RenderScene (void)
 	R_DrawParticles (true);
 
 	R_EndTranslucency ();
+	TRACE_END ();
 
+	TRACE_BEGIN ("Debug overlays");
 	R_ShowTris (); //johnfitz
 
 	R_ShowBoundingBoxes (); //johnfitz
 
 	R_ShowPointFile ();
+	TRACE_END ();
+
+	TRACE_END ();
 }
 
 /*
@@ -2036,9 +2056,19 @@ void R_RenderView (void)
 	else if (gl_finish.value)
 		glFinish ();
 
+	TRACE_BEGIN ("R_RenderView");
+
+	TRACE_BEGIN ("R_SetupView");
 	R_SetupView (); //johnfitz -- this does everything that should be done once per frame
+	TRACE_END ();
+
 	R_RenderScene ();
+
+	TRACE_BEGIN ("R_WarpScaleView");
 	R_WarpScaleView ();
+	TRACE_END ();
+
+	TRACE_END ();
 
 	//johnfitz -- modified r_speeds output
 	time2 = Sys_DoubleTime ();
@@ -25,11 +25,49 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "gl_shaders.h"
 #include "q_ctype.h"
 
+#define PROGRAM_CACHE_FILE		"shadercache.bin"
+#define PROGRAM_CACHE_MAGIC		"IWPB"
+#define PROGRAM_CACHE_VERSION	1
+
+typedef struct glprogram_s
+{
+	GLuint			program;
+	GLuint			shaders[2];
+	int				numshaders;
+	const GLchar	*sources[2];
+	GLenum			types[2];
+	int				numsources;
+	char			*macros;
+	char			name[256];
+	uint64_t		key;				// hash of everything that goes into the binary
+	qboolean		fromcache;
+	double			submittime;			// issuing the compile/link, or the binary upload
+	double			waittime;			// waiting for the driver to finish it
+} glprogram_t;
+
+typedef struct
+{
+	uint64_t		key;
+	GLenum			format;
+	GLsizei			length;
+	const byte		*binary;
+} glprogramcacheentry_t;
+
 glprogs_t glprogs;
-static GLuint gl_programs[128];
+static glprogram_t gl_programs[128];
 static GLuint gl_current_program;
 static int gl_num_programs;
 
+static struct
+{
+	qboolean				enabled;
+	qboolean				dirty;			// something had to be compiled
+	byte					*data;			// file contents
+	glprogramcacheentry_t	*entries;
+	int						numentries;
+	double					createtime;		// wall time for GL_CreateShaders
+} glprogramcache;
+
 /*
 =============
 GL_InitError
@@ -98,35 +136,32 @@ static qboolean AppendString (char **dst, const char *dstend, const char *str, i
 
 /*
 =============
-GL_CreateShader
+GL_ShaderTypeString
 =============
 */
-static GLuint GL_CreateShader (GLenum type, const char *source, const char *extradefs, const char *name)
+static const char *GL_ShaderTypeString (GLenum type)
 {
-	const char *strings[16];
-	const char *typestr = NULL;
-	char header[256];
-	int numstrings = 0;
-	GLint status;
-	GLuint shader;
-
 	switch (type)
 	{
 		case GL_VERTEX_SHADER:
-			typestr = "vertex";
-			break;
+			return "vertex";
 		case GL_FRAGMENT_SHADER:
-			typestr = "fragment";
-			break;
+			return "fragment";
 		case GL_COMPUTE_SHADER:
-			typestr = "compute";
-			break;
+			return "compute";
 		default:
-			Sys_Error ("GL_CreateShader: unknown type 0x%X for %s", type, name);
-			break;
+			return NULL;
 	}
+}
 
-	q_snprintf (header, sizeof (header),
+/*
+=============
+GL_GetShaderHeader
+=============
+*/
+static void GL_GetShaderHeader (char *header, size_t size)
+{
+	q_snprintf (header, size,
 		"#version 430\n"
 		"\n"
 		"#define BINDLESS %d\n"
@@ -134,6 +169,26 @@ static GLuint GL_CreateShader (GLenum type, const char *source, const char *extr
 		gl_bindless_able,
 		gl_clipcontrol_able
 	);
+}
+
+/*
+=============
+GL_CreateShader
+
+Only starts compiling, GL_CheckShader reports errors
+=============
+*/
+static GLuint GL_CreateShader (GLenum type, const char *source, const char *extradefs, const char *name)
+{
+	const char *strings[16];
+	char header[256];
+	int numstrings = 0;
+	GLuint shader;
+
+	if (!GL_ShaderTypeString (type))
+		Sys_Error ("GL_CreateShader: unknown type 0x%X for %s", type, name);
+
+	GL_GetShaderHeader (header, sizeof (header));
 	strings[numstrings++] = header;
 
 	if (extradefs && *extradefs)
@@ -144,74 +199,351 @@ static GLuint GL_CreateShader (GLenum type, const char *source, const char *extr
 	GL_ObjectLabelFunc (GL_SHADER, shader, -1, name);
 	GL_ShaderSourceFunc (shader, numstrings, strings, NULL);
 	GL_CompileShaderFunc (shader);
+
+	return shader;
+}
+
+/*
+=============
+GL_CheckShader
+=============
+*/
+static void GL_CheckShader (GLuint shader, const char *name)
+{
+	GLint status, type;
+
 	GL_GetShaderivFunc (shader, GL_COMPILE_STATUS, &status);
+	GL_GetShaderivFunc (shader, GL_SHADER_TYPE, &type);
 
 	if (status != GL_TRUE)
 	{
 		char infolog[1024];
 		memset(infolog, 0, sizeof(infolog));
 		GL_GetShaderInfoLogFunc (shader, sizeof(infolog), NULL, infolog);
-		GL_InitError ("Error compiling %s %s shader:\n\n%s", name, typestr, infolog);
+		GL_InitError ("Error compiling %s %s shader:\n\n%s", name, GL_ShaderTypeString (type), infolog);
+	}
+}
+
+/*
+=============
+GL_HashProgramData
+
+64-bit FNV-1a, cache keys are compared without the sources
+=============
+*/
+static uint64_t GL_HashProgramData (uint64_t hash, const void *data, size_t size)
+{
+	const byte *ptr = (const byte *) data;
+	while (size--)
+	{
+		hash ^= *ptr++;
+		hash *= 0x100000001b3ull;
 	}
+	return hash;
+}
 
-	return shader;
+static uint64_t GL_HashProgramString (uint64_t hash, const char *str)
+{
+	return GL_HashProgramData (hash, str ? str : "", str ? strlen (str) + 1 : 1);
 }
 
 /*
 =============
-GL_CreateProgramFromShaders
+GL_GetProgramKey
 =============
 */
-static GLuint GL_CreateProgramFromShaders (const GLuint *shaders, int numshaders, const char *name)
+static uint64_t GL_GetProgramKey (const glprogram_t *prog)
 {
-	GLuint program;
-	GLint status;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	char header[256];
+	int i;
+
+	GL_GetShaderHeader (header, sizeof (header));
+	hash = GL_HashProgramString (hash, gl_vendor);
+	hash = GL_HashProgramString (hash, gl_renderer);
+	hash = GL_HashProgramString (hash, gl_version);
+	hash = GL_HashProgramString (hash, header);
+	hash = GL_HashProgramString (hash, prog->macros);
+	for (i = 0; i < prog->numsources; i++)
+	{
+		hash = GL_HashProgramData (hash, &prog->types[i], sizeof (prog->types[i]));
+		hash = GL_HashProgramString (hash, prog->sources[i]);
+	}
+
+	return hash;
+}
+
+// the cache is packed, so entries after the first binary can be unaligned
+static int GL_ReadCacheInt (const byte *p)
+{
+	int v;
+	memcpy (&v, p, 4);
+	return LittleLong (v);
+}
+
+static void GL_WriteCacheInt (byte *p, int v)
+{
+	v = LittleLong (v);
+	memcpy (p, &v, 4);
+}
+
+/*
+=============
+GL_LoadProgramCache
+
+File layout: magic, version, count, then count times
+[key (8)] [format (4)] [length (4)] [binary (length)], all little-endian
+=============
+*/
+static void GL_LoadProgramCache (void)
+{
+	FILE *f;
+	long size, ofs;
+	int i, count;
+	byte *data;
+
+	f = Sys_fopen (va ("%s/%s", host_parms->userdir, PROGRAM_CACHE_FILE), "rb");
+	if (!f)
+		return;
+
+	fseek (f, 0, SEEK_END);
+	size = ftell (f);
+	fseek (f, 0, SEEK_SET);
+	data = size > 12 ? (byte *) malloc (size) : NULL;
+	if (data && fread (data, 1, size, f) != (size_t) size)
+	{
+		free (data);
+		data = NULL;
+	}
+	fclose (f);
+
+	if (!data)
+		return;
+
+	if (memcmp (data, PROGRAM_CACHE_MAGIC, 4) != 0 || GL_ReadCacheInt (data + 4) != PROGRAM_CACHE_VERSION)
+	{
+		Con_DPrintf ("Ignoring outdated %s\n", PROGRAM_CACHE_FILE);
+		free (data);
+		return;
+	}
+
+	count = GL_ReadCacheInt (data + 8);
+	if (count <= 0 || count > (int) countof (gl_programs))
+	{
+		free (data);
+		return;
+	}
+
+	glprogramcache.data = data;
+	glprogramcache.entries = (glprogramcacheentry_t *) calloc (count, sizeof (glprogramcacheentry_t));
+	if (!glprogramcache.entries)
+		Sys_Error ("GL_LoadProgramCache: out of memory on %d entries", count);
+
+	for (i = 0, ofs = 12; i < count; i++)
+	{
+		glprogramcacheentry_t *e = &glprogramcache.entries[i];
+
+		if (ofs + 16 > size)
+			break;
+		e->key = (uint32_t) GL_ReadCacheInt (data + ofs) | ((uint64_t) (uint32_t) GL_ReadCacheInt (data + ofs + 4) << 32);
+		e->format = (GLenum) GL_ReadCacheInt (data + ofs + 8);
+		e->length = GL_ReadCacheInt (data + ofs + 12);
+		ofs += 16;
+		if (e->length <= 0 || e->length > size - ofs)
+			break;
+		e->binary = data + ofs;
+		ofs += e->length;
+	}
+	glprogramcache.numentries = i;
+}
+
+/*
+=============
+GL_FreeProgramCache
+=============
+*/
+static void GL_FreeProgramCache (void)
+{
+	free (glprogramcache.entries);
+	free (glprogramcache.data);
+	glprogramcache.entries = NULL;
+	glprogramcache.data = NULL;
+	glprogramcache.numentries = 0;
+}
 
-	program = GL_CreateProgramFunc ();
-	GL_ObjectLabelFunc (GL_PROGRAM, program, -1, name);
+/*
+=============
+GL_FindCachedProgram
+=============
+*/
+static const glprogramcacheentry_t *GL_FindCachedProgram (uint64_t key)
+{
+	int i;
+	for (i = 0; i < glprogramcache.numentries; i++)
+		if (glprogramcache.entries[i].key == key)
+			return &glprogramcache.entries[i];
+	return NULL;
+}
 
-	while (numshaders-- > 0)
+/*
+=============
+GL_SaveProgramCache
+
+Replaces the cache with the binaries of the current programs
+=============
+*/
+static void GL_SaveProgramCache (void)
+{
+	byte *buf, *dst;
+	size_t total;
+	GLint length;
+	GLsizei written;
+	GLenum format;
+	int i, count;
+
+	total = 12;
+	for (i = 0; i < gl_num_programs; i++)
 	{
-		GL_AttachShaderFunc (program, *shaders);
-		GL_DeleteShaderFunc (*shaders);
-		++shaders;
+		length = 0;
+		GL_GetProgramivFunc (gl_programs[i].program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+		{
+			Con_DPrintf ("Couldn't retrieve %s program binary, not caching programs\n", gl_programs[i].name);
+			return;
+		}
+		total += 16 + length;
 	}
 
-	GL_LinkProgramFunc (program);
-	GL_GetProgramivFunc (program, GL_LINK_STATUS, &status);
+	buf = (byte *) malloc (total);
+	if (!buf)
+		return;
+
+	memcpy (buf, PROGRAM_CACHE_MAGIC, 4);
+	GL_WriteCacheInt (buf + 4, PROGRAM_CACHE_VERSION);
+	dst = buf + 12;
+	for (i = count = 0; i < gl_num_programs; i++)
+	{
+		glprogram_t *prog = &gl_programs[i];
+		uint32_t lo = (uint32_t) prog->key, hi = (uint32_t) (prog->key >> 32);
+
+		written = 0;
+		length = (GLint) (total - (dst + 16 - buf));
+		GL_GetProgramBinaryFunc (prog->program, length, &written, &format, dst + 16);
+		if (written <= 0)
+			continue;
+
+		GL_WriteCacheInt (dst + 0, (int) lo);
+		GL_WriteCacheInt (dst + 4, (int) hi);
+		GL_WriteCacheInt (dst + 8, (int) format);
+		GL_WriteCacheInt (dst + 12, written);
+		dst += 16 + written;
+		count++;
+	}
+	GL_WriteCacheInt (buf + 8, count);
+
+	if (COM_WriteFile_OSPath (va ("%s/%s", host_parms->userdir, PROGRAM_CACHE_FILE), buf, dst - buf))
+		Con_DPrintf ("Wrote %d program binaries to %s (%d KB)\n", count, PROGRAM_CACHE_FILE, (int) ((dst - buf) >> 10));
+
+	free (buf);
+}
+
+/*
+=============
+GL_CompileProgram
+
+Starts compiling and linking the program's shaders
+=============
+*/
+static void GL_CompileProgram (glprogram_t *prog)
+{
+	int i;
+
+	prog->numshaders = 0;
+	for (i = 0; i < prog->numsources; i++)
+		if (prog->sources[i])
+			prog->shaders[prog->numshaders++] = GL_CreateShader (prog->types[i], prog->sources[i], prog->macros, prog->name);
+
+	for (i = 0; i < prog->numshaders; i++)
+		GL_AttachShaderFunc (prog->program, prog->shaders[i]);
+
+	if (glprogramcache.enabled)
+		GL_ProgramParameteriFunc (prog->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	GL_LinkProgramFunc (prog->program);
+}
+
+/*
+=============
+GL_FinishProgram
+
+Waits for a program to be ready and reports errors.  A cached binary
+that the driver doesn't take anymore is compiled from source instead.
+=============
+*/
+static void GL_FinishProgram (glprogram_t *prog)
+{
+	double time = Sys_DoubleTime ();
+	GLint status;
+	int i;
+
+	GL_GetProgramivFunc (prog->program, GL_LINK_STATUS, &status);
+
+	if (status != GL_TRUE && prog->fromcache)
+	{
+		Con_DPrintf ("Cached %s program rejected, recompiling\n", prog->name);
+		prog->fromcache = false;
+		GL_CompileProgram (prog);
+		GL_GetProgramivFunc (prog->program, GL_LINK_STATUS, &status);
+	}
 
 	if (status != GL_TRUE)
 	{
 		char infolog[1024];
+
+		for (i = 0; i < prog->numshaders; i++)
+			GL_CheckShader (prog->shaders[i], prog->name);
+
 		memset(infolog, 0, sizeof(infolog));
-		GL_GetProgramInfoLogFunc (program, sizeof(infolog), NULL, infolog);
-		GL_InitError ("Error linking %s program:\n\n%s", name, infolog);
+		GL_GetProgramInfoLogFunc (prog->program, sizeof(infolog), NULL, infolog);
+		GL_InitError ("Error linking %s program:\n\n%s", prog->name, infolog);
 	}
 
-	if (gl_num_programs == countof(gl_programs))
-		Sys_Error ("gl_programs overflow");
-	gl_programs[gl_num_programs] = program;
-	gl_num_programs++;
+	for (i = 0; i < prog->numshaders; i++)
+	{
+		GL_DetachShaderFunc (prog->program, prog->shaders[i]);
+		GL_DeleteShaderFunc (prog->shaders[i]);
+	}
+	prog->numshaders = 0;
 
-	return program;
+	if (!prog->fromcache)
+		glprogramcache.dirty = true;
+
+	prog->waittime = Sys_DoubleTime () - time;
 }
 
 /*
 ====================
 GL_CreateProgramFromSources
+
+Starts building the program, either from the program cache or from source.
+The driver may finish it in the background, GL_CreateShaders waits for
+all of them at the end.
 ====================
 */
 static GLuint GL_CreateProgramFromSources (int count, const GLchar **sources, const GLenum *types, const char *name, va_list argptr)
 {
+	const glprogramcacheentry_t *cached;
+	glprogram_t *prog;
 	char macros[1024];
 	char eval[256];
 	char *pipe;
-	int i, realcount;
-	GLuint shaders[2];
+	double time;
+	int i;
 
 	if (count <= 0 || count > 2)
 		Sys_Error ("GL_CreateProgramFromSources: invalid source count (%d)", count);
 
+	time = Sys_DoubleTime ();
+
 	q_vsnprintf (eval, sizeof (eval), name, argptr);
 	macros[0] = 0;
 
@@ -244,14 +576,42 @@ static GLuint GL_CreateProgramFromSources (int count, const GLchar **sources, co
 		AppendString (&dst, dstend, "\n", 1);
 	}
 
-	name = eval;
+	if (gl_num_programs == countof(gl_programs))
+		Sys_Error ("gl_programs overflow");
+	prog = &gl_programs[gl_num_programs++];
+	memset (prog, 0, sizeof (*prog));
 
-	realcount = 0;
+	q_strlcpy (prog->name, eval, sizeof (prog->name));
+	prog->macros = Z_Strdup (macros);
+	prog->numsources = count;
 	for (i = 0; i < count; i++)
-		if (sources[i])
-			shaders[realcount++] = GL_CreateShader (types[i], sources[i], macros, name);
+	{
+		prog->sources[i] = sources[i];
+		prog->types[i] = types[i];
+	}
+
+	prog->program = GL_CreateProgramFunc ();
+	GL_ObjectLabelFunc (GL_PROGRAM, prog->program, -1, prog->name);
 
-	return GL_CreateProgramFromShaders (shaders, realcount, name);
+	cached = NULL;
+	if (glprogramcache.enabled)
+	{
+		prog->key = GL_GetProgramKey (prog);
+		cached = GL_FindCachedProgram (prog->key);
+	}
+
+	if (cached)
+	{
+		prog->fromcache = true;
+		GL_ProgramParameteriFunc (prog->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		GL_ProgramBinaryFunc (prog->program, cached->format, cached->binary, cached->length);
+	}
+	else
+		GL_CompileProgram (prog);
+
+	prog->submittime = Sys_DoubleTime () - time;
+
+	return prog->program;
 }
 
 /*
@@ -330,6 +690,19 @@ GL_CreateShaders
 void GL_CreateShaders (void)
 {
 	int palettize, dither, mode, alphatest, warp, oit, md5;
+	double time = Sys_DoubleTime ();
+	GLint numformats = 0;
+	int i;
+
+	glGetIntegerv (GL_NUM_PROGRAM_BINARY_FORMATS, &numformats);
+	glprogramcache.enabled = numformats > 0 && !COM_CheckParm ("-noshadercache");
+	glprogramcache.dirty = false;
+	if (glprogramcache.enabled)
+		GL_LoadProgramCache ();
+
+	// let the driver compile the programs below on its own threads
+	if (gl_parallel_shader_compile_able)
+		GL_MaxShaderCompilerThreadsKHRFunc (0xFFFFFFFFu);
 
 	glprogs.gui = GL_CreateProgram (gui_vertex_shader, gui_fragment_shader, "gui");
 	glprogs.viewblend = GL_CreateProgram (viewblend_vertex_shader, viewblend_fragment_shader, "viewblend");
@@ -377,6 +750,41 @@ void GL_CreateShaders (void)
 	for (mode = 0; mode < 3; mode++)
 		glprogs.palette_init[mode] = GL_CreateComputeProgram (palette_init_compute_shader, "palette init|MODE %d", mode);
 	glprogs.palette_postprocess = GL_CreateComputeProgram (palette_postprocess_compute_shader, "palette postprocess");
+
+	for (i = 0; i < gl_num_programs; i++)
+		GL_FinishProgram (&gl_programs[i]);
+
+	GL_FreeProgramCache ();
+	if (glprogramcache.enabled && glprogramcache.dirty)
+		GL_SaveProgramCache ();
+
+	glprogramcache.createtime = Sys_DoubleTime () - time;
+	Con_DPrintf ("Created %d GL programs in %.1f ms\n", gl_num_programs, glprogramcache.createtime * 1000.0);
+}
+
+/*
+=============
+GL_ShaderStats_f
+=============
+*/
+void GL_ShaderStats_f (void)
+{
+	double submit = 0.0, wait = 0.0;
+	int i, cached = 0;
+
+	Con_Printf ("program                                  source    submit     wait\n");
+	for (i = 0; i < gl_num_programs; i++)
+	{
+		const glprogram_t *prog = &gl_programs[i];
+		Con_Printf ("%-40.40s %-8s %6.2fms %6.2fms\n", prog->name, prog->fromcache ? "cache" : "compiled",
+			prog->submittime * 1000.0, prog->waittime * 1000.0);
+		submit += prog->submittime;
+		wait += prog->waittime;
+		cached += prog->fromcache;
+	}
+	Con_Printf ("%d programs, %d from cache%s: %.1f ms submit, %.1f ms wait, %.1f ms total\n",
+		gl_num_programs, cached, gl_parallel_shader_compile_able ? " (parallel compile)" : "",
+		submit * 1000.0, wait * 1000.0, glprogramcache.createtime * 1000.0);
 }
 
 /*
@@ -389,8 +797,10 @@ void GL_DeleteShaders (void)
 	int i;
 	for (i = 0; i < gl_num_programs; i++)
 	{
-		GL_DeleteProgramFunc (gl_programs[i]);
-		gl_programs[i] = 0;
+		GL_DeleteProgramFunc (gl_programs[i].program);
+		Z_Free (gl_programs[i].macros);
+		gl_programs[i].program = 0;
+		gl_programs[i].macros = NULL;
 	}
 	gl_num_programs = 0;
 
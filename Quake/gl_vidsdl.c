@@ -31,6 +31,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #else
 #include "SDL.h"
 #endif
+#ifdef USE_NULLGL
+#include "gl_null.h"
+#endif
 
 //ericw -- for putting the driver into multithreaded mode
 #ifdef __APPLE__
@@ -87,6 +90,7 @@ qboolean gl_buffer_storage_able = false;
 qboolean gl_multi_bind_able = false;
 qboolean gl_bindless_able = false;
 qboolean gl_clipcontrol_able = false;
+qboolean gl_parallel_shader_compile_able = false;
 float gl_max_anisotropy; //johnfitz
 int gl_stencilbits;
 
@@ -134,6 +138,12 @@ static const glfunc_t gl_arb_clip_control_functions[] =
 	QGL_ARB_clip_control_FUNCTIONS(QGL_REGISTER_NAMED_FUNC)
 	{NULL, NULL}
 };
+
+static const glfunc_t gl_khr_parallel_shader_compile_functions[] =
+{
+	QGL_KHR_parallel_shader_compile_FUNCTIONS(QGL_REGISTER_NAMED_FUNC)
+	{NULL, NULL}
+};
 #undef QGL_REGISTER_NAMED_FUNC
 
 //====================================
@@ -459,6 +469,9 @@ static qboolean VID_SetMode (int width, int height, int refreshrate, qboolean fu
 	if (!draw_context)
 	{
 		flags = SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN | SDL_WINDOW_RESIZABLE;
+#ifdef USE_NULLGL
+		flags &= ~SDL_WINDOW_OPENGL;
+#endif
 
 		if (vid_borderless.value)
 			flags |= SDL_WINDOW_BORDERLESS;
@@ -1095,6 +1108,12 @@ static void GL_CheckExtensions (void)
 		GL_FindExtension ("GL_ARB_clip_control") &&
 		GL_InitFunctions (gl_arb_clip_control_functions, false)
 	;
+
+	gl_parallel_shader_compile_able =
+		!COM_CheckParm ("-noparallelshaders") &&
+		GL_FindExtension ("GL_KHR_parallel_shader_compile") &&
+		GL_InitFunctions (gl_khr_parallel_shader_compile_functions, false)
+	;
 }
 
 /*
@@ -1636,6 +1655,9 @@ void	VID_Init (void)
 	Cmd_AddCommand ("vid_describemodes", VID_DescribeModes_f);
 
 	putenv (vid_center);	/* SDL_putenv is problematic in versions <= 1.2.9 */
+#ifdef USE_NULLGL
+	SDL_setenv ("SDL_VIDEODRIVER", "dummy", 0); /* headless: no display needed */
+#endif
 
 	if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0)
 		Sys_Error("Couldn't init SDL video: %s", SDL_GetError());
@@ -1746,6 +1768,7 @@ void	VID_Init (void)
 	cmd = Cmd_AddCommand ("gl_info", GL_Info_f); //johnfitz
 	if (cmd)
 		cmd->completion = GL_Info_Completion_f;
+	Cmd_AddCommand ("shader_stats", GL_ShaderStats_f);
 
 	//johnfitz -- removed code creating "glquake" subdirectory
 
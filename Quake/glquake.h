@@ -120,6 +120,7 @@ extern	qboolean	gl_buffer_storage_able;
 extern	qboolean	gl_multi_bind_able;
 extern	qboolean	gl_bindless_able;
 extern	qboolean	gl_clipcontrol_able;
+extern	qboolean	gl_parallel_shader_compile_able;
 
 extern	const char	*gl_vendor;
 extern	const char	*gl_renderer;
@@ -152,6 +153,9 @@ extern	const char	*gl_version;
 	x(void,			GetProgramiv, (GLuint program, GLenum pname, GLint *params))\
 	x(void,			UseProgram, (GLuint program))\
 	x(void,			LinkProgram, (GLuint program))\
+	x(void,			ProgramParameteri, (GLuint program, GLenum pname, GLint value))\
+	x(void,			GetProgramBinary, (GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary))\
+	x(void,			ProgramBinary, (GLuint program, GLenum binaryFormat, const void *binary, GLsizei length))\
 	x(void,			GetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog))\
 	x(GLuint,		CreateShader, (GLenum type))\
 	x(void,			DeleteShader, (GLuint shader))\
@@ -240,12 +244,16 @@ extern	const char	*gl_version;
 
 #define GL_ZERO_TO_ONE		0x935F
 
+#define QGL_KHR_parallel_shader_compile_FUNCTIONS(x)\
+	x(void,			MaxShaderCompilerThreadsKHR, (GLuint count))\
+
 #define QGL_ALL_FUNCTIONS(x)\
 	QGL_CORE_FUNCTIONS(x)\
 	QGL_ARB_buffer_storage_FUNCTIONS(x)\
 	QGL_ARB_multi_bind_FUNCTIONS(x)\
 	QGL_ARB_bindless_texture_FUNCTIONS(x)\
 	QGL_ARB_clip_control_FUNCTIONS(x)\
+	QGL_KHR_parallel_shader_compile_FUNCTIONS(x)\
 
 #define QGL_DECLARE_FUNC(ret, name, args) extern ret (APIENTRYP GL_##name##Func) args;
 QGL_ALL_FUNCTIONS(QGL_DECLARE_FUNC)
@@ -550,6 +558,7 @@ void GL_UseProgram (GLuint program);
 void GL_ClearCachedProgram (void);
 void GL_CreateShaders (void);
 void GL_DeleteShaders (void);
+void GL_ShaderStats_f (void);
 
 typedef struct glframebufs_s {
 	GLint			max_color_tex_samples;
@@ -67,6 +67,7 @@ cvar_t	max_edicts = {"max_edicts", "16384", CVAR_NONE}; //johnfitz //ericw -- ch
 cvar_t	cl_nocsqc = {"cl_nocsqc", "0", CVAR_NONE};	//spike -- blocks the loading of any csqc modules
 
 cvar_t	sys_ticrate = {"sys_ticrate","0.05",CVAR_NONE}; // dedicated server
+cvar_t	sys_eventloop = {"sys_eventloop","1",CVAR_NONE}; // dedicated server: sleep on the network between ticks
 cvar_t	serverprofile = {"serverprofile","0",CVAR_NONE};
 
 cvar_t	fraglimit = {"fraglimit","0",CVAR_NOTIFY|CVAR_SERVERINFO};
@@ -198,6 +199,7 @@ void Host_ReportError (const char *error, ...)
 	inerror = true;
 
 	PR_SwitchQCVM(NULL);
+	Mod_SyncLoadTasks ();
 
 	SCR_EndLoadingPlaque ();		// reenable screen updates
 
@@ -359,6 +361,8 @@ void Host_InitLocal (void)
 {
 	Cmd_AddCommand ("version", Host_Version_f);
 	Cmd_AddCommand ("writeconfig", Host_WriteConfig_f);
+	Tasks_InitCommands ();
+	Trace_InitCommands ();
 
 	Host_InitCommands ();
 
@@ -377,6 +381,7 @@ void Host_InitLocal (void)
 	Cvar_RegisterVariable (&cl_titlestats);
 
 	Cvar_RegisterVariable (&sys_ticrate);
+	Cvar_RegisterVariable (&sys_eventloop);
 	Cvar_RegisterVariable (&serverprofile);
 
 	Cvar_RegisterVariable (&fraglimit);
@@ -670,95 +675,161 @@ void Host_ClearMemory (void)
 //
 //==============================================================================
 
+// Lock-free multi-producer, single-consumer queue (intrusive linked list
+// with a stub node). Any thread can push without blocking, only the main
+// thread pops, and callbacks run outside of any lock.
+
 typedef struct asyncproc_s
 {
+	struct asyncproc_s	*next;
 	void				(*func) (void *param);
 	void				*param;
+	double				time;			// when it was queued
 } asyncproc_t;
 
 typedef struct asyncqueue_s
 {
-	size_t				head;
-	size_t				tail;
-	size_t				capacity;
-	qboolean			teardown;
-	SDL_mutex			*mutex;
-	SDL_cond			*notfull;
-	asyncproc_t			*procs;
+	void				*head;			// last pushed node, swapped by producers
+	asyncproc_t			*tail;			// next node to pop, only touched by the consumer
+	asyncproc_t			stub;
+	SDL_atomic_t		teardown;
+	SDL_atomic_t		depth;
 } asyncqueue_t;
 
+typedef struct asyncstats_s
+{
+	int					count;			// procs run since the last reset
+	int					maxdepth;
+	double				totallatency;
+	double				maxlatency;
+} asyncstats_t;
+
 static asyncqueue_t		async_queue;
+static asyncstats_t		async_stats;
 
-static void AsyncQueue_Init (asyncqueue_t *queue, size_t capacity)
+static void AsyncQueue_Init (asyncqueue_t *queue)
 {
 	memset (queue, 0, sizeof (*queue));
+	queue->tail = &queue->stub;
+	SDL_AtomicSetPtr (&queue->head, &queue->stub);
+}
 
-	if (!capacity)
-		capacity = 1024;
-	else
-		capacity = Q_nextPow2 (capacity);
-	queue->capacity = capacity;
-	capacity *= sizeof (queue->procs[0]);
-	queue->procs = (asyncproc_t *) malloc (capacity);
-	if (!queue->procs)
-		Sys_Error ("AsyncQueue_Init: malloc failed on %" SDL_PRIu64 " bytes", (uint64_t) capacity);
-
-	queue->mutex = SDL_CreateMutex ();
-	if (!queue->mutex)
-		Sys_Error ("AsyncQueue_Init: could not create mutex");
-
-	queue->notfull = SDL_CreateCond ();
-	if (!queue->notfull)
-		Sys_Error ("AsyncQueue_Init: could not create condition variable");
+static void AsyncQueue_Link (asyncqueue_t *queue, asyncproc_t *proc)
+{
+	asyncproc_t *prev;
+
+	SDL_AtomicSetPtr ((void **) &proc->next, NULL);
+	prev = (asyncproc_t *) SDL_AtomicSetPtr (&queue->head, proc);
+	SDL_AtomicSetPtr ((void **) &prev->next, proc);
 }
 
 static void AsyncQueue_Push (asyncqueue_t *queue, void (*func) (void *param), void *param)
 {
 	asyncproc_t *proc;
 
-	if (!queue->mutex)
+	if (!SDL_AtomicGetPtr (&queue->head) || SDL_AtomicGet (&queue->teardown))
 		return;
-	SDL_LockMutex (queue->mutex);
-	while (!queue->teardown && queue->tail - queue->head >= queue->capacity)
-		SDL_CondWait (queue->notfull, queue->mutex);
 
-	if (!queue->teardown)
+	proc = (asyncproc_t *) malloc (sizeof (*proc));
+	if (!proc)
+		Sys_Error ("AsyncQueue_Push: malloc failed on %" SDL_PRIu64 " bytes", (uint64_t) sizeof (*proc));
+	proc->func = func;
+	proc->param = param;
+	proc->time = Sys_DoubleTime ();
+
+	SDL_AtomicAdd (&queue->depth, 1);
+	AsyncQueue_Link (queue, proc);
+}
+
+// Returns NULL if the queue is empty or a producer is halfway through a push
+static asyncproc_t *AsyncQueue_Pop (asyncqueue_t *queue)
+{
+	asyncproc_t *tail = queue->tail;
+	asyncproc_t *next = (asyncproc_t *) SDL_AtomicGetPtr ((void **) &tail->next);
+
+	if (tail == &queue->stub)
+	{
+		if (!next)
+			return NULL;
+		queue->tail = tail = next;
+		next = (asyncproc_t *) SDL_AtomicGetPtr ((void **) &tail->next);
+	}
+
+	if (next)
 	{
-		proc = &queue->procs[(queue->tail++) & (queue->capacity - 1)];
-		proc->func = func;
-		proc->param = param;
+		queue->tail = next;
+		return tail;
 	}
 
-	SDL_UnlockMutex (queue->mutex);
+	if (tail != SDL_AtomicGetPtr (&queue->head))
+		return NULL;
+
+	// tail is the last node, put the stub back behind it so it can be unlinked
+	AsyncQueue_Link (queue, &queue->stub);
+	next = (asyncproc_t *) SDL_AtomicGetPtr ((void **) &tail->next);
+	if (next)
+	{
+		queue->tail = next;
+		return tail;
+	}
+
+	return NULL;
 }
 
 static void AsyncQueue_Drain (asyncqueue_t *queue)
 {
-	SDL_LockMutex (queue->mutex);
-	while (queue->head != queue->tail)
+	asyncproc_t *proc;
+	double now = 0.0;
+	int depth;
+
+	if (!queue->tail)
+		return;
+
+	depth = SDL_AtomicGet (&queue->depth);
+	async_stats.maxdepth = q_max (async_stats.maxdepth, depth);
+	if (depth)
+		now = Sys_DoubleTime ();
+
+	while ((proc = AsyncQueue_Pop (queue)) != NULL)
 	{
-		asyncproc_t *proc = &queue->procs[(queue->head++) & (queue->capacity - 1)];
+		double latency = q_max (now - proc->time, 0.0);
+		async_stats.count++;
+		async_stats.totallatency += latency;
+		async_stats.maxlatency = q_max (async_stats.maxlatency, latency);
+		SDL_AtomicAdd (&queue->depth, -1);
+
 		proc->func (proc->param);
-		SDL_CondSignal (queue->notfull);
+		free (proc);
 	}
-	SDL_UnlockMutex (queue->mutex);
 }
 
 static void AsyncQueue_Destroy (asyncqueue_t *queue)
 {
-	if (!queue->mutex)
+	if (!queue->tail)
 		return;
 
-	SDL_LockMutex (queue->mutex);
-	queue->teardown = true;
-	SDL_UnlockMutex (queue->mutex);
-	SDL_CondBroadcast (queue->notfull);
-
+	SDL_AtomicSet (&queue->teardown, 1);
 	AsyncQueue_Drain (queue);
+}
 
-	SDL_DestroyCond (queue->notfull);
-	SDL_DestroyMutex (queue->mutex);
-	memset (queue, 0, sizeof (*queue));
+/*
+==================
+Host_PrintAsyncStats
+
+Prints the main thread queue counters gathered since the last call
+==================
+*/
+static void Host_PrintAsyncStats (void)
+{
+	if (!async_stats.count && !async_stats.maxdepth)
+		return;
+
+	Con_Printf ("%d async | %d max depth | %5.2f avg %5.2f max latency\n",
+		async_stats.count, async_stats.maxdepth,
+		async_stats.totallatency * 1000.0 / q_max (async_stats.count, 1),
+		async_stats.maxlatency * 1000.0);
+
+	memset (&async_stats, 0, sizeof (async_stats));
 }
 
 void Host_InvokeOnMainThread (void (*func) (void *param), void *param)
@@ -948,6 +1019,9 @@ void Host_ServerFrame (void)
 // run the world state
 	pr_global_struct->frametime = host_frametime;
 
+// send the datagrams of the whole frame together
+	NET_BeginBatch ();
+
 // set the time and clear the general datagram
 	SV_ClearDatagram ();
 
@@ -955,12 +1029,18 @@ void Host_ServerFrame (void)
 	SV_CheckForNewClients ();
 
 // read client messages
+	TRACE_BEGIN ("SV_RunClients");
 	SV_RunClients ();
+	TRACE_END ();
 
 // move things around and think
 // always pause in single player if in console or menus
 	if (!sv.paused && (svs.maxclients > 1 || key_dest == key_game) )
+	{
+		TRACE_BEGIN ("SV_Physics");
 		SV_Physics ();
+		TRACE_END ();
+	}
 
 //johnfitz -- devstats
 	if (cls.signon == SIGNONS)
@@ -979,7 +1059,10 @@ void Host_ServerFrame (void)
 //johnfitz
 
 // send all messages to the clients
+	TRACE_BEGIN ("SV_SendClientMessages");
 	SV_SendClientMessages ();
+	NET_EndBatch ();
+	TRACE_END ();
 
 	Host_CheckAutosave ();
 }
@@ -1201,11 +1284,18 @@ void _Host_Frame (double time)
 	static double	accumtime = 0;
 	double time1, time2, time3;
 	qboolean ranserver = false;
+	qboolean timed;
 
 	time1 = Sys_DoubleTime ();
 
 	if (setjmp (host_abortserver) )
+	{
+		NET_EndBatch ();
+		TRACE_END_ALL ();
 		return;			// something bad happened, or the server disconnected
+	}
+
+	TRACE_BEGIN ("Host_Frame");
 
 // keep the random time dependent
 	rand ();
@@ -1229,9 +1319,13 @@ void _Host_Frame (double time)
 	Host_GetConsoleCommands ();
 
 // process console commands
+	TRACE_BEGIN ("Cbuf_Execute");
 	Cbuf_Execute ();
+	TRACE_END ();
 
+	TRACE_BEGIN ("NET_Poll");
 	NET_Poll();
+	TRACE_END ();
 
 	if (cl.sendprespawn)
 	{
@@ -1260,12 +1354,16 @@ void _Host_Frame (double time)
 		}
 		else
 			accumtime -= host_netinterval;
+		TRACE_BEGIN ("CL_SendCmd");
 		CL_SendCmd ();
+		TRACE_END ();
 		if (sv.active)
 		{
+			TRACE_BEGIN ("Host_ServerFrame");
 			PR_SwitchQCVM(&sv.qcvm);
 			Host_ServerFrame ();
 			PR_SwitchQCVM(NULL);
+			TRACE_END ();
 		}
 		host_frametime = realframetime;
 		Cbuf_Waited();
@@ -1274,20 +1372,30 @@ void _Host_Frame (double time)
 
 // fetch results from server
 	if (cls.state == ca_connected)
+	{
+		TRACE_BEGIN ("CL_ReadFromServer");
 		CL_ReadFromServer ();
+		TRACE_END ();
+	}
 
 // update video
-	if (host_speeds.value)
+	timed = host_speeds.value || cls.timedemo;
+	if (timed)
 		time2 = Sys_DoubleTime ();
 
+	TRACE_BEGIN ("SCR_UpdateScreen");
 	SCR_UpdateScreen ();
+	TRACE_END ();
 
+	TRACE_BEGIN ("CL_RunParticles");
 	CL_RunParticles (); //johnfitz -- seperated from rendering
+	TRACE_END ();
 
-	if (host_speeds.value)
+	if (timed)
 		time3 = Sys_DoubleTime ();
 
 // update audio
+	TRACE_BEGIN ("S_Update");
 	BGM_Update();	// adds music raw samples and/or advances midi driver
 	if (cls.signon == SIGNONS)
 	{
@@ -1296,21 +1404,28 @@ void _Host_Frame (double time)
 	}
 	else
 		S_Update (vec3_origin, vec3_origin, vec3_origin, vec3_origin);
+	TRACE_END ();
 
 	CDAudio_Update();
 	UpdateWindowTitle();
 
-	if (host_speeds.value)
+	if (timed)
+	{
+		time1 = time2 - time1;
+		time2 = time3 - time2;
+		time3 = Sys_DoubleTime () - time3;
+
+		if (cls.timedemo)
+			CL_BenchmarkFrame (time1, time2, time3, ranserver);
+	}
+
+	if (host_speeds.value && timed)
 	{
 		static double pass[3] = {0.0, 0.0, 0.0};
 		static double elapsed = 0.0;
 		static int numframes = 0;
 		static int numserverframes = 0;
 
-		time1 = time2 - time1;
-		time2 = time3 - time2;
-		time3 = Sys_DoubleTime () - time3;
-
 		if (ranserver || host_speeds.value < 0.f)
 		{
 			pass[0] += time1;
@@ -1329,6 +1444,7 @@ void _Host_Frame (double time)
 			pass[2] /= numframes;
 
 			Host_PrintTimes (pass, names, countof (pass), host_speeds.value < 0.f);
+			Host_PrintAsyncStats ();
 
 			pass[0] = pass[1] = pass[2] = elapsed = 0.0;
 			numframes = numserverframes = 0;
@@ -1336,6 +1452,8 @@ void _Host_Frame (double time)
 	}
 
 	host_framecount++;
+
+	TRACE_END ();
 }
 
 void Host_Frame (double time)
@@ -1392,7 +1510,9 @@ void Host_Init (void)
 		Sys_Error ("Only %4.1f megs of memory available, can't execute game", host_parms->memsize / (float)0x100000);
 
 	Memory_Init (host_parms->membase, host_parms->memsize);
-	AsyncQueue_Init (&async_queue, 1024);
+	AsyncQueue_Init (&async_queue);
+	Trace_Init ();
+	Tasks_Init ();
 	Cbuf_Init ();
 	Cmd_Init ();
 	LOG_Init (host_parms);
@@ -1464,6 +1584,7 @@ void Host_Init (void)
 	// johnfitz -- in case the vid mode was locked during vid_init, we can unlock it now.
 		// note: two leading newlines because the command buffer swallows one of them.
 		Cbuf_AddText ("\n\nvid_unlock\n");
+		CL_BenchmarkCommandLine ();
 	}
 
 	if (cls.state == ca_dedicated)
@@ -1504,6 +1625,7 @@ void Host_Shutdown(void)
 	AsyncQueue_Destroy (&async_queue);
 
 	Host_ShutdownSave ();
+	Tasks_Shutdown ();
 	Host_WriteConfiguration ();
 
 // stop downloads before shutting down networking
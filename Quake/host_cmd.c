@@ -35,6 +35,7 @@ extern cvar_t	nomonsters;
 
 // 0 = no, 1 = ask, 2 = when dead, 3 = always
 cvar_t sv_autoload = {"sv_autoload", "2", CVAR_ARCHIVE};
+cvar_t sv_savebinary = {"sv_savebinary", "0", CVAR_ARCHIVE};
 
 int	current_skill;
 
@@ -2209,12 +2210,16 @@ LOAD / SAVE GAME
 ===============================================================================
 */
 
-static savedata_t		save_data;
-static qboolean			save_pending;
+static savedata_t		save_slots[2];
+static savedata_t		*save_writing;		// slot owned by the save thread
+static savedata_t		*save_queued;		// filled slot waiting for the save thread
+static qboolean			save_quit;
+static qboolean			save_error;
 static SDL_Thread		*save_thread;
 static SDL_mutex		*save_mutex;
 static SDL_cond			*save_finished_condition;
 static SDL_cond			*save_pending_condition;
+static double			save_restoretime;	// time spent restoring globals and edicts on the last load
 
 /*
 ===============
@@ -2270,10 +2275,7 @@ void Host_ShutdownSave (void)
 		return; // not initialized yet
 
 	SDL_LockMutex (save_mutex);
-	while (save_pending)
-		SDL_CondWait (save_finished_condition, save_mutex);
-	save_pending = true;
-	save_data.file = NULL;
+	save_quit = true;
 	SDL_CondSignal (save_pending_condition);
 	SDL_UnlockMutex (save_mutex);
 
@@ -2286,79 +2288,107 @@ void Host_ShutdownSave (void)
 	SDL_DestroyCond (save_pending_condition);
 	save_pending_condition = NULL;
 
-	SaveData_Clear (&save_data);
+	SaveData_Clear (&save_slots[0]);
+	SaveData_Clear (&save_slots[1]);
 }
 
 void Host_WaitForSaveThread (void)
 {
 	SDL_LockMutex (save_mutex);
-	while (save_pending)
+	while (save_writing || save_queued)
 		SDL_CondWait (save_finished_condition, save_mutex);
 	SDL_UnlockMutex (save_mutex);
 }
 
 qboolean Host_IsSaving (void)
 {
-	qboolean saving;
+	qboolean saving, error;
 	SDL_LockMutex (save_mutex);
-	saving = save_pending;
+	saving = save_writing || save_queued;
+	error = save_error;
+	save_error = false;
 	SDL_UnlockMutex (save_mutex);
 
-	if (saving)
-		return true;
-
-	if (save_data.abort.value && sv.lastsave[0])
+	if (error)
 	{
 		sv.lastsave[0] = '\0';
-		if (save_data.abort.value < 0)
-			Con_Printf ("Save error.\n");
+		Con_Printf ("Save error.\n");
 	}
 
-	return false;
+	return saving;
+}
+
+/*
+===============
+Host_WriteSave
+
+Writes a filled savedata_t to its file, returns false if the save was aborted
+===============
+*/
+static qboolean Host_WriteSave (savedata_t *save)
+{
+	edict_t		*ed;
+	int			i;
+
+	if (save->binary)
+	{
+		SaveData_WriteBinary (save);
+		return !SDL_AtomicGet (&save->abort);
+	}
+
+	SaveData_WriteHeader (save);
+	for (i = 0, ed = save->edicts; i < save->num_edicts; i++, ed = NEXT_EDICT (ed))
+	{
+		if (SDL_AtomicGet(&save->abort))
+			return false;
+		ED_Write (save, ed);
+	}
+	fprintf (save->file, "// %d edicts\n", save->num_edicts);
+
+	return true;
 }
 
 static int Host_BackgroundSave (void *param)
 {
-	savedata_t	*save = (savedata_t *) param;
+	savedata_t	*save;
 
 	while (true)
 	{
-		edict_t		*ed;
-		int			i;
-		qboolean	abort = false;
+		qboolean	abort;
 
 		SDL_LockMutex (save_mutex);
-		while (!save_pending)
+		while (!save_queued && !save_quit)
 			SDL_CondWait (save_pending_condition, save_mutex);
+		save = save_writing = save_queued;
+		save_queued = NULL;
+		SDL_CondBroadcast (save_finished_condition);	// the queue has room again
 		SDL_UnlockMutex (save_mutex);
 
-		if (!save->file)
+		if (!save)
 			break;
 
-		PR_SwitchQCVM (&sv.qcvm);
-		SaveData_WriteHeader (save);
-		for (i = 0, ed = save->edicts; i < save->num_edicts; i++, ed = NEXT_EDICT (ed))
+		// opened here rather than by the save command, so that a new save
+		// to the same file doesn't have to wait for the old one to let go
+		save->file = Sys_fopen (save->path, save->binary ? "wb" : "w");
+		if (!save->file)
+			SDL_AtomicCAS (&save->abort, 0, -1);
+		else
 		{
-			if (SDL_AtomicGet(&save->abort))
-			{
-				abort = true;
-				break;
-			}
-			ED_Write (save, ed);
-			fflush (save->file);
-		}
-		if (!abort)
-			fprintf (save->file, "// %d edicts\n", save->num_edicts);
-		PR_SwitchQCVM (NULL);
+			PR_SwitchQCVM (&sv.qcvm);
+			abort = !Host_WriteSave (save);
+			PR_SwitchQCVM (NULL);
 
-		fclose (save->file);
-		save->file = NULL;
-		if (abort)
-			Sys_remove (save->path);
+			fclose (save->file);
+			save->file = NULL;
+			if (abort)
+				Sys_remove (save->path);
+		}
 
 		SDL_LockMutex (save_mutex);
-		save_pending = false;
-		SDL_CondSignal (save_finished_condition);
+		if (SDL_AtomicGet (&save->abort) < 0)
+			save_error = true;
+		save_writing = NULL;
+		SDL_CondBroadcast (save_finished_condition);
 		SDL_UnlockMutex (save_mutex);
 	}
 
@@ -2370,50 +2400,75 @@ static void Host_InitSaveThread (void)
 	save_mutex = SDL_CreateMutex ();
 	save_finished_condition = SDL_CreateCond ();
 	save_pending_condition = SDL_CreateCond ();
-	save_thread = SDL_CreateThread (Host_BackgroundSave, "SaveThread", &save_data);
-	SaveData_Init (&save_data);
+	save_thread = SDL_CreateThread (Host_BackgroundSave, "SaveThread", NULL);
+	SaveData_Init (&save_slots[0]);
+	SaveData_Init (&save_slots[1]);
 }
 
 /*
 ===============
-Host_Savegame_f
+Host_CanSave
 ===============
 */
-static void Host_Savegame_f (void)
+static qboolean Host_CanSave (void)
 {
-	char		relname[MAX_OSPATH];
-	char		name[MAX_OSPATH];
-	const char	*skipnotify;
-	FILE		*f;
 	int			i;
 
-	if (cmd_source != src_command)
-		return;
-
 	if (!sv.active)
 	{
 		Con_Printf ("Not playing a local game.\n");
-		return;
+		return false;
 	}
 
 	if (sv.nomonsters)
 	{
 		Con_Printf ("Can't save when using \"nomonsters\".\n");
-		return;
+		return false;
 	}
 
 	if (cl.intermission)
 	{
 		Con_Printf ("Can't save in intermission.\n");
-		return;
+		return false;
 	}
 
 	if (svs.maxclients != 1)
 	{
 		Con_Printf ("Can't save multiplayer games.\n");
-		return;
+		return false;
 	}
 
+	for (i=0 ; i<svs.maxclients ; i++)
+	{
+		if (svs.clients[i].active && (svs.clients[i].edict->v.health <= 0) )
+		{
+			Con_Printf ("Can't savegame with a dead player\n");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+===============
+Host_Savegame_f
+===============
+*/
+static void Host_Savegame_f (void)
+{
+	char		relname[MAX_OSPATH];
+	char		name[MAX_OSPATH];
+	const char	*skipnotify;
+	qboolean	binary;
+	savedata_t	*save;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (!Host_CanSave ())
+		return;
+
 	if (Cmd_Argc() < 2)
 	{
 		Con_Printf ("save <savename> : save a game\n");
@@ -2426,15 +2481,6 @@ static void Host_Savegame_f (void)
 		return;
 	}
 
-	for (i=0 ; i<svs.maxclients ; i++)
-	{
-		if (svs.clients[i].active && (svs.clients[i].edict->v.health <= 0) )
-		{
-			Con_Printf ("Can't savegame with a dead player\n");
-			return;
-		}
-	}
-
 	q_strlcpy (relname, Cmd_Argv(1), sizeof(relname));
 	COM_AddExtension (relname, ".sav", sizeof(relname));
 	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, relname);
@@ -2445,35 +2491,38 @@ static void Host_Savegame_f (void)
 	Con_LinkPrintf (name, "%s%s", skipnotify, relname);
 	Con_SafePrintf ("%s...\n", skipnotify);
 
-	if (!strcmp (relname, sv.lastsave) && Host_IsSaving ())
-	{
-		SDL_AtomicCAS (&save_data.abort, 0, 1);
-		SDL_LockMutex (save_mutex);
-		while (save_pending)
-			SDL_CondWait (save_finished_condition, save_mutex);
-		SDL_UnlockMutex (save_mutex);
-	}
-
-	f = Sys_fopen (name, "w");
-	if (!f)
-	{
-		Con_Printf ("ERROR: couldn't open.\n");
-		return;
-	}
+	binary = sv_savebinary.value != 0.f;
 
 	SDL_LockMutex (save_mutex);
-	while (save_pending)
+
+	// only one save can wait in line: a new save replaces a queued one
+	// to the same file, but has to wait for one to a different file
+	while (save_queued && strcmp (save_queued->path, name))
 		SDL_CondWait (save_finished_condition, save_mutex);
 
-	q_strlcpy (save_data.path, name, sizeof (save_data.path));
-	save_data.file = f;
-	save_data.abort.value = 0;
+	// a save to the same file that's already being written is now stale
+	if (save_writing && !strcmp (save_writing->path, name))
+		SDL_AtomicCAS (&save_writing->abort, 0, 1);
+
+	// take the slot back from the queue while filling it, so that the
+	// save thread can't pick it up half-written
+	if (save_queued)
+		save = save_queued;
+	else
+		save = (save_writing == &save_slots[0]) ? &save_slots[1] : &save_slots[0];
+	save_queued = NULL;
+	SDL_UnlockMutex (save_mutex);
+
+	q_strlcpy (save->path, name, sizeof (save->path));
+	save->binary = binary;
+	save->abort.value = 0;
 
 	PR_SwitchQCVM (&sv.qcvm);
-	SaveData_Fill (&save_data);
+	SaveData_Fill (save);
 	PR_SwitchQCVM (NULL);
 
-	save_pending = true;
+	SDL_LockMutex (save_mutex);
+	save_queued = save;
 	SDL_CondSignal (save_pending_condition);
 	SDL_UnlockMutex (save_mutex);
 
@@ -2496,12 +2545,17 @@ static void Host_Loadgame_f (void)
 	char	mapname[MAX_QPATH];
 	float	time, tfloat;
 	const char	*data;
+	const byte	*body = NULL;
+	long	len;
 	int	i;
 	edict_t	*ent;
 	int	entnum;
 	int	version;
 	float	spawn_parms[NUM_SPAWN_PARMS];
 	qboolean kexonly = false;
+	qboolean binary = false;
+	savedata_t header;
+	double	restorestart;
 
 	if (cmd_source != src_command)
 		return;
@@ -2566,7 +2620,12 @@ static void Host_Loadgame_f (void)
 	if (start != NULL)
 		free (start);
 	
-	start = (char *) COM_LoadMallocFile_TextMode_OSPath(name, NULL);
+	start = (char *) COM_LoadMallocFile_OSPath (name, &len);
+	if (start != NULL && atoi (start) != SAVEGAME_VERSION_BINARY)
+	{	// text saves get CRLF translation
+		free (start);
+		start = (char *) COM_LoadMallocFile_TextMode_OSPath (name, &len);
+	}
 	if (start == NULL)
 	{
 		Con_Printf ("ERROR: couldn't open.\n");
@@ -2595,6 +2654,10 @@ static void Host_Loadgame_f (void)
 				M_ToggleMenu_f ();
 		}
 	}
+	else if (version == SAVEGAME_VERSION_BINARY && !kexonly)
+	{
+		binary = true;
+	}
 	else if (version != SAVEGAME_VERSION || kexonly)
 	{
 		int expected = kexonly ? SAVEGAME_VERSION_KEX : SAVEGAME_VERSION;
@@ -2608,17 +2671,37 @@ static void Host_Loadgame_f (void)
 		SCR_EndLoadingPlaque ();
 		return;
 	}
-	data = COM_ParseStringNewline (data);
-	for (i = 0; i < NUM_SPAWN_PARMS; i++)
-		data = COM_ParseFloatNewline (data, &spawn_parms[i]);
-// this silliness is so we can load 1.06 save files, which have float skill values
-	data = COM_ParseFloatNewline(data, &tfloat);
-	current_skill = (int)(tfloat + 0.1);
-	Cvar_SetValue ("skill", (float)current_skill);
 
-	data = COM_ParseStringNewline (data);
-	q_strlcpy (mapname, com_token, sizeof(mapname));
-	data = COM_ParseFloatNewline (data, &time);
+	if (binary)
+	{
+	// skip the version and comment lines, the rest is binary
+		data = strchr (start, '\n');
+		if (data)
+			data = strchr (data + 1, '\n');
+		if (!data)
+			Host_Error ("Savegame is truncated");
+		body = SaveData_ParseBinaryHeader (&header, (const byte *) data + 1, (const byte *) start + len);
+		for (i = 0; i < NUM_SPAWN_PARMS; i++)
+			spawn_parms[i] = header.spawn_parms[i];
+		current_skill = header.skill;
+		Cvar_SetValue ("skill", (float)current_skill);
+		q_strlcpy (mapname, header.mapname, sizeof(mapname));
+		time = header.time;
+	}
+	else
+	{
+		data = COM_ParseStringNewline (data);
+		for (i = 0; i < NUM_SPAWN_PARMS; i++)
+			data = COM_ParseFloatNewline (data, &spawn_parms[i]);
+	// this silliness is so we can load 1.06 save files, which have float skill values
+		data = COM_ParseFloatNewline(data, &tfloat);
+		current_skill = (int)(tfloat + 0.1);
+		Cvar_SetValue ("skill", (float)current_skill);
+
+		data = COM_ParseStringNewline (data);
+		q_strlcpy (mapname, com_token, sizeof(mapname));
+		data = COM_ParseFloatNewline (data, &time);
+	}
 
 // Note: calling CL_Disconnect instead of CL_Disconnect_f to avoid stopping the music
 	CL_Disconnect ();
@@ -2640,49 +2723,63 @@ static void Host_Loadgame_f (void)
 	sv.paused = true;		// pause until all clients connect
 	sv.loadgame = true;
 
+	restorestart = Sys_DoubleTime ();
+
 // load the light styles
 	for (i = 0; i < MAX_LIGHTSTYLES; i++)
 	{
+		if (binary)
+		{
+			sv.lightstyles[i] = (const char *)Hunk_Strdup (header.lightstyles[i], "lightstyles");
+			continue;
+		}
 		data = COM_ParseStringNewline (data);
 		sv.lightstyles[i] = (const char *)Hunk_Strdup (com_token, "lightstyles");
 	}
 
 // load the edicts out of the savegame file
-	entnum = -1;		// -1 is the globals
-	while (*data)
+	if (binary)
+	{
+		entnum = ED_ParseBinarySave (body, (const byte *) start + len);
+	}
+	else
 	{
-		data = COM_Parse (data);
-		if (!com_token[0])
-			break;		// end of file
-		if (strcmp(com_token,"{"))
+		entnum = -1;		// -1 is the globals
+		while (*data)
 		{
-			Host_Error ("First token isn't a brace");
-		}
-
-		if (entnum == -1)
-		{	// parse the global vars
-			data = ED_ParseGlobals (data);
-		}
-		else
-		{	// parse an edict
-			ent = EDICT_NUM(entnum);
-			if (entnum < qcvm->num_edicts)
+			data = COM_Parse (data);
+			if (!com_token[0])
+				break;		// end of file
+			if (strcmp(com_token,"{"))
 			{
-				ED_ClearEdict (ent);
+				Host_Error ("First token isn't a brace");
+			}
+
+			if (entnum == -1)
+			{	// parse the global vars
+				data = ED_ParseGlobals (data);
 			}
 			else
-			{
-				memset (ent, 0, qcvm->edict_size);
-				ent->baseline.scale = ENTSCALE_DEFAULT;
+			{	// parse an edict
+				ent = EDICT_NUM(entnum);
+				if (entnum < qcvm->num_edicts)
+				{
+					ED_ClearEdict (ent);
+				}
+				else
+				{
+					memset (ent, 0, qcvm->edict_size);
+					ent->baseline.scale = ENTSCALE_DEFAULT;
+				}
+				data = ED_ParseEdict (data, ent);
+
+				// link it into the bsp tree
+				if (!ent->free)
+					SV_LinkEdict (ent, false);
 			}
-			data = ED_ParseEdict (data, ent);
 
-			// link it into the bsp tree
-			if (!ent->free)
-				SV_LinkEdict (ent, false);
+			entnum++;
 		}
-
-		entnum++;
 	}
 
 	// Free edicts allocated during map loading but no longer used after restoring saved game state
@@ -2695,6 +2792,9 @@ static void Host_Loadgame_f (void)
 	qcvm->time = time;
 	sv.autosave.time = time;
 
+	save_restoretime = Sys_DoubleTime () - restorestart;
+	Con_DPrintf ("Restored %d edicts in %.1f ms\n", entnum, save_restoretime * 1000.0);
+
 	free (start);
 	start = NULL;
 
@@ -2715,6 +2815,95 @@ static void Host_Loadgame_f (void)
 		IN_Activate(); // moved to here from M_Load_Key()
 }
 
+/*
+===============
+Host_SaveBenchmark_f
+
+Saves the current game in both formats on the main thread, loads each one
+back and prints how long every step took
+===============
+*/
+static void Host_SaveBenchmark_f (void)
+{
+	static const char *const formats[2] = {"text", "binary"};
+	char		relname[2][MAX_QPATH];
+	char		name[2][MAX_OSPATH];
+	char		lastsave[MAX_OSPATH];
+	double		time, filltime[2], writetime[2], restoretime[2];
+	long		size[2];
+	size_t		copied[2], total[2];
+	savedata_t	*save;
+	FILE		*f;
+	int			i;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (!Host_CanSave ())
+		return;
+
+	Host_WaitForSaveThread ();
+	save = &save_slots[0];
+	q_strlcpy (lastsave, sv.lastsave, sizeof (lastsave));
+
+	for (i = 0; i < 2; i++)
+	{
+		q_snprintf (relname[i], sizeof (relname[i]), "save_benchmark_%s.sav", formats[i]);
+		q_snprintf (name[i], sizeof (name[i]), "%s/%s", com_gamedir, relname[i]);
+		f = Sys_fopen (name[i], i ? "wb" : "w");
+		if (!f)
+		{
+			Con_Printf ("ERROR: couldn't open %s.\n", name[i]);
+			return;
+		}
+
+		save->file = f;
+		save->binary = i != 0;
+		save->abort.value = 0;
+
+		PR_SwitchQCVM (&sv.qcvm);
+		time = Sys_DoubleTime ();
+		SaveData_Fill (save);
+		filltime[i] = Sys_DoubleTime () - time;
+		copied[i] = save->copiedbytes;
+		total[i] = save->totalbytes;
+		time = Sys_DoubleTime ();
+		Host_WriteSave (save);
+		fflush (f);
+		writetime[i] = Sys_DoubleTime () - time;
+		PR_SwitchQCVM (NULL);
+
+		size[i] = ftell (f);
+		fclose (f);
+		save->file = NULL;
+
+		if (save->abort.value)
+		{
+			Con_Printf ("Save error.\n");
+			for (; i >= 0; i--)
+				Sys_remove (name[i]);
+			return;
+		}
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		save_restoretime = 0.0;
+		Cmd_ExecuteString (va ("load \"%s\"", relname[i]), src_command);
+		restoretime[i] = save_restoretime;
+	}
+
+	for (i = 0; i < 2; i++)
+		Sys_remove (name[i]);
+	q_strlcpy (sv.lastsave, lastsave, sizeof (sv.lastsave));
+
+	Con_Printf ("format      size   snapshot      write    restore   edicts copied\n");
+	for (i = 0; i < 2; i++)
+		Con_Printf ("%-6s %7.0f KB %7.2f ms %7.2f ms %7.2f ms %5.0f/%.0f KB\n", formats[i],
+			size[i] / 1024.0, filltime[i] * 1000.0, writetime[i] * 1000.0, restoretime[i] * 1000.0,
+			copied[i] / 1024.0, total[i] / 1024.0);
+}
+
 //============================================================================
 
 /*
@@ -3788,6 +3977,7 @@ void Host_InitCommands (void)
 	Cmd_AddCommand_ClientCommand ("ping", Host_Ping_f);
 	Cmd_AddCommand ("load", Host_Loadgame_f);
 	Cmd_AddCommand ("save", Host_Savegame_f);
+	Cmd_AddCommand ("save_benchmark", Host_SaveBenchmark_f);
 	Cmd_AddCommand_ClientCommand ("give", Host_Give_f);
 
 	Cmd_AddCommand ("startdemos", Host_Startdemos_f);
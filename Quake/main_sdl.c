@@ -114,6 +114,37 @@ static double Sys_Throttle (double oldtime)
 	return Sys_WaitUntil (oldtime + Host_GetFrameInterval ());
 }
 
+/*
+==================
+Sys_WaitForTick
+
+Event-driven wait for dedicated servers. sys_ticrate, or the frame rate
+limit if that is longer, is always the minimum time between ticks, so the
+simulation rate and bandwidth don't depend on traffic. An empty server ticks less often so that it stays idle, but once
+sys_ticrate has passed it sleeps on the network sockets and wakes up as soon
+as a packet arrives, so new clients don't wait for the slow idle tick.
+==================
+*/
+#define IDLE_TICRATE	0.1
+
+static void Sys_WaitForTick (double elapsed)
+{
+	double tick = q_max (sys_ticrate.value, Host_GetFrameInterval ());
+	double maxtime = tick;
+
+	if (!net_activeconnections)
+		maxtime = q_max (maxtime, IDLE_TICRATE);
+
+	if (elapsed < tick)
+	{
+		SDL_Delay ((Uint32) ceil ((tick - elapsed) * 1000.0));
+		elapsed = tick;
+	}
+
+	if (elapsed < maxtime)
+		NET_Sleep (maxtime - elapsed);
+}
+
 #define DEFAULT_MEMORY (384 * 1024 * 1024) // ericw -- was 72MB (64-bit) / 64MB (32-bit)
 
 static quakeparms_t	parms;
@@ -171,6 +202,15 @@ int main(int argc, char *argv[])
 			newtime = Sys_DoubleTime ();
 			time = newtime - oldtime;
 
+			if (sys_eventloop.value)
+			{
+				Sys_WaitForTick (time);
+				newtime = Sys_DoubleTime ();
+				Host_Frame (newtime - oldtime);
+				oldtime = newtime;
+				continue;
+			}
+
 			while (time < sys_ticrate.value )
 			{
 				SDL_Delay(1);
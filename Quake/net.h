@@ -90,6 +90,15 @@ void	NET_Close (struct qsocket_s *sock);
 
 void	NET_Poll (void);
 
+void	NET_BeginBatch (void);
+void	NET_EndBatch (void);
+// Datagrams written in between are queued and sent together where the lan
+// drivers support it
+
+qboolean NET_Sleep (double timeout);
+// Blocks until a packet arrives on one of the open sockets or the timeout
+// (in seconds) runs out, for dedicated servers that have nothing else to do
+
 
 // Server list related globals:
 extern	qboolean	slistInProgress;
@@ -89,7 +89,11 @@ net_landriver_t	net_landrivers[] =
 		UDP_GetAddrFromName,
 		UDP_AddrCompare,
 		UDP_GetSocketPort,
-		UDP_SetSocketPort
+		UDP_SetSocketPort,
+		UDP_GetAcceptSocket,
+		UDP_GetSystemSocket,
+		UDP_SetBatching,
+		UDP_HasPending
 	}
 };
 
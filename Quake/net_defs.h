@@ -186,6 +186,10 @@ typedef struct
 	int		(*AddrCompare) (struct qsockaddr *addr1, struct qsockaddr *addr2);
 	int		(*GetSocketPort) (struct qsockaddr *addr);
 	int		(*SetSocketPort) (struct qsockaddr *addr, int port);
+	sys_socket_t	(*GetAcceptSocket) (void);
+	sys_socket_t	(*GetSystemSocket) (sys_socket_t socketid);
+	void		(*SetBatching) (qboolean enable);
+	qboolean	(*HasPending) (void);	// datagrams already read from a socket but not handed out
 } net_landriver_t;
 
 #define	MAX_NET_DRIVERS		8
@@ -684,6 +684,8 @@ int NET_SendToAll (sizebuf_t *data, double blocktime)
 	qboolean	msg_init[MAX_SCOREBOARD];	/* did we write the message to the client's connection	*/
 	qboolean	msg_sent[MAX_SCOREBOARD];	/* did the msg arrive its destination (canSend state).	*/
 
+	NET_EndBatch ();	/* this waits for the acks, so nothing can sit in a queue */
+
 	for (i = 0, host_client = svs.clients; i < svs.maxclients; i++, host_client++)
 	{
 		/*
@@ -874,6 +876,116 @@ void NET_Shutdown (void)
 }
 
 
+/*
+====================
+NET_BeginBatch
+====================
+*/
+void NET_BeginBatch (void)
+{
+	int	i;
+
+	for (i = 0; i < net_numlandrivers; i++)
+		if (net_landrivers[i].initialized)
+			net_landrivers[i].SetBatching (true);
+}
+
+/*
+====================
+NET_EndBatch
+====================
+*/
+void NET_EndBatch (void)
+{
+	int	i;
+
+	for (i = 0; i < net_numlandrivers; i++)
+		if (net_landrivers[i].initialized)
+			net_landrivers[i].SetBatching (false);
+}
+
+/*
+====================
+NET_AddSleepSocket
+====================
+*/
+static qboolean NET_AddSleepSocket (fd_set *set, int *count, sys_socket_t *maxsock, int landriver, sys_socket_t socketid)
+{
+	sys_socket_t	s;
+
+	if (socketid == INVALID_SOCKET)
+		return false;
+	s = net_landrivers[landriver].GetSystemSocket (socketid);
+	if (s == INVALID_SOCKET)
+		return false;
+#if defined(PLATFORM_WINDOWS)
+	if (*count >= FD_SETSIZE)	// winsock counts sockets, not descriptors
+		return false;
+#else
+	if (s >= FD_SETSIZE)
+		return false;
+#endif
+
+	FD_SET (s, set);
+	if (*count == 0 || s > *maxsock)
+		*maxsock = s;
+	(*count)++;
+	return true;
+}
+
+/*
+====================
+NET_Sleep
+
+Blocks until a datagram arrives on the accept or connection sockets of the
+lan drivers, or until timeout seconds have passed.  Returns true if there's
+something to read, right away if a driver still holds datagrams from an
+earlier batched read.
+====================
+*/
+qboolean NET_Sleep (double timeout)
+{
+	fd_set		set;
+	struct timeval	tv;
+	sys_socket_t	maxsock = 0;
+	int		i, count = 0;
+	qsocket_t	*s;
+
+	if (timeout < 0.0)
+		timeout = 0.0;
+
+	for (i = 0; i < net_numlandrivers; i++)
+		if (net_landrivers[i].initialized && net_landrivers[i].HasPending ())
+			return true;
+
+	FD_ZERO (&set);
+	for (i = 0; i < net_numlandrivers; i++)
+	{
+		if (!net_landrivers[i].initialized)
+			continue;
+		NET_AddSleepSocket (&set, &count, &maxsock, i, net_landrivers[i].controlSock);
+		NET_AddSleepSocket (&set, &count, &maxsock, i, net_landrivers[i].GetAcceptSocket ());
+	}
+	for (s = net_activeSockets; s; s = s->next)
+	{
+		if (IS_LOOP_DRIVER(s->driver) || s->disconnected)
+			continue;
+		NET_AddSleepSocket (&set, &count, &maxsock, s->landriver, s->socket);
+	}
+
+	if (!count)
+	{	// nothing to wait on
+		Sys_Sleep ((unsigned long)(timeout * 1000.0));
+		return false;
+	}
+
+	tv.tv_sec = (long) timeout;
+	tv.tv_usec = (long) ((timeout - tv.tv_sec) * 1000000.0);
+
+	return selectsocket ((int)maxsock + 1, &set, NULL, NULL, &tv) > 0;
+}
+
+
 static PollProcedure *pollProcedureList = NULL;
 
 void NET_Poll(void)
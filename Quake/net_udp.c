@@ -20,12 +20,20 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* for recvmmsg and sendmmsg */
+#endif
+
 #include "q_stdinc.h"
 #include "arch_def.h"
 #include "net_sys.h"
 #include "quakedef.h"
 #include "net_defs.h"
 
+#if defined(__linux__)
+#define USE_MMSG
+#endif
+
 static sys_socket_t net_acceptsocket = INVALID_SOCKET;	// socket for fielding new connections
 static sys_socket_t net_controlsocket;
 static sys_socket_t net_broadcastsocket = 0;
@@ -35,6 +43,50 @@ static in_addr_t	myAddr;
 
 #include "net_udp.h"
 
+/*
+Batched I/O: a read drains up to UDP_RECV_BATCH datagrams from a socket with
+a single recvmmsg and hands them out one at a time.  Only one socket can have
+datagrams waiting at once; reads from any other socket meanwhile go straight
+to recvfrom.  While batching is enabled, writes are queued and sent with one
+sendmmsg per socket when it gets disabled again.  Without recvmmsg/sendmmsg
+everything goes through recvfrom/sendto as before.
+*/
+#define UDP_RECV_BATCH		16
+#define UDP_SEND_BATCH		64
+#define UDP_SEND_BUFSIZE	(256 * 1024)
+
+typedef struct
+{
+	sys_socket_t		socket;		// owner of the waiting datagrams
+	int			count;
+	int			next;
+	byte			*data;		// UDP_RECV_BATCH * NET_DATAGRAMSIZE bytes
+#ifdef USE_MMSG
+	struct mmsghdr		msgs[UDP_RECV_BATCH];
+	struct iovec		iov[UDP_RECV_BATCH];
+	struct qsockaddr	from[UDP_RECV_BATCH];
+#endif
+} udprecvbatch_t;
+
+typedef struct
+{
+	qboolean		active;
+	int			count;
+	int			used;
+	sys_socket_t		sockets[UDP_SEND_BATCH];
+	struct qsockaddr	to[UDP_SEND_BATCH];
+	int			offsets[UDP_SEND_BATCH];
+	int			lengths[UDP_SEND_BATCH];
+	byte			data[UDP_SEND_BUFSIZE];
+} udpsendbatch_t;
+
+static udprecvbatch_t	udp_recv;
+static udpsendbatch_t	udp_send;
+static qboolean		udp_nommsg;	// set when the kernel turns out not to support them
+
+static void UDP_FlushWrites (void);
+static void UDP_Bench_f (void);
+
 //=============================================================================
 
 sys_socket_t UDP_Init (void)
@@ -118,6 +170,8 @@ sys_socket_t UDP_Init (void)
 	tst = strrchr(my_tcpip_address, ':');
 	if (tst) *tst = 0;
 
+	Cmd_AddCommand ("udp_bench", UDP_Bench_f);
+
 	Con_SafePrintf("UDP Initialized\n");
 	tcpipAvailable = true;
 
@@ -192,6 +246,12 @@ int UDP_CloseSocket (sys_socket_t socketid)
 {
 	if (socketid == net_broadcastsocket)
 		net_broadcastsocket = 0;
+	// don't lose queued datagrams, and don't hand out stale ones once the
+	// descriptor gets reused
+	if (udp_send.count)
+		UDP_FlushWrites ();
+	if (udp_recv.socket == socketid)
+		udp_recv.count = udp_recv.next = 0;
 	return closesocket (socketid);
 }
 
@@ -270,6 +330,10 @@ sys_socket_t UDP_CheckNewConnections (void)
 	if (net_acceptsocket == INVALID_SOCKET)
 		return INVALID_SOCKET;
 
+	// datagrams already pulled in by a batched read don't show up in FIONREAD
+	if (udp_recv.socket == net_acceptsocket && udp_recv.next < udp_recv.count)
+		return net_acceptsocket;
+
 	if (ioctl (net_acceptsocket, FIONREAD, &available) == -1)
 	{
 		int err = SOCKETERRNO;
@@ -284,7 +348,7 @@ sys_socket_t UDP_CheckNewConnections (void)
 
 //=============================================================================
 
-int UDP_Read (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
+static int UDP_ReadSingle (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
 {
 	socklen_t addrlen = sizeof(struct qsockaddr);
 	int ret;
@@ -300,6 +364,72 @@ int UDP_Read (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
 	return ret;
 }
 
+int UDP_Read (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
+{
+#ifdef USE_MMSG
+	udprecvbatch_t	*b = &udp_recv;
+	struct mmsghdr	*m;
+	int		i, ret;
+
+	if (b->next < b->count)
+	{
+		if (b->socket != socketid)	// another socket's datagrams are still waiting
+			return UDP_ReadSingle (socketid, buf, len, addr);
+	}
+	else if (!udp_nommsg)
+	{
+		if (!b->data)
+		{
+			b->data = (byte *) malloc (UDP_RECV_BATCH * NET_DATAGRAMSIZE);
+			if (!b->data)
+				Sys_Error ("UDP_Read: out of memory");
+		}
+		for (i = 0; i < UDP_RECV_BATCH; i++)
+		{
+			b->iov[i].iov_base = b->data + i * NET_DATAGRAMSIZE;
+			b->iov[i].iov_len = NET_DATAGRAMSIZE;
+			memset (&b->msgs[i], 0, sizeof (b->msgs[i]));
+			b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+			b->msgs[i].msg_hdr.msg_iovlen = 1;
+			b->msgs[i].msg_hdr.msg_name = &b->from[i];
+			b->msgs[i].msg_hdr.msg_namelen = sizeof (b->from[i]);
+		}
+
+		ret = recvmmsg (socketid, b->msgs, UDP_RECV_BATCH, 0, NULL);
+		if (ret == SOCKET_ERROR)
+		{
+			int err = SOCKETERRNO;
+			if (err == ENOSYS)
+			{
+				udp_nommsg = true;
+				return UDP_ReadSingle (socketid, buf, len, addr);
+			}
+			if (err == NET_EWOULDBLOCK || err == NET_ECONNREFUSED)
+				return 0;
+			Con_SafePrintf ("UDP_Read, recvmmsg: %s\n", socketerror(err));
+			return ret;
+		}
+		if (ret == 0)
+			return 0;
+
+		b->socket = socketid;
+		b->count = ret;
+		b->next = 0;
+	}
+	else
+		return UDP_ReadSingle (socketid, buf, len, addr);
+
+	m = &b->msgs[b->next++];
+	ret = q_min ((int) m->msg_len, len);
+	memcpy (buf, b->iov[m - b->msgs].iov_base, ret);
+	memset (addr, 0, sizeof (struct qsockaddr));
+	memcpy (addr, m->msg_hdr.msg_name, q_min (m->msg_hdr.msg_namelen, sizeof (struct qsockaddr)));
+	return ret;
+#else
+	return UDP_ReadSingle (socketid, buf, len, addr);
+#endif
+}
+
 //=============================================================================
 
 static int UDP_MakeSocketBroadcastCapable (sys_socket_t socketid)
@@ -342,7 +472,7 @@ int UDP_Broadcast (sys_socket_t socketid, byte *buf, int len)
 
 //=============================================================================
 
-int UDP_Write (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
+static int UDP_WriteSingle (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
 {
 	int	ret;
 
@@ -358,6 +488,113 @@ int UDP_Write (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr
 	return ret;
 }
 
+#ifdef USE_MMSG
+static void UDP_SendBatch (sys_socket_t socketid, struct mmsghdr *msgs, int count)
+{
+	int	sent = 0, ret;
+
+	while (sent < count && !udp_nommsg)
+	{
+		ret = sendmmsg (socketid, msgs + sent, count - sent, 0);
+		if (ret == SOCKET_ERROR)
+		{
+			int err = SOCKETERRNO;
+			if (err == ENOSYS)
+			{
+				udp_nommsg = true;
+				break;
+			}
+			if (err != NET_EWOULDBLOCK)
+				Con_SafePrintf ("UDP_Write, sendmmsg: %s\n", socketerror(err));
+			sent++;	// drop the datagram that failed, as sendto would have
+			continue;
+		}
+		sent += ret;
+	}
+
+	for (; sent < count; sent++)
+		UDP_WriteSingle (socketid, (byte *) msgs[sent].msg_hdr.msg_iov->iov_base, msgs[sent].msg_hdr.msg_iov->iov_len,
+			(struct qsockaddr *) msgs[sent].msg_hdr.msg_name);
+}
+#endif
+
+static void UDP_FlushWrites (void)
+{
+#ifdef USE_MMSG
+	udpsendbatch_t	*q = &udp_send;
+	struct mmsghdr	msgs[UDP_SEND_BATCH];
+	struct iovec	iov[UDP_SEND_BATCH];
+	qboolean	done[UDP_SEND_BATCH];
+	int		i, j, count;
+
+	memset (done, 0, sizeof (done));
+	for (i = 0; i < q->count; i++)
+	{
+		if (done[i])
+			continue;
+
+	// gather everything queued for this socket, keeping the order
+		for (j = i, count = 0; j < q->count; j++)
+		{
+			if (done[j] || q->sockets[j] != q->sockets[i])
+				continue;
+			iov[count].iov_base = q->data + q->offsets[j];
+			iov[count].iov_len = q->lengths[j];
+			memset (&msgs[count], 0, sizeof (msgs[count]));
+			msgs[count].msg_hdr.msg_iov = &iov[count];
+			msgs[count].msg_hdr.msg_iovlen = 1;
+			msgs[count].msg_hdr.msg_name = &q->to[j];
+			msgs[count].msg_hdr.msg_namelen = sizeof (struct qsockaddr);
+			done[j] = true;
+			count++;
+		}
+		UDP_SendBatch (q->sockets[i], msgs, count);
+	}
+
+	q->count = 0;
+	q->used = 0;
+#endif
+}
+
+int UDP_Write (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
+{
+#ifdef USE_MMSG
+	udpsendbatch_t	*q = &udp_send;
+
+	if (q->active && !udp_nommsg && len <= UDP_SEND_BUFSIZE)
+	{
+		if (q->count == UDP_SEND_BATCH || q->used + len > UDP_SEND_BUFSIZE)
+			UDP_FlushWrites ();
+		q->sockets[q->count] = socketid;
+		q->to[q->count] = *addr;
+		q->offsets[q->count] = q->used;
+		q->lengths[q->count] = len;
+		memcpy (q->data + q->used, buf, len);
+		q->used += len;
+		q->count++;
+		return len;
+	}
+#endif
+	return UDP_WriteSingle (socketid, buf, len, addr);
+}
+
+//=============================================================================
+
+void UDP_SetBatching (qboolean enable)
+{
+#ifdef USE_MMSG
+	if (!enable && udp_send.count)
+		UDP_FlushWrites ();
+	udp_send.active = enable;
+#endif
+}
+
+qboolean UDP_HasPending (void)
+{
+	// select() can't see what a batched read already pulled in
+	return udp_recv.next < udp_recv.count;
+}
+
 //=============================================================================
 
 const char *UDP_AddrToString (struct qsockaddr *addr)
@@ -478,3 +715,117 @@ int UDP_SetSocketPort (struct qsockaddr *addr, int port)
 
 //=============================================================================
 
+sys_socket_t UDP_GetAcceptSocket (void)
+{
+	return net_acceptsocket;
+}
+
+
+sys_socket_t UDP_GetSystemSocket (sys_socket_t socketid)
+{
+	return socketid;
+}
+
+//=============================================================================
+
+/*
+============
+UDP_BenchRun
+
+Sends bursts of size byte datagrams from src to dst, reading each burst back
+before the next one, and returns the number received per second
+============
+*/
+static double UDP_BenchRun (sys_socket_t src, sys_socket_t dst, struct qsockaddr *to, int packets, int size, qboolean batched, int *received)
+{
+	static byte	buf[NET_DATAGRAMSIZE];
+	struct qsockaddr	from;
+	double		start, elapsed;
+	int		i, count, sent, got;
+
+	memset (buf, 0x55, size);
+	start = Sys_DoubleTime ();
+	for (sent = got = 0; sent < packets; sent += count)
+	{
+		count = q_min (UDP_SEND_BATCH / 2, packets - sent);
+		if (batched)
+		{
+			UDP_SetBatching (true);
+			for (i = 0; i < count; i++)
+				UDP_Write (src, buf, size, to);
+			UDP_SetBatching (false);
+			while (UDP_Read (dst, buf, sizeof (buf), &from) > 0)
+				got++;
+		}
+		else
+		{
+			for (i = 0; i < count; i++)
+				UDP_WriteSingle (src, buf, size, to);
+			while (UDP_ReadSingle (dst, buf, sizeof (buf), &from) > 0)
+				got++;
+		}
+	}
+	elapsed = Sys_DoubleTime () - start;
+
+	*received = got;
+	return elapsed > 0.0 ? got / elapsed : 0.0;
+}
+
+/*
+============
+UDP_Bench_f
+
+Compares the plain and batched paths over loopback
+udp_bench [packets] [size]
+============
+*/
+static void UDP_Bench_f (void)
+{
+	sys_socket_t	src, dst;
+	struct qsockaddr	to;
+	socklen_t	addrlen = sizeof (to);
+	int		packets, size, got_single, got_batched;
+	double		single, batched;
+
+	packets = Cmd_Argc () > 1 ? Q_atoi (Cmd_Argv (1)) : 100000;
+	size = Cmd_Argc () > 2 ? Q_atoi (Cmd_Argv (2)) : 64;
+	packets = q_max (packets, 1);
+	size = CLAMP (1, size, 1400);
+
+	src = UDP_OpenSocket (0);
+	if (src == INVALID_SOCKET)
+		return;
+	dst = UDP_OpenSocket (0);
+	if (dst == INVALID_SOCKET)
+	{
+		UDP_CloseSocket (src);
+		return;
+	}
+
+	if (getsockname (dst, (struct sockaddr *)&to, &addrlen) != 0)
+	{
+		int err = SOCKETERRNO;
+		Con_Printf ("udp_bench: getsockname: %s\n", socketerror(err));
+	}
+	else
+	{
+		((struct sockaddr_in *)&to)->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		single = UDP_BenchRun (src, dst, &to, packets, size, false, &got_single);
+		batched = UDP_BenchRun (src, dst, &to, packets, size, true, &got_batched);
+
+		Con_Printf ("%d datagrams of %d bytes over loopback:\n", packets, size);
+		Con_Printf ("  sendto/recvfrom:   %9.0f packets/s (%d received)\n", single, got_single);
+#ifdef USE_MMSG
+		Con_Printf ("  sendmmsg/recvmmsg: %9.0f packets/s (%d received)%s\n", batched, got_batched,
+			udp_nommsg ? ", not supported by the kernel" : "");
+#else
+		Con_Printf ("  batched:           %9.0f packets/s (%d received), not supported on this platform\n", batched, got_batched);
+#endif
+	}
+
+	UDP_CloseSocket (dst);
+	UDP_CloseSocket (src);
+}
+
+//=============================================================================
@@ -40,6 +40,10 @@ int  UDP_GetAddrFromName (const char *name, struct qsockaddr *addr);
 int  UDP_AddrCompare (struct qsockaddr *addr1, struct qsockaddr *addr2);
 int  UDP_GetSocketPort (struct qsockaddr *addr);
 int  UDP_SetSocketPort (struct qsockaddr *addr, int port);
+sys_socket_t  UDP_GetAcceptSocket (void);
+sys_socket_t  UDP_GetSystemSocket (sys_socket_t socketid);
+void UDP_SetBatching (qboolean enable);
+qboolean UDP_HasPending (void);
 
 #endif	/* __net_udp_h */
 
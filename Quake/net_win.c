@@ -91,7 +91,11 @@ net_landriver_t	net_landrivers[] =
 		WINS_GetAddrFromName,
 		WINS_AddrCompare,
 		WINS_GetSocketPort,
-		WINS_SetSocketPort
+		WINS_SetSocketPort,
+		WINS_GetAcceptSocket,
+		WINS_GetSystemSocket,
+		WINS_SetBatching,
+		WINS_HasPending
 	},
 
 	{	"Winsock IPX",
@@ -114,7 +118,11 @@ net_landriver_t	net_landrivers[] =
 		WIPX_GetAddrFromName,
 		WIPX_AddrCompare,
 		WIPX_GetSocketPort,
-		WIPX_SetSocketPort
+		WIPX_SetSocketPort,
+		WIPX_GetAcceptSocket,
+		WIPX_GetSystemSocket,
+		WIPX_SetBatching,
+		WIPX_HasPending
 	}
 };
 
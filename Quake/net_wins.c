@@ -542,3 +542,28 @@ int WINS_SetSocketPort (struct qsockaddr *addr, int port)
 
 //=============================================================================
 
+sys_socket_t WINS_GetAcceptSocket (void)
+{
+	return net_acceptsocket;
+}
+
+
+sys_socket_t WINS_GetSystemSocket (sys_socket_t socketid)
+{
+	return socketid;
+}
+
+//=============================================================================
+
+void WINS_SetBatching (qboolean enable)
+{
+	// no batched calls in winsock, writes always go out right away
+}
+
+qboolean WINS_HasPending (void)
+{
+	return false;	// reads aren't batched either
+}
+
+//=============================================================================
+
@@ -40,6 +40,10 @@ int  WINS_GetAddrFromName (const char *name, struct qsockaddr *addr);
 int  WINS_AddrCompare (struct qsockaddr *addr1, struct qsockaddr *addr2);
 int  WINS_GetSocketPort (struct qsockaddr *addr);
 int  WINS_SetSocketPort (struct qsockaddr *addr, int port);
+sys_socket_t  WINS_GetAcceptSocket (void);
+sys_socket_t  WINS_GetSystemSocket (sys_socket_t socketid);
+void WINS_SetBatching (qboolean enable);
+qboolean WINS_HasPending (void);
 
 #endif	/* __NET_WINSOCK_H */
 
@@ -446,3 +446,30 @@ int WIPX_SetSocketPort (struct qsockaddr *addr, int port)
 
 //=============================================================================
 
+sys_socket_t WIPX_GetAcceptSocket (void)
+{
+	return net_acceptsocket;
+}
+
+
+sys_socket_t WIPX_GetSystemSocket (sys_socket_t handle)
+{
+	if (handle == INVALID_SOCKET || ipxsocket[handle] == 0)
+		return INVALID_SOCKET;
+	return ipxsocket[handle];
+}
+
+//=============================================================================
+
+void WIPX_SetBatching (qboolean enable)
+{
+	// no batched calls in winsock, writes always go out right away
+}
+
+qboolean WIPX_HasPending (void)
+{
+	return false;	// reads aren't batched either
+}
+
+//=============================================================================
+
@@ -40,6 +40,10 @@ int  WIPX_GetAddrFromName (const char *name, struct qsockaddr *addr);
 int  WIPX_AddrCompare (struct qsockaddr *addr1, struct qsockaddr *addr2);
 int  WIPX_GetSocketPort (struct qsockaddr *addr);
 int  WIPX_SetSocketPort (struct qsockaddr *addr, int port);
+sys_socket_t  WIPX_GetAcceptSocket (void);
+sys_socket_t  WIPX_GetSystemSocket (sys_socket_t socketid);
+void WIPX_SetBatching (qboolean enable);
+qboolean WIPX_HasPending (void);
 
 #endif	/* __NET_WINIPX_H */
 
@@ -972,41 +972,91 @@ Returns a chain of entities that have origins within a spherical area
 findradius (origin, radius)
 =================
 */
+cvar_t sv_fastfindradius = {"sv_fastfindradius", "1", CVAR_NONE};
+
+static qboolean PF_InRadius (edict_t *ent, const float *org, float radsq)
+{
+	float d, lensq;
+
+	if (ent->free)
+		return false;
+	if (ent->v.solid == SOLID_NOT)
+		return false;
+
+	d = org[0] - (ent->v.origin[0] + (ent->v.mins[0] + ent->v.maxs[0]) * 0.5);
+	lensq = d * d;
+	if (lensq > radsq)
+		return false;
+	d = org[1] - (ent->v.origin[1] + (ent->v.mins[1] + ent->v.maxs[1]) * 0.5);
+	lensq += d * d;
+	if (lensq > radsq)
+		return false;
+	d = org[2] - (ent->v.origin[2] + (ent->v.mins[2] + ent->v.maxs[2]) * 0.5);
+	lensq += d * d;
+	if (lensq > radsq)
+		return false;
+
+	return true;
+}
+
+static int PF_CompareEdicts (const void *pa, const void *pb)
+{
+	const edict_t *a = *(const edict_t **) pa;
+	const edict_t *b = *(const edict_t **) pb;
+	return (a > b) - (a < b);
+}
+
 static void PF_findradius (void)
 {
 	edict_t	*ent, *chain;
+	edict_t	**list;
 	float	rad;
 	float	*org;
-	int		i;
+	vec3_t	mins, maxs;
+	int		i, count, mark;
 
 	chain = (edict_t *)qcvm->edicts;
 
 	org = G_VECTOR(OFS_PARM0);
 	rad = G_FLOAT(OFS_PARM1);
+
+	// walk the area nodes instead of all the edicts,
+	// sorting the candidates so the chain has the same order as a full scan
+	if (sv_fastfindradius.value && rad == rad)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			mins[i] = org[i] - fabs (rad);
+			maxs[i] = org[i] + fabs (rad);
+		}
+		rad *= rad;
+
+		mark = Hunk_LowMark ();
+		list = (edict_t **) Hunk_AllocNoFill (qcvm->num_edicts * sizeof (edict_t *));
+		count = SV_AreaEdicts (mins, maxs, list, qcvm->num_edicts);
+		qsort (list, count, sizeof (*list), PF_CompareEdicts);
+
+		for (i = 0; i < count; i++)
+		{
+			ent = list[i];
+			if (!PF_InRadius (ent, org, rad))
+				continue;
+			ent->v.chain = EDICT_TO_PROG(chain);
+			chain = ent;
+		}
+
+		Hunk_FreeToLowMark (mark);
+		RETURN_EDICT(chain);
+		return;
+	}
+
 	rad *= rad;
 
 	ent = NEXT_EDICT(qcvm->edicts);
 	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
 	{
-		float d, lensq;
-		if (ent->free)
-			continue;
-		if (ent->v.solid == SOLID_NOT)
-			continue;
-
-		d = org[0] - (ent->v.origin[0] + (ent->v.mins[0] + ent->v.maxs[0]) * 0.5);
-		lensq = d * d;
-		if (lensq > rad)
-			continue;
-		d = org[1] - (ent->v.origin[1] + (ent->v.mins[1] + ent->v.maxs[1]) * 0.5);
-		lensq += d * d;
-		if (lensq > rad)
+		if (!PF_InRadius (ent, org, rad))
 			continue;
-		d = org[2] - (ent->v.origin[2] + (ent->v.mins[2] + ent->v.maxs[2]) * 0.5);
-		lensq += d * d;
-		if (lensq > rad)
-			continue;
-
 		ent->v.chain = EDICT_TO_PROG(chain);
 		chain = ent;
 	}
@@ -1072,6 +1122,278 @@ static void PF_Remove (void)
 }
 
 
+/*
+=================
+find() index
+
+Hash index over the string fields in FINDINDEX_FIELDS, so that
+find(e, targetname, "x") only has to look at entities whose value
+hashes the same way instead of comparing against every edict.
+
+Entries are refreshed lazily: the OP_STOREP_* opcodes (the only way QC
+can write to an entity field), ED_ClearEdict and ED_ParseEdict mark an
+edict as dirty after the write, and dirty edicts are re-hashed on the
+next lookup. ED_Free unlinks.
+Values that live in the temp string buffers can change without a write,
+so those are kept on a separate chain that every lookup scans.
+=================
+*/
+cvar_t sv_fastfind = {"sv_fastfind", "1", CVAR_NONE};
+
+#define FINDINDEX_BUCKETS	1024	/* must be a power of 2 */
+#define FINDINDEX_VOLATILE	FINDINDEX_BUCKETS
+
+static const int findindex_fields[FINDINDEX_FIELDS] =
+{
+	offsetof (entvars_t, classname) / 4,
+	offsetof (entvars_t, target) / 4,
+	offsetof (entvars_t, targetname) / 4,
+};
+
+typedef struct prfindchain_s
+{
+	int			heads[FINDINDEX_BUCKETS + 1];	/* -1 terminated */
+	int			*next, *prev;
+	int			*bucket;						/* -1 if not linked */
+} prfindchain_t;
+
+typedef struct prfindindex_s
+{
+	edict_t			*edicts;		/* edict block the index was built for */
+	int				max_edicts;
+	int				numdirty;
+	int				*dirty;
+	byte			*isdirty;
+	prfindchain_t	chains[FINDINDEX_FIELDS];
+} prfindindex_t;
+
+static struct
+{
+	int64_t		hits;
+	int64_t		misses;
+} pr_findstats;
+
+static qboolean PR_IsTempString (const char *s)
+{
+	return s >= pr_string_temp[0] && s < pr_string_temp[STRINGTEMP_BUFFERS];
+}
+
+static void PR_FindChainUnlink (prfindchain_t *ch, int num)
+{
+	int b = ch->bucket[num];
+	if (b < 0)
+		return;
+	if (ch->prev[num] >= 0)
+		ch->next[ch->prev[num]] = ch->next[num];
+	else
+		ch->heads[b] = ch->next[num];
+	if (ch->next[num] >= 0)
+		ch->prev[ch->next[num]] = ch->prev[num];
+	ch->bucket[num] = -1;
+}
+
+static void PR_FindChainLink (prfindchain_t *ch, int num, int b)
+{
+	ch->bucket[num] = b;
+	ch->prev[num] = -1;
+	ch->next[num] = ch->heads[b];
+	if (ch->heads[b] >= 0)
+		ch->prev[ch->heads[b]] = num;
+	ch->heads[b] = num;
+}
+
+/*
+=================
+PR_FindIndexRehash
+=================
+*/
+static void PR_FindIndexRehash (prfindindex_t *idx, int num)
+{
+	edict_t		*ed = EDICT_NUM (num);
+	const char	*s;
+	int			i, b;
+
+	for (i = 0; i < FINDINDEX_FIELDS; i++)
+	{
+		prfindchain_t *ch = &idx->chains[i];
+		PR_FindChainUnlink (ch, num);
+		if (ed->free)
+			continue;
+		s = E_STRING (ed, findindex_fields[i]);
+		if (!s || !*s)
+			continue;	// empty searches are never indexed
+		if (PR_IsTempString (s))
+			b = FINDINDEX_VOLATILE;
+		else
+			b = COM_HashString (s) & (FINDINDEX_BUCKETS - 1);
+		PR_FindChainLink (ch, num, b);
+	}
+}
+
+/*
+=================
+PR_FindIndexFree
+=================
+*/
+void PR_FindIndexFree (void)
+{
+	free (qcvm->findindex);
+	qcvm->findindex = NULL;
+}
+
+/*
+=================
+PR_FindIndexBuild
+
+(Re)creates the index for the current edict block, with every edict dirty
+=================
+*/
+static prfindindex_t *PR_FindIndexBuild (void)
+{
+	prfindindex_t	*idx;
+	byte			*mem;
+	size_t			n = qcvm->max_edicts;
+	int				i;
+
+	PR_FindIndexFree ();
+
+	mem = (byte *) malloc (sizeof (*idx) + n * (sizeof (int) * (1 + 3 * FINDINDEX_FIELDS) + 1));
+	if (!mem)
+		Sys_Error ("PR_FindIndexBuild: out of memory (%d edicts)", qcvm->max_edicts);
+	idx = (prfindindex_t *) mem;
+	mem += sizeof (*idx);
+
+	idx->edicts = qcvm->edicts;
+	idx->max_edicts = qcvm->max_edicts;
+	idx->dirty = (int *) mem;
+	mem += n * sizeof (int);
+	for (i = 0; i < FINDINDEX_FIELDS; i++)
+	{
+		prfindchain_t *ch = &idx->chains[i];
+		memset (ch->heads, 0xff, sizeof (ch->heads));
+		ch->next = (int *) mem;
+		mem += n * sizeof (int);
+		ch->prev = (int *) mem;
+		mem += n * sizeof (int);
+		ch->bucket = (int *) mem;
+		mem += n * sizeof (int);
+		memset (ch->bucket, 0xff, n * sizeof (int));
+	}
+	idx->isdirty = mem;
+	memset (idx->isdirty, 1, qcvm->num_edicts);
+	memset (idx->isdirty + qcvm->num_edicts, 0, n - qcvm->num_edicts);
+
+	idx->numdirty = qcvm->num_edicts;
+	for (i = 0; i < qcvm->num_edicts; i++)
+		idx->dirty[i] = i;
+
+	qcvm->findindex = idx;
+	return idx;
+}
+
+/*
+=================
+PR_FindIndexTouch
+
+Called when an indexed field of ed may be about to change
+=================
+*/
+void PR_FindIndexTouch (edict_t *ed)
+{
+	prfindindex_t	*idx = qcvm->findindex;
+	int				num;
+
+	if (!idx)
+		return;
+	num = ((byte *)ed - (byte *)qcvm->edicts) / qcvm->edict_size;
+	if ((unsigned)num >= (unsigned)idx->max_edicts || idx->isdirty[num])
+		return;
+	idx->isdirty[num] = 1;
+	idx->dirty[idx->numdirty++] = num;
+}
+
+/*
+=================
+PR_FindIndexRemove
+=================
+*/
+void PR_FindIndexRemove (edict_t *ed)
+{
+	prfindindex_t	*idx = qcvm->findindex;
+	int				i, num;
+
+	if (!idx)
+		return;
+	num = ((byte *)ed - (byte *)qcvm->edicts) / qcvm->edict_size;
+	if ((unsigned)num >= (unsigned)idx->max_edicts)
+		return;
+	for (i = 0; i < FINDINDEX_FIELDS; i++)
+		PR_FindChainUnlink (&idx->chains[i], num);
+}
+
+/*
+=================
+PR_FindIndexLookup
+
+Returns the first edict after start whose field matches s, or NULL
+=================
+*/
+static edict_t *PR_FindIndexLookup (int field, int start, const char *s)
+{
+	prfindindex_t	*idx = qcvm->findindex;
+	prfindchain_t	*ch;
+	edict_t			*ed;
+	const char		*t;
+	int				i, e, b, best;
+
+	if (!idx || idx->edicts != qcvm->edicts || idx->max_edicts != qcvm->max_edicts)
+		idx = PR_FindIndexBuild ();
+
+	for (i = 0; i < idx->numdirty; i++)
+	{
+		e = idx->dirty[i];
+		idx->isdirty[e] = 0;
+		PR_FindIndexRehash (idx, e);
+	}
+	idx->numdirty = 0;
+
+	ch = &idx->chains[field];
+	best = qcvm->num_edicts;
+	for (b = COM_HashString (s) & (FINDINDEX_BUCKETS - 1); ; b = FINDINDEX_VOLATILE)
+	{
+		for (e = ch->heads[b]; e >= 0; e = ch->next[e])
+		{
+			if (e <= start || e >= best)
+				continue;
+			ed = EDICT_NUM (e);
+			if (ed->free)
+				continue;
+			t = E_STRING (ed, findindex_fields[field]);
+			if (t && !strcmp (t, s))
+				best = e;
+		}
+		if (b == FINDINDEX_VOLATILE)
+			break;
+	}
+
+	return best < qcvm->num_edicts ? EDICT_NUM (best) : NULL;
+}
+
+/*
+=================
+PR_FindStats_f
+=================
+*/
+void PR_FindStats_f (void)
+{
+	int64_t total = pr_findstats.hits + pr_findstats.misses;
+
+	Con_Printf ("find: %" SDL_PRIs64 " indexed, %" SDL_PRIs64 " full scans (%.1f%% indexed)\n",
+		pr_findstats.hits, pr_findstats.misses,
+		total ? pr_findstats.hits * 100.0 / total : 0.0);
+	memset (&pr_findstats, 0, sizeof (pr_findstats));
+}
+
 // entity (entity start, .string field, string match) find = #5;
 static void PF_Find (void)
 {
@@ -1086,6 +1408,24 @@ static void PF_Find (void)
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
 
+	if (sv_fastfind.value && *s)
+	{
+		int i;
+		for (i = 0; i < FINDINDEX_FIELDS; i++)
+		{
+			if (findindex_fields[i] == f)
+			{
+				pr_findstats.hits++;
+				ed = PR_FindIndexLookup (i, e, s);
+				if (!ed)
+					ed = qcvm->edicts;
+				RETURN_EDICT(ed);
+				return;
+			}
+		}
+	}
+	pr_findstats.misses++;
+
 	for (e++ ; e < qcvm->num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
@@ -184,6 +184,7 @@ void ED_ClearEdict (edict_t *e)
 	else
 		ED_RemoveFromFreeList (e);
 	memset (&e->v, 0, qcvm->progs->entityfields * 4);
+	PR_FindIndexTouch (e);
 }
 
 /*
@@ -221,6 +222,7 @@ edict_t *ED_Alloc (void)
 	e = EDICT_NUM(qcvm->num_edicts++);
 	memset(e, 0, qcvm->edict_size); // ericw -- switched sv.edicts to malloc(), so we are accessing uninitialized memory and must fully zero it, not just ED_ClearEdict
 	e->baseline.scale = ENTSCALE_DEFAULT;
+	PR_FindIndexTouch (e);
 
 	return e;
 }
@@ -237,6 +239,7 @@ void ED_Free (edict_t *ed)
 {
 	SV_UnlinkEdict (ed);		// unlink from world bsp
 	ED_AddToFreeList (ed);
+	PR_FindIndexRemove (ed);
 
 	ed->v.model = 0;
 	ed->v.takedamage = 0;
@@ -1412,6 +1415,8 @@ const char *ED_ParseEdict (const char *data, edict_t *ent)
 			Host_Error ("ED_ParseEdict: parse error");
 	}
 
+	PR_FindIndexTouch (ent);
+
 	if (!init)
 		ED_Free (ent);
 
@@ -1643,10 +1648,17 @@ void PR_ClearProgs(qcvm_t *vm)
 	qcvm = NULL;
 	PR_SwitchQCVM(vm);
 	PR_ShutdownExtensions();
+	PR_ProfileFree();
+	PR_FindIndexFree();
 
 	if (qcvm->knownstrings)
 		Z_Free ((void *)qcvm->knownstrings);
-	free(qcvm->edicts); // ericw -- sv.edicts switched to use malloc()
+	free(qcvm->edictpagegen);
+	free(qcvm->edictpagewrites);
+	if (qcvm->edictwatch.base)
+		Sys_WatchFree (&qcvm->edictwatch); // see SV_SpawnServer
+	else
+		free(qcvm->edicts); // ericw -- sv.edicts switched to use malloc()
 	if (qcvm->fielddefs != (ddef_t *)((byte *)qcvm->progs + qcvm->progs->ofs_fielddefs))
 		free(qcvm->fielddefs);
 	memset(qcvm, 0, sizeof(*qcvm));
@@ -2246,6 +2258,7 @@ qboolean PR_LoadProgs (const char *filename, qboolean fatal)
 	PR_FindEntityFields ();
 	PR_FindFunctionRanges ();
 	PR_FillOffsetTables ();
+	PR_DecodeProgs ();
 
 	qcvm->effects_mask = PR_FindSupportedEffects ();
 
@@ -2279,6 +2292,10 @@ void PR_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("pr_execstats", PR_ExecStats_f);
+	Cmd_AddCommand ("pr_findstats", PR_FindStats_f);
+	Cvar_RegisterVariable (&pr_fastexec);
+	PR_InitProfiler ();
 	Cvar_RegisterVariable (&nomonsters);
 	Cvar_SetCallback (&nomonsters, ED_Nomonsters_f);
 	Cvar_RegisterVariable (&gamecfg);
@@ -2439,10 +2456,55 @@ int PR_AllocString (int size, char **ptr)
 
 //===========================================================================
 
+static int	ed_writegen;	// never reset, so stale snapshots can't look up to date
+
+/*
+=============
+ED_CollectWrites
+
+Stamps the edict pages written since the last call with a new generation.
+Only the main thread writes to edicts, so nothing can slip in between.
+=============
+*/
+static void ED_CollectWrites (void)
+{
+	int		i, numpages;
+
+	if (!qcvm->edictwatch.pagesize)
+		return;
+
+	numpages = qcvm->edictwatch.size / qcvm->edictwatch.pagesize;
+	if (!qcvm->edictpagegen)
+	{
+		qcvm->edictpagegen = (int *) calloc (numpages, sizeof (int));
+		qcvm->edictpagewrites = (byte *) calloc (numpages, 1);
+		if (!qcvm->edictpagegen || !qcvm->edictpagewrites)
+			Sys_Error ("ED_CollectWrites: out of memory");
+	}
+
+	ed_writegen++;
+	if (!Sys_WatchGetWrites (&qcvm->edictwatch, qcvm->edictpagewrites))
+	{	// unknown, everything counts as written
+		for (i = 0; i < numpages; i++)
+			qcvm->edictpagegen[i] = ed_writegen;
+		memset (qcvm->edictpagewrites, 0, numpages);
+		return;
+	}
+
+	for (i = 0; i < numpages; i++)
+	{
+		if (qcvm->edictpagewrites[i])
+		{
+			qcvm->edictpagegen[i] = ed_writegen;
+			qcvm->edictpagewrites[i] = 0;
+		}
+	}
+}
+
 void SaveData_Init (savedata_t *save)
 {
 	memset (save, 0, sizeof (*save));
-	save->buffersize = 48 * 1024 * 1024; // ad_sepulcher needs ~32 MB
+	save->buffersize = 4 * 1024 * 1024; // edicts have their own buffer
 	save->buffer = (byte *) malloc (save->buffersize);
 	if (!save->buffer)
 		Sys_Error ("SaveData_Init: couldn't allocate %d bytes", save->buffersize);
@@ -2453,9 +2515,73 @@ void SaveData_Clear (savedata_t *save)
 	if (save->file)
 		fclose (save->file);
 	free (save->buffer);
+	free (save->edictbuffer);
 	memset (save, 0, sizeof (*save));
 }
 
+/*
+=============
+SaveData_FillEdicts
+
+Brings the edict copy up to date. When writes are tracked only the pages
+written since this buffer was last filled get copied.
+=============
+*/
+static void SaveData_FillEdicts (savedata_t *save)
+{
+	size_t	size = (size_t) qcvm->num_edicts * qcvm->edict_size;
+	size_t	pagesize, ofs;
+	int		i, numpages;
+
+	if (!save->edictbuffer || save->edictbuffersize != (size_t) qcvm->max_edicts * qcvm->edict_size)
+	{
+		free (save->edictbuffer);
+		save->edictbuffersize = (size_t) qcvm->max_edicts * qcvm->edict_size;
+		save->edictbuffer = (byte *) malloc (save->edictbuffersize);
+		if (!save->edictbuffer)
+			Sys_Error ("SaveData_Fill: failed to allocate %" SDL_PRIu64 " bytes", (uint64_t) save->edictbuffersize);
+		save->edictsource = NULL;
+	}
+
+	save->edicts = (edict_t *) save->edictbuffer;
+	save->num_edicts = qcvm->num_edicts;
+	save->totalbytes = size;
+
+	ED_CollectWrites ();
+	pagesize = qcvm->edictwatch.pagesize;
+	if (!pagesize)
+	{	// not tracked, copy what's in use
+		memcpy (save->edictbuffer, qcvm->edicts, size);
+		save->edictsource = NULL;
+		save->copiedbytes = size;
+		return;
+	}
+
+	// keep every page of the copy in sync, not just the ones in use,
+	// so edicts past num_edicts are right when num_edicts grows again
+	if (save->edictsource != qcvm->edicts)
+	{
+		memcpy (save->edictbuffer, qcvm->edicts, save->edictbuffersize);
+		save->edictsource = qcvm->edicts;
+		save->edictgen = ed_writegen;
+		save->copiedbytes = save->edictbuffersize;
+		return;
+	}
+
+	numpages = qcvm->edictwatch.size / pagesize;
+	save->copiedbytes = 0;
+	for (i = 0; i < numpages; i++)
+	{
+		ofs = i * pagesize;
+		if (qcvm->edictpagegen[i] <= save->edictgen || ofs >= save->edictbuffersize)
+			continue;
+		size = q_min (pagesize, save->edictbuffersize - ofs);
+		memcpy (save->edictbuffer + ofs, (byte *) qcvm->edicts + ofs, size);
+		save->copiedbytes += size;
+	}
+	save->edictgen = ed_writegen;
+}
+
 void SaveData_Fill (savedata_t *save)
 {
 	int i, ofs, size;
@@ -2468,10 +2594,11 @@ void SaveData_Fill (savedata_t *save)
 	save->skill = current_skill;
 	save->time = qcvm->time;
 
+	SaveData_FillEdicts (save);
+
 	/* determine buffer size */
 	size = sizeof (*save->knownstrings) * qcvm->numknownstrings;
 	size += sizeof (*save->globals) * qcvm->progs->numglobals;
-	size += qcvm->edict_size * qcvm->num_edicts;
 
 	for (i = 0; i < MAX_LIGHTSTYLES; i++)
 		if (sv.lightstyles[i])
@@ -2505,12 +2632,6 @@ void SaveData_Fill (savedata_t *save)
 	ofs += sizeof (*save->globals) * qcvm->progs->numglobals;
 	memcpy (save->globals, qcvm->globals, sizeof (*save->globals) * qcvm->progs->numglobals);
 
-	/* edicts */
-	save->edicts = (edict_t *) (save->buffer + ofs);
-	ofs += qcvm->num_edicts * qcvm->edict_size;
-	memcpy (save->edicts, qcvm->edicts, qcvm->num_edicts * qcvm->edict_size);
-	save->num_edicts = qcvm->num_edicts;
-
 	/* lightstyles */
 	for (i = 0; i < MAX_LIGHTSTYLES; i++)
 	{
@@ -2560,3 +2681,736 @@ void SaveData_WriteHeader (savedata_t *save)
 
 	ED_WriteGlobals (save);
 }
+
+/*
+==============================================================================
+
+BINARY SAVEGAMES
+
+Same contents as the text format, but field and global names are written
+once in def tables, values are stored raw and strings are written once in a
+string table keyed by their string_t in the saved VM. Edicts are encoded in
+chunks spread over the task workers.
+
+==============================================================================
+*/
+
+#define SAVEBIN_CHUNK	256		// edicts per encoding task
+
+// per-edict flags
+#define SAVEBIN_FREE	1
+#define SAVEBIN_ALPHA	2		// engine-side alpha when progs.dat has no alpha field
+
+typedef struct
+{
+	int			numedicts;
+	byte		*data;			// vec
+	int			*strings;		// vec, string ids referenced by data
+} savechunk_t;
+
+typedef struct
+{
+	savedata_t	*save;
+	ddef_t		**fields;		// vec
+	savechunk_t	*chunks;
+} savewriter_t;
+
+typedef struct
+{
+	const byte	*data;
+	const byte	*end;
+} savereader_t;
+
+#define SAVESTR_STRING		1
+#define SAVESTR_FUNCTION	2
+#define SAVESTR_FIELD		4
+
+typedef struct
+{
+	int			id;
+	const char	*str;
+	int			resolved;		// SAVESTR_* bits
+	string_t	string;
+	func_t		function;
+	int			field;
+} savestring_t;
+
+typedef struct
+{
+	int			type;
+	int			ofs;			// in the current progs, -1 if the def is gone
+	qboolean	alpha;
+} savedef_t;
+
+static savestring_t	*save_strings;	// vecs, kept around between loads
+static savedef_t	*save_globaldefs;
+static savedef_t	*save_fielddefs;
+
+static qboolean SaveBin_IsSavedType (int type)
+{
+	switch (type)
+	{
+	case ev_string:
+	case ev_float:
+	case ev_vector:
+	case ev_entity:
+	case ev_function:
+	case ev_field:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static int SaveBin_CompareInts (const void *pa, const void *pb)
+{
+	int a = *(const int *) pa;
+	int b = *(const int *) pb;
+	return (a > b) - (a < b);
+}
+
+static byte *SaveBin_Reserve (byte **buf, size_t size)
+{
+	byte *p;
+	Vec_Grow ((void **) buf, 1, q_max (size, 1));
+	p = *buf + VEC_HEADER (*buf).size;
+	VEC_HEADER (*buf).size += size;
+	return p;
+}
+
+static void SaveBin_WriteInt (byte **buf, int value)
+{
+	value = LittleLong (value);
+	memcpy (SaveBin_Reserve (buf, 4), &value, 4);
+}
+
+static void SaveBin_WriteFloat (byte **buf, float value)
+{
+	value = LittleFloat (value);
+	memcpy (SaveBin_Reserve (buf, 4), &value, 4);
+}
+
+static void SaveBin_WriteString (byte **buf, const char *str)
+{
+	int len = strlen (str);
+	SaveBin_WriteInt (buf, len);
+	memcpy (SaveBin_Reserve (buf, len + 1), str, len + 1);
+}
+
+static void SaveBin_WriteStringRef (byte **buf, int **strings, int id)
+{
+	SaveBin_WriteInt (buf, id);
+	VEC_PUSH (*strings, id);
+}
+
+/*
+=============
+SaveBin_WriteValue
+=============
+*/
+static void SaveBin_WriteValue (savedata_t *save, byte **buf, int **strings, int type, const eval_t *val)
+{
+	ddef_t	*def;
+	int		i;
+
+	switch (type)
+	{
+	case ev_string:
+		SaveBin_WriteStringRef (buf, strings, val->string);
+		break;
+	case ev_float:
+		SaveBin_WriteFloat (buf, val->_float);
+		break;
+	case ev_vector:
+		for (i = 0; i < 3; i++)
+			SaveBin_WriteFloat (buf, val->vector[i]);
+		break;
+	case ev_entity:
+		SaveBin_WriteInt (buf, SAVE_NUM_FOR_EDICT (save, SAVE_PROG_TO_EDICT (save, val->edict)));
+		break;
+	case ev_function:
+		if (val->function < 0 || val->function >= qcvm->progs->numfunctions)
+		{
+			SDL_AtomicCAS (&save->abort, 0, -1);
+			SaveBin_WriteStringRef (buf, strings, 0);
+		}
+		else
+			SaveBin_WriteStringRef (buf, strings, qcvm->functions[val->function].s_name);
+		break;
+	case ev_field:
+		def = ED_FieldAtOfs (val->_int);
+		if (!def)
+			SDL_AtomicCAS (&save->abort, 0, -1);
+		SaveBin_WriteStringRef (buf, strings, def ? def->s_name : 0);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+=============
+SaveBin_WriteChunk
+
+Encodes SAVEBIN_CHUNK edicts, runs on the task workers
+=============
+*/
+static void SaveBin_WriteChunk (int index, void *data)
+{
+	savewriter_t	*w = (savewriter_t *) data;
+	savechunk_t		*chunk = &w->chunks[index];
+	savedata_t		*save = w->save;
+	qcvm_t			*oldvm;
+	edict_t			*ed;
+	ddef_t			*d;
+	const int		*v;
+	int				i, j, k, type, first, numfields, masksize, flagsofs, maskofs;
+
+	if (SDL_AtomicGet (&save->abort))
+		return;
+
+	// qcvm is thread-local
+	PR_PushQCVM (&sv.qcvm, &oldvm);
+
+	first = index * SAVEBIN_CHUNK;
+	chunk->numedicts = q_min (SAVEBIN_CHUNK, save->num_edicts - first);
+	numfields = VEC_SIZE (w->fields);
+	masksize = (numfields + 7) >> 3;
+
+	for (i = 0; i < chunk->numedicts; i++)
+	{
+		ed = (edict_t *) ((byte *) save->edicts + (first + i) * qcvm->edict_size);
+
+		flagsofs = VEC_SIZE (chunk->data);
+		*SaveBin_Reserve (&chunk->data, 1) = 0;
+		if (ed->free)
+		{
+			chunk->data[flagsofs] = SAVEBIN_FREE;
+			continue;
+		}
+
+	// one bit per field def, values follow for the bits that are set
+		maskofs = VEC_SIZE (chunk->data);
+		memset (SaveBin_Reserve (&chunk->data, masksize), 0, masksize);
+
+		for (j = 0; j < numfields; j++)
+		{
+			d = w->fields[j];
+			v = (const int *)((const char *)&ed->v + d->ofs*4);
+			type = d->type & ~DEF_SAVEGLOBAL;
+
+		// if the value is still all 0, skip the field
+			for (k = 0; k < type_size[type]; k++)
+			{
+				if (v[k])
+					break;
+			}
+			if (k == type_size[type])
+				continue;
+
+			chunk->data[maskofs + (j >> 3)] |= 1 << (j & 7);
+			SaveBin_WriteValue (save, &chunk->data, &chunk->strings, type, (const eval_t *) v);
+		}
+
+		if (qcvm->extfields.alpha < 0 && ed->alpha != ENTALPHA_DEFAULT)
+		{
+			chunk->data[flagsofs] |= SAVEBIN_ALPHA;
+			SaveBin_WriteFloat (&chunk->data, ENTALPHA_TOSAVE (ed->alpha));
+		}
+	}
+
+	PR_PopQCVM (oldvm);
+}
+
+/*
+=============
+SaveData_WriteBinary
+
+Writes the whole snapshot in SAVEGAME_VERSION_BINARY format.
+The version and comment lines stay text so the save menu can list the file.
+=============
+*/
+void SaveData_WriteBinary (savedata_t *save)
+{
+	savewriter_t	w;
+	ddef_t			*def;
+	ddef_t			**globaldefs = NULL;
+	byte			*head = NULL;
+	byte			*globals = NULL;
+	int				*strings = NULL;
+	int				i, type, numchunks, numstrings;
+	uint64_t		timebits;
+
+	memset (&w, 0, sizeof (w));
+	w.save = save;
+
+// pick the defs the text format would write
+	for (i = 1; i < qcvm->progs->numfielddefs; i++)
+	{
+		def = &qcvm->fielddefs[i];
+		if (!(def->type & DEF_SAVEGLOBAL) || !SaveBin_IsSavedType (def->type & ~DEF_SAVEGLOBAL))
+			continue;
+		VEC_PUSH (w.fields, def);
+	}
+	for (i = 0; i < qcvm->progs->numglobaldefs; i++)
+	{
+		def = &qcvm->globaldefs[i];
+		if (!(def->type & DEF_SAVEGLOBAL))
+			continue;
+		type = def->type & ~DEF_SAVEGLOBAL;
+		if (type != ev_string && type != ev_float && type != ev_entity)
+			continue;
+		VEC_PUSH (globaldefs, def);
+	}
+
+// edicts
+	numchunks = (save->num_edicts + SAVEBIN_CHUNK - 1) / SAVEBIN_CHUNK;
+	w.chunks = (savechunk_t *) calloc (numchunks, sizeof (*w.chunks));
+	if (!w.chunks)
+	{
+		SDL_AtomicCAS (&save->abort, 0, -1);
+		goto done;
+	}
+	Task_ParallelFor (numchunks, 1, SaveBin_WriteChunk, &w);
+	if (SDL_AtomicGet (&save->abort))
+		goto done;
+
+// globals
+	for (i = 0; i < (int) VEC_SIZE (globaldefs); i++)
+	{
+		def = globaldefs[i];
+		SaveBin_WriteValue (save, &globals, &strings, def->type & ~DEF_SAVEGLOBAL, (const eval_t *) &save->globals[def->ofs]);
+	}
+
+// string table, sorted by id so the loader can binary search it
+	for (i = 0; i < (int) VEC_SIZE (w.fields); i++)
+		VEC_PUSH (strings, w.fields[i]->s_name);
+	for (i = 0; i < (int) VEC_SIZE (globaldefs); i++)
+		VEC_PUSH (strings, globaldefs[i]->s_name);
+	for (i = 0; i < numchunks; i++)
+		if (w.chunks[i].strings)
+			Vec_Append ((void **) &strings, sizeof (*strings), w.chunks[i].strings, VEC_SIZE (w.chunks[i].strings));
+
+	numstrings = 0;
+	if (strings)
+	{
+		qsort (strings, VEC_SIZE (strings), sizeof (*strings), SaveBin_CompareInts);
+		for (i = 0; i < (int) VEC_SIZE (strings); i++)
+			if (!numstrings || strings[i] != strings[numstrings - 1])
+				strings[numstrings++] = strings[i];
+	}
+
+// header
+	for (i = 0; i < NUM_SPAWN_PARMS; i++)
+		SaveBin_WriteFloat (&head, save->spawn_parms[i]);
+	SaveBin_WriteInt (&head, save->skill);
+	memcpy (&timebits, &save->time, sizeof (timebits));
+	SaveBin_WriteInt (&head, (int) (uint32_t) timebits);
+	SaveBin_WriteInt (&head, (int) (uint32_t) (timebits >> 32));
+	SaveBin_WriteString (&head, save->mapname);
+	for (i = 0; i < MAX_LIGHTSTYLES; i++)
+		SaveBin_WriteString (&head, save->lightstyles[i]);
+
+	SaveBin_WriteInt (&head, numstrings);
+	for (i = 0; i < numstrings; i++)
+	{
+		SaveBin_WriteInt (&head, strings[i]);
+		SaveBin_WriteString (&head, PR_GetSaveString (save, strings[i]));
+	}
+
+	SaveBin_WriteInt (&head, VEC_SIZE (globaldefs));
+	for (i = 0; i < (int) VEC_SIZE (globaldefs); i++)
+	{
+		SaveBin_WriteInt (&head, globaldefs[i]->type & ~DEF_SAVEGLOBAL);
+		SaveBin_WriteInt (&head, globaldefs[i]->s_name);
+	}
+
+	SaveBin_WriteInt (&head, VEC_SIZE (w.fields));
+	for (i = 0; i < (int) VEC_SIZE (w.fields); i++)
+	{
+		SaveBin_WriteInt (&head, w.fields[i]->type & ~DEF_SAVEGLOBAL);
+		SaveBin_WriteInt (&head, w.fields[i]->s_name);
+	}
+
+	if (globals)
+		Vec_Append ((void **) &head, 1, globals, VEC_SIZE (globals));
+
+	SaveBin_WriteInt (&head, save->num_edicts);
+	SaveBin_WriteInt (&head, numchunks);
+
+	if (SDL_AtomicGet (&save->abort))
+		goto done;
+
+// write it all out
+	fprintf (save->file, "%i\n", SAVEGAME_VERSION_BINARY);
+	fprintf (save->file, "%s\n", save->comment);
+	fwrite (head, 1, VEC_SIZE (head), save->file);
+	for (i = 0; i < numchunks; i++)
+	{
+		byte chunkhead[8];
+		int count = LittleLong (w.chunks[i].numedicts);
+		int size = LittleLong ((int) VEC_SIZE (w.chunks[i].data));
+		memcpy (chunkhead, &count, 4);
+		memcpy (chunkhead + 4, &size, 4);
+		fwrite (chunkhead, 1, sizeof (chunkhead), save->file);
+		if (w.chunks[i].data)
+			fwrite (w.chunks[i].data, 1, VEC_SIZE (w.chunks[i].data), save->file);
+	}
+	if (ferror (save->file))
+		SDL_AtomicCAS (&save->abort, 0, -1);
+
+done:
+	if (w.chunks)
+	{
+		for (i = 0; i < numchunks; i++)
+		{
+			VEC_FREE (w.chunks[i].data);
+			VEC_FREE (w.chunks[i].strings);
+		}
+		free (w.chunks);
+	}
+	VEC_FREE (w.fields);
+	VEC_FREE (globaldefs);
+	VEC_FREE (head);
+	VEC_FREE (globals);
+	VEC_FREE (strings);
+}
+
+static const byte *SaveBin_Read (savereader_t *r, size_t size)
+{
+	const byte *p = r->data;
+	if ((size_t) (r->end - r->data) < size)
+		Host_Error ("Savegame is truncated");
+	r->data += size;
+	return p;
+}
+
+static int SaveBin_ReadInt (savereader_t *r)
+{
+	int value;
+	memcpy (&value, SaveBin_Read (r, 4), 4);
+	return LittleLong (value);
+}
+
+static float SaveBin_ReadFloat (savereader_t *r)
+{
+	float value;
+	memcpy (&value, SaveBin_Read (r, 4), 4);
+	return LittleFloat (value);
+}
+
+static int SaveBin_ReadCount (savereader_t *r)
+{
+	int count = SaveBin_ReadInt (r);
+	if (count < 0 || count > r->end - r->data)
+		Host_Error ("Savegame is corrupt");
+	return count;
+}
+
+static const char *SaveBin_ReadString (savereader_t *r)
+{
+	int			len = SaveBin_ReadCount (r);
+	const char	*str = (const char *) SaveBin_Read (r, len + 1);
+	if (str[len])
+		Host_Error ("Savegame is corrupt");
+	return str;
+}
+
+static int SaveBin_CompareStrings (const void *pa, const void *pb)
+{
+	int a = *(const int *) pa;
+	int b = ((const savestring_t *) pb)->id;
+	return (a > b) - (a < b);
+}
+
+static savestring_t *SaveBin_FindString (int id)
+{
+	savestring_t *s = (savestring_t *) bsearch (&id, save_strings, VEC_SIZE (save_strings), sizeof (*save_strings), SaveBin_CompareStrings);
+	if (!s)
+		Host_Error ("Savegame references unknown string %d", id);
+	return s;
+}
+
+/*
+=============
+SaveBin_ReadValue
+
+Resolves string, function and field names once per string table entry
+=============
+*/
+static void SaveBin_ReadValue (savereader_t *r, int type, eval_t *val)
+{
+	savestring_t	*s;
+	dfunction_t		*func;
+	ddef_t			*def;
+	char			*buf = NULL;
+	int				i;
+
+	switch (type)
+	{
+	case ev_string:
+		s = SaveBin_FindString (SaveBin_ReadInt (r));
+		if (!(s->resolved & SAVESTR_STRING))
+		{
+			s->resolved |= SAVESTR_STRING;
+			if (s->id)
+			{
+				s->string = PR_AllocString (strlen (s->str) + 1, &buf);
+				strcpy (buf, s->str);
+			}
+			else
+				s->string = 0;
+		}
+		val->string = s->string;
+		break;
+
+	case ev_float:
+		val->_float = SaveBin_ReadFloat (r);
+		break;
+
+	case ev_vector:
+		for (i = 0; i < 3; i++)
+			val->vector[i] = SaveBin_ReadFloat (r);
+		break;
+
+	case ev_entity:
+		val->edict = EDICT_TO_PROG (EDICT_NUM (SaveBin_ReadInt (r)));
+		break;
+
+	case ev_function:
+		s = SaveBin_FindString (SaveBin_ReadInt (r));
+		if (!(s->resolved & SAVESTR_FUNCTION))
+		{
+			s->resolved |= SAVESTR_FUNCTION;
+			func = ED_FindFunction (s->str);
+			if (!func)
+				Con_Printf ("Can't find function %s\n", s->str);
+			s->function = func ? func - qcvm->functions : 0;
+		}
+		val->function = s->function;
+		break;
+
+	case ev_field:
+		s = SaveBin_FindString (SaveBin_ReadInt (r));
+		if (!(s->resolved & SAVESTR_FIELD))
+		{
+			s->resolved |= SAVESTR_FIELD;
+			def = ED_FindField (s->str);
+			if (!def)
+				Con_DPrintf ("Can't find field %s\n", s->str);
+			s->field = def ? G_INT (def->ofs) : 0;
+		}
+		val->_int = s->field;
+		break;
+
+	default:
+		Host_Error ("Savegame is corrupt");
+		break;
+	}
+}
+
+/*
+=============
+SaveBin_ReadDefs
+
+Maps the saved def table onto the current progs
+=============
+*/
+static savedef_t *SaveBin_ReadDefs (savereader_t *r, savedef_t *defs, qboolean fields)
+{
+	ddef_t		*key;
+	savedef_t	*def;
+	const char	*name;
+	int			i, count;
+
+	VEC_CLEAR (defs);
+	count = SaveBin_ReadCount (r);
+	if (count)
+	{
+		Vec_Grow ((void **) &defs, sizeof (*defs), count);
+		VEC_HEADER (defs).size = count;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		def = &defs[i];
+		def->type = SaveBin_ReadInt (r);
+		name = SaveBin_FindString (SaveBin_ReadInt (r))->str;
+		def->ofs = -1;
+		def->alpha = fields && !strcmp (name, "alpha");
+		if (!SaveBin_IsSavedType (def->type))
+			Host_Error ("Savegame is corrupt");
+
+		// keynames with a leading underscore are skipped by the text loader as well
+		if (fields && name[0] == '_')
+			continue;
+
+		key = fields ? ED_FindField (name) : ED_FindGlobal (name);
+		if (!key)
+		{
+			if (!fields)
+				Con_Printf ("'%s' is not a global\n", name);
+			else if (strncmp (name, "sky", 3) && strcmp (name, "fog") && strcmp (name, "alpha"))
+				Con_DPrintf ("\"%s\" is not a field\n", name);
+			continue;
+		}
+		if ((key->type & ~DEF_SAVEGLOBAL) != def->type)
+		{
+			Con_DPrintf ("\"%s\" changed type\n", name);
+			continue;
+		}
+		def->ofs = key->ofs;
+	}
+
+	return defs;
+}
+
+/*
+=============
+SaveData_ParseBinaryHeader
+
+Reads everything that's needed before the map is spawned.
+data points right after the comment line, lightstyles point into it.
+Returns the position of ED_ParseBinarySave's data.
+=============
+*/
+const byte *SaveData_ParseBinaryHeader (savedata_t *save, const byte *data, const byte *end)
+{
+	savereader_t	r;
+	uint64_t		timebits;
+	int				i;
+
+	r.data = data;
+	r.end = end;
+
+	for (i = 0; i < NUM_SPAWN_PARMS; i++)
+		save->spawn_parms[i] = SaveBin_ReadFloat (&r);
+	save->skill = SaveBin_ReadInt (&r);
+	timebits = (uint32_t) SaveBin_ReadInt (&r);
+	timebits |= (uint64_t) (uint32_t) SaveBin_ReadInt (&r) << 32;
+	memcpy (&save->time, &timebits, sizeof (save->time));
+	q_strlcpy (save->mapname, SaveBin_ReadString (&r), sizeof (save->mapname));
+	for (i = 0; i < MAX_LIGHTSTYLES; i++)
+		save->lightstyles[i] = SaveBin_ReadString (&r);
+
+	return r.data;
+}
+
+/*
+=============
+ED_ParseBinarySave
+
+Restores the globals and edicts of a SAVEGAME_VERSION_BINARY file the same
+way Host_Loadgame_f does for text saves, returns the number of edicts
+=============
+*/
+int ED_ParseBinarySave (const byte *data, const byte *end)
+{
+	savereader_t	r;
+	savedef_t		*def;
+	edict_t			*ent;
+	const byte		*mask, *chunkend;
+	eval_t			val;
+	qboolean		init;
+	int				i, j, k, numstrings, numedicts, numchunks, count, masksize, flags, entnum;
+
+	r.data = data;
+	r.end = end;
+
+// string table
+	VEC_CLEAR (save_strings);
+	numstrings = SaveBin_ReadCount (&r);
+	if (numstrings)
+	{
+		Vec_Grow ((void **) &save_strings, sizeof (*save_strings), numstrings);
+		VEC_HEADER (save_strings).size = numstrings;
+	}
+	for (i = 0; i < numstrings; i++)
+	{
+		memset (&save_strings[i], 0, sizeof (save_strings[i]));
+		save_strings[i].id = SaveBin_ReadInt (&r);
+		save_strings[i].str = SaveBin_ReadString (&r);
+		if (i > 0 && save_strings[i].id <= save_strings[i - 1].id)
+			Host_Error ("Savegame is corrupt");
+	}
+
+	save_globaldefs = SaveBin_ReadDefs (&r, save_globaldefs, false);
+	save_fielddefs = SaveBin_ReadDefs (&r, save_fielddefs, true);
+
+// globals
+	for (i = 0; i < (int) VEC_SIZE (save_globaldefs); i++)
+	{
+		def = &save_globaldefs[i];
+		SaveBin_ReadValue (&r, def->type, &val);
+		if (def->ofs >= 0)
+			memcpy (&qcvm->globals[def->ofs], &val, type_size[def->type] * 4);
+	}
+
+// edicts
+	numedicts = SaveBin_ReadInt (&r);
+	numchunks = SaveBin_ReadCount (&r);
+	masksize = (VEC_SIZE (save_fielddefs) + 7) >> 3;
+	entnum = 0;
+
+	for (i = 0; i < numchunks; i++)
+	{
+		count = SaveBin_ReadCount (&r);
+		chunkend = r.data + SaveBin_ReadCount (&r);
+
+		for (j = 0; j < count; j++, entnum++)
+		{
+			ent = EDICT_NUM (entnum);
+			if (entnum < qcvm->num_edicts)
+			{
+				ED_ClearEdict (ent);
+			}
+			else
+			{
+				memset (ent, 0, qcvm->edict_size);
+				ent->baseline.scale = ENTSCALE_DEFAULT;
+			}
+
+			init = false;
+			flags = *SaveBin_Read (&r, 1);
+			if (!(flags & SAVEBIN_FREE))
+			{
+				mask = SaveBin_Read (&r, masksize);
+				for (k = 0; k < (int) VEC_SIZE (save_fielddefs); k++)
+				{
+					if (!(mask[k >> 3] & (1 << (k & 7))))
+						continue;
+					init = true;
+					def = &save_fielddefs[k];
+					SaveBin_ReadValue (&r, def->type, &val);
+					if (def->ofs >= 0)
+						memcpy ((int *)&ent->v + def->ofs, &val, type_size[def->type] * 4);
+					//johnfitz -- hack to support .alpha even when progs.dat doesn't know about it
+					if (def->alpha && def->type == ev_float)
+						ent->alpha = ENTALPHA_ENCODE (val._float);
+				}
+				if (flags & SAVEBIN_ALPHA)
+				{
+					init = true;
+					ent->alpha = ENTALPHA_ENCODE (SaveBin_ReadFloat (&r));
+				}
+			}
+
+			PR_FindIndexTouch (ent);
+
+			if (!init)
+				ED_Free (ent);
+
+			// link it into the bsp tree
+			if (!ent->free)
+				SV_LinkEdict (ent, false);
+		}
+
+		if (r.data != chunkend)
+			Host_Error ("Savegame is corrupt");
+	}
+
+	if (entnum != numedicts)
+		Host_Error ("Savegame is corrupt");
+
+	return entnum;
+}
@@ -255,6 +255,400 @@ void PR_Profile_f (void)
 }
 
 
+/*
+==============================================================================
+
+WALL-TIME PROFILER
+
+When pr_profile is enabled, every QC function and builtin call is timed
+and attributed to its position in a call tree. Builtins that call back
+into QC (e.g. touch functions run from walkmove) show up as parents of
+those calls. The tree can be printed per function (pr_profile_report)
+or written in collapsed-stack format for flame graph tools (pr_profile_dump).
+
+==============================================================================
+*/
+
+cvar_t	pr_profile = {"pr_profile", "0", CVAR_NONE};
+
+#define PR_PROFILE_MAX_DEPTH	(MAX_STACK_DEPTH * 2)
+
+typedef struct prprofnode_s
+{
+	int			func;		// index into qcvm->functions
+	int			parent;		// node index, -1 for the root
+	int			child;		// first child node, or -1
+	int			sibling;	// next sibling node, or -1
+	int64_t		calls;
+	double		inclusive;
+	double		exclusive;
+} prprofnode_t;
+
+typedef struct prprofframe_s
+{
+	int			node;
+	double		start;
+	double		children;	// time spent in callees
+} prprofframe_t;
+
+typedef struct prprofiler_s
+{
+	prprofnode_t	*nodes;		// dynamic array, node 0 is the root
+	prprofframe_t	frames[PR_PROFILE_MAX_DEPTH];
+	int				depth;
+	int				skipped;	// calls past PR_PROFILE_MAX_DEPTH
+	double			starttime;
+} prprofiler_t;
+
+/*
+============
+PR_ProfileAddNode
+============
+*/
+static int PR_ProfileAddNode (prprofiler_t *prof, int func, int parent)
+{
+	prprofnode_t node;
+
+	memset (&node, 0, sizeof (node));
+	node.func = func;
+	node.parent = parent;
+	node.child = -1;
+	node.sibling = -1;
+	if (parent >= 0)
+	{
+		node.sibling = prof->nodes[parent].child;
+		prof->nodes[parent].child = (int) VEC_SIZE (prof->nodes);
+	}
+	VEC_PUSH (prof->nodes, node);
+
+	return (int) VEC_SIZE (prof->nodes) - 1;
+}
+
+/*
+============
+PR_ProfileBegin
+
+Called for top-level QC calls. Latches pr_profile for the duration of the call
+and drops any frames left over from a call aborted by an error.
+============
+*/
+static void PR_ProfileBegin (void)
+{
+	qcvm->profiling = pr_profile.value && qcvm == &sv.qcvm;
+	if (!qcvm->profiling)
+		return;
+
+	if (!qcvm->profiler)
+	{
+		qcvm->profiler = (prprofiler_t *) calloc (1, sizeof (prprofiler_t));
+		if (!qcvm->profiler)
+			Sys_Error ("PR_ProfileBegin: out of memory");
+		qcvm->profiler->starttime = Sys_DoubleTime ();
+	}
+	if (!VEC_SIZE (qcvm->profiler->nodes))
+		PR_ProfileAddNode (qcvm->profiler, 0, -1);
+
+	qcvm->profiler->depth = 0;
+	qcvm->profiler->skipped = 0;
+}
+
+/*
+============
+PR_ProfileEnter
+============
+*/
+static void PR_ProfileEnter (dfunction_t *f)
+{
+	prprofiler_t	*prof = qcvm->profiler;
+	prprofframe_t	*frame;
+	int				func = f - qcvm->functions;
+	int				parent, node;
+
+	if (prof->depth >= PR_PROFILE_MAX_DEPTH)
+	{
+		prof->skipped++;
+		return;
+	}
+
+	parent = prof->depth ? prof->frames[prof->depth - 1].node : 0;
+	for (node = prof->nodes[parent].child; node >= 0; node = prof->nodes[node].sibling)
+		if (prof->nodes[node].func == func)
+			break;
+	if (node < 0)
+		node = PR_ProfileAddNode (prof, func, parent);
+
+	frame = &prof->frames[prof->depth++];
+	frame->node = node;
+	frame->children = 0.0;
+	frame->start = Sys_DoubleTime ();
+}
+
+/*
+============
+PR_ProfileLeave
+============
+*/
+static void PR_ProfileLeave (void)
+{
+	prprofiler_t	*prof = qcvm->profiler;
+	prprofframe_t	*frame;
+	prprofnode_t	*node;
+	double			elapsed;
+
+	if (prof->skipped > 0)
+	{
+		prof->skipped--;
+		return;
+	}
+	if (prof->depth <= 0)
+		return;
+
+	frame = &prof->frames[--prof->depth];
+	elapsed = Sys_DoubleTime () - frame->start;
+	node = &prof->nodes[frame->node];
+	node->calls++;
+	node->inclusive += elapsed;
+	node->exclusive += elapsed - frame->children;
+	if (prof->depth > 0)
+		prof->frames[prof->depth - 1].children += elapsed;
+}
+
+/*
+============
+PR_ProfileFree
+
+Called from PR_ClearProgs
+============
+*/
+void PR_ProfileFree (void)
+{
+	if (!qcvm->profiler)
+		return;
+	VEC_FREE (qcvm->profiler->nodes);
+	free (qcvm->profiler);
+	qcvm->profiler = NULL;
+	qcvm->profiling = false;
+}
+
+/*
+============
+PR_ProfileFunctionName
+============
+*/
+static const char *PR_ProfileFunctionName (int func)
+{
+	dfunction_t *f = &qcvm->functions[func];
+	if (f->first_statement < 0)
+		return va ("builtin:%s", PR_GetString (f->s_name));
+	return PR_GetString (f->s_name);
+}
+
+typedef struct prproftotal_s
+{
+	int			func;
+	int			active;		// number of instances on the current tree path (for recursion)
+	int64_t		calls;
+	double		inclusive;
+	double		exclusive;
+} prproftotal_t;
+
+/*
+============
+PR_ProfileAccumulate
+
+Sums up the call tree per function. Inclusive time is only counted for
+the outermost instance of a function on each path, so recursion isn't counted twice.
+============
+*/
+static void PR_ProfileAccumulate (prprofiler_t *prof, int node, prproftotal_t *totals)
+{
+	prprofnode_t	*n = &prof->nodes[node];
+	prproftotal_t	*t = &totals[n->func];
+	int				child;
+
+	t->calls += n->calls;
+	t->exclusive += n->exclusive;
+	if (!t->active)
+		t->inclusive += n->inclusive;
+
+	t->active++;
+	for (child = n->child; child >= 0; child = prof->nodes[child].sibling)
+		PR_ProfileAccumulate (prof, child, totals);
+	t->active--;
+}
+
+/*
+============
+PR_ProfileCompareTotals
+============
+*/
+static int PR_ProfileCompareTotals (const void *pa, const void *pb)
+{
+	const prproftotal_t *a = (const prproftotal_t *) pa;
+	const prproftotal_t *b = (const prproftotal_t *) pb;
+	if (a->exclusive != b->exclusive)
+		return a->exclusive < b->exclusive ? 1 : -1;
+	return a->func - b->func;
+}
+
+/*
+============
+PR_ProfileReport_f
+============
+*/
+static void PR_ProfileReport_f (void)
+{
+	prprofiler_t	*prof;
+	prproftotal_t	*totals;
+	int				i, count, numfuncs;
+	double			elapsed;
+
+	if (!sv.active)
+		return;
+
+	PR_SwitchQCVM(&sv.qcvm);
+
+	prof = qcvm->profiler;
+	if (!prof || VEC_SIZE (prof->nodes) <= 1)
+	{
+		Con_Printf ("No profile data%s.\n", pr_profile.value ? "" : " (set pr_profile to 1 to enable)");
+		PR_SwitchQCVM(NULL);
+		return;
+	}
+
+	count = Cmd_Argc () >= 2 ? q_max (atoi (Cmd_Argv (1)), 1) : 20;
+	numfuncs = qcvm->progs->numfunctions;
+	totals = (prproftotal_t *) calloc (numfuncs, sizeof (*totals));
+	if (!totals)
+		Sys_Error ("PR_ProfileReport_f: out of memory");
+	for (i = 0; i < numfuncs; i++)
+		totals[i].func = i;
+
+	PR_ProfileAccumulate (prof, 0, totals);
+	qsort (totals, numfuncs, sizeof (*totals), PR_ProfileCompareTotals);
+
+	elapsed = Sys_DoubleTime () - prof->starttime;
+	Con_Printf ("%.1f sec profiled, %d call tree nodes\n", elapsed, (int) VEC_SIZE (prof->nodes));
+	Con_Printf ("   calls  incl ms  excl ms  excl%%  function\n");
+	for (i = 0; i < numfuncs && i < count; i++)
+	{
+		prproftotal_t *t = &totals[i];
+		if (!t->calls)
+			break;
+		Con_Printf ("%8" SDL_PRIs64 " %8.1f %8.1f %5.1f%%  %s\n",
+			t->calls, t->inclusive * 1000.0, t->exclusive * 1000.0,
+			elapsed > 0.0 ? t->exclusive * 100.0 / elapsed : 0.0,
+			PR_ProfileFunctionName (t->func)
+		);
+	}
+
+	free (totals);
+
+	PR_SwitchQCVM(NULL);
+}
+
+/*
+============
+PR_ProfileWriteNode
+
+Writes one line per call tree node in collapsed-stack format ("a;b;c <usec>")
+============
+*/
+static void PR_ProfileWriteNode (FILE *f, prprofiler_t *prof, int node, char *path, size_t pathlen, size_t pathsize)
+{
+	prprofnode_t	*n = &prof->nodes[node];
+	dfunction_t		*func = &qcvm->functions[n->func];
+	int				child, len;
+
+	if (node != 0)
+	{
+		len = q_snprintf (path + pathlen, pathsize - pathlen, "%s%s%s",
+			pathlen ? ";" : "", func->first_statement < 0 ? "builtin:" : "", PR_GetString (func->s_name));
+		if (len < 0 || pathlen + len >= pathsize)
+			return;
+		pathlen += len;
+		if (n->exclusive > 0.0)
+			fprintf (f, "%s %.0f\n", path, n->exclusive * 1e6);
+	}
+
+	for (child = n->child; child >= 0; child = prof->nodes[child].sibling)
+		PR_ProfileWriteNode (f, prof, child, path, pathlen, pathsize);
+}
+
+/*
+============
+PR_ProfileDump_f
+============
+*/
+static void PR_ProfileDump_f (void)
+{
+	FILE	*f;
+	char	relname[MAX_OSPATH];
+	char	name[MAX_OSPATH];
+	char	*path;
+	size_t	pathsize = 64 * 1024;
+
+	if (!sv.active)
+		return;
+
+	if (!sv.qcvm.profiler || VEC_SIZE (sv.qcvm.profiler->nodes) <= 1)
+	{
+		Con_Printf ("No profile data%s.\n", pr_profile.value ? "" : " (set pr_profile to 1 to enable)");
+		return;
+	}
+
+	q_strlcpy (relname, Cmd_Argc () >= 2 ? Cmd_Argv (1) : "qcprofile.txt", sizeof (relname));
+	COM_AddExtension (relname, ".txt", sizeof (relname));
+	q_snprintf (name, sizeof (name), "%s/%s", com_gamedir, relname);
+	f = Sys_fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open file %s.\n", relname);
+		return;
+	}
+
+	path = (char *) malloc (pathsize);
+	if (!path)
+		Sys_Error ("PR_ProfileDump_f: out of memory");
+	path[0] = '\0';
+
+	PR_SwitchQCVM(&sv.qcvm);
+	PR_ProfileWriteNode (f, qcvm->profiler, 0, path, 0, pathsize);
+	PR_SwitchQCVM(NULL);
+
+	free (path);
+	fclose (f);
+
+	Con_Printf ("Wrote %s (collapsed stacks, microseconds)\n", relname);
+}
+
+/*
+============
+PR_ProfileReset_f
+============
+*/
+static void PR_ProfileReset_f (void)
+{
+	if (!sv.active || !sv.qcvm.profiler)
+		return;
+	VEC_CLEAR (sv.qcvm.profiler->nodes);
+	sv.qcvm.profiler->starttime = Sys_DoubleTime ();
+}
+
+/*
+============
+PR_InitProfiler
+============
+*/
+void PR_InitProfiler (void)
+{
+	Cvar_RegisterVariable (&pr_profile);
+	Cmd_AddCommand ("pr_profile_report", PR_ProfileReport_f);
+	Cmd_AddCommand ("pr_profile_dump", PR_ProfileDump_f);
+	Cmd_AddCommand ("pr_profile_reset", PR_ProfileReset_f);
+}
+
+
 /*
 ============
 PR_RunError
@@ -298,6 +692,9 @@ static int PR_EnterFunction (dfunction_t *f)
 	if (qcvm->depth >= MAX_STACK_DEPTH)
 		PR_RunError("stack overflow");
 
+	if (qcvm->profiling)
+		PR_ProfileEnter (f);
+
 	// save off any locals that the new function steps on
 	c = f->locals;
 	if (qcvm->localstack_used + c > LOCALSTACK_SIZE)
@@ -334,6 +731,9 @@ static int PR_LeaveFunction (void)
 	if (qcvm->depth <= 0)
 		Host_Error("prog stack underflow");
 
+	if (qcvm->profiling)
+		PR_ProfileLeave ();
+
 	// Restore locals from the stack
 	c = qcvm->xfunction->locals;
 	qcvm->localstack_used -= c;
@@ -383,46 +783,312 @@ static void PR_CheckBuiltinExtension (dfunction_t *func)
 
 /*
 ====================
-PR_ExecuteProgram
-
-The interpretation main loop
+PR_CallBuiltin
 ====================
 */
-#define OPA ((eval_t *)&qcvm->globals[(unsigned short)st->a])
-#define OPB ((eval_t *)&qcvm->globals[(unsigned short)st->b])
-#define OPC ((eval_t *)&qcvm->globals[(unsigned short)st->c])
+static void PR_CallBuiltin (dfunction_t *func)
+{
+	int i = -func->first_statement;
+	if (i >= qcvm->numbuiltins)
+		PR_RunError("Bad builtin call number %d", i);
+	PR_CheckBuiltinExtension (func);
+	if (qcvm->profiling)
+	{
+		PR_ProfileEnter (func);
+		qcvm->builtins[i]();
+		PR_ProfileLeave ();
+	}
+	else
+		qcvm->builtins[i]();
+}
 
-void PR_ExecuteProgram (func_t fnum)
+/*
+==============================================================================
+
+PRE-DECODED STATEMENTS
+
+PR_DecodeProgs translates the raw statements into a parallel array of
+prstatement_t's with resolved operand pointers and a compact opcode set
+(e.g. all the integer stores share one handler). Comparisons immediately
+followed by an IF/IFNOT on their result are fused into a single statement.
+The original statement stays decoded on its own as well, so jumps landing
+directly on the branch still work.
+
+==============================================================================
+*/
+
+#define PR_DECODED_OPS(X)																	\
+	X(BAD)																					\
+	X(ADD_F)	X(ADD_V)	X(SUB_F)	X(SUB_V)												\
+	X(MUL_F)	X(MUL_V)	X(MUL_FV)	X(MUL_VF)	X(DIV_F)									\
+	X(BITAND)	X(BITOR)	X(AND)		X(OR)													\
+	X(GE)		X(LE)		X(GT)		X(LT)													\
+	X(NOT_F)	X(NOT_V)	X(NOT_S)	X(NOT_FNC)	X(NOT_ENT)									\
+	X(EQ_F)		X(EQ_V)		X(EQ_S)		X(EQ_E)		X(EQ_FNC)									\
+	X(NE_F)		X(NE_V)		X(NE_S)		X(NE_E)		X(NE_FNC)									\
+	X(STORE)	X(STORE_V)	X(STOREP)	X(STOREP_V)											\
+	X(ADDRESS)	X(LOAD)		X(LOAD_V)														\
+	X(IF)		X(IFNOT)	X(GOTO)		X(CALL)		X(RETURN)	X(STATE)						\
+	PR_FUSED_COMPARES(PR_FUSED_OP, X)
+
+// comparisons that get fused with a following IF/IFNOT
+#define PR_FUSED_COMPARES(F, X)																\
+	F(X, EQ_F)	F(X, NE_F)	F(X, EQ_E)	F(X, NE_E)	F(X, NOT_F)	F(X, NOT_ENT)					\
+	F(X, GE)	F(X, LE)	F(X, GT)	F(X, LT)
+
+#define PR_FUSED_OP(X, name)	X(name##_IF) X(name##_IFNOT)
+
+typedef enum
 {
-	eval_t		*ptr;
+#define PROP_ENUM(name)		PROP_##name,
+	PR_DECODED_OPS (PROP_ENUM)
+#undef PROP_ENUM
+	PROP_COUNT
+} prop_t;
+
+cvar_t	pr_fastexec = {"pr_fastexec", "1", CVAR_NONE};
+
+/*
+=================
+PR_DecodeOp
+
+Maps a raw opcode to its pre-decoded equivalent
+=================
+*/
+static prop_t PR_DecodeOp (int op)
+{
+	switch (op)
+	{
+	case OP_ADD_F:		return PROP_ADD_F;
+	case OP_ADD_V:		return PROP_ADD_V;
+	case OP_SUB_F:		return PROP_SUB_F;
+	case OP_SUB_V:		return PROP_SUB_V;
+	case OP_MUL_F:		return PROP_MUL_F;
+	case OP_MUL_V:		return PROP_MUL_V;
+	case OP_MUL_FV:		return PROP_MUL_FV;
+	case OP_MUL_VF:		return PROP_MUL_VF;
+	case OP_DIV_F:		return PROP_DIV_F;
+	case OP_BITAND:		return PROP_BITAND;
+	case OP_BITOR:		return PROP_BITOR;
+	case OP_AND:		return PROP_AND;
+	case OP_OR:			return PROP_OR;
+	case OP_GE:			return PROP_GE;
+	case OP_LE:			return PROP_LE;
+	case OP_GT:			return PROP_GT;
+	case OP_LT:			return PROP_LT;
+	case OP_NOT_F:		return PROP_NOT_F;
+	case OP_NOT_V:		return PROP_NOT_V;
+	case OP_NOT_S:		return PROP_NOT_S;
+	case OP_NOT_FNC:	return PROP_NOT_FNC;
+	case OP_NOT_ENT:	return PROP_NOT_ENT;
+	case OP_EQ_F:		return PROP_EQ_F;
+	case OP_EQ_V:		return PROP_EQ_V;
+	case OP_EQ_S:		return PROP_EQ_S;
+	case OP_EQ_E:		return PROP_EQ_E;
+	case OP_EQ_FNC:		return PROP_EQ_FNC;
+	case OP_NE_F:		return PROP_NE_F;
+	case OP_NE_V:		return PROP_NE_V;
+	case OP_NE_S:		return PROP_NE_S;
+	case OP_NE_E:		return PROP_NE_E;
+	case OP_NE_FNC:		return PROP_NE_FNC;
+
+	case OP_STORE_F:
+	case OP_STORE_ENT:
+	case OP_STORE_FLD:
+	case OP_STORE_S:
+	case OP_STORE_FNC:	return PROP_STORE;
+	case OP_STORE_V:	return PROP_STORE_V;
+
+	case OP_STOREP_F:
+	case OP_STOREP_ENT:
+	case OP_STOREP_FLD:
+	case OP_STOREP_S:
+	case OP_STOREP_FNC:	return PROP_STOREP;
+	case OP_STOREP_V:	return PROP_STOREP_V;
+
+	case OP_ADDRESS:	return PROP_ADDRESS;
+
+	case OP_LOAD_F:
+	case OP_LOAD_FLD:
+	case OP_LOAD_ENT:
+	case OP_LOAD_S:
+	case OP_LOAD_FNC:	return PROP_LOAD;
+	case OP_LOAD_V:		return PROP_LOAD_V;
+
+	case OP_IF:			return PROP_IF;
+	case OP_IFNOT:		return PROP_IFNOT;
+	case OP_GOTO:		return PROP_GOTO;
+
+	case OP_CALL0:
+	case OP_CALL1:
+	case OP_CALL2:
+	case OP_CALL3:
+	case OP_CALL4:
+	case OP_CALL5:
+	case OP_CALL6:
+	case OP_CALL7:
+	case OP_CALL8:		return PROP_CALL;
+
+	case OP_DONE:
+	case OP_RETURN:		return PROP_RETURN;
+
+	case OP_STATE:		return PROP_STATE;
+
+	default:			return PROP_BAD;
+	}
+}
+
+/*
+=================
+PR_FuseBranch
+
+Returns the fused compare+branch opcode for the given pair, or PROP_BAD
+=================
+*/
+static prop_t PR_FuseBranch (prop_t cmp, const dstatement_t *branch)
+{
+	qboolean ifnot;
+
+	if (branch->op == OP_IF)
+		ifnot = false;
+	else if (branch->op == OP_IFNOT)
+		ifnot = true;
+	else
+		return PROP_BAD;
+
+	switch (cmp)
+	{
+#define PR_FUSE_CASE(X, name)	case PROP_##name: return ifnot ? PROP_##name##_IFNOT : PROP_##name##_IF;
+	PR_FUSED_COMPARES (PR_FUSE_CASE, _)
+#undef PR_FUSE_CASE
+	default:
+		return PROP_BAD;
+	}
+}
+
+/*
+=================
+PR_DecodeProgs
+
+Called from PR_LoadProgs once the statements have been byte-swapped
+=================
+*/
+void PR_DecodeProgs (void)
+{
+	int				i, numfused;
+	int				numstatements = qcvm->progs->numstatements;
 	dstatement_t	*st;
-	dfunction_t	*f, *newf;
-	int profile, startprofile;
-	edict_t		*ed;
-	int		exitdepth;
+	prstatement_t	*ds;
+	prop_t			fused;
 
-	if (!fnum || fnum >= qcvm->progs->numfunctions)
+	#define OPERAND(x)	((eval_t *)&qcvm->globals[(unsigned short)(x)])
+
+	qcvm->decoded = (prstatement_t *) Hunk_AllocNameNoFill (numstatements * sizeof (prstatement_t), "qc_decoded");
+
+	for (i = 0, numfused = 0; i < numstatements; i++)
 	{
-		if (pr_global_struct->self)
-			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
-		Host_Error ("PR_ExecuteProgram: NULL function");
+		st = &qcvm->statements[i];
+		ds = &qcvm->decoded[i];
+
+		ds->op = PR_DecodeOp (st->op);
+		ds->arg = 0;
+		ds->a = OPERAND (st->a);
+		ds->b = OPERAND (st->b);
+		ds->c = OPERAND (st->c);
+
+		switch (ds->op)
+		{
+		case PROP_IF:
+		case PROP_IFNOT:
+			ds->arg = st->b;
+			break;
+		case PROP_GOTO:
+			ds->arg = st->a;
+			break;
+		case PROP_CALL:
+			ds->arg = st->op - OP_CALL0;
+			break;
+		default:
+			if (i + 1 < numstatements && st[1].a == st->c)
+			{
+				fused = PR_FuseBranch (ds->op, &st[1]);
+				if (fused != PROP_BAD)
+				{
+					ds->op = fused;
+					ds->arg = st[1].b + 1;	// relative to the compare, not the branch
+					numfused++;
+				}
+			}
+			break;
+		}
 	}
 
-	f = &qcvm->functions[fnum];
+	#undef OPERAND
 
-	qcvm->trace = false;
+	Con_DPrintf ("%d QC statements decoded (%d fused branches)\n", numstatements, numfused);
+}
 
-// make a stack frame
-	exitdepth = qcvm->depth;
+/*
+==============================================================================
+
+INTERPRETERS
+
+==============================================================================
+*/
+
+#define PR_RUNAWAY_LIMIT	0x1000000 /* was 100000 */
+
+/*
+====================
+PR_StorePointerTouch
+
+Marks an edict's find() index entry dirty after QC stored to one of the
+indexed fields through a pointer. This can't happen at OP_ADDRESS, since
+the value stored may come from a call that runs find() in between.
+====================
+*/
+static inline void PR_StorePointerTouch (int ofs)
+{
+	int		num, field;
+
+	if (!qcvm->findindex)
+		return;
+	num = ofs / qcvm->edict_size;
+	field = (ofs - num * qcvm->edict_size - (int) offsetof (edict_t, v)) / 4;
+	if (ED_IsFindIndexField (field))
+		PR_FindIndexTouch ((edict_t *)((byte *)qcvm->edicts + num * qcvm->edict_size));
+}
 
-	st = &qcvm->statements[PR_EnterFunction(f)];
-	startprofile = profile = 0;
+static struct
+{
+	double		time;
+	int64_t		calls;
+	int64_t		statements;
+} pr_execstats[2];
+
+/*
+====================
+PR_ExecuteSwitch
+
+Reference interpreter working on the raw statements.
+Also used for tracing, since it's the only one that can print statements as it goes.
+====================
+*/
+#define OPA ((eval_t *)&qcvm->globals[(unsigned short)st->a])
+#define OPB ((eval_t *)&qcvm->globals[(unsigned short)st->b])
+#define OPC ((eval_t *)&qcvm->globals[(unsigned short)st->c])
+
+static int PR_ExecuteSwitch (dstatement_t *st, int exitdepth, int profile, int startprofile)
+{
+	eval_t		*ptr;
+	dfunction_t	*newf;
+	edict_t		*ed;
 
     while (1)
     {
 	st++;	/* next statement */
 
-	if (++profile > 0x1000000) /* was 100000 */
+	if (++profile > PR_RUNAWAY_LIMIT)
 	{
 		qcvm->xstatement = st - qcvm->statements;
 		PR_RunError("runaway loop error");
@@ -573,6 +1239,7 @@ void PR_ExecuteProgram (func_t fnum)
 	case OP_STOREP_FNC:	// pointers
 		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
 		ptr->_int = OPA->_int;
+		PR_StorePointerTouch (OPB->_int);
 		break;
 	case OP_STOREP_V:
 		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
@@ -649,11 +1316,7 @@ void PR_ExecuteProgram (func_t fnum)
 		newf = &qcvm->functions[OPA->function];
 		if (newf->first_statement < 0)
 		{ // Built-in function
-			int i = -newf->first_statement;
-			if (i >= qcvm->numbuiltins)
-				PR_RunError("Bad builtin call number %d", i);
-			PR_CheckBuiltinExtension (newf);
-			qcvm->builtins[i]();
+			PR_CallBuiltin (newf);
 			break;
 		}
 		// Normal function
@@ -671,7 +1334,7 @@ void PR_ExecuteProgram (func_t fnum)
 		st = &qcvm->statements[PR_LeaveFunction()];
 		if (qcvm->depth == exitdepth)
 		{ // Done
-			return;
+			return profile;
 		}
 		break;
 
@@ -692,3 +1355,413 @@ void PR_ExecuteProgram (func_t fnum)
 #undef OPA
 #undef OPB
 #undef OPC
+
+/*
+====================
+PR_ExecuteDecoded
+
+Fast interpreter working on the pre-decoded statements.
+Uses computed gotos where available, a plain switch otherwise.
+The runaway loop check is only done on backward jumps, since
+there's no other way to run forever without overflowing the stack.
+====================
+*/
+#if defined(__GNUC__) && !defined(PR_NO_COMPUTED_GOTO)
+	#define PR_COMPUTED_GOTO
+#endif
+
+#define OPA (ds->a)
+#define OPB (ds->b)
+#define OPC (ds->c)
+
+#ifdef PR_COMPUTED_GOTO
+	#define CASE(name)		op_##name:
+	#define NEXT			do { ds++; profile++; goto *dispatch[ds->op]; } while (0)
+#else
+	#define CASE(name)		case PROP_##name:
+	#define NEXT			break
+#endif
+
+#define JUMP(ofs)																	\
+	do {																			\
+		int jump = (ofs);															\
+		ds += jump - 1;		/* -1 to offset the ds++ */								\
+		if (jump <= 0 && profile > PR_RUNAWAY_LIMIT)								\
+		{																			\
+			qcvm->xstatement = ds + 1 - qcvm->decoded;								\
+			PR_RunError ("runaway loop error");										\
+		}																			\
+	} while (0)
+
+#define FUSED_BRANCH(name, expr)													\
+	CASE (name##_IF)																\
+		cond = (expr);																\
+		OPC->_float = cond;															\
+		if (cond)																	\
+			JUMP (ds->arg);															\
+		else																		\
+			ds++;																	\
+		profile++;																	\
+		NEXT;																		\
+	CASE (name##_IFNOT)																\
+		cond = (expr);																\
+		OPC->_float = cond;															\
+		if (!cond)																	\
+			JUMP (ds->arg);															\
+		else																		\
+			ds++;																	\
+		profile++;																	\
+		NEXT;
+
+static int PR_ExecuteDecoded (prstatement_t *ds, int exitdepth, int profile, int startprofile)
+{
+	eval_t		*ptr;
+	dfunction_t	*newf;
+	edict_t		*ed;
+	int			cond;
+
+#ifdef PR_COMPUTED_GOTO
+	static const void *const dispatch[PROP_COUNT] =
+	{
+	#define PROP_LABEL(name)	&&op_##name,
+		PR_DECODED_OPS (PROP_LABEL)
+	#undef PROP_LABEL
+	};
+
+	NEXT;
+#else
+	while (1)
+	{
+	ds++;
+	profile++;
+
+	switch (ds->op)
+	{
+#endif
+
+	CASE (ADD_F)
+		OPC->_float = OPA->_float + OPB->_float;
+		NEXT;
+	CASE (ADD_V)
+		OPC->vector[0] = OPA->vector[0] + OPB->vector[0];
+		OPC->vector[1] = OPA->vector[1] + OPB->vector[1];
+		OPC->vector[2] = OPA->vector[2] + OPB->vector[2];
+		NEXT;
+
+	CASE (SUB_F)
+		OPC->_float = OPA->_float - OPB->_float;
+		NEXT;
+	CASE (SUB_V)
+		OPC->vector[0] = OPA->vector[0] - OPB->vector[0];
+		OPC->vector[1] = OPA->vector[1] - OPB->vector[1];
+		OPC->vector[2] = OPA->vector[2] - OPB->vector[2];
+		NEXT;
+
+	CASE (MUL_F)
+		OPC->_float = OPA->_float * OPB->_float;
+		NEXT;
+	CASE (MUL_V)
+		OPC->_float = OPA->vector[0] * OPB->vector[0] +
+			      OPA->vector[1] * OPB->vector[1] +
+			      OPA->vector[2] * OPB->vector[2];
+		NEXT;
+	CASE (MUL_FV)
+		OPC->vector[0] = OPA->_float * OPB->vector[0];
+		OPC->vector[1] = OPA->_float * OPB->vector[1];
+		OPC->vector[2] = OPA->_float * OPB->vector[2];
+		NEXT;
+	CASE (MUL_VF)
+		OPC->vector[0] = OPB->_float * OPA->vector[0];
+		OPC->vector[1] = OPB->_float * OPA->vector[1];
+		OPC->vector[2] = OPB->_float * OPA->vector[2];
+		NEXT;
+
+	CASE (DIV_F)
+		OPC->_float = OPA->_float / OPB->_float;
+		NEXT;
+
+	CASE (BITAND)
+		OPC->_float = (int)OPA->_float & (int)OPB->_float;
+		NEXT;
+	CASE (BITOR)
+		OPC->_float = (int)OPA->_float | (int)OPB->_float;
+		NEXT;
+
+	CASE (GE)
+		OPC->_float = OPA->_float >= OPB->_float;
+		NEXT;
+	CASE (LE)
+		OPC->_float = OPA->_float <= OPB->_float;
+		NEXT;
+	CASE (GT)
+		OPC->_float = OPA->_float > OPB->_float;
+		NEXT;
+	CASE (LT)
+		OPC->_float = OPA->_float < OPB->_float;
+		NEXT;
+	CASE (AND)
+		OPC->_float = OPA->_float && OPB->_float;
+		NEXT;
+	CASE (OR)
+		OPC->_float = OPA->_float || OPB->_float;
+		NEXT;
+
+	CASE (NOT_F)
+		OPC->_float = !OPA->_float;
+		NEXT;
+	CASE (NOT_V)
+		OPC->_float = !OPA->vector[0] && !OPA->vector[1] && !OPA->vector[2];
+		NEXT;
+	CASE (NOT_S)
+		OPC->_float = !OPA->string || !*PR_GetString(OPA->string);
+		NEXT;
+	CASE (NOT_FNC)
+		OPC->_float = !OPA->function;
+		NEXT;
+	CASE (NOT_ENT)
+		OPC->_float = (PROG_TO_EDICT(OPA->edict) == qcvm->edicts);
+		NEXT;
+
+	CASE (EQ_F)
+		OPC->_float = OPA->_float == OPB->_float;
+		NEXT;
+	CASE (EQ_V)
+		OPC->_float = (OPA->vector[0] == OPB->vector[0]) &&
+			      (OPA->vector[1] == OPB->vector[1]) &&
+			      (OPA->vector[2] == OPB->vector[2]);
+		NEXT;
+	CASE (EQ_S)
+		OPC->_float = !strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
+		NEXT;
+	CASE (EQ_E)
+		OPC->_float = OPA->_int == OPB->_int;
+		NEXT;
+	CASE (EQ_FNC)
+		OPC->_float = OPA->function == OPB->function;
+		NEXT;
+
+	CASE (NE_F)
+		OPC->_float = OPA->_float != OPB->_float;
+		NEXT;
+	CASE (NE_V)
+		OPC->_float = (OPA->vector[0] != OPB->vector[0]) ||
+			      (OPA->vector[1] != OPB->vector[1]) ||
+			      (OPA->vector[2] != OPB->vector[2]);
+		NEXT;
+	CASE (NE_S)
+		OPC->_float = strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
+		NEXT;
+	CASE (NE_E)
+		OPC->_float = OPA->_int != OPB->_int;
+		NEXT;
+	CASE (NE_FNC)
+		OPC->_float = OPA->function != OPB->function;
+		NEXT;
+
+	FUSED_BRANCH (EQ_F,		OPA->_float == OPB->_float)
+	FUSED_BRANCH (NE_F,		OPA->_float != OPB->_float)
+	FUSED_BRANCH (EQ_E,		OPA->_int == OPB->_int)
+	FUSED_BRANCH (NE_E,		OPA->_int != OPB->_int)
+	FUSED_BRANCH (NOT_F,	!OPA->_float)
+	FUSED_BRANCH (NOT_ENT,	PROG_TO_EDICT(OPA->edict) == qcvm->edicts)
+	FUSED_BRANCH (GE,		OPA->_float >= OPB->_float)
+	FUSED_BRANCH (LE,		OPA->_float <= OPB->_float)
+	FUSED_BRANCH (GT,		OPA->_float > OPB->_float)
+	FUSED_BRANCH (LT,		OPA->_float < OPB->_float)
+
+	CASE (STORE)
+		OPB->_int = OPA->_int;
+		NEXT;
+	CASE (STORE_V)
+		OPB->vector[0] = OPA->vector[0];
+		OPB->vector[1] = OPA->vector[1];
+		OPB->vector[2] = OPA->vector[2];
+		NEXT;
+
+	CASE (STOREP)
+		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
+		ptr->_int = OPA->_int;
+		PR_StorePointerTouch (OPB->_int);
+		NEXT;
+	CASE (STOREP_V)
+		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
+		ptr->vector[0] = OPA->vector[0];
+		ptr->vector[1] = OPA->vector[1];
+		ptr->vector[2] = OPA->vector[2];
+		NEXT;
+
+	CASE (ADDRESS)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		if (ed == (edict_t *)qcvm->edicts && sv.state == ss_active)
+		{
+			qcvm->xstatement = ds - qcvm->decoded;
+			PR_RunError("assignment to world entity");
+		}
+		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)qcvm->edicts;
+		NEXT;
+
+	CASE (LOAD)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		NEXT;
+	CASE (LOAD_V)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		ptr = (eval_t *)((int *)&ed->v + OPB->_int);
+		OPC->vector[0] = ptr->vector[0];
+		OPC->vector[1] = ptr->vector[1];
+		OPC->vector[2] = ptr->vector[2];
+		NEXT;
+
+	CASE (IFNOT)
+		if (!OPA->_int)
+			JUMP (ds->arg);
+		NEXT;
+	CASE (IF)
+		if (OPA->_int)
+			JUMP (ds->arg);
+		NEXT;
+	CASE (GOTO)
+		JUMP (ds->arg);
+		NEXT;
+
+	CASE (CALL)
+		qcvm->xfunction->profile += profile - startprofile;
+		startprofile = profile;
+		qcvm->xstatement = ds - qcvm->decoded;
+		qcvm->argc = ds->arg;
+		if (!OPA->function)
+			PR_RunError("NULL function");
+		newf = &qcvm->functions[OPA->function];
+		if (newf->first_statement < 0)
+		{ // Built-in function
+			PR_CallBuiltin (newf);
+			// traceon switches to the slow path for the rest of this call
+			if (qcvm->trace)
+				return PR_ExecuteSwitch (&qcvm->statements[ds - qcvm->decoded], exitdepth, profile, startprofile);
+			NEXT;
+		}
+		// Normal function
+		ds = &qcvm->decoded[PR_EnterFunction(newf)];
+		NEXT;
+
+	CASE (RETURN)
+		qcvm->xfunction->profile += profile - startprofile;
+		startprofile = profile;
+		qcvm->xstatement = ds - qcvm->decoded;
+		qcvm->globals[OFS_RETURN] = OPA->vector[0];
+		qcvm->globals[OFS_RETURN + 1] = OPA->vector[1];
+		qcvm->globals[OFS_RETURN + 2] = OPA->vector[2];
+		ds = &qcvm->decoded[PR_LeaveFunction()];
+		if (qcvm->depth == exitdepth)
+		{ // Done
+			return profile;
+		}
+		NEXT;
+
+	CASE (STATE)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		ed->v.frame = OPA->_float;
+		ed->v.think = OPB->function;
+		NEXT;
+
+#ifndef PR_COMPUTED_GOTO
+	default:
+#endif
+	CASE (BAD)
+		qcvm->xstatement = ds - qcvm->decoded;
+		PR_RunError("Bad opcode %i", qcvm->statements[qcvm->xstatement].op);
+
+#ifndef PR_COMPUTED_GOTO
+	}
+	}	/* end of while(1) loop */
+#endif
+}
+
+#undef FUSED_BRANCH
+#undef JUMP
+#undef NEXT
+#undef CASE
+#undef OPA
+#undef OPB
+#undef OPC
+
+/*
+====================
+PR_ExecuteProgram
+====================
+*/
+void PR_ExecuteProgram (func_t fnum)
+{
+	dfunction_t	*f;
+	int		exitdepth, s, fast, statements;
+	double		start;
+
+	if (!fnum || fnum >= qcvm->progs->numfunctions)
+	{
+		if (pr_global_struct->self)
+			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
+		Host_Error ("PR_ExecuteProgram: NULL function");
+	}
+
+	f = &qcvm->functions[fnum];
+
+	qcvm->trace = false;
+	fast = pr_fastexec.value && qcvm->decoded;
+
+// make a stack frame
+	exitdepth = qcvm->depth;
+	start = 0.0;
+	if (exitdepth == 0)
+	{
+		PR_ProfileBegin ();
+		start = Sys_DoubleTime ();
+	}
+
+	s = PR_EnterFunction(f);
+	if (fast)
+		statements = PR_ExecuteDecoded (&qcvm->decoded[s], exitdepth, 0, 0);
+	else
+		statements = PR_ExecuteSwitch (&qcvm->statements[s], exitdepth, 0, 0);
+
+	pr_execstats[fast].statements += statements;
+	if (exitdepth == 0)
+	{
+		pr_execstats[fast].time += Sys_DoubleTime () - start;
+		pr_execstats[fast].calls++;
+	}
+}
+
+/*
+====================
+PR_ExecStats_f
+
+Compares the two interpreters, using the time spent in top-level QC calls
+since the last invocation. Toggle pr_fastexec in between to benchmark.
+====================
+*/
+void PR_ExecStats_f (void)
+{
+	static const char *const names[2] = {"switch", "decoded"};
+	int i;
+
+	Con_Printf ("interpreter   calls      statements   msec      Mstmt/s\n");
+	for (i = 0; i < 2; i++)
+	{
+		Con_Printf ("%-12s %6" SDL_PRIs64 " %15" SDL_PRIs64 " %9.1f %9.2f\n",
+			names[i], pr_execstats[i].calls, pr_execstats[i].statements,
+			pr_execstats[i].time * 1000.0,
+			pr_execstats[i].time > 0.0 ? pr_execstats[i].statements / pr_execstats[i].time / 1e6 : 0.0
+		);
+	}
+	memset (pr_execstats, 0, sizeof (pr_execstats));
+}
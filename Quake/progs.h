@@ -85,6 +85,13 @@ typedef struct
 	dfunction_t	*f;
 } prstack_t;
 
+typedef struct prstatement_s
+{
+	int			op;		/* pre-decoded opcode, see pr_exec.c */
+	int			arg;	/* branch offset or call argument count */
+	eval_t		*a, *b, *c;
+} prstatement_t;
+
 typedef struct prhashtable_s
 {
 	int			capacity;
@@ -110,6 +117,7 @@ struct pr_extfuncs_s
 #undef QCEXTFUNC
 };
 extern	cvar_t	pr_checkextension;	//if 0, extensions are disabled (unless they'd be fatal, but they're still spammy)
+extern	cvar_t	pr_fastexec;		//if 0, the reference switch-based interpreter is used instead of the pre-decoded one
 	
 struct pr_extglobals_s
 {
@@ -205,6 +213,7 @@ typedef struct qcvm_s
 	dprograms_t		*progs;
 	dfunction_t		*functions;
 	dstatement_t	*statements;
+	prstatement_t	*decoded;	/* parallel to statements, used by the fast interpreter */
 	float			*globals;	/* same as pr_global_struct */
 	ddef_t			*fielddefs;	//yay reflection.
 
@@ -218,6 +227,9 @@ typedef struct qcvm_s
 	int				argc;
 
 	qboolean		trace;
+	qboolean		profiling;	/* pr_profile, latched for the current top-level call */
+	struct prprofiler_s	*profiler;
+	struct prfindindex_s	*findindex;	/* see PF_Find, NULL until the first lookup */
 	dfunction_t		*xfunction;
 	int				xstatement;
 
@@ -268,6 +280,9 @@ typedef struct qcvm_s
 	edict_t		*edicts;			// can NOT be array indexed, because
 									// edict_t is variable sized, but can
 									// be used to reference the world ent
+	syswatch_t	edictwatch;			// server only, tracks writes for incremental save snapshots
+	int			*edictpagegen;		// write generation of each edict page
+	byte		*edictpagewrites;	// scratch for Sys_WatchGetWrites
 
 	int			numentityfields;
 	int			*entityfieldofs;
@@ -297,12 +312,20 @@ typedef struct savedata_s
 	edict_t			*edicts;
 	float			*globals;
 	const char		*lightstyles[MAX_LIGHTSTYLES];
-	byte			*buffer;
+	byte			*buffer;		// known strings, globals and lightstyles
 	int				buffersize;
+	byte			*edictbuffer;	// edicts, only the pages written since the last fill get copied
+	size_t			edictbuffersize;
+	const void		*edictsource;	// edict array edictbuffer was filled from
+	int				edictgen;		// edict write generation edictbuffer is up to date with
+	size_t			copiedbytes;	// stats for the last fill
+	size_t			totalbytes;
+	qboolean		binary;			// write SAVEGAME_VERSION_BINARY instead of text
 } savedata_t;
 
 #define	SAVEGAME_VERSION		5
 #define	SAVEGAME_VERSION_KEX	6
+#define	SAVEGAME_VERSION_BINARY	105	// version and comment lines as text, then binary data
 
 extern THREAD_LOCAL globalvars_t	*pr_global_struct;
 extern THREAD_LOCAL qcvm_t			*qcvm;
@@ -314,6 +337,7 @@ void PR_PopQCVM(qcvm_t *oldvm);
 void PR_Init (void);
 
 void PR_ExecuteProgram (func_t fnum);
+void PR_DecodeProgs (void);
 void PR_ClearProgs(qcvm_t *vm);
 qboolean PR_LoadProgs (const char *filename, qboolean fatal);
 void PR_EnableExtensions (void);
@@ -327,7 +351,22 @@ int PR_SetEngineString (const char *s);
 void PR_ClearEngineString (int num);
 int PR_AllocString (int bufferlength, char **ptr);
 
+/* string fields kept in the find() index */
+#define FINDINDEX_FIELDS	3
+#define ED_IsFindIndexField(ofs)	\
+	((ofs) == (int) (offsetof (entvars_t, classname) / 4) ||	\
+	 (ofs) == (int) (offsetof (entvars_t, target) / 4) ||		\
+	 (ofs) == (int) (offsetof (entvars_t, targetname) / 4))
+
+void PR_FindIndexTouch (edict_t *ed);
+void PR_FindIndexRemove (edict_t *ed);
+void PR_FindIndexFree (void);
+void PR_FindStats_f (void);
+
 void PR_Profile_f (void);
+void PR_ExecStats_f (void);
+void PR_InitProfiler (void);
+void PR_ProfileFree (void);
 
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
@@ -403,5 +442,8 @@ void SaveData_Init (savedata_t *save);
 void SaveData_Clear (savedata_t *save);
 void SaveData_Fill (savedata_t *save);
 void SaveData_WriteHeader (savedata_t *save);
+void SaveData_WriteBinary (savedata_t *save);
+const byte *SaveData_ParseBinaryHeader (savedata_t *save, const byte *data, const byte *end);
+int ED_ParseBinarySave (const byte *data, const byte *end);
 
 #endif	/* QUAKE_PROGS_H */
@@ -73,6 +73,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define U_TRANS			(1<<15)
 //johnfitz
 
+// svc_snapshot entity records use the same bits, except for U_SIGNAL
+#define U_REMOVE		U_SIGNAL	// entity left the snapshot, entity 0 ends the list
+
 #define	SU_VIEWHEIGHT	(1<<0)
 #define	SU_IDEALPITCH	(1<<1)
 #define	SU_PUNCH1		(1<<2)
@@ -224,6 +227,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define svc_backtolobby		55
 #define svc_localsound		56
 
+// delta snapshots, only sent to clients that asked with "deltasnapshots 1"
+#define svc_snapshot		57	// [long] sequence [byte] delta from sequence - n, 0 = from baselines
+								// then entity records (see U_REMOVE)
+
 //
 // client to server
 //
@@ -232,6 +239,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	clc_disconnect	2
 #define	clc_move		3		// [usercmd_t]
 #define	clc_stringcmd	4		// [string] message
+#define	clc_ackframe	50		// [long] last svc_snapshot sequence the client decoded
 
 //
 // temp entity events
@@ -267,6 +275,25 @@ typedef struct
 	int		effects;
 } entity_state_t;
 
+// delta snapshots: both sides keep the last few around to delta from
+#define SNAPSHOT_FRAMES		32	// must be a power of two
+
+typedef struct
+{
+	entity_state_t	state;
+	unsigned short	num;
+	qboolean		step;			// sent as U_STEP
+	int				lerpfinish;		// sent as U_LERPFINISH, -1 if not sent
+} snapentity_t;
+
+typedef struct
+{
+	unsigned int	sequence;		// 0 = unused
+	int				numents;
+	int				maxents;
+	snapentity_t	*ents;
+} snapframe_t;
+
 typedef struct
 {
 	vec3_t	viewangles;
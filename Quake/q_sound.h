@@ -36,6 +36,7 @@ typedef struct sfx_s
 {
 	char	name[MAX_QPATH];
 	cache_user_t	cache;
+	struct sndload_s	*loading;	/* being decoded on a worker */
 } sfx_t;
 
 /* !!! if this is changed, it must be changed in asm_i386.h too !!! */
@@ -89,12 +90,34 @@ typedef struct
 	int	dataofs;		/* chunk starts this many bytes from file start	*/
 } wavinfo_t;
 
+typedef enum
+{
+	WAVMSG_NONE,
+	WAVMSG_DEVELOPER,
+	WAVMSG_PRINT,
+	WAVMSG_WARNING,
+	WAVMSG_FATAL,
+} wavmsg_t;
+
+/* wav parsing state, messages are kept for the main thread to print */
+typedef struct
+{
+	byte	*data_p;
+	byte	*iff_end;
+	byte	*last_chunk;
+	byte	*iff_data;
+	int	iff_chunk_len;
+	wavmsg_t	level;		/* most severe message so far		*/
+	char	messages[256];
+} wavparser_t;
+
 void S_Init (void);
 void S_Startup (void);
 void S_Shutdown (void);
 void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation);
 void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation);
 void S_StopSound (int entnum, int entchannel);
+void S_StopDynamicSounds (void);
 void S_StopAllSounds(qboolean clear);
 void S_ClearBuffer (void);
 void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up);
@@ -113,11 +136,8 @@ void S_InitPaintChannels (void);
 float S_GetLoFreqLevel (void);
 float S_GetHiFreqLevel (void);
 
-/* picks a channel based on priorities, empty slots, number of channels */
-channel_t *SND_PickChannel (int entnum, int entchannel);
-
-/* spatializes a channel */
-void SND_Spatialize (channel_t *ch);
+/* mixing position, safe to call from the host while the mixer thread runs */
+int S_GetPaintedTime (void);
 
 /* music stream support */
 void S_RawSamples(int samples, int rate, int width, int channels, byte * data, float volume);
@@ -160,10 +180,11 @@ extern	channel_t	snd_channels[MAX_CHANNELS];
 
 extern	volatile dma_t	*shm;
 
-extern	int		total_channels;
+extern	int		total_channels;	/* owned by the mixer */
 extern	int		soundtime;
 extern	int		paintedtime;
 extern	int		s_rawend;
+extern	SDL_atomic_t	snd_rawend;	/* s_rawend as last published to the mixer */
 
 extern	vec3_t		listener_origin;
 extern	vec3_t		listener_forward;
@@ -184,9 +205,17 @@ extern	cvar_t		bgmvolume;
 void S_LocalSound (const char *name);
 sfxcache_t *S_LoadSound (sfx_t *s);
 
-wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength);
+/* returns the cached sound, or queues it for decoding on a worker thread
+ * and returns NULL until S_UpdateLoads has put it in the cache */
+sfxcache_t *S_LoadSoundAsync (sfx_t *s);
+/* caches the sounds that finished decoding, or waits for all of them */
+void S_UpdateLoads (qboolean wait);
+
+wavinfo_t WAV_Parse (wavparser_t *parser, const char *name, byte *wav, int wavlength);
+void WAV_PrintMessages (wavparser_t *parser);
 
 void SND_InitScaletable (void);
+void SND_SimdTest_f (void);
 
 #endif	/* __QUAKE_SOUND__ */
 
@@ -266,6 +266,9 @@ typedef struct
 #define	APIENTRY
 #endif
 
+#include "tasks.h"
+#include "trace.h"
+
 #include "progs.h"
 #include "server.h"
 
@@ -306,6 +309,7 @@ extern qboolean noclip_anglehack;
 extern	quakeparms_t *host_parms;
 
 extern	cvar_t		sys_ticrate;
+extern	cvar_t		sys_eventloop;
 extern	cvar_t		sys_nostdout;
 extern	cvar_t		developer;
 extern	cvar_t		map_checks;
@@ -161,6 +161,10 @@ typedef struct client_s
 	int				oldstats_i[MAX_CL_STATS];		//previous values of stats. if these differ from the current values, reflag resendstats.
 	float			oldstats_f[MAX_CL_STATS];		//previous values of stats. if these differ from the current values, reflag resendstats.
 	char			*oldstats_s[MAX_CL_STATS];
+
+// svc_snapshot
+	qboolean		deltasnapshots;		// client asked for delta compressed entities
+	unsigned int	snapshotack;		// last snapshot sequence the client decoded
 } client_t;
 
 
@@ -278,6 +282,7 @@ void SV_LocalSound (client_t *client, const char *sample); // for 2021 rerelease
 void SV_DropClient (qboolean crash);
 
 void SV_SendClientMessages (void);
+void SV_AckSnapshot (client_t *client, unsigned int sequence);
 void SV_ClearDatagram (void);
 void SV_ReserveSignonSpace (int numbytes);
 
@@ -34,6 +34,8 @@ static void S_SoundList (void);
 static void S_Update_ (void);
 void S_StopAllSounds (qboolean clear);
 static void S_StopAllSoundsC (void);
+static void S_StartMixerThread (void);
+static void S_StopMixerThread (void);
 
 void S_SetUnderwaterIntensity (float intensity);
 
@@ -41,10 +43,38 @@ void S_SetUnderwaterIntensity (float intensity);
 // Internal sound data & structures
 // =======================================================================
 
+// the mixer's channels, only touched by S_MixerUpdate and what it calls
 channel_t	snd_channels[MAX_CHANNELS];
 int		total_channels;
 
-static int	snd_blocked = 0;
+// what the host last told the mixer about each channel, for picking
+// and replacing channels without reading the mixer's state
+typedef struct
+{
+	channel_t	chan;		// end is only an estimate, pos is the start skip
+	int		frame;		// snd_hostframe when the sound was started
+} hostchannel_t;
+
+static hostchannel_t	host_channels[MAX_CHANNELS];
+static int		host_total_channels;
+static int		host_paintedtime;	// for noticing the mixer's time wrap
+static int		snd_hostframe;
+
+// what spatialization needs to know about the listener
+typedef struct
+{
+	vec3_t		origin;
+	vec3_t		right;
+	int		viewentity;
+	sfx_t		*ambient_sfx[NUM_AMBIENTS];
+	int		ambient_vol[NUM_AMBIENTS];
+	float		underwater;
+} sndlistener_t;
+
+static sndlistener_t	host_listener;
+static sndlistener_t	mix_listener;
+
+static SDL_atomic_t	snd_blocked;
 static qboolean	snd_initialized = false;
 
 static dma_t	sn;
@@ -59,14 +89,18 @@ vec3_t		listener_up;
 
 int		soundtime;	// sample PAIRS
 int		paintedtime;	// sample PAIRS
+static SDL_atomic_t	snd_paintedtime;	// paintedtime as last published by the mixer
 
 int		s_rawend;
+SDL_atomic_t	snd_rawend;
 portable_samplepair_t	s_rawsamples[MAX_RAW_SAMPLES];
 
 
 #define	MAX_SFX		1024
 static sfx_t	*known_sfx = NULL;	// hunk allocated [MAX_SFX]
 static int	num_sfx;
+static sfx_t	*sfx_hashmap[MAX_SFX * 2];
+static hashstats_t	sfx_stats = {"sounds"};
 
 static sfx_t	*ambient_sfx[NUM_AMBIENTS];
 
@@ -91,6 +125,194 @@ static	cvar_t	ambient_fade = {"ambient_fade", "100", CVAR_NONE};
 static	cvar_t	snd_noextraupdate = {"snd_noextraupdate", "0", CVAR_NONE};
 static	cvar_t	snd_show = {"snd_show", "0", CVAR_NONE};
 static	cvar_t	_snd_mixahead = {"_snd_mixahead", "0.1", CVAR_ARCHIVE};
+static	cvar_t	snd_mixthread = {"snd_mixthread", "1", CVAR_ARCHIVE};
+
+/*
+===============================================================================
+
+MIXER COMMAND QUEUE
+
+The host never touches the mixer's channels. It posts what changed to a
+single producer, single consumer ring that the mixer drains before each
+paint, either on its own thread or, with snd_mixthread 0, inline from
+S_Update like before.
+
+===============================================================================
+*/
+
+#define SND_MAX_COMMANDS	1024	// must be a power of two
+#define SND_MIX_INTERVAL	5	// ms between mixer thread wakeups
+
+typedef enum
+{
+	SNDCMD_START,			// chan.end is relative to the mixer's paintedtime
+	SNDCMD_STATIC,
+	SNDCMD_STOP,
+	SNDCMD_STOPDYNAMIC,
+	SNDCMD_STOPALL,
+	SNDCMD_CLEARBUFFER,
+	SNDCMD_LISTENER,
+} sndcmdtype_t;
+
+typedef struct
+{
+	sndcmdtype_t	type;
+	int		channel;
+	union
+	{
+		channel_t	chan;
+		sndlistener_t	listener;
+	};
+} sndcmd_t;
+
+static struct
+{
+	sndcmd_t	cmds[SND_MAX_COMMANDS];
+	SDL_atomic_t	head;		// next slot the host writes
+	SDL_atomic_t	tail;		// next slot the mixer reads
+} snd_queue;
+
+static struct
+{
+	SDL_Thread	*thread;
+	SDL_sem		*wake;
+	SDL_atomic_t	quit;
+} snd_mixer;
+
+static void S_MixerUpdate (void);
+static void S_RunCommands (void);
+
+/*
+=================
+S_PostCommand
+=================
+*/
+static void S_PostCommand (const sndcmd_t *cmd)
+{
+	int head = SDL_AtomicGet (&snd_queue.head);
+
+	while ((unsigned int)(head - SDL_AtomicGet (&snd_queue.tail)) >= SND_MAX_COMMANDS)
+	{
+		if (snd_mixer.thread)
+		{
+			SDL_SemPost (snd_mixer.wake);
+			SDL_Delay (1);
+		}
+		else
+			S_RunCommands ();
+	}
+
+	snd_queue.cmds[head & (SND_MAX_COMMANDS - 1)] = *cmd;
+	SDL_AtomicSet (&snd_queue.head, head + 1);
+}
+
+/*
+=================
+S_PostSimpleCommand
+=================
+*/
+static void S_PostSimpleCommand (sndcmdtype_t type, int channel)
+{
+	sndcmd_t cmd;
+
+	memset (&cmd, 0, sizeof (cmd));
+	cmd.type = type;
+	cmd.channel = channel;
+	S_PostCommand (&cmd);
+}
+
+/*
+=================
+S_KickMixer
+
+Gets posted commands applied soon, or right away without a mixer thread
+=================
+*/
+static void S_KickMixer (qboolean mix)
+{
+	if (snd_mixer.thread)
+	{
+		if (!SDL_SemValue (snd_mixer.wake))
+			SDL_SemPost (snd_mixer.wake);
+	}
+	else if (mix)
+		S_MixerUpdate ();
+	else
+		S_RunCommands ();
+}
+
+/*
+=================
+S_MixerThread
+=================
+*/
+static int SDLCALL S_MixerThread (void *unused)
+{
+	TRACE_THREAD_NAME ("mixer");
+
+	while (!SDL_AtomicGet (&snd_mixer.quit))
+	{
+		SDL_SemWaitTimeout (snd_mixer.wake, SND_MIX_INTERVAL);
+		TRACE_BEGIN ("S_MixerUpdate");
+		S_MixerUpdate ();
+		TRACE_END ();
+	}
+
+	return 0;
+}
+
+/*
+=================
+S_StartMixerThread
+=================
+*/
+static void S_StartMixerThread (void)
+{
+	if (snd_mixer.thread || !sound_started)
+		return;
+
+	if (!snd_mixer.wake)
+		snd_mixer.wake = SDL_CreateSemaphore (0);
+	SDL_AtomicSet (&snd_mixer.quit, 0);
+	if (snd_mixer.wake)
+		snd_mixer.thread = SDL_CreateThread (S_MixerThread, "Mixer", NULL);
+	if (!snd_mixer.thread)
+		Con_Printf ("Couldn't start the mixer thread, mixing on the main thread\n");
+}
+
+/*
+=================
+S_StopMixerThread
+=================
+*/
+static void S_StopMixerThread (void)
+{
+	if (!snd_mixer.thread)
+		return;
+
+	SDL_AtomicSet (&snd_mixer.quit, 1);
+	SDL_SemPost (snd_mixer.wake);
+	SDL_WaitThread (snd_mixer.thread, NULL);
+	snd_mixer.thread = NULL;
+}
+
+static void SND_Callback_snd_mixthread (cvar_t *var)
+{
+	if (var->value)
+		S_StartMixerThread ();
+	else
+		S_StopMixerThread ();
+}
+
+/*
+=================
+S_GetPaintedTime
+=================
+*/
+int S_GetPaintedTime (void)
+{
+	return SDL_AtomicGet (&snd_paintedtime);
+}
 
 
 static void S_SoundInfo_f (void)
@@ -106,7 +328,8 @@ static void S_SoundInfo_f (void)
 	Con_Printf("%5d samples\n", shm->samples);
 	Con_Printf("%5d samplepos\n", shm->samplepos);
 	Con_Printf("%5d submission_chunk\n", shm->submission_chunk);
-	Con_Printf("%5d total_channels\n", total_channels);
+	Con_Printf("%5d total_channels\n", host_total_channels);
+	Con_Printf("%s mixer thread\n", snd_mixer.thread ? "running" : "no");
 	Con_Printf("%p dma buffer\n", shm->buffer);
 }
 
@@ -145,6 +368,8 @@ void S_Startup (void)
 	{
 		Con_Printf("Audio: %d bit, %s, %d Hz\n", shm->samplebits,
 				(shm->channels == 2) ? "stereo" : "mono", shm->speed);
+		if (snd_mixthread.value)
+			S_StartMixerThread ();
 	}
 }
 
@@ -178,6 +403,7 @@ void S_Init (void)
 	Cvar_RegisterVariable(&snd_mixspeed);
 	Cvar_RegisterVariable(&snd_filterquality);
 	Cvar_RegisterVariable(&snd_waterfx);
+	Cvar_RegisterVariable(&snd_mixthread);
 
 	if (safemode || COM_CheckParm("-nosound"))
 		return;
@@ -189,6 +415,7 @@ void S_Init (void)
 	Cmd_AddCommand("stopsound", S_StopAllSoundsC);
 	Cmd_AddCommand("soundlist", S_SoundList);
 	Cmd_AddCommand("soundinfo", S_SoundInfo_f);
+	Cmd_AddCommand("snd_simdtest", SND_SimdTest_f);
 
 	i = COM_CheckParm("-sndspeed");
 	if (i && i < com_argc-1)
@@ -210,11 +437,14 @@ void S_Init (void)
 
 	Cvar_SetCallback(&sfxvolume, SND_Callback_sfxvolume);
 	Cvar_SetCallback(&snd_filterquality, &SND_Callback_snd_filterquality);
+	Cvar_SetCallback(&snd_mixthread, SND_Callback_snd_mixthread);
 
 	SND_InitScaletable ();
 
 	known_sfx = (sfx_t *) Hunk_AllocName (MAX_SFX*sizeof(sfx_t), "sfx_t");
 	num_sfx = 0;
+	memset (sfx_hashmap, 0, sizeof (sfx_hashmap));
+	COM_AddHashStats (&sfx_stats);
 
 	snd_initialized = true;
 
@@ -243,8 +473,13 @@ void S_Shutdown (void)
 	if (!sound_started)
 		return;
 
+	S_StopMixerThread ();
+	S_UpdateLoads (true);
+
 	sound_started = 0;
-	snd_blocked = 0;
+	SDL_AtomicSet (&snd_blocked, 0);
+	SDL_AtomicSet (&snd_queue.head, 0);
+	SDL_AtomicSet (&snd_queue.tail, 0);
 
 	S_CodecShutdown();
 
@@ -265,7 +500,7 @@ S_FindName
 */
 static sfx_t *S_FindName (const char *name)
 {
-	int		i;
+	size_t	capacity, pos;
 	sfx_t	*sfx;
 
 	if (!name)
@@ -275,19 +510,30 @@ static sfx_t *S_FindName (const char *name)
 		Sys_Error ("Sound name too long: %s", name);
 
 // see if already loaded
-	for (i = 0; i < num_sfx; i++)
+	capacity = Q_COUNTOF (sfx_hashmap);
+	pos = COM_HashString (name) % capacity;
+	sfx_stats.lookups++;
+	while (sfx_hashmap[pos])
 	{
-		if (!strcmp(known_sfx[i].name, name))
+		sfx_stats.probes++;
+		if (!strcmp(sfx_hashmap[pos]->name, name))
 		{
-			return &known_sfx[i];
+			sfx_stats.found++;
+			return sfx_hashmap[pos];
 		}
+
+		++pos;
+		if (pos == capacity)
+			pos = 0;
 	}
 
 	if (num_sfx == MAX_SFX)
 		Sys_Error ("S_FindName: out of sfx_t");
 
-	sfx = &known_sfx[i];
+// the map is twice as big as known_sfx, so there's always a free slot
+	sfx = &known_sfx[num_sfx];
 	q_strlcpy (sfx->name, name, sizeof(sfx->name));
+	sfx_hashmap[pos] = sfx;
 
 	num_sfx++;
 
@@ -327,9 +573,9 @@ sfx_t *S_PrecacheSound (const char *name)
 
 	sfx = S_FindName (name);
 
-// cache it in
+// cache it in, S_EndPrecaching or S_Update picks it up when it's done
 	if (precache.value)
-		S_LoadSound (sfx);
+		S_LoadSoundAsync (sfx);
 
 	return sfx;
 }
@@ -344,40 +590,43 @@ SND_PickChannel
 picks a channel based on priorities, empty slots, number of channels
 =================
 */
-channel_t *SND_PickChannel (int entnum, int entchannel)
+static int SND_PickChannel (int entnum, int entchannel)
 {
 	int	ch_idx;
 	int	first_to_die;
 	int	life_left;
+	int	time;
+	channel_t	*ch;
+
+	time = S_GetPaintedTime ();
 
 // Check for replacement sound, or find the best one to replace
 	first_to_die = -1;
 	life_left = 0x7fffffff;
 	for (ch_idx = NUM_AMBIENTS; ch_idx < NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS; ch_idx++)
 	{
+		ch = &host_channels[ch_idx].chan;
+
 		if (entchannel != 0		// channel 0 never overrides
-			&& snd_channels[ch_idx].entnum == entnum
-			&& (snd_channels[ch_idx].entchannel == entchannel || entchannel == -1) )
+			&& ch->entnum == entnum
+			&& (ch->entchannel == entchannel || entchannel == -1) )
 		{	// always override sound from same entity
 			first_to_die = ch_idx;
 			break;
 		}
 
 		// don't let monster sounds override player sounds
-		if (snd_channels[ch_idx].entnum == cl.viewentity && entnum != cl.viewentity && snd_channels[ch_idx].sfx)
+		if (ch->entnum == cl.viewentity && entnum != cl.viewentity && ch->sfx)
 			continue;
 
-		if (snd_channels[ch_idx].end - paintedtime < life_left)
+		if (ch->end - time < life_left)
 		{
-			life_left = snd_channels[ch_idx].end - paintedtime;
+			life_left = ch->end - time;
 			first_to_die = ch_idx;
 		}
 	}
 
-	if (first_to_die == -1)
-		return NULL;
-
-	return &snd_channels[first_to_die];
+	return first_to_die;
 }
 
 /*
@@ -387,7 +636,7 @@ SND_Spatialize
 spatializes a channel
 =================
 */
-void SND_Spatialize (channel_t *ch)
+static void SND_Spatialize (channel_t *ch, const sndlistener_t *listener)
 {
 	vec_t	dot;
 	vec_t	dist;
@@ -395,7 +644,7 @@ void SND_Spatialize (channel_t *ch)
 	vec3_t	source_vec;
 
 // anything coming from the view entity will always be full volume
-	if (ch->entnum == cl.viewentity)
+	if (ch->entnum == listener->viewentity)
 	{
 		ch->leftvol = ch->master_vol;
 		ch->rightvol = ch->master_vol;
@@ -403,9 +652,9 @@ void SND_Spatialize (channel_t *ch)
 	}
 
 // calculate stereo seperation and distance attenuation
-	VectorSubtract(ch->origin, listener_origin, source_vec);
+	VectorSubtract(ch->origin, listener->origin, source_vec);
 	dist = VectorNormalize(source_vec) * ch->dist_mult;
-	dot = DotProduct(listener_right, source_vec);
+	dot = DotProduct(listener->right, source_vec);
 
 	if (shm->channels == 1)
 	{
@@ -437,14 +686,16 @@ void SND_Spatialize (channel_t *ch)
 
 void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation)
 {
-	channel_t	*target_chan, *check;
+	hostchannel_t	*target, *check;
+	channel_t	*target_chan;
 	sfxcache_t	*sc;
 	sfx_t		*old_sfx;
 	vec3_t		old_origin;
 	float		old_vol;
 	float		old_atten;
-	int			ch_idx;
+	int			ch_idx, target_idx;
 	int			skip;
+	sndcmd_t	cmd;
 
 	if (!sound_started)
 		return;
@@ -456,9 +707,11 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 		return;
 
 // pick a channel to play on
-	target_chan = SND_PickChannel(entnum, entchannel);
-	if (!target_chan)
+	target_idx = SND_PickChannel(entnum, entchannel);
+	if (target_idx < 0)
 		return;
+	target = &host_channels[target_idx];
+	target_chan = &target->chan;
 
 // keep track of the old sound playing on this channel (for demo rewinding)
 	old_sfx = NULL;
@@ -474,22 +727,27 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 	}
 
 // spatialize
-	memset (target_chan, 0, sizeof(*target_chan));
+	memset (target, 0, sizeof(*target));
 	VectorCopy(origin, target_chan->origin);
 	target_chan->dist_mult = attenuation / sound_nominal_clip_dist;
 	target_chan->master_vol = (int) (fvol * 255);
 	target_chan->entnum = entnum;
 	target_chan->entchannel = entchannel;
-	SND_Spatialize(target_chan);
+	host_listener.viewentity = cl.viewentity;
+	SND_Spatialize(target_chan, &host_listener);
 
 	if (!target_chan->leftvol && !target_chan->rightvol)
+	{
+		S_PostSimpleCommand (SNDCMD_STOP, target_idx);
 		return;		// not audible at all
+	}
 
 // new channel
 	sc = S_LoadSound (sfx);
 	if (!sc)
 	{
 		target_chan->sfx = NULL;
+		S_PostSimpleCommand (SNDCMD_STOP, target_idx);
 		return;		// couldn't load the sound's data
 	}
 
@@ -499,17 +757,19 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 		CL_AddDemoRewindSound (entnum, entchannel, old_sfx, old_origin, old_vol, old_atten);
 
 	target_chan->sfx = sfx;
-	target_chan->pos = 0.0;
-	target_chan->end = paintedtime + sc->length;
+	target_chan->looping = sc->loopstart;
+	target_chan->pos = 0;
+	target_chan->end = S_GetPaintedTime () + sc->length;
+	target->frame = snd_hostframe;
 
 // if an identical sound has also been started this frame, offset the pos
 // a bit to keep it from just making the first one louder
-	check = &snd_channels[NUM_AMBIENTS];
+	check = &host_channels[NUM_AMBIENTS];
 	for (ch_idx = NUM_AMBIENTS; ch_idx < NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS; ch_idx++, check++)
 	{
-		if (check == target_chan)
+		if (check == target)
 			continue;
-		if (check->sfx == sfx && !check->pos)
+		if (check->chan.sfx == sfx && check->frame == snd_hostframe && !check->chan.pos)
 		{
 			/*
 			skip = rand () % (int)(0.1 * shm->speed);
@@ -527,6 +787,13 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 			break;
 		}
 	}
+
+	memset (&cmd, 0, sizeof (cmd));
+	cmd.type = SNDCMD_START;
+	cmd.channel = target_idx;
+	cmd.chan = *target_chan;
+	cmd.chan.end = sc->length - target_chan->pos;
+	S_PostCommand (&cmd);
 }
 
 void S_StopSound (int entnum, int entchannel)
@@ -535,32 +802,41 @@ void S_StopSound (int entnum, int entchannel)
 
 	for (i = 0; i < MAX_DYNAMIC_CHANNELS; i++)
 	{
-		if (snd_channels[i].entnum == entnum
-			&& snd_channels[i].entchannel == entchannel)
+		if (host_channels[i].chan.entnum == entnum
+			&& host_channels[i].chan.entchannel == entchannel)
 		{
-			snd_channels[i].end = 0;
-			snd_channels[i].sfx = NULL;
+			host_channels[i].chan.end = 0;
+			host_channels[i].chan.sfx = NULL;
+			S_PostSimpleCommand (SNDCMD_STOP, i);
 			return;
 		}
 	}
 }
 
-void S_StopAllSounds (qboolean clear)
-{
-	int		i;
+/*
+=================
+S_StopDynamicSounds
 
+Stops all entity sounds, keeping ambient and static ones
+=================
+*/
+void S_StopDynamicSounds (void)
+{
 	if (!sound_started)
 		return;
 
-	total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;	// no statics
+	memset (&host_channels[NUM_AMBIENTS], 0, MAX_DYNAMIC_CHANNELS * sizeof(hostchannel_t));
+	S_PostSimpleCommand (SNDCMD_STOPDYNAMIC, 0);
+}
 
-	for (i = 0; i < MAX_CHANNELS; i++)
-	{
-		if (snd_channels[i].sfx)
-			snd_channels[i].sfx = NULL;
-	}
+void S_StopAllSounds (qboolean clear)
+{
+	if (!sound_started)
+		return;
 
-	memset(snd_channels, 0, MAX_CHANNELS * sizeof(channel_t));
+	host_total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;	// no statics
+	memset(host_channels, 0, MAX_CHANNELS * sizeof(hostchannel_t));
+	S_PostSimpleCommand (SNDCMD_STOPALL, 0);
 
 	if (clear)
 		S_ClearBuffer ();
@@ -571,28 +847,24 @@ static void S_StopAllSoundsC (void)
 	S_StopAllSounds (true);
 }
 
+/*
+=================
+S_ClearBuffer
+
+Drops the streamed music right away, the mixer clears the DMA buffer
+when it gets to the command
+=================
+*/
 void S_ClearBuffer (void)
 {
-	int		clear;
-
 	if (!sound_started || !shm)
 		return;
 
-	SNDDMA_LockBuffer ();
-	if (! shm->buffer)
-		return;
-
 	s_rawend = 0;
+	SDL_AtomicSet (&snd_rawend, s_rawend);
 
-	if (shm->samplebits == 8 && !shm->signed8)
-		clear = 0x80;
-	else
-		clear = 0;
-
-	memset (shm->buffer, clear, shm->samples * shm->samplebits / 8);
-	memset (s_rawsamples, 0, sizeof (s_rawsamples));
-
-	SNDDMA_Submit ();
+	S_PostSimpleCommand (SNDCMD_CLEARBUFFER, 0);
+	S_KickMixer (false);
 }
 
 
@@ -605,18 +877,23 @@ void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 {
 	channel_t	*ss;
 	sfxcache_t		*sc;
+	sndcmd_t	cmd;
 
 	if (!sfx)
 		return;
 
-	if (total_channels == MAX_CHANNELS)
+	if (host_total_channels == MAX_CHANNELS)
 	{
 		Con_Printf ("total_channels == MAX_CHANNELS\n");
 		return;
 	}
 
-	ss = &snd_channels[total_channels];
-	total_channels++;
+	memset (&cmd, 0, sizeof (cmd));
+	cmd.type = SNDCMD_STATIC;
+	cmd.channel = host_total_channels;
+
+	ss = &host_channels[host_total_channels].chan;
+	host_total_channels++;
 
 	sc = S_LoadSound (sfx);
 	if (!sc)
@@ -632,9 +909,12 @@ void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 	VectorCopy (origin, ss->origin);
 	ss->master_vol = (int)vol;
 	ss->dist_mult = (attenuation / 64) / sound_nominal_clip_dist;
-	ss->end = paintedtime + sc->length;
+	ss->looping = sc->loopstart;
+	ss->end = S_GetPaintedTime () + sc->length;
 
-	SND_Spatialize (ss);
+	cmd.chan = *ss;
+	cmd.chan.end = sc->length;
+	S_PostCommand (&cmd);
 }
 
 
@@ -658,48 +938,73 @@ static float S_UnderwaterIntensityForContents (int contents)
 	}
 }
 
+/*
+===================
+S_UpdateUnderwaterIntensity
+
+Fades the underwater effect towards target, returns the new intensity
+===================
+*/
+static float S_UpdateUnderwaterIntensity (float target)
+{
+	static float	intensity;
+
+	target *= CLAMP (0.f, snd_waterfx.value, 2.f);
+	if (intensity < target)
+	{
+		intensity += host_frametime * 4.f;
+		intensity = q_min (intensity, target);
+	}
+	else if (intensity > target)
+	{
+		intensity -= host_frametime * 4.f;
+		intensity = q_max (intensity, target);
+	}
+
+	return intensity;
+}
+
 /*
 ===================
 S_UpdateAmbientSounds
 ===================
 */
-static void S_UpdateAmbientSounds (void)
+static void S_UpdateAmbientSounds (sndlistener_t *listener)
 {
 	mleaf_t			*l;
 	int				ambient_channel;
-	channel_t		*chan;
 	float			vol, underwater;
 	static float	levels[NUM_AMBIENTS];
 
+	memset (listener->ambient_sfx, 0, sizeof (listener->ambient_sfx));
+	memset (listener->ambient_vol, 0, sizeof (listener->ambient_vol));
+
 // no ambients when disconnected
 	if (cls.state != ca_connected || !cl.worldmodel)
 	{
 		memset (levels, 0, sizeof (levels));
-		S_SetUnderwaterIntensity (0.f);
+		listener->underwater = S_UpdateUnderwaterIntensity (0.f);
 		return;
 	}
 
 // calc ambient sound levels
-	l = Mod_PointInLeaf (listener_origin, cl.worldmodel);
+	l = Mod_PointInLeaf (listener->origin, cl.worldmodel);
 	if (cl.forceunderwater)
 		underwater = 1.f;
 	else if (l)
 		underwater = S_UnderwaterIntensityForContents (l->contents);
 	else
 		underwater = 0.f;
-	S_SetUnderwaterIntensity (underwater);
+	listener->underwater = S_UpdateUnderwaterIntensity (underwater);
 	if (!l || !ambient_level.value)
 	{
-		for (ambient_channel = 0; ambient_channel < NUM_AMBIENTS; ambient_channel++)
-			snd_channels[ambient_channel].sfx = NULL;
 		memset (levels, 0, sizeof (levels));
 		return;
 	}
 
 	for (ambient_channel = 0; ambient_channel < NUM_AMBIENTS; ambient_channel++)
 	{
-		chan = &snd_channels[ambient_channel];
-		chan->sfx = ambient_sfx[ambient_channel];
+		listener->ambient_sfx[ambient_channel] = ambient_sfx[ambient_channel];
 
 		vol = (int) (ambient_level.value * l->ambient_sound_level[ambient_channel]);
 		if (vol < 8.f)
@@ -721,7 +1026,7 @@ static void S_UpdateAmbientSounds (void)
 				levels[ambient_channel] = vol;
 		}
 
-		chan->leftvol = chan->rightvol = chan->master_vol = (int) levels[ambient_channel];
+		listener->ambient_vol[ambient_channel] = (int) levels[ambient_channel];
 	}
 }
 
@@ -743,8 +1048,8 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data, f
 	float scale;
 	int intVolume;
 
-	if (s_rawend < paintedtime)
-		s_rawend = paintedtime;
+	if (s_rawend < S_GetPaintedTime ())
+		s_rawend = S_GetPaintedTime ();
 
 	scale = (float) rate / shm->speed;
 	intVolume = (int) (256 * volume);
@@ -809,6 +1114,60 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data, f
 			s_rawsamples [dst].right = (((byte *) data)[src] - 128) * intVolume;
 		}
 	}
+
+// the samples need to be in place before the mixer gets to see them
+	SDL_AtomicSet (&snd_rawend, s_rawend);
+}
+
+/*
+============
+S_UpdateHostChannels
+
+Keeps the host's idea of which channels are busy close to the mixer's, and
+the sounds they play in the cache
+============
+*/
+static void S_UpdateHostChannels (void)
+{
+	int			i;
+	int			time, looplen;
+	channel_t	*ch;
+	sfxcache_t	*sc;
+
+	time = S_GetPaintedTime ();
+	if (time < host_paintedtime)
+	{	// the mixer chopped its time off and stopped everything
+		host_total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;
+		memset (host_channels, 0, MAX_CHANNELS * sizeof(hostchannel_t));
+	}
+	host_paintedtime = time;
+
+	for (i = 0; i < NUM_AMBIENTS; i++)
+		if (ambient_sfx[i])
+			S_LoadSoundAsync (ambient_sfx[i]);
+
+	for (i = NUM_AMBIENTS; i < host_total_channels; i++)
+	{
+		ch = &host_channels[i].chan;
+		if (!ch->sfx)
+			continue;
+
+	// the mixer doesn't reload sounds that got thrown out of the cache,
+	// they stay silent until a worker has decoded them again
+		sc = S_LoadSoundAsync (ch->sfx);
+		if (!sc)
+			continue;
+
+		if (ch->end - time > 0)
+			continue;
+		looplen = sc->length - ch->looping;
+		if (ch->looping >= 0 && looplen > 0)
+			ch->end += ((time - ch->end) / looplen + 1) * looplen;
+		else
+		{	// channel just stopped
+			ch->sfx = NULL;
+		}
+	}
 }
 
 /*
@@ -820,12 +1179,12 @@ Called once each time through the main loop
 */
 void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 {
-	int			i, j;
+	int			i;
 	int			total;
 	channel_t	*ch;
-	channel_t	*combine;
+	sndcmd_t	cmd;
 
-	if (!sound_started || (snd_blocked > 0))
+	if (!sound_started || SDL_AtomicGet (&snd_blocked) > 0)
 		return;
 
 	VectorCopy(origin, listener_origin);
@@ -833,8 +1192,174 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	VectorCopy(right, listener_right);
 	VectorCopy(up, listener_up);
 
+	S_UpdateLoads (false);
+	S_UpdateHostChannels ();
+
+	VectorCopy(origin, host_listener.origin);
+	VectorCopy(right, host_listener.right);
+	host_listener.viewentity = cl.viewentity;
+
 // update general area ambient sound sources
-	S_UpdateAmbientSounds ();
+	S_UpdateAmbientSounds (&host_listener);
+
+	memset (&cmd, 0, sizeof (cmd));
+	cmd.type = SNDCMD_LISTENER;
+	cmd.listener = host_listener;
+	S_PostCommand (&cmd);
+
+//
+// debugging output, volumes as the mixer will see them minus the
+// combining of static sounds
+//
+	if (snd_show.value)
+	{
+		total = 0;
+		for (i = 0; i < host_total_channels; i++)
+		{
+			channel_t spatialized = host_channels[i].chan;
+			ch = &spatialized;
+			if (i < NUM_AMBIENTS)
+			{
+				ch->sfx = host_listener.ambient_sfx[i];
+				ch->leftvol = ch->rightvol = host_listener.ambient_vol[i];
+			}
+			else if (ch->sfx)
+				SND_Spatialize (ch, &host_listener);
+			if (ch->sfx && (ch->leftvol || ch->rightvol))
+			{
+				sfxcache_t *sc = (sfxcache_t *) Cache_Check (&ch->sfx->cache);
+				if (snd_show.value >= 2.f)
+					Con_SafePrintf ("L:%3i R:%3i | ENT:%5i CH:%3i | %s%s\n",
+						ch->leftvol, ch->rightvol, ch->entnum, ch->entchannel, ch->sfx->name, sc && sc->loopstart >= 0 ? " [L]" : "");
+				total++;
+			}
+		}
+
+		Con_Printf ("----(%i)----\n", total);
+	}
+
+// add raw data from streamed samples
+//	BGM_Update();	// moved to the main loop just before S_Update ()
+	SDL_AtomicSet (&snd_rawend, s_rawend);
+
+	snd_hostframe++;
+
+// mix some sound
+	S_KickMixer (true);
+}
+
+/*
+===============================================================================
+
+MIXER
+
+Everything below runs on the mixer thread, or from S_Update without one.
+
+===============================================================================
+*/
+
+/*
+============
+S_ClearDMABuffer
+============
+*/
+static void S_ClearDMABuffer (void)
+{
+	int		clear;
+
+	SNDDMA_LockBuffer ();
+	if (! shm->buffer)
+		return;
+
+	if (shm->samplebits == 8 && !shm->signed8)
+		clear = 0x80;
+	else
+		clear = 0;
+
+	memset (shm->buffer, clear, shm->samples * shm->samplebits / 8);
+
+	SNDDMA_Submit ();
+}
+
+/*
+============
+S_ExecuteCommand
+============
+*/
+static void S_ExecuteCommand (const sndcmd_t *cmd)
+{
+	channel_t	*ch;
+	int			i;
+
+	switch (cmd->type)
+	{
+	case SNDCMD_START:
+	case SNDCMD_STATIC:
+		ch = &snd_channels[cmd->channel];
+		*ch = cmd->chan;
+		ch->end += paintedtime;
+		SND_Spatialize (ch, &mix_listener);
+		if (cmd->type == SNDCMD_STATIC)
+			total_channels = q_max (total_channels, cmd->channel + 1);
+		break;
+
+	case SNDCMD_STOP:
+		snd_channels[cmd->channel].end = 0;
+		snd_channels[cmd->channel].sfx = NULL;
+		break;
+
+	case SNDCMD_STOPDYNAMIC:
+		memset (&snd_channels[NUM_AMBIENTS], 0, MAX_DYNAMIC_CHANNELS * sizeof(channel_t));
+		break;
+
+	case SNDCMD_STOPALL:
+		total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;	// no statics
+		memset (snd_channels, 0, MAX_CHANNELS * sizeof(channel_t));
+		break;
+
+	case SNDCMD_CLEARBUFFER:
+		S_ClearDMABuffer ();
+		break;
+
+	case SNDCMD_LISTENER:
+		mix_listener = cmd->listener;
+		for (i = 0; i < NUM_AMBIENTS; i++)
+		{
+			ch = &snd_channels[i];
+			ch->sfx = mix_listener.ambient_sfx[i];
+			ch->leftvol = ch->rightvol = ch->master_vol = mix_listener.ambient_vol[i];
+		}
+		S_SetUnderwaterIntensity (mix_listener.underwater);
+		break;
+	}
+}
+
+/*
+============
+S_RunCommands
+============
+*/
+static void S_RunCommands (void)
+{
+	int	tail = SDL_AtomicGet (&snd_queue.tail);
+	int	head = SDL_AtomicGet (&snd_queue.head);
+
+	for (; tail != head; tail++)
+		S_ExecuteCommand (&snd_queue.cmds[tail & (SND_MAX_COMMANDS - 1)]);
+
+	SDL_AtomicSet (&snd_queue.tail, tail);
+}
+
+/*
+============
+S_SpatializeChannels
+============
+*/
+static void S_SpatializeChannels (void)
+{
+	int			i, j;
+	channel_t	*ch;
+	channel_t	*combine;
 
 	combine = NULL;
 
@@ -844,7 +1369,7 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	{
 		if (!ch->sfx)
 			continue;
-		SND_Spatialize(ch);	// respatialize channel
+		SND_Spatialize(ch, &mix_listener);	// respatialize channel
 		if (!ch->leftvol && !ch->rightvol)
 			continue;
 
@@ -885,34 +1410,28 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 			}
 		}
 	}
+}
 
-//
-// debugging output
-//
-	if (snd_show.value)
-	{
-		total = 0;
-		ch = snd_channels;
-		for (i = 0; i < total_channels; i++, ch++)
-		{
-			if (ch->sfx && (ch->leftvol || ch->rightvol) )
-			{
-				sfxcache_t *sc = (sfxcache_t *) Cache_Check (&ch->sfx->cache);
-				if (snd_show.value >= 2.f)
-					Con_SafePrintf ("L:%3i R:%3i | ENT:%5i CH:%3i | %s%s\n",
-						ch->leftvol, ch->rightvol, ch->entnum, ch->entchannel, ch->sfx->name, sc && sc->loopstart >= 0 ? " [L]" : "");
-				total++;
-			}
-		}
+/*
+============
+S_MixerUpdate
+============
+*/
+static void S_MixerUpdate (void)
+{
+	S_RunCommands ();
 
-		Con_Printf ("----(%i)----\n", total);
-	}
+	if (SDL_AtomicGet (&snd_blocked) > 0)
+		return;
 
-// add raw data from streamed samples
-//	BGM_Update();	// moved to the main loop just before S_Update ()
+	S_SpatializeChannels ();
 
-// mix some sound
-	S_Update_();
+// keep the cached sound data from moving while we read it
+	Cache_Lock ();
+	S_Update_ ();
+	Cache_Unlock ();
+
+	SDL_AtomicSet (&snd_paintedtime, paintedtime);
 }
 
 static void GetSoundtime (void)
@@ -936,7 +1455,9 @@ static void GetSoundtime (void)
 		{	// time to chop things off to avoid 32 bit limits
 			buffers = 0;
 			paintedtime = fullsamples;
-			S_StopAllSounds (true);
+			total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;
+			memset (snd_channels, 0, MAX_CHANNELS * sizeof(channel_t));
+			S_ClearDMABuffer ();
 		}
 	}
 	oldsamplepos = samplepos;
@@ -948,7 +1469,11 @@ void S_ExtraUpdate (void)
 {
 	if (snd_noextraupdate.value)
 		return;		// don't pollute timings
-	S_Update_();
+	if (snd_mixer.thread)
+		return;		// the mixer thread doesn't need help
+	if (!sound_started)
+		return;
+	S_MixerUpdate ();
 }
 
 static void S_Update_ (void)
@@ -956,7 +1481,7 @@ static void S_Update_ (void)
 	unsigned int	endtime;
 	int		samps;
 
-	if (!sound_started || (snd_blocked > 0))
+	if (!sound_started)
 		return;
 
 	SNDDMA_LockBuffer ();
@@ -988,9 +1513,9 @@ void S_BlockSound (void)
 /* FIXME: do we really need the blocking at the
  * driver level?
  */
-	if (sound_started && snd_blocked == 0)	/* ++snd_blocked == 1 */
+	if (sound_started && SDL_AtomicGet (&snd_blocked) == 0)	/* ++snd_blocked == 1 */
 	{
-		snd_blocked  = 1;
+		SDL_AtomicSet (&snd_blocked, 1);
 		S_ClearBuffer ();
 		if (shm)
 			SNDDMA_BlockSound();
@@ -999,11 +1524,11 @@ void S_BlockSound (void)
 
 void S_UnblockSound (void)
 {
-	if (!sound_started || !snd_blocked)
+	if (!sound_started || !SDL_AtomicGet (&snd_blocked))
 		return;
-	if (snd_blocked == 1)			/* --snd_blocked == 0 */
+	if (SDL_AtomicGet (&snd_blocked) == 1)			/* --snd_blocked == 0 */
 	{
-		snd_blocked  = 0;
+		SDL_AtomicSet (&snd_blocked, 0);
 		SNDDMA_UnblockSound();
 		S_ClearBuffer ();
 	}
@@ -1115,4 +1640,5 @@ void S_BeginPrecaching (void)
 
 void S_EndPrecaching (void)
 {
+	S_UpdateLoads (true);
 }
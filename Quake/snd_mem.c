@@ -23,33 +23,47 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+// a sound being decoded on a worker thread
+typedef struct sndload_s
+{
+	taskgroup_t		group;
+	sfx_t			*sfx;
+	byte			*file;
+	size_t			filesize;
+	sysmapping_t	map;
+	int				speed;		// output rate
+	qboolean		as8bit;
+	sfxcache_t		*sc;		// malloc'd result, NULL on failure
+	size_t			size;		// of sc
+	wavparser_t		parser;		// for the messages
+} sndload_t;
+
+static sndload_t	**snd_loads;	// in flight, owned by the main thread
+
+static void WAV_Message (wavparser_t *parser, wavmsg_t level, const char *fmt, ...) FUNC_PRINTF(3,4);
+
 /*
 ================
 ResampleSfx
 ================
 */
-static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
+static void ResampleSfx (sfxcache_t *sc, int outrate, qboolean as8bit, int inrate, int inwidth, byte *data)
 {
 	int		outcount;
 	int		srcsample;
 	float	stepscale;
 	int		i;
 	int		sample, samplefrac, fracstep;
-	sfxcache_t	*sc;
-
-	sc = (sfxcache_t *) Cache_Check (&sfx->cache);
-	if (!sc)
-		return;
 
-	stepscale = (float)inrate / shm->speed;	// this is usually 0.5, 1, or 2
+	stepscale = (float)inrate / outrate;	// this is usually 0.5, 1, or 2
 
 	outcount = sc->length / stepscale;
 	sc->length = outcount;
 	if (sc->loopstart != -1)
 		sc->loopstart = sc->loopstart / stepscale;
 
-	sc->speed = shm->speed;
-	if (loadas8bit.value)
+	sc->speed = outrate;
+	if (as8bit)
 		sc->width = 1;
 	else
 		sc->width = inwidth;
@@ -89,85 +103,191 @@ static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 
 /*
 ==============
-S_LoadSound
+S_DecodeSound
+
+Parses and resamples a loaded file into a malloc'd sfxcache_t.
+Runs on a worker thread, so it only reports problems through the parser.
 ==============
 */
-sfxcache_t *S_LoadSound (sfx_t *s)
+static void S_DecodeSound (void *param)
 {
-	char	namebuffer[256];
-	byte	*data;
+	sndload_t	*load = (sndload_t *) param;
+	sfx_t		*s = load->sfx;
 	wavinfo_t	info;
-	int		len;
-	float	stepscale;
-	size_t	filesize;
+	int			len;
+	float		stepscale;
+
+	info = WAV_Parse (&load->parser, s->name, load->file, load->filesize);
+	if (load->parser.level == WAVMSG_FATAL)
+		return;
+
+	if (info.channels != 1)
+	{
+		WAV_Message (&load->parser, WAVMSG_PRINT, "%s is a stereo sample\n", s->name);
+		return;
+	}
+
+	if (info.width != 1 && info.width != 2)
+	{
+		WAV_Message (&load->parser, WAVMSG_PRINT, "%s is not 8 or 16 bit\n", s->name);
+		return;
+	}
+
+	stepscale = (float)info.rate / load->speed;
+	len = info.samples / stepscale;
+
+	len = len * info.width * info.channels;
+
+	if (info.samples == 0 || len == 0)
+	{
+		WAV_Message (&load->parser, WAVMSG_PRINT, "%s has zero samples\n", s->name);
+		return;
+	}
+
+	load->size = len + sizeof(sfxcache_t);
+	load->sc = (sfxcache_t *) malloc (load->size);
+	if (!load->sc)
+		return;
+
+	load->sc->length = info.samples;
+	load->sc->loopstart = info.loopstart;
+	load->sc->speed = info.rate;
+	load->sc->width = info.width;
+	load->sc->stereo = info.channels;
+
+	ResampleSfx (load->sc, load->speed, load->as8bit, load->sc->speed, load->sc->width, load->file + info.dataofs);
+}
+
+/*
+==============
+S_FinishLoad
+
+Prints what the worker had to say and moves its result into the cache
+==============
+*/
+static void S_FinishLoad (sndload_t *load)
+{
+	sfx_t		*s = load->sfx;
 	sfxcache_t	*sc;
 
+	Task_Wait (&load->group);
+
+	WAV_PrintMessages (&load->parser);
+
+	if (load->sc)
+	{
+	// the mixer thread can see the entry as soon as it is allocated,
+	// keep it from reading a half-copied sound
+		Cache_Lock ();
+		sc = (sfxcache_t *) Cache_Alloc (&s->cache, load->size, s->name);
+		if (sc)
+			memcpy (sc, load->sc, load->size);
+		Cache_Unlock ();
+		free (load->sc);
+	}
+
+	QFS_FreeMappedFile (load->file, &load->map);
+	s->loading = NULL;
+	free (load);
+}
+
+/*
+==============
+S_LoadSoundAsync
+==============
+*/
+sfxcache_t *S_LoadSoundAsync (sfx_t *s)
+{
+	char	namebuffer[256];
+	sfxcache_t	*sc;
+	sndload_t	*load;
+
 // see if still in memory
 	sc = (sfxcache_t *) Cache_Check (&s->cache);
-	if (sc)
+	if (sc || s->loading)
 		return sc;
 
-//	Con_Printf ("S_LoadSound: %x\n", (int)stackbuf);
-
-// load it in
+// load it in. the file is read here, pak files can't be read from
+// several threads, but with fs_mmap only the mapping happens here
 	q_strlcpy(namebuffer, "sound/", sizeof(namebuffer));
 	q_strlcat(namebuffer, s->name, sizeof(namebuffer));
 
-//	Con_Printf ("loading %s\n",namebuffer);
+	load = (sndload_t *) calloc (1, sizeof (*load));
+	if (!load)
+		Sys_Error ("S_LoadSoundAsync: out of memory");
 
-	data = QFS_LoadMallocFile (namebuffer, NULL, &filesize);
-
-	if (!data)
+	load->file = QFS_LoadMappedFile (namebuffer, NULL, &load->filesize, &load->map);
+	if (!load->file)
 	{
+		free (load);
 		Con_Printf ("Couldn't load %s\n", namebuffer);
 		return NULL;
 	}
 
-	info = GetWavinfo (s->name, data, filesize);
-	if (info.channels != 1)
-	{
-		free (data);
-		Con_Printf ("%s is a stereo sample\n",s->name);
-		return NULL;
-	}
+	load->sfx = s;
+	load->speed = shm->speed;
+	load->as8bit = loadas8bit.value != 0.f;
+	s->loading = load;
+	VEC_PUSH (snd_loads, load);
 
-	if (info.width != 1 && info.width != 2)
-	{
-		free (data);
-		Con_Printf("%s is not 8 or 16 bit\n", s->name);
-		return NULL;
-	}
+	Task_Submit (&load->group, S_DecodeSound, load);
 
-	stepscale = (float)info.rate / shm->speed;
-	len = info.samples / stepscale;
+	return NULL;
+}
 
-	len = len * info.width * info.channels;
+/*
+==============
+S_LoadSound
+==============
+*/
+sfxcache_t *S_LoadSound (sfx_t *s)
+{
+	sndload_t	*load;
+	size_t		i;
 
-	if (info.samples == 0 || len == 0)
-	{
-		free (data);
-		Con_Printf("%s has zero samples\n", s->name);
-		return NULL;
-	}
+	if (S_LoadSoundAsync (s) || !s->loading)
+		return (sfxcache_t *) Cache_Check (&s->cache);
 
-	sc = (sfxcache_t *) Cache_Alloc ( &s->cache, len + sizeof(sfxcache_t), s->name);
-	if (!sc)
+// wait for this one, it may have been queued a while ago
+	load = s->loading;
+	for (i = 0; i < VEC_SIZE (snd_loads); i++)
 	{
-		free (data);
-		return NULL;
+		if (snd_loads[i] == load)
+		{
+			snd_loads[i] = VEC_LAST (snd_loads);
+			VEC_POP_N (snd_loads, 1);
+			break;
+		}
 	}
+	S_FinishLoad (load);
 
-	sc->length = info.samples;
-	sc->loopstart = info.loopstart;
-	sc->speed = info.rate;
-	sc->width = info.width;
-	sc->stereo = info.channels;
+	return (sfxcache_t *) Cache_Check (&s->cache);
+}
 
-	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
+/*
+==============
+S_UpdateLoads
 
-	free (data);
+Moves finished sounds into the cache, or all of them when wait is set
+==============
+*/
+void S_UpdateLoads (qboolean wait)
+{
+	size_t		i;
+	sndload_t	*load;
 
-	return sc;
+	for (i = 0; i < VEC_SIZE (snd_loads); )
+	{
+		load = snd_loads[i];
+		if (!wait && !Task_Done (&load->group))
+		{
+			i++;
+			continue;
+		}
+		snd_loads[i] = VEC_LAST (snd_loads);
+		VEC_POP_N (snd_loads, 1);
+		S_FinishLoad (load);
+	}
 }
 
 
@@ -177,91 +297,118 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 
 WAV loading
 
+Parsing state lives in a wavparser_t so that sounds can be
+decoded on several threads at once
+
 ===============================================================================
 */
 
-static byte	*data_p;
-static byte	*iff_end;
-static byte	*last_chunk;
-static byte	*iff_data;
-static int	iff_chunk_len;
+static void WAV_Message (wavparser_t *parser, wavmsg_t level, const char *fmt, ...)
+{
+	va_list		argptr;
+	size_t		len;
+
+	if (level == WAVMSG_DEVELOPER && developer.value < 2)
+		return;
+
+	len = strlen (parser->messages);
+	va_start (argptr, fmt);
+	q_vsnprintf (parser->messages + len, sizeof (parser->messages) - len, fmt, argptr);
+	va_end (argptr);
+
+	parser->level = q_max (parser->level, level);
+}
+
+/*
+============
+WAV_PrintMessages
+
+Prints what went wrong while parsing, from the main thread
+============
+*/
+void WAV_PrintMessages (wavparser_t *parser)
+{
+	if (!parser->messages[0])
+		return;
+
+	switch (parser->level)
+	{
+	case WAVMSG_FATAL:
+		Sys_Error ("%s", parser->messages);
+		break;
+	case WAVMSG_WARNING:
+		Con_Warning ("%s", parser->messages);
+		break;
+	case WAVMSG_DEVELOPER:
+		Con_DPrintf2 ("%s", parser->messages);
+		break;
+	default:
+		Con_Printf ("%s", parser->messages);
+		break;
+	}
+
+	parser->messages[0] = 0;
+	parser->level = WAVMSG_NONE;
+}
 
-static short GetLittleShort (void)
+static short GetLittleShort (wavparser_t *p)
 {
 	short val = 0;
-	val = *data_p;
-	val = val + (*(data_p+1)<<8);
-	data_p += 2;
+	val = *p->data_p;
+	val = val + (*(p->data_p+1)<<8);
+	p->data_p += 2;
 	return val;
 }
 
-static int GetLittleLong (void)
+static int GetLittleLong (wavparser_t *p)
 {
 	int val = 0;
-	val = *data_p;
-	val = val + (*(data_p+1)<<8);
-	val = val + (*(data_p+2)<<16);
-	val = val + (*(data_p+3)<<24);
-	data_p += 4;
+	val = *p->data_p;
+	val = val + (*(p->data_p+1)<<8);
+	val = val + (*(p->data_p+2)<<16);
+	val = val + (*(p->data_p+3)<<24);
+	p->data_p += 4;
 	return val;
 }
 
-static void FindNextChunk (const char *name)
+static void FindNextChunk (wavparser_t *p, const char *name)
 {
 	while (1)
 	{
 	// Need at least 8 bytes for a chunk
-		if (last_chunk + 8 >= iff_end)
+		if (p->last_chunk + 8 >= p->iff_end)
 		{
-			data_p = NULL;
+			p->data_p = NULL;
 			return;
 		}
 
-		data_p = last_chunk + 4;
-		iff_chunk_len = GetLittleLong();
-		if (iff_chunk_len < 0 || iff_chunk_len > iff_end - data_p)
+		p->data_p = p->last_chunk + 4;
+		p->iff_chunk_len = GetLittleLong(p);
+		if (p->iff_chunk_len < 0 || p->iff_chunk_len > p->iff_end - p->data_p)
 		{
-			data_p = NULL;
-			Con_DPrintf2("bad \"%s\" chunk length (%d)\n", name, iff_chunk_len);
+			p->data_p = NULL;
+			WAV_Message (p, WAVMSG_DEVELOPER, "bad \"%s\" chunk length (%d)\n", name, p->iff_chunk_len);
 			return;
 		}
-		last_chunk = data_p + ((iff_chunk_len + 1) & ~1);
-		data_p -= 8;
-		if (!strncmp((char *)data_p, name, 4))
+		p->last_chunk = p->data_p + ((p->iff_chunk_len + 1) & ~1);
+		p->data_p -= 8;
+		if (!strncmp((char *)p->data_p, name, 4))
 			return;
 	}
 }
 
-static void FindChunk (const char *name)
+static void FindChunk (wavparser_t *p, const char *name)
 {
-	last_chunk = iff_data;
-	FindNextChunk (name);
+	p->last_chunk = p->iff_data;
+	FindNextChunk (p, name);
 }
 
-#if 0
-static void DumpChunks (void)
-{
-	char	str[5];
-
-	str[4] = 0;
-	data_p = iff_data;
-	do
-	{
-		memcpy (str, data_p, 4);
-		data_p += 4;
-		iff_chunk_len = GetLittleLong();
-		Con_Printf ("0x%x : %s (%d)\n", (int)(data_p - 4), str, iff_chunk_len);
-		data_p += (iff_chunk_len + 1) & ~1;
-	} while (data_p < iff_end);
-}
-#endif
-
 /*
 ============
-GetWavinfo
+WAV_Parse
 ============
 */
-wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength)
+wavinfo_t WAV_Parse (wavparser_t *p, const char *name, byte *wav, int wavlength)
 {
 	wavinfo_t	info;
 	int	i;
@@ -273,63 +420,58 @@ wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength)
 	if (!wav)
 		return info;
 
-	iff_data = wav;
-	iff_end = wav + wavlength;
+	p->iff_data = wav;
+	p->iff_end = wav + wavlength;
 
 // find "RIFF" chunk
-	FindChunk("RIFF");
-	if (!(data_p && !strncmp((char *)data_p + 8, "WAVE", 4)))
+	FindChunk(p, "RIFF");
+	if (!(p->data_p && !strncmp((char *)p->data_p + 8, "WAVE", 4)))
 	{
-		Con_Printf("%s missing RIFF/WAVE chunks\n", name);
+		WAV_Message (p, WAVMSG_PRINT, "%s missing RIFF/WAVE chunks\n", name);
 		return info;
 	}
 
 // get "fmt " chunk
-	iff_data = data_p + 12;
-#if 0
-	DumpChunks ();
-#endif
+	p->iff_data = p->data_p + 12;
 
-	FindChunk("fmt ");
-	if (!data_p)
+	FindChunk(p, "fmt ");
+	if (!p->data_p)
 	{
-		Con_Printf("%s is missing fmt chunk\n", name);
+		WAV_Message (p, WAVMSG_PRINT, "%s is missing fmt chunk\n", name);
 		return info;
 	}
-	data_p += 8;
-	format = GetLittleShort();
+	p->data_p += 8;
+	format = GetLittleShort(p);
 	if (format != WAV_FORMAT_PCM)
 	{
-		Con_Printf("%s is not Microsoft PCM format\n", name);
+		WAV_Message (p, WAVMSG_PRINT, "%s is not Microsoft PCM format\n", name);
 		return info;
 	}
 
-	info.channels = GetLittleShort();
-	info.rate = GetLittleLong();
-	data_p += 4 + 2;
-	i = GetLittleShort();
+	info.channels = GetLittleShort(p);
+	info.rate = GetLittleLong(p);
+	p->data_p += 4 + 2;
+	i = GetLittleShort(p);
 	if (i != 8 && i != 16)
 		return info;
 	info.width = i / 8;
 
 // get cue chunk
-	FindChunk("cue ");
-	if (data_p)
+	FindChunk(p, "cue ");
+	if (p->data_p)
 	{
-		data_p += 32;
-		info.loopstart = GetLittleLong();
-	//	Con_Printf("loopstart=%d\n", sfx->loopstart);
+		p->data_p += 32;
+		info.loopstart = GetLittleLong(p);
 
 	// if the next chunk is a LIST chunk, look for a cue length marker
-		FindNextChunk ("LIST");
-		if (data_p)
+		FindNextChunk (p, "LIST");
+		if (p->data_p)
 		{
-			if (!strncmp((char *)data_p + 28, "mark", 4))
+			if (!strncmp((char *)p->data_p + 28, "mark", 4))
 			{	// this is not a proper parse, but it works with cooledit...
-				data_p += 24;
-				i = GetLittleLong();	// samples in loop
+				p->data_p += 24;
+				i = GetLittleLong(p);	// samples in loop
 				info.samples = info.loopstart + i;
-		//		Con_Printf("looped length: %i\n", i);
 			}
 		}
 	}
@@ -337,33 +479,35 @@ wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength)
 		info.loopstart = -1;
 
 // find data chunk
-	FindChunk("data");
-	if (!data_p)
+	FindChunk(p, "data");
+	if (!p->data_p)
 	{
-		Con_Printf("%s is missing data chunk\n", name);
+		WAV_Message (p, WAVMSG_PRINT, "%s is missing data chunk\n", name);
 		return info;
 	}
 
-	data_p += 4;
-	samples = GetLittleLong() / info.width;
+	p->data_p += 4;
+	samples = GetLittleLong(p) / info.width;
 
 	if (info.samples)
 	{
 		if (samples < info.samples)
-			Sys_Error ("%s has a bad loop length", name);
+		{
+			WAV_Message (p, WAVMSG_FATAL, "%s has a bad loop length", name);
+			return info;
+		}
 	}
 	else
 		info.samples = samples;
 
 	if (info.loopstart >= info.samples)
 	{
-		Con_Warning ("%s has loop start >= end\n", name);
+		WAV_Message (p, WAVMSG_WARNING, "%s has loop start >= end\n", name);
 		info.loopstart = -1;
 		info.samples = samples;
 	}
 
-	info.dataofs = data_p - wav;
+	info.dataofs = p->data_p - wav;
 
 	return info;
 }
-
@@ -34,11 +34,408 @@ static int	snd_vol;
 static float	snd_lofreqlevel;
 static float	snd_hifreqlevel;
 
+#ifdef USE_SSE2
+/*
+===============================================================================
+
+SSE2 KERNELS
+
+These give exactly the same output as the scalar code they replace. That
+includes C's round-towards-zero integer division. SSE2 has no 32-bit
+multiply and no 32-bit min/max, so both are emulated.
+
+===============================================================================
+*/
+
+// x / (1 << shift), rounding towards zero
+static inline __m128i SND_DivPow2_SSE2 (__m128i x, int shift)
+{
+	__m128i bias = _mm_srli_epi32 (_mm_srai_epi32 (x, 31), 32 - shift);
+	return _mm_srai_epi32 (_mm_add_epi32 (x, bias), shift);
+}
+
+// low 32 bits of a * b (_mm_mullo_epi32 is SSE4.1)
+static inline __m128i SND_MulLo32_SSE2 (__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32 (a, b);
+	__m128i odd = _mm_mul_epu32 (_mm_srli_epi64 (a, 32), _mm_srli_epi64 (b, 32));
+	return _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, _MM_SHUFFLE (0, 0, 2, 0)), _mm_shuffle_epi32 (odd, _MM_SHUFFLE (0, 0, 2, 0)));
+}
+
+// CLAMP (lo, x, hi) for 32-bit lanes (_mm_min/max_epi32 are SSE4.1)
+static inline __m128i SND_Clamp32_SSE2 (__m128i x, __m128i lo, __m128i hi)
+{
+	__m128i mask = _mm_cmplt_epi32 (x, lo);
+	x = _mm_or_si128 (_mm_and_si128 (mask, lo), _mm_andnot_si128 (mask, x));
+	mask = _mm_cmpgt_epi32 (x, hi);
+	return _mm_or_si128 (_mm_and_si128 (mask, hi), _mm_andnot_si128 (mask, x));
+}
+
+/*
+================
+SND_PaintFrom8_SSE2
+
+Same as the snd_scaletable lookup: every entry is the signed sample times
+the entry for 1
+================
+*/
+static void SND_PaintFrom8_SSE2 (portable_samplepair_t *out, const unsigned char *sfx, int count, int lscale, int rscale)
+{
+	const __m128i	lvec = _mm_set1_epi32 (lscale);
+	const __m128i	rvec = _mm_set1_epi32 (rscale);
+	int				i, packed;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		__m128i s, l, r;
+
+		memcpy (&packed, sfx + i, 4);
+		s = _mm_cvtsi32_si128 (packed);
+		s = _mm_unpacklo_epi8 (s, s);
+		s = _mm_srai_epi32 (_mm_unpacklo_epi16 (s, s), 24);	// sign-extend
+
+		l = SND_MulLo32_SSE2 (s, lvec);
+		r = SND_MulLo32_SSE2 (s, rvec);
+
+		_mm_storeu_si128 ((__m128i *) &out[i + 0], _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) &out[i + 0]), _mm_unpacklo_epi32 (l, r)));
+		_mm_storeu_si128 ((__m128i *) &out[i + 2], _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) &out[i + 2]), _mm_unpackhi_epi32 (l, r)));
+	}
+
+	for (; i < count; i++)
+	{
+		int data = sfx[i] < 128 ? sfx[i] : sfx[i] - 256;
+		out[i].left += data * lscale;
+		out[i].right += data * rscale;
+	}
+}
+
+/*
+================
+SND_PaintFrom16_SSE2
+
+Volumes must fit in a signed short, so that full 32-bit products can be
+built from 16-bit multiplies
+================
+*/
+static void SND_PaintFrom16_SSE2 (portable_samplepair_t *out, const short *sfx, int count, int leftvol, int rightvol)
+{
+	const __m128i	lvec = _mm_set1_epi16 ((short) leftvol);
+	const __m128i	rvec = _mm_set1_epi16 ((short) rightvol);
+	int				i;
+
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		__m128i d = _mm_loadu_si128 ((const __m128i *) (sfx + i));
+		__m128i llo = _mm_mullo_epi16 (d, lvec);
+		__m128i lhi = _mm_mulhi_epi16 (d, lvec);
+		__m128i rlo = _mm_mullo_epi16 (d, rvec);
+		__m128i rhi = _mm_mulhi_epi16 (d, rvec);
+		__m128i l03 = _mm_unpacklo_epi16 (llo, lhi);
+		__m128i l47 = _mm_unpackhi_epi16 (llo, lhi);
+		__m128i r03 = _mm_unpacklo_epi16 (rlo, rhi);
+		__m128i r47 = _mm_unpackhi_epi16 (rlo, rhi);
+		__m128i *dst = (__m128i *) &out[i];
+
+		_mm_storeu_si128 (dst + 0, _mm_add_epi32 (_mm_loadu_si128 (dst + 0), _mm_unpacklo_epi32 (l03, r03)));
+		_mm_storeu_si128 (dst + 1, _mm_add_epi32 (_mm_loadu_si128 (dst + 1), _mm_unpackhi_epi32 (l03, r03)));
+		_mm_storeu_si128 (dst + 2, _mm_add_epi32 (_mm_loadu_si128 (dst + 2), _mm_unpacklo_epi32 (l47, r47)));
+		_mm_storeu_si128 (dst + 3, _mm_add_epi32 (_mm_loadu_si128 (dst + 3), _mm_unpackhi_epi32 (l47, r47)));
+	}
+
+	for (; i < count; i++)
+	{
+		out[i].left += sfx[i] * leftvol;
+		out[i].right += sfx[i] * rightvol;
+	}
+}
+
+/*
+================
+SND_ClipPaintBuffer_SSE2
+
+CLAMP (-32768 * 256, x, 32767 * 256) / 2 over count ints
+================
+*/
+static void SND_ClipPaintBuffer_SSE2 (int *p, int count)
+{
+	const __m128i	lo = _mm_set1_epi32 (-32768 * 256);
+	const __m128i	hi = _mm_set1_epi32 (32767 * 256);
+	int				i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128 ((const __m128i *) (p + i));
+		_mm_storeu_si128 ((__m128i *) (p + i), SND_DivPow2_SSE2 (SND_Clamp32_SSE2 (v, lo, hi), 1));
+	}
+
+	for (; i < count; i++)
+		p[i] = CLAMP (-32768 * 256, p[i], 32767 * 256) / 2;
+}
+
+/*
+================
+SND_AddMusic_SSE2
+
+dst += src / 2 over count ints
+================
+*/
+static void SND_AddMusic_SSE2 (int *dst, const int *src, int count)
+{
+	int i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		__m128i v = SND_DivPow2_SSE2 (_mm_loadu_si128 ((const __m128i *) (src + i)), 1);
+		_mm_storeu_si128 ((__m128i *) (dst + i), _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) (dst + i)), v));
+	}
+
+	for (; i < count; i++)
+		dst[i] += src[i] / 2;
+}
+
+/*
+================
+SND_WriteStereo16_SSE2
+
+out = CLAMP (-32768, in / 256, 32767) over count ints;
+the saturating pack does the clamping
+================
+*/
+static void SND_WriteStereo16_SSE2 (short *out, const int *in, int count)
+{
+	int i, val;
+
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		__m128i a = SND_DivPow2_SSE2 (_mm_loadu_si128 ((const __m128i *) (in + i)), 8);
+		__m128i b = SND_DivPow2_SSE2 (_mm_loadu_si128 ((const __m128i *) (in + i + 4)), 8);
+		_mm_storeu_si128 ((__m128i *) (out + i), _mm_packs_epi32 (a, b));
+	}
+
+	for (; i < count; i++)
+	{
+		val = in[i] / 256;
+		out[i] = CLAMP (-32768, val, 32767);
+	}
+}
+
+/*
+===============================================================================
+
+SSE2 SELF-CHECK
+
+snd_simdtest runs every SSE2 kernel and the scalar code it replaces on the
+same random input and reports any difference. The input covers odd lengths,
+unaligned buffers and values at the clipping limits.
+
+===============================================================================
+*/
+
+#define SIMDTEST_TRIALS		4096
+#define SIMDTEST_MAXLEN		67		// odd, so that every tail length comes up
+
+static unsigned int		simdtest_seed;
+
+// xorshift32, so that a seed gives the same input on every platform
+static unsigned int SND_SimdTestRand (void)
+{
+	simdtest_seed ^= simdtest_seed << 13;
+	simdtest_seed ^= simdtest_seed >> 17;
+	simdtest_seed ^= simdtest_seed << 5;
+	return simdtest_seed;
+}
+
+// random value in [lo, hi], with the limits and the clipping edges coming up often
+static int SND_SimdTestValue (int lo, int hi)
+{
+	static const int edges[] =
+	{
+		INT_MIN, INT_MIN + 1, -32768 * 256 - 1, -32768 * 256, -32768 * 256 + 1, -256, -255, -1,
+		0, 1, 255, 256, 32767 * 256 - 1, 32767 * 256, 32767 * 256 + 1, INT_MAX - 1, INT_MAX,
+	};
+	unsigned int r = SND_SimdTestRand ();
+	int val;
+
+	switch (r & 7)
+	{
+	case 0:
+		return lo;
+	case 1:
+		return hi;
+	case 2:
+		val = edges[(r >> 3) % countof (edges)];
+		if (val >= lo && val <= hi)
+			return val;
+		// fall through
+	default:
+		return (int) (lo + (int64_t) (SND_SimdTestRand () % (uint64_t) ((int64_t) hi - lo + 1)));
+	}
+}
+
+static void SND_SimdTestFill (int *p, int count, int lo, int hi)
+{
+	int i;
+	for (i = 0; i < count; i++)
+		p[i] = SND_SimdTestValue (lo, hi);
+}
+
+// returns the index of the first difference, or -1
+static int SND_SimdTestCompare (const void *a, const void *b, int count, int size)
+{
+	int i;
+	for (i = 0; i < count; i++)
+		if (memcmp ((const byte *) a + i * size, (const byte *) b + i * size, size))
+			return i;
+	return -1;
+}
+
+/*
+================
+SND_SimdTest_f
+================
+*/
+void SND_SimdTest_f (void)
+{
+	static const char *const names[] = {"PaintFrom8", "PaintFrom16", "ClipPaintBuffer", "AddMusic", "WriteStereo16"};
+	static portable_samplepair_t	simd[SIMDTEST_MAXLEN + 4], ref[SIMDTEST_MAXLEN + 4];
+	static int						src[2 * SIMDTEST_MAXLEN + 8];
+	static unsigned char			sfx8[SIMDTEST_MAXLEN + 4];
+	static short					sfx16[SIMDTEST_MAXLEN + 8], out16[2][2 * SIMDTEST_MAXLEN + 8];
+	int		failures[countof (names)];
+	int		trial, test, len, ofs, i, bad, val;
+	int		*lscale, *rscale, lvol, rvol;
+	int		*simdp, *refp;
+
+	if (!SDL_HasSSE2 ())
+	{
+		Con_Printf ("SSE2 is not available on this CPU\n");
+		return;
+	}
+
+	simdtest_seed = Cmd_Argc () >= 2 ? (unsigned int) strtoul (Cmd_Argv (1), NULL, 0) : 0;
+	if (!simdtest_seed)
+		simdtest_seed = 0x5eed;	// xorshift gets stuck on 0
+	memset (failures, 0, sizeof (failures));
+
+	for (trial = 0; trial < SIMDTEST_TRIALS; trial++)
+	{
+		for (test = 0; test < (int) countof (names); test++)
+		{
+			len = SND_SimdTestRand () % (SIMDTEST_MAXLEN + 1);
+			ofs = SND_SimdTestRand () & 3;	// misalign the buffers
+			simdp = (int *) (simd + ofs);
+			refp = (int *) (ref + ofs);
+			bad = -1;
+
+			switch (test)
+			{
+			case 0:
+				for (i = 0; i < len; i++)
+					sfx8[ofs + i] = (unsigned char) SND_SimdTestValue (0, 255);
+				lscale = snd_scaletable[SND_SimdTestRand () & 31];
+				rscale = snd_scaletable[SND_SimdTestRand () & 31];
+				SND_SimdTestFill (simdp, len * 2, -(1 << 28), 1 << 28);
+				memcpy (refp, simdp, len * sizeof (portable_samplepair_t));
+				SND_PaintFrom8_SSE2 ((portable_samplepair_t *) simdp, sfx8 + ofs, len, lscale[1], rscale[1]);
+				for (i = 0; i < len; i++)
+				{
+					ref[ofs + i].left += lscale[sfx8[ofs + i]];
+					ref[ofs + i].right += rscale[sfx8[ofs + i]];
+				}
+				bad = SND_SimdTestCompare (simdp, refp, len, sizeof (portable_samplepair_t));
+				break;
+
+			case 1:
+				for (i = 0; i < len; i++)
+					sfx16[ofs + i] = (short) SND_SimdTestValue (-32768, 32767);
+				lvol = SND_SimdTestValue (-32768, 32767);
+				rvol = SND_SimdTestValue (-32768, 32767);
+				SND_SimdTestFill (simdp, len * 2, -(1 << 29), 1 << 29);
+				memcpy (refp, simdp, len * sizeof (portable_samplepair_t));
+				SND_PaintFrom16_SSE2 ((portable_samplepair_t *) simdp, sfx16 + ofs, len, lvol, rvol);
+				for (i = 0; i < len; i++)
+				{
+					ref[ofs + i].left += sfx16[ofs + i] * lvol;
+					ref[ofs + i].right += sfx16[ofs + i] * rvol;
+				}
+				bad = SND_SimdTestCompare (simdp, refp, len, sizeof (portable_samplepair_t));
+				break;
+
+			case 2:
+				SND_SimdTestFill (simdp, len * 2, INT_MIN, INT_MAX);
+				memcpy (refp, simdp, len * sizeof (portable_samplepair_t));
+				SND_ClipPaintBuffer_SSE2 (simdp, len * 2);
+				for (i = 0; i < len; i++)
+				{
+					ref[ofs + i].left = CLAMP(-32768 * 256, ref[ofs + i].left, 32767 * 256) / 2;
+					ref[ofs + i].right = CLAMP(-32768 * 256, ref[ofs + i].right, 32767 * 256) / 2;
+				}
+				bad = SND_SimdTestCompare (simdp, refp, len, sizeof (portable_samplepair_t));
+				break;
+
+			case 3:
+				SND_SimdTestFill (src + ofs, len * 2, INT_MIN, INT_MAX);
+				SND_SimdTestFill (simdp, len * 2, -(1 << 30), 1 << 30);
+				memcpy (refp, simdp, len * sizeof (portable_samplepair_t));
+				SND_AddMusic_SSE2 (simdp, src + ofs, len * 2);
+				for (i = 0; i < len * 2; i++)
+					refp[i] += src[ofs + i] / 2;
+				bad = SND_SimdTestCompare (simdp, refp, len, sizeof (portable_samplepair_t));
+				break;
+
+			case 4:
+				// odd counts too, even though the DMA buffer always takes pairs
+				SND_SimdTestFill (src + ofs, len, INT_MIN, INT_MAX);
+				SND_WriteStereo16_SSE2 (out16[0] + ofs, src + ofs, len);
+				for (i = 0; i < len; i++)
+				{
+					val = src[ofs + i] / 256;
+					if (val > 0x7fff)
+						out16[1][ofs + i] = 0x7fff;
+					else if (val < (short)0x8000)
+						out16[1][ofs + i] = (short)0x8000;
+					else
+						out16[1][ofs + i] = val;
+				}
+				bad = SND_SimdTestCompare (out16[0] + ofs, out16[1] + ofs, len, sizeof (short));
+				break;
+			}
+
+			if (bad >= 0 && failures[test]++ == 0)
+				Con_Printf ("%s: mismatch at %d of %d (trial %d)\n", names[test], bad, len, trial);
+		}
+	}
+
+	for (test = 0; test < (int) countof (names); test++)
+	{
+		if (failures[test])
+			Con_Printf ("%-16s %d of %d trials FAILED\n", names[test], failures[test], SIMDTEST_TRIALS);
+		else
+			Con_Printf ("%-16s ok\n", names[test]);
+	}
+}
+
+#else // !USE_SSE2
+
+void SND_SimdTest_f (void)
+{
+	Con_Printf ("This build has no SSE2 kernels to test\n");
+}
+#endif // USE_SSE2
+
 static void Snd_WriteLinearBlastStereo16 (void)
 {
 	int		i;
 	int		val;
 
+#ifdef USE_SSE2
+	if (use_simd)
+	{
+		SND_WriteStereo16_SSE2 (snd_out, snd_p, snd_linear_count);
+		return;
+	}
+#endif
+
 	for (i = 0; i < snd_linear_count; i += 2)
 	{
 		val = snd_p[i] / 256;
@@ -200,6 +597,7 @@ static void S_MakeBlackmanWindowKernel(float *kernel, int M, float f_c)
 typedef struct {
 	float *memory;  // kernelsize floats
 	float *kernel;  // kernelsize floats
+	float *input;   // kernelsize + PAINTBUFFER_SIZE floats
 	int kernelsize; // M+1, rounded up to be a multiple of 16
 	int M;			// M value used to make kernel, even
 	int parity;		// 0-3
@@ -212,6 +610,7 @@ static void S_UpdateFilter(filter_t *filter, int M, float f_c)
 	{
 		if (filter->memory != NULL) free(filter->memory);
 		if (filter->kernel != NULL) free(filter->kernel);
+		if (filter->input != NULL) free(filter->input);
 
 		filter->M = M;
 		filter->f_c = f_c;
@@ -221,8 +620,9 @@ static void S_UpdateFilter(filter_t *filter, int M, float f_c)
 		filter->kernelsize = (M + 1) + 16 - ((M + 1) % 16);
 		filter->memory = (float *) calloc(filter->kernelsize, sizeof(float));
 		filter->kernel = (float *) calloc(filter->kernelsize, sizeof(float));
+		filter->input = (float *) malloc((filter->kernelsize + PAINTBUFFER_SIZE) * sizeof(float));
 
-		if (!filter->memory || !filter->kernel)
+		if (!filter->memory || !filter->kernel || !filter->input)
 			Sys_Error ("S_UpdateFilter: out of memory (%" SDL_PRIu64 " bytes)", (uint64_t)(filter->kernelsize * sizeof (float)));
 
 		S_MakeBlackmanWindowKernel(filter->kernel, M, f_c);
@@ -244,17 +644,11 @@ known to be 0 and skip 3/4 of the filter kernel.
 static void S_ApplyFilter(filter_t *filter, int *data, int stride, int count)
 {
 	int i, j;
-	size_t inputsize;
-	float *input;
+	float *input = filter->input; // not the hunk, this may run on the mixer thread
 	const int kernelsize = filter->kernelsize;
 	const float *kernel = filter->kernel;
-	int mark;
 	int parity;
 
-	mark = Hunk_LowMark ();
-	inputsize = sizeof(float) * (filter->kernelsize + count);
-	input = (float *) Hunk_AllocNoFill (inputsize);
-
 // set up the input buffer
 // memory holds the previous filter->kernelsize samples of input.
 	memcpy(input, filter->memory, filter->kernelsize * sizeof(float));
@@ -292,8 +686,6 @@ static void S_ApplyFilter(filter_t *filter, int *data, int stride, int count)
 	}
 
 	filter->parity = parity;
-
-	Hunk_FreeToLowMark (mark);
 }
 
 /*
@@ -346,21 +738,9 @@ static struct {
 	float	accum[2];
 } underwater = {0.f, 1.f, {0.f, 0.f}};
 
-extern cvar_t snd_waterfx;
-
-void S_SetUnderwaterIntensity (float target)
+void S_SetUnderwaterIntensity (float intensity)
 {
-	target *= CLAMP (0.f, snd_waterfx.value, 2.f);
-	if (underwater.intensity < target)
-	{
-		underwater.intensity += host_frametime * 4.f;
-		underwater.intensity = q_min (underwater.intensity, target);
-	}
-	else if (underwater.intensity > target)
-	{
-		underwater.intensity -= host_frametime * 4.f;
-		underwater.intensity = q_max (underwater.intensity, target);
-	}
+	underwater.intensity = intensity;
 	underwater.alpha = exp (-underwater.intensity * log (12.f));
 }
 
@@ -430,10 +810,12 @@ void S_PaintChannels (int endtime)
 {
 	int		i;
 	int		end, ltime, count;
+	int		rawend;
 	channel_t	*ch;
 	sfxcache_t	*sc;
 
 	snd_vol = sfxvolume.value * 256;
+	rawend = SDL_AtomicGet (&snd_rawend);
 
 	while (paintedtime < endtime)
 	{
@@ -453,7 +835,9 @@ void S_PaintChannels (int endtime)
 				continue;
 			if (!ch->leftvol && !ch->rightvol)
 				continue;
-			sc = S_LoadSound (ch->sfx);
+		// the host keeps the sounds of its channels loaded, we can't
+		// go through the cache ourselves when running on the mixer thread
+			sc = (sfxcache_t *) ch->sfx->cache.data;
 			if (!sc)
 				continue;
 
@@ -498,6 +882,11 @@ void S_PaintChannels (int endtime)
 	// clip each sample to 0dB, then reduce by 6dB (to leave some headroom for
 	// the lowpass filter and the music). the lowpass will smooth out the
 	// clipping
+#ifdef USE_SSE2
+		if (use_simd)
+			SND_ClipPaintBuffer_SSE2 ((int *)paintbuffer, (end - paintedtime) * 2);
+		else
+#endif
 		for (i=0; i<end-paintedtime; i++)
 		{
 			paintbuffer[i].left = CLAMP(-32768 * 256, paintbuffer[i].left, 32767 * 256) / 2;
@@ -516,13 +905,27 @@ void S_PaintChannels (int endtime)
 		S_UpdateLevels (end - paintedtime);
 
 	// paint in the music
-		if (s_rawend >= paintedtime)
+		if (rawend >= paintedtime)
 		{	// copy from the streaming sound source
 			int		s;
 			int		stop;
 
-			stop = (end < s_rawend) ? end : s_rawend;
+			stop = (end < rawend) ? end : rawend;
 
+#ifdef USE_SSE2
+			if (use_simd)
+			{
+				// the raw samples are a ring buffer, add them in contiguous runs
+				for (i = paintedtime; i < stop; )
+				{
+					s = i & (MAX_RAW_SAMPLES - 1);
+					count = q_min (stop - i, MAX_RAW_SAMPLES - s);
+					SND_AddMusic_SSE2 ((int *)&paintbuffer[i - paintedtime], (const int *)&s_rawsamples[s], count * 2);
+					i += count;
+				}
+			}
+			else
+#endif
 			for (i = paintedtime; i < stop; i++)
 			{
 				s = i & (MAX_RAW_SAMPLES - 1);
@@ -581,6 +984,15 @@ static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int
 	rscale = snd_scaletable[ch->rightvol >> 3];
 	sfx = (unsigned char *)sc->data + ch->pos;
 
+#ifdef USE_SSE2
+	if (use_simd)
+	{
+		SND_PaintFrom8_SSE2 (paintbuffer + paintbufferstart, sfx, count, lscale[1], rscale[1]);
+		ch->pos += count;
+		return;
+	}
+#endif
+
 	for (i = 0; i < count; i++)
 	{
 		data = sfx[i];
@@ -605,6 +1017,15 @@ static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, in
 	rightvol /= 256;
 	sfx = (signed short *)sc->data + ch->pos;
 
+#ifdef USE_SSE2
+	if (use_simd && leftvol == (short)leftvol && rightvol == (short)rightvol)
+	{
+		SND_PaintFrom16_SSE2 (paintbuffer + paintbufferstart, sfx, count, leftvol, rightvol);
+		ch->pos += count;
+		return;
+	}
+#endif
+
 	for (i = 0; i < count; i++)
 	{
 		data = sfx[i];
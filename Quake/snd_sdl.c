@@ -81,6 +81,9 @@ qboolean SNDDMA_Init (dma_t *dma)
 	char	drivername[128];
 	const char *driver, *device;
 
+#ifdef USE_NULLGL
+	SDL_setenv ("SDL_AUDIODRIVER", "dummy", 0); /* headless: keep mixing, no output */
+#endif
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
 	{
 		Con_Printf("Couldn't init SDL audio: %s\n", SDL_GetError());
@@ -34,6 +34,12 @@ int		sv_protocol = PROTOCOL_RMQ; //johnfitz
 extern cvar_t nomonsters;
 
 static cvar_t sv_netsort = {"sv_netsort", "1", CVAR_NONE};
+static cvar_t sv_parallelsnapshots = {"sv_parallelsnapshots", "1", CVAR_NONE};
+static cvar_t sv_deltasnapshots = {"sv_deltasnapshots", "1", CVAR_NONE};
+
+static void SV_ResetSnapshot (int clientnum);
+static void SV_DeltaSnapshots_f (void);
+static void SV_SnapshotStats_f (void);
 
 //============================================================================
 
@@ -151,7 +157,10 @@ void SV_Init (void)
 	extern	cvar_t	sv_altnoclip; //johnfitz
 	extern	cvar_t	sv_gameplayfix_random;
 	extern	cvar_t	sv_gameplayfix_elevators;
+	extern	cvar_t	sv_fastfindradius;
+	extern	cvar_t	sv_fastfind;
 	extern	cvar_t	sv_autoload;
+	extern	cvar_t	sv_savebinary;
 	extern	cvar_t	sv_autosave;
 	extern	cvar_t	sv_autosave_interval;
 
@@ -173,12 +182,19 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_altnoclip); //johnfitz
 	Cvar_RegisterVariable (&sv_gameplayfix_random);
 	Cvar_RegisterVariable (&sv_gameplayfix_elevators);
+	Cvar_RegisterVariable (&sv_fastfindradius);
+	Cvar_RegisterVariable (&sv_fastfind);
 	Cvar_RegisterVariable (&sv_netsort);
+	Cvar_RegisterVariable (&sv_parallelsnapshots);
+	Cvar_RegisterVariable (&sv_deltasnapshots);
 	Cvar_RegisterVariable (&sv_autoload);
+	Cvar_RegisterVariable (&sv_savebinary);
 	Cvar_RegisterVariable (&sv_autosave);
 	Cvar_RegisterVariable (&sv_autosave_interval);
 
 	Cmd_AddCommand ("sv_protocol", &SV_Protocol_f); //johnfitz
+	Cmd_AddCommand_ClientCommand ("deltasnapshots", SV_DeltaSnapshots_f);
+	Cmd_AddCommand ("snapshot_stats", SV_SnapshotStats_f);
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -454,6 +470,12 @@ void SV_SendServerinfo (client_t *client)
 
 	client->sendsignon = PRESPAWN_FLUSH;
 	client->spawned = false;		// need prespawn, spawn, etc
+
+	// the client clears its snapshots along with everything else,
+	// and asks for them again if it wants them
+	client->deltasnapshots = false;
+	client->snapshotack = 0;
+	SV_ResetSnapshot (client - svs.clients);
 }
 
 /*
@@ -578,27 +600,31 @@ crosses a waterline.
 =============================================================================
 */
 
-static int	fatbytes;
-static byte	*fatpvs;
-static int	fatpvs_capacity;
+static int		fatbytes;
+static mleaf_t	**fatleafs;
+static int		numfatleafs;
+static int		maxfatleafs;
 
 void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel) //johnfitz -- added worldmodel as a parameter
 {
-	int		i;
-	byte	*pvs;
 	mplane_t	*plane;
 	float	d;
 
 	while (1)
 	{
-	// if this is a leaf, accumulate the pvs bits
+	// if this is a leaf, remember it so its pvs bits can be merged
 		if (node->contents < 0)
 		{
 			if (node->contents != CONTENTS_SOLID)
 			{
-				pvs = Mod_LeafPVS ( (mleaf_t *)node, worldmodel); //johnfitz -- worldmodel as a parameter
-				for (i=0 ; i<fatbytes ; i++)
-					fatpvs[i] |= pvs[i];
+				if (numfatleafs == maxfatleafs)
+				{
+					maxfatleafs = q_max (maxfatleafs * 2, 64);
+					fatleafs = (mleaf_t **) realloc (fatleafs, maxfatleafs * sizeof (fatleafs[0]));
+					if (!fatleafs)
+						Sys_Error ("SV_AddToFatPVS: realloc() failed on %d leafs", maxfatleafs);
+				}
+				fatleafs[numfatleafs++] = (mleaf_t *)node;
 			}
 			return;
 		}
@@ -622,24 +648,18 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel) //johnfitz
 SV_FatPVS
 
 Calculates a PVS that is the inclusive or of all leafs within 8 pixels of the
-given point.
+given point. The merged rows are cached by Mod_FatPVS, so the result is only
+valid until the next call.
 =============
 */
 byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel) //johnfitz -- added worldmodel as a parameter
 {
 	fatbytes = (worldmodel->numleafs+7)>>3; // ericw -- was +31, assumed to be a bug/typo
 	fatbytes = (fatbytes + VIS_ALIGN_MASK) & ~VIS_ALIGN_MASK; // round up
-	if (fatpvs == NULL || fatbytes > fatpvs_capacity)
-	{
-		fatpvs_capacity = fatbytes;
-		fatpvs = (byte *) realloc (fatpvs, fatpvs_capacity);
-		if (!fatpvs)
-			Sys_Error ("SV_FatPVS: realloc() failed on %d bytes", fatpvs_capacity);
-	}
-	
-	Q_memset (fatpvs, 0, fatbytes);
+
+	numfatleafs = 0;
 	SV_AddToFatPVS (org, worldmodel->nodes, worldmodel); //johnfitz -- worldmodel as a parameter
-	return fatpvs;
+	return Mod_FatPVS (worldmodel, fatleafs, numfatleafs);
 }
 
 /*
@@ -678,36 +698,519 @@ qboolean SV_VisibleToClient (edict_t *client, edict_t *test, qmodel_t *worldmode
 
 #define MAX_NET_EDICTS 65536
 
-static uint16_t		net_edicts[MAX_NET_EDICTS];
-static byte			net_edict_dists[MAX_NET_EDICTS];
-static int			net_edict_bins[256];
-static uint16_t		net_edicts_sorted[MAX_NET_EDICTS];
+// Per-client scratch state for building an unreliable datagram.
+// The entity part of the snapshots is written on worker threads,
+// so everything it touches has to be owned by the snapshot.
+typedef struct svsnapshot_s
+{
+	qboolean	pending;			// needs entities + send this frame
+	qboolean	overflow;			// ran out of room while writing entities
+	sizebuf_t	msg;
+	byte		buf[MAX_DATAGRAM];
+	vec3_t		org;
+	byte		*pvs;
+	int			pvscapacity;
+	uint16_t	*edicts;
+	uint16_t	*sorted;
+	byte		*dists;
+	int			capacity;			// max number of entries in edicts/sorted/dists
+	int			bins[256];
+
+	// delta snapshots
+	qboolean	delta;				// client wants svc_snapshot
+	unsigned int	ack;			// last sequence the client decoded
+	unsigned int	sequence;		// last sequence written
+	snapframe_t	frames[SNAPSHOT_FRAMES];
+	int			*refindex;			// entity number -> index + 1 in the reference frame
+	byte		*seen;				// reference frame entries that are still visible
+
+	// for snapshot_stats
+	int			statframes;
+	int			statdeltas;
+	double		statbytes;
+	double		statentbytes;
+} svsnapshot_t;
+
+static svsnapshot_t	*sv_snapshots;
+static int			sv_numsnapshots;
+static double		sv_snapstatstime;
+
+/*
+=============
+SV_SetupSnapshots
+=============
+*/
+static void SV_SetupSnapshots (int numclients)
+{
+	if (numclients <= sv_numsnapshots)
+		return;
+
+	sv_snapshots = (svsnapshot_t *) realloc (sv_snapshots, numclients * sizeof (svsnapshot_t));
+	if (!sv_snapshots)
+		Sys_Error ("SV_SetupSnapshots: realloc() failed on %d snapshots", numclients);
+	memset (sv_snapshots + sv_numsnapshots, 0, (numclients - sv_numsnapshots) * sizeof (svsnapshot_t));
+	sv_numsnapshots = numclients;
+}
+
+/*
+=============
+SV_PrepareSnapshot
+
+Copies the client's fat PVS and sizes the sorting buffers.
+Runs on the main thread (the PVS cache isn't thread-safe).
+=============
+*/
+static void SV_PrepareSnapshot (edict_t *clent, svsnapshot_t *snap)
+{
+	int		count;
+	byte	*pvs;
+
+	VectorAdd (clent->v.origin, clent->v.view_ofs, snap->org);
+	pvs = SV_FatPVS (snap->org, sv.worldmodel);
+	if (fatbytes > snap->pvscapacity)
+	{
+		snap->pvscapacity = fatbytes;
+		snap->pvs = (byte *) realloc (snap->pvs, snap->pvscapacity);
+		if (!snap->pvs)
+			Sys_Error ("SV_PrepareSnapshot: realloc() failed on %d bytes", snap->pvscapacity);
+	}
+	memcpy (snap->pvs, pvs, fatbytes);
+
+	count = q_min (qcvm->num_edicts, MAX_NET_EDICTS);
+	if (count > snap->capacity)
+	{
+		snap->capacity = count;
+		snap->edicts = (uint16_t *) realloc (snap->edicts, count * sizeof (snap->edicts[0]));
+		snap->sorted = (uint16_t *) realloc (snap->sorted, count * sizeof (snap->sorted[0]));
+		snap->dists = (byte *) realloc (snap->dists, count * sizeof (snap->dists[0]));
+		snap->seen = (byte *) realloc (snap->seen, count * sizeof (snap->seen[0]));
+		if (!snap->edicts || !snap->sorted || !snap->dists || !snap->seen)
+			Sys_Error ("SV_PrepareSnapshot: realloc() failed on %d edicts", count);
+	}
+
+	// the next frame can't hold more than one entry per edict
+	if (snap->delta)
+	{
+		snapframe_t *frame = &snap->frames[(snap->sequence + 1) & (SNAPSHOT_FRAMES - 1)];
+		if (!snap->refindex)
+		{
+			snap->refindex = (int *) calloc (MAX_NET_EDICTS, sizeof (snap->refindex[0]));
+			if (!snap->refindex)
+				Sys_Error ("SV_PrepareSnapshot: calloc() failed on %d edicts", MAX_NET_EDICTS);
+		}
+		if (count > frame->maxents)
+		{
+			frame->maxents = count;
+			frame->ents = (snapentity_t *) realloc (frame->ents, count * sizeof (frame->ents[0]));
+			if (!frame->ents)
+				Sys_Error ("SV_PrepareSnapshot: realloc() failed on %d snapshot entities", count);
+		}
+	}
+}
+
+/*
+=============
+SV_ResetSnapshot
+
+Forgets the snapshots sent to a client.  Sequence numbers keep counting,
+so that late acks can't match a frame from before the reset
+=============
+*/
+static void SV_ResetSnapshot (int clientnum)
+{
+	int		i;
+
+	if (clientnum >= sv_numsnapshots)
+		return;
+	for (i = 0; i < SNAPSHOT_FRAMES; i++)
+	{
+		sv_snapshots[clientnum].frames[i].sequence = 0;
+		sv_snapshots[clientnum].frames[i].numents = 0;
+	}
+}
+
+/*
+=============
+SV_AckSnapshot
+=============
+*/
+void SV_AckSnapshot (client_t *client, unsigned int sequence)
+{
+	if (client->deltasnapshots && sequence > client->snapshotack)
+		client->snapshotack = sequence;
+}
+
+/*
+=============
+SV_DeltaSnapshots_f
+
+deltasnapshots [0|1], sent by clients that can parse svc_snapshot
+=============
+*/
+static void SV_DeltaSnapshots_f (void)
+{
+	if (cmd_source == src_command)
+	{
+		Cmd_ForwardToServer ();
+		return;
+	}
+
+	host_client->deltasnapshots = sv.protocol != PROTOCOL_NETQUAKE && (Cmd_Argc () < 2 || Q_atoi (Cmd_Argv (1)));
+	host_client->snapshotack = 0;
+}
+
+/*
+=============
+SV_UpdateEntityAlphaScale
+
+Refreshes the alpha/scale fields of entities with visible models
+once per frame, before the snapshots read them concurrently
+=============
+*/
+static void SV_UpdateEntityAlphaScale (void)
+{
+	int		e;
+	eval_t	*val;
+	edict_t	*ent;
+
+	ent = NEXT_EDICT(qcvm->edicts);
+	for (e=1 ; e<qcvm->num_edicts ; e++, ent = NEXT_EDICT(ent))
+	{
+		if (!ent->v.modelindex || !PR_GetString(ent->v.model)[0])
+			continue;
+
+		//johnfitz -- alpha
+		val = GetEdictFieldValueByName(ent, "alpha");
+		if (val)
+			ent->alpha = ENTALPHA_ENCODE(val->_float);
+		//johnfitz
+
+		val = GetEdictFieldValueByName(ent, "scale");
+		if (val)
+			ent->scale = ENTSCALE_ENCODE(val->_float);
+		else
+			ent->scale = ENTSCALE_DEFAULT;
+	}
+}
+
+/*
+=============
+SV_GetSnapEntity
+
+What an svc_snapshot record would say about the entity
+=============
+*/
+static void SV_GetSnapEntity (edict_t *ent, int e, snapentity_t *out)
+{
+	out->num = e;
+	VectorCopy (ent->v.origin, out->state.origin);
+	VectorCopy (ent->v.angles, out->state.angles);
+	out->state.modelindex = (int) ent->v.modelindex;
+	out->state.frame = (int) ent->v.frame;
+	out->state.colormap = (int) ent->v.colormap;
+	out->state.skin = (int) ent->v.skin;
+	out->state.alpha = ent->alpha;
+	out->state.scale = ent->scale;
+	out->state.effects = (int) ent->v.effects & qcvm->effects_mask & 0xFF;
+	out->step = ent->v.movetype == MOVETYPE_STEP;
+	out->lerpfinish = ent->sendinterval ? (byte) Q_rint ((ent->v.nextthink - qcvm->time) * 255) : -1;
+}
+
+/*
+=============
+SV_SnapEntityBits
+
+Which fields of cur have to be sent to a client that has from
+=============
+*/
+static int SV_SnapEntityBits (const snapentity_t *cur, const snapentity_t *from)
+{
+	int		i, bits = 0;
+	float	miss;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		miss = cur->state.origin[i] - from->state.origin[i];
+		if (miss < -0.1 || miss > 0.1)
+			bits |= U_ORIGIN1<<i;
+	}
+	if (cur->state.angles[0] != from->state.angles[0])
+		bits |= U_ANGLE1;
+	if (cur->state.angles[1] != from->state.angles[1])
+		bits |= U_ANGLE2;
+	if (cur->state.angles[2] != from->state.angles[2])
+		bits |= U_ANGLE3;
+	if (cur->state.colormap != from->state.colormap)
+		bits |= U_COLORMAP;
+	if (cur->state.skin != from->state.skin)
+		bits |= U_SKIN;
+	if (cur->state.frame != from->state.frame)
+		bits |= U_FRAME;
+	if (cur->state.effects != from->state.effects)
+		bits |= U_EFFECTS;
+	if (cur->state.modelindex != from->state.modelindex)
+		bits |= U_MODEL;
+	if (cur->state.alpha != from->state.alpha)
+		bits |= U_ALPHA;
+	if (cur->state.scale != from->state.scale)
+		bits |= U_SCALE;
+	if (bits & U_FRAME && cur->state.frame & 0xFF00)
+		bits |= U_FRAME2;
+	if (bits & U_MODEL && cur->state.modelindex & 0xFF00)
+		bits |= U_MODEL2;
+
+	return bits;
+}
+
+/*
+=============
+SV_WriteSnapshotEntities
+
+Writes the visible entities in snap->sorted as an svc_snapshot, delta
+compressed against the last snapshot the client acknowledged (or against
+the baselines if that one's gone).  Entities that didn't change are left
+out, entities that left are removed.
+
+The new frame holds what the client will end up with, which isn't quite
+what's visible if the packet fills up: entities that don't fit keep their
+old state on the client, or stay unknown to it.
+
+Thread-safe like SV_WriteEntitiesToClient
+=============
+*/
+static void SV_WriteSnapshotEntities (svsnapshot_t *snap, int numents)
+{
+	sizebuf_t		*msg = &snap->msg;
+	uint16_t		*list = snap->sorted;
+	snapframe_t		*ref, *frame;
+	snapentity_t	cur, base, *to;
+	const snapentity_t	*from;
+	unsigned int	sequence;
+	edict_t			*ent;
+	int				i, j, e, idx, bits, count, start;
+	qboolean		full;
+
+	if (msg->cursize + 6 + 2 + 40 > msg->maxsize)
+	{
+		snap->overflow = true;
+		return;
+	}
+
+	sequence = snap->sequence + 1;
+
+	ref = &snap->frames[snap->ack & (SNAPSHOT_FRAMES - 1)];
+	if (!snap->ack || ref->sequence != snap->ack || sequence - snap->ack >= SNAPSHOT_FRAMES)
+		ref = NULL;
+
+	frame = &snap->frames[sequence & (SNAPSHOT_FRAMES - 1)];
+	frame->sequence = sequence;
+	frame->numents = 0;
+	snap->sequence = sequence;
+
+	start = msg->cursize;
+	MSG_WriteByte (msg, svc_snapshot);
+	MSG_WriteLong (msg, sequence);
+	MSG_WriteByte (msg, ref ? sequence - ref->sequence : 0);
+
+// index the reference frame
+	if (ref)
+	{
+		for (i = 0; i < ref->numents; i++)
+		{
+			snap->refindex[ref->ents[i].num] = i + 1;
+			snap->seen[i] = false;
+		}
+	}
+
+// drop invisible entities from the list, and see which ones the client already has
+	for (i = count = 0; i < numents; i++)
+	{
+		ent = EDICT_NUM (list[i]);
+		//johnfitz -- don't send invisible entities unless they have effects
+		if (ent->alpha == ENTALPHA_ZERO && !((int)ent->v.effects & qcvm->effects_mask))
+			continue;
+		list[count++] = list[i];
+		if (ref && (idx = snap->refindex[list[i]]) != 0)
+			snap->seen[idx - 1] = true;
+	}
+
+// remove the entities that went away
+	full = false;
+	for (i = 0; ref && i < ref->numents; i++)
+	{
+		if (snap->seen[i])
+			continue;
+		e = ref->ents[i].num;
+		if (!full && msg->cursize + 3 + 3 <= msg->maxsize)
+		{
+			if (e >= 256)
+			{
+				MSG_WriteByte (msg, U_REMOVE | U_MOREBITS);
+				MSG_WriteByte (msg, U_LONGENTITY >> 8);
+				MSG_WriteShort (msg, e);
+			}
+			else
+			{
+				MSG_WriteByte (msg, U_REMOVE);
+				MSG_WriteByte (msg, e);
+			}
+		}
+		else
+		{	// the client will keep it around until there's room
+			full = true;
+			frame->ents[frame->numents++] = ref->ents[i];
+		}
+	}
+
+// send the rest (closest first)
+	for (j = 0; j < count; j++)
+	{
+		e = list[j];
+		ent = EDICT_NUM (e);
+		SV_GetSnapEntity (ent, e, &cur);
+
+		idx = ref ? snap->refindex[e] : 0;
+		if (idx)
+			from = &ref->ents[idx - 1];
+		else
+		{
+			base.num = e;
+			base.state = ent->baseline;
+			base.state.effects = 0;		// not part of the baseline message
+			base.step = false;
+			base.lerpfinish = -1;
+			from = &base;
+		}
+
+		bits = SV_SnapEntityBits (&cur, from);
+		to = &frame->ents[frame->numents];
+
+		if (idx && !bits && cur.step == from->step && cur.lerpfinish == from->lerpfinish)
+		{	// unchanged, the client carries it over
+			*to = *from;
+			frame->numents++;
+			continue;
+		}
+
+		if (full || msg->cursize + 40 + 3 > msg->maxsize)
+		{
+			full = true;
+			snap->overflow = true; // reported by SV_SendClientDatagram
+			if (idx)
+			{
+				*to = *from;
+				frame->numents++;
+			}
+			continue;
+		}
+
+		// remember exactly what the client is going to have
+		*to = cur;
+		for (i=0 ; i<3 ; i++)
+			if (!(bits & (U_ORIGIN1<<i)))
+				to->state.origin[i] = from->state.origin[i];
+		frame->numents++;
+
+		if (cur.step)
+			bits |= U_STEP;
+		if (cur.lerpfinish >= 0)
+			bits |= U_LERPFINISH;
+		if (e >= 256)
+			bits |= U_LONGENTITY;
+		if (bits >= 65536)
+			bits |= U_EXTEND1;
+		if (bits >= 16777216)
+			bits |= U_EXTEND2;
+		if (bits >= 256)
+			bits |= U_MOREBITS;
+
+		MSG_WriteByte (msg, bits & 0xFF);
+		if (bits & U_MOREBITS)
+			MSG_WriteByte (msg, bits>>8);
+		if (bits & U_EXTEND1)
+			MSG_WriteByte (msg, bits>>16);
+		if (bits & U_EXTEND2)
+			MSG_WriteByte (msg, bits>>24);
+
+		if (bits & U_LONGENTITY)
+			MSG_WriteShort (msg, e);
+		else
+			MSG_WriteByte (msg, e);
+
+		if (bits & U_MODEL)
+			MSG_WriteByte (msg, cur.state.modelindex);
+		if (bits & U_FRAME)
+			MSG_WriteByte (msg, cur.state.frame);
+		if (bits & U_COLORMAP)
+			MSG_WriteByte (msg, cur.state.colormap);
+		if (bits & U_SKIN)
+			MSG_WriteByte (msg, cur.state.skin);
+		if (bits & U_EFFECTS)
+			MSG_WriteByte (msg, cur.state.effects);
+		if (bits & U_ORIGIN1)
+			MSG_WriteCoord (msg, cur.state.origin[0], sv.protocolflags);
+		if (bits & U_ANGLE1)
+			MSG_WriteAngle (msg, cur.state.angles[0], sv.protocolflags);
+		if (bits & U_ORIGIN2)
+			MSG_WriteCoord (msg, cur.state.origin[1], sv.protocolflags);
+		if (bits & U_ANGLE2)
+			MSG_WriteAngle (msg, cur.state.angles[1], sv.protocolflags);
+		if (bits & U_ORIGIN3)
+			MSG_WriteCoord (msg, cur.state.origin[2], sv.protocolflags);
+		if (bits & U_ANGLE3)
+			MSG_WriteAngle (msg, cur.state.angles[2], sv.protocolflags);
+		if (bits & U_ALPHA)
+			MSG_WriteByte (msg, cur.state.alpha);
+		if (bits & U_SCALE)
+			MSG_WriteByte (msg, cur.state.scale);
+		if (bits & U_FRAME2)
+			MSG_WriteByte (msg, cur.state.frame >> 8);
+		if (bits & U_MODEL2)
+			MSG_WriteByte (msg, cur.state.modelindex >> 8);
+		if (bits & U_LERPFINISH)
+			MSG_WriteByte (msg, cur.lerpfinish);
+	}
+
+	MSG_WriteByte (msg, U_REMOVE);
+	MSG_WriteByte (msg, 0);
+
+	if (ref)
+	{
+		for (i = 0; i < ref->numents; i++)
+			snap->refindex[ref->ents[i].num] = 0;
+		snap->statdeltas++;
+	}
+	snap->statentbytes += msg->cursize - start;
+}
 
 /*
 =============
 SV_WriteEntitiesToClient
 
+Thread-safe: only reads shared server state and writes to the snapshot
 =============
 */
-void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
+static void SV_WriteEntitiesToClient (edict_t *clent, svsnapshot_t *snap)
 {
 	int		e, i, j, numents;
 	int		bits;
-	byte	*pvs;
-	vec3_t	org, forward, right, up;
+	byte	*pvs = snap->pvs;
+	float	*org = snap->org;
+	vec3_t	forward, right, up;
 	float	miss, dist, size;
-	eval_t	*val;
 	edict_t	*ent;
-
-// find the client's PVS
-	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-	pvs = SV_FatPVS (org, sv.worldmodel);
+	sizebuf_t	*msg = &snap->msg;
+	uint16_t	*net_edicts = snap->edicts;
+	uint16_t	*net_edicts_sorted = snap->sorted;
+	byte		*net_edict_dists = snap->dists;
+	int			*net_edict_bins = snap->bins;
+	int			maxents = snap->capacity;
 
 // find the client's orientation
 	AngleVectors (clent->v.v_angle, forward, right, up);
 
 // reset sorting bins
-	memset (net_edict_bins, 0, sizeof (net_edict_bins));
+	memset (net_edict_bins, 0, sizeof (snap->bins));
 
 // add clent
 	if (sv_netsort.value)
@@ -778,7 +1281,7 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 			else
 				net_edicts_sorted[numents] = e;
 
-			if (++numents == MAX_NET_EDICTS)
+			if (++numents == maxents)
 				break;
 		}
 		else
@@ -789,7 +1292,7 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 	{
 		// compute bin offsets
 		e = 0;
-		for (i=0 ; i<countof(net_edict_bins) ; i++)
+		for (i=0 ; i<countof(snap->bins) ; i++)
 		{
 			int tmp = net_edict_bins[i];
 			net_edict_bins[i] = e;
@@ -801,6 +1304,12 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 			net_edicts_sorted[net_edict_bins[net_edict_dists[e]]++] = net_edicts[e];
 	}
 
+	if (snap->delta)
+	{
+		SV_WriteSnapshotEntities (snap, numents);
+		return;
+	}
+
 // send entities (closest first)
 	for (j=0 ; j<numents ; j++)
 	{
@@ -813,14 +1322,8 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 		// FIXME: Use tighter limit according to protocol flags and send bits.
 		if (msg->cursize + 40 > msg->maxsize)
 		{
-			//johnfitz -- less spammy overflow message
-			if (!dev_overflows.packetsize || dev_overflows.packetsize + CONSOLE_RESPAM_TIME < realtime )
-			{
-				Con_Printf ("Packet overflow!\n");
-				dev_overflows.packetsize = realtime;
-			}
-			goto stats;
-			//johnfitz
+			snap->overflow = true; // reported by SV_SendClientDatagram
+			return;
 		}
 
 // send an update
@@ -860,23 +1363,13 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 		if (ent->baseline.modelindex != ent->v.modelindex)
 			bits |= U_MODEL;
 
-		//johnfitz -- alpha
-		// TODO: find a cleaner place to put this code
-		val = GetEdictFieldValueByName(ent, "alpha");
-		if (val)
-			ent->alpha = ENTALPHA_ENCODE(val->_float);
+		// alpha and scale were refreshed by SV_UpdateEntityAlphaScale
 
-		//don't send invisible entities unless they have effects
+		//johnfitz -- don't send invisible entities unless they have effects
 		if (ent->alpha == ENTALPHA_ZERO && !((int)ent->v.effects & qcvm->effects_mask))
 			continue;
 		//johnfitz
 
-		val = GetEdictFieldValueByName(ent, "scale");
-		if (val)
-			ent->scale = ENTSCALE_ENCODE(val->_float);
-		else
-			ent->scale = ENTSCALE_DEFAULT;
-
 		//johnfitz -- PROTOCOL_FITZQUAKE
 		if (sv.protocol != PROTOCOL_NETQUAKE)
 		{
@@ -953,14 +1446,27 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 			MSG_WriteByte(msg, (byte)(Q_rint((ent->v.nextthink-qcvm->time)*255)));
 		//johnfitz
 	}
+}
 
-	//johnfitz -- devstats
-stats:
-	if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
-		Con_DWarning ("%i byte packet exceeds standard limit of 1024 (max = %d).\n", msg->cursize, msg->maxsize);
-	dev_stats.packetsize = msg->cursize;
-	dev_peakstats.packetsize = q_max(msg->cursize, dev_peakstats.packetsize);
-	//johnfitz
+/*
+=============
+SV_BuildSnapshot
+
+Task callback writing the entity part of a client's datagram
+=============
+*/
+static void SV_BuildSnapshot (int clientnum, void *unused)
+{
+	svsnapshot_t	*snap = &sv_snapshots[clientnum];
+	qcvm_t			*oldvm;
+
+	if (!snap->pending)
+		return;
+
+	// qcvm is thread-local
+	PR_PushQCVM (&sv.qcvm, &oldvm);
+	SV_WriteEntitiesToClient (svs.clients[clientnum].edict, snap);
+	PR_PopQCVM (oldvm);
 }
 
 /*
@@ -1175,37 +1681,80 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 
 /*
 =======================
-SV_SendClientDatagram
+SV_BeginClientDatagram
+
+Writes the time and client data and prepares the snapshot
+for the entity pass, on the main thread
 =======================
 */
-qboolean SV_SendClientDatagram (client_t *client)
+static void SV_BeginClientDatagram (client_t *client, svsnapshot_t *snap)
 {
-	byte		buf[MAX_DATAGRAM];
-	sizebuf_t	msg;
+	sizebuf_t	*msg = &snap->msg;
 
-	msg.data = buf;
-	msg.maxsize = sizeof(buf);
-	msg.cursize = 0;
+	msg->data = snap->buf;
+	msg->maxsize = sizeof(snap->buf);
+	msg->cursize = 0;
+	msg->allowoverflow = false;
+	msg->overflowed = false;
 
 	//johnfitz -- if client is nonlocal, use smaller max size so packets aren't fragmented
 	if (Q_strcmp(NET_QSocketGetAddressString(client->netconnection), "LOCAL") != 0)
-		msg.maxsize = DATAGRAM_MTU;
+		msg->maxsize = DATAGRAM_MTU;
 	//johnfitz
 
-	MSG_WriteByte (&msg, svc_time);
-	MSG_WriteFloat (&msg, qcvm->time);
+	MSG_WriteByte (msg, svc_time);
+	MSG_WriteFloat (msg, qcvm->time);
 
 // add the client specific data to the datagram
-	SV_WriteClientdataToMessage (client->edict, &msg);
+	SV_WriteClientdataToMessage (client->edict, msg);
 
-	SV_WriteEntitiesToClient (client->edict, &msg);
+	snap->delta = client->deltasnapshots && sv_deltasnapshots.value;
+	snap->ack = client->snapshotack;
+	SV_PrepareSnapshot (client->edict, snap);
+	snap->overflow = false;
+	snap->pending = true;
+}
+
+/*
+=======================
+SV_SendClientDatagram
+
+Finishes a datagram whose entities have been written and sends it
+=======================
+*/
+static qboolean SV_SendClientDatagram (client_t *client, svsnapshot_t *snap)
+{
+	sizebuf_t	*msg = &snap->msg;
+
+	snap->pending = false;
+
+	if (snap->overflow)
+	{
+		//johnfitz -- less spammy overflow message
+		if (!dev_overflows.packetsize || dev_overflows.packetsize + CONSOLE_RESPAM_TIME < realtime )
+		{
+			Con_Printf ("Packet overflow!\n");
+			dev_overflows.packetsize = realtime;
+		}
+		//johnfitz
+	}
+
+	//johnfitz -- devstats
+	if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
+		Con_DWarning ("%i byte packet exceeds standard limit of 1024 (max = %d).\n", msg->cursize, msg->maxsize);
+	dev_stats.packetsize = msg->cursize;
+	dev_peakstats.packetsize = q_max(msg->cursize, dev_peakstats.packetsize);
+	//johnfitz
 
 // copy the server datagram if there is space
-	if (msg.cursize + sv.datagram.cursize < msg.maxsize)
-		SZ_Write (&msg, sv.datagram.data, sv.datagram.cursize);
+	if (msg->cursize + sv.datagram.cursize < msg->maxsize)
+		SZ_Write (msg, sv.datagram.data, sv.datagram.cursize);
+
+	snap->statframes++;
+	snap->statbytes += msg->cursize;
 
 // send the datagram
-	if (NET_SendUnreliableMessage (client->netconnection, &msg) == -1)
+	if (NET_SendUnreliableMessage (client->netconnection, msg) == -1)
 	{
 		SV_DropClient (true);// if the message couldn't send, kick off
 		return false;
@@ -1297,6 +1846,52 @@ void SV_WriteUnderwaterOverride (client_t *client)
 }
 
 
+/*
+=======================
+SV_SnapshotStats_f
+
+snapshot_stats [reset]
+=======================
+*/
+static void SV_SnapshotStats_f (void)
+{
+	int				i;
+	double			elapsed;
+	client_t		*client;
+	svsnapshot_t	*snap;
+
+	if (!sv.active)
+	{
+		Con_Printf ("No active server\n");
+		return;
+	}
+
+	elapsed = realtime - sv_snapstatstime;
+	Con_Printf ("client           mode   frames  delta  bytes/frame  entity bytes   bytes/sec\n");
+	for (i = 0, client = svs.clients; i < svs.maxclients && i < sv_numsnapshots; i++, client++)
+	{
+		if (!client->active)
+			continue;
+		snap = &sv_snapshots[i];
+		Con_Printf ("%-15.15s  %-5s  %6d  %5.1f%%  %11.1f  %12.1f  %10.0f\n",
+			client->name, client->deltasnapshots && sv_deltasnapshots.value ? "delta" : "full",
+			snap->statframes, snap->statframes ? snap->statdeltas * 100.0 / snap->statframes : 0.0,
+			snap->statframes ? snap->statbytes / snap->statframes : 0.0,
+			snap->statframes ? snap->statentbytes / snap->statframes : 0.0,
+			elapsed > 0.0 ? snap->statbytes / elapsed : 0.0);
+	}
+
+	if (Cmd_Argc () >= 2 && !q_strcasecmp (Cmd_Argv (1), "reset"))
+	{
+		for (i = 0; i < sv_numsnapshots; i++)
+		{
+			sv_snapshots[i].statframes = sv_snapshots[i].statdeltas = 0;
+			sv_snapshots[i].statbytes = sv_snapshots[i].statentbytes = 0.0;
+		}
+		sv_snapstatstime = realtime;
+	}
+}
+
 /*
 =======================
 SV_UpdateToReliableMessages
@@ -1369,20 +1964,44 @@ SV_SendClientMessages
 */
 void SV_SendClientMessages (void)
 {
-	int			i;
+	int			i, numpending;
 
 // update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
-// build individual updates
+// build the client and entity data for all spawned clients,
+// the entity part can run in parallel since it only reads server state
+	SV_SetupSnapshots (svs.maxclients);
+	SV_UpdateEntityAlphaScale ();
+	for (i=0, numpending=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
+	{
+		if (host_client->active && host_client->spawned)
+		{
+			SV_BeginClientDatagram (host_client, &sv_snapshots[i]);
+			numpending++;
+		}
+	}
+	if (numpending > 1 && sv_parallelsnapshots.value)
+		Task_ParallelFor (svs.maxclients, 1, SV_BuildSnapshot, NULL);
+	else if (numpending)
+	{
+		for (i=0 ; i<svs.maxclients ; i++)
+			if (sv_snapshots[i].pending)
+				SV_WriteEntitiesToClient (svs.clients[i].edict, &sv_snapshots[i]);
+	}
+
+// send individual updates
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 	{
 		if (!host_client->active)
+		{
+			sv_snapshots[i].pending = false;
 			continue;
+		}
 
-		if (host_client->spawned)
+		if (sv_snapshots[i].pending)
 		{
-			if (!SV_SendClientDatagram (host_client))
+			if (!SV_SendClientDatagram (host_client, &sv_snapshots[i]))
 				continue;
 		}
 		else
@@ -1970,7 +2589,9 @@ void SV_SpawnServer (const char *server)
 // allocate server memory
 	/* Host_ClearMemory() called above already cleared the whole sv structure */
 	qcvm->max_edicts = CLAMP (MIN_EDICTS,(int)max_edicts.value,MAX_EDICTS); //johnfitz -- max_edicts cvar
-	qcvm->edicts = (edict_t *) malloc (qcvm->max_edicts*qcvm->edict_size); // ericw -- sv.edicts switched to use malloc()
+	// ericw -- sv.edicts switched to use malloc()
+	// writes are tracked so save snapshots only copy what changed
+	qcvm->edicts = (edict_t *) Sys_WatchAlloc ((size_t)qcvm->max_edicts*qcvm->edict_size, &qcvm->edictwatch);
 	if (!qcvm->edicts)
 		Sys_Error ("SV_SpawnServer: out of memory (%d edicts x %d bytes)", qcvm->max_edicts, qcvm->edict_size);
 	ClearLink (&qcvm->free_edicts);
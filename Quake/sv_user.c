@@ -527,8 +527,10 @@ nextmsg:
 
 			case clc_stringcmd:
 				s = MSG_ReadString ();
-				if (q_strncasecmp(s, "spawn", 5) && q_strncasecmp(s, "begin", 5) && q_strncasecmp(s, "prespawn", 8) && qcvm->extfuncs.SV_ParseClientCommand)
+				if (q_strncasecmp(s, "spawn", 5) && q_strncasecmp(s, "begin", 5) && q_strncasecmp(s, "prespawn", 8) &&
+					q_strncasecmp(s, "deltasnapshots", 14) && qcvm->extfuncs.SV_ParseClientCommand)
 				{	//the spawn/begin/prespawn are because of numerous mods that disobey the rules.
+					//deltasnapshots is engine-to-engine and means nothing to the progs.
 					//at a minimum, we must be able to join the server, so that we can see any sprints/bprints (because dprint sucks, yes there's proper ways to deal with this, but moders don't always know them).
 					client_t *ohc = host_client;
 					qboolean checked = GetBit (qcvm->checked_ext, KRIMZON_SV_PARSECLIENTCOMMAND);
@@ -588,6 +590,8 @@ nextmsg:
 					ret = 1;
 				else if (q_strncasecmp(s, "ban", 3) == 0)
 					ret = 1;
+				else if (q_strncasecmp(s, "deltasnapshots", 14) == 0)
+					ret = 1;
 
 				if (ret == 1)
 					Cmd_ExecuteString (s, src_client);
@@ -602,6 +606,10 @@ nextmsg:
 			case clc_move:
 				SV_ReadClientMove (&host_client->cmd);
 				break;
+
+			case clc_ackframe:
+				SV_AckSnapshot (host_client, (unsigned int) MSG_ReadLong ());
+				break;
 			}
 		}
 	} while (ret == 1);
@@ -102,6 +102,35 @@ int Sys_FileType (const char *path);
 /* returns an FS entity type, i.e. FS_ENT_FILE or FS_ENT_DIRECTORY.
  * returns FS_ENT_NONE (0) if no such file or directory is present. */
 
+typedef struct sysmapping_s {
+	void	*base;		/* NULL if nothing is mapped */
+	size_t	size;
+} sysmapping_t;
+
+void *Sys_MapFile (FILE *f, qfileofs_t ofs, size_t len, sysmapping_t *map);
+/* maps len bytes of f starting at ofs, returns a pointer to the first byte
+ * or NULL on failure. The view is copy-on-write: it can be modified without
+ * affecting the file. It stays valid until Sys_UnmapFile, even if f is closed. */
+void Sys_UnmapFile (sysmapping_t *map);
+
+typedef struct syswatch_s {
+	byte		*base;		/* NULL if nothing is allocated */
+	size_t		size;		/* rounded up to whole pages */
+	size_t		pagesize;	/* 0 if writes aren't tracked */
+	void		*state;
+	qboolean	armed;
+} syswatch_t;
+
+void *Sys_WatchAlloc (size_t size, syswatch_t *watch);
+/* allocates size zero-filled bytes and tracks which pages get written, if the
+ * platform allows it. Only one allocation is tracked at a time, any others are
+ * plain memory. Returns NULL on failure. */
+qboolean Sys_WatchGetWrites (syswatch_t *watch, byte *pages);
+/* sets pages[i] to 1 for every page written since the previous call, then
+ * starts over. Returns false if that isn't known (first call, or writes aren't
+ * tracked), in which case every page should be treated as written. */
+void Sys_WatchFree (syswatch_t *watch);
+
 qboolean Sys_IsDebuggerPresent (void);
 
 void *Sys_LoadLibrary (const char *path);
@@ -34,6 +34,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <signal.h>
 #include <fcntl.h>
 #include <time.h>
 #include <dirent.h>
@@ -124,6 +126,152 @@ qboolean Sys_FileExists (const char *path)
 	return access (path, F_OK) == 0;
 }
 
+void *Sys_MapFile (FILE *f, qfileofs_t ofs, size_t len, sysmapping_t *map)
+{
+	long		pagesize = sysconf (_SC_PAGESIZE);
+	qfileofs_t	aligned = ofs - ofs % (pagesize > 0 ? pagesize : 4096);
+	void		*base;
+
+	map->base = NULL;
+	map->size = 0;
+	if (!len || ofs < 0)
+		return NULL;
+
+	base = mmap (NULL, len + (size_t)(ofs - aligned), PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno (f), (off_t)aligned);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	map->base = base;
+	map->size = len + (size_t)(ofs - aligned);
+	return (byte *)base + (ofs - aligned);
+}
+
+void Sys_UnmapFile (sysmapping_t *map)
+{
+	if (map->base)
+		munmap (map->base, map->size);
+	map->base = NULL;
+	map->size = 0;
+}
+
+/* write tracking: the watched pages are made read-only, the first write to
+ * each one faults, gets recorded and makes the page writable again */
+static syswatch_t		*sys_watch;
+static qboolean			sys_watchhandler;
+static struct sigaction	sys_oldsegv;
+static struct sigaction	sys_oldbus;
+
+static void Sys_WatchFault (int sig, siginfo_t *info, void *context)
+{
+	syswatch_t			*watch = sys_watch;
+	byte				*addr = (byte *) info->si_addr;
+	struct sigaction	*old;
+	size_t				page;
+
+	if (watch && addr >= watch->base && addr < watch->base + watch->size)
+	{
+		page = (size_t)(addr - watch->base) / watch->pagesize;
+		((byte *) watch->state)[page] = 1;
+		if (mprotect (watch->base + page * watch->pagesize, watch->pagesize, PROT_READ | PROT_WRITE) == 0)
+			return;
+	}
+
+	/* not ours, let the previous handler deal with it */
+	old = (sig == SIGBUS) ? &sys_oldbus : &sys_oldsegv;
+	if (old->sa_flags & SA_SIGINFO)
+		old->sa_sigaction (sig, info, context);
+	else if (old->sa_handler != SIG_DFL && old->sa_handler != SIG_IGN)
+		old->sa_handler (sig);
+	else
+		sigaction (sig, old, NULL); /* the fault repeats with the default action */
+}
+
+void *Sys_WatchAlloc (size_t size, syswatch_t *watch)
+{
+	long	pagesize = sysconf (_SC_PAGESIZE);
+	void	*base;
+
+	memset (watch, 0, sizeof (*watch));
+	if (pagesize <= 0)
+		pagesize = 4096;
+	size = (size + pagesize - 1) & ~((size_t) pagesize - 1);
+
+	if (!sys_watch && !COM_CheckParm ("-nowritewatch"))
+	{
+		if (!sys_watchhandler)
+		{
+			struct sigaction sa;
+			memset (&sa, 0, sizeof (sa));
+			sa.sa_sigaction = Sys_WatchFault;
+			sa.sa_flags = SA_SIGINFO;
+			sigemptyset (&sa.sa_mask);
+			sys_watchhandler = sigaction (SIGSEGV, &sa, &sys_oldsegv) == 0 &&
+				sigaction (SIGBUS, &sa, &sys_oldbus) == 0;
+		}
+
+		base = sys_watchhandler ? mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0) : MAP_FAILED;
+		if (base != MAP_FAILED)
+		{
+			watch->state = calloc (size / pagesize, 1);
+			if (watch->state)
+			{
+				watch->base = (byte *) base;
+				watch->size = size;
+				watch->pagesize = pagesize;
+				sys_watch = watch;
+				return base;
+			}
+			munmap (base, size);
+		}
+	}
+
+	watch->base = (byte *) calloc (1, size);
+	watch->size = size;
+	return watch->base;
+}
+
+qboolean Sys_WatchGetWrites (syswatch_t *watch, byte *pages)
+{
+	byte		*written = (byte *) watch->state;
+	qboolean	known = watch->armed;
+	size_t		i, count;
+
+	if (!watch->pagesize)
+		return false;
+
+	count = watch->size / watch->pagesize;
+	for (i = 0; i < count; i++)
+	{
+		if (written[i])
+		{
+			pages[i] = 1;
+			written[i] = 0;
+		}
+	}
+
+	watch->armed = mprotect (watch->base, watch->size, PROT_READ) == 0;
+	if (!watch->armed)
+	{	/* give up on tracking */
+		mprotect (watch->base, watch->size, PROT_READ | PROT_WRITE);
+		return false;
+	}
+
+	return known;
+}
+
+void Sys_WatchFree (syswatch_t *watch)
+{
+	if (watch->pagesize)
+	{
+		sys_watch = NULL;
+		munmap (watch->base, watch->size);
+		free (watch->state);
+	}
+	else
+		free (watch->base);
+	memset (watch, 0, sizeof (*watch));
+}
+
 int Sys_FileType (const char *path)
 {
 	/*
@@ -171,6 +171,113 @@ qfileofs_t Sys_filelength (FILE *f)
 	return end;
 }
 
+void *Sys_MapFile (FILE *f, qfileofs_t ofs, size_t len, sysmapping_t *map)
+{
+	SYSTEM_INFO	info;
+	HANDLE		file, mapping;
+	qfileofs_t	aligned;
+	void		*base;
+
+	map->base = NULL;
+	map->size = 0;
+	if (!len || ofs < 0)
+		return NULL;
+
+	file = (HANDLE) _get_osfhandle (_fileno (f));
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	mapping = CreateFileMappingW (file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (!mapping)
+		return NULL;
+
+	GetSystemInfo (&info);
+	aligned = ofs - ofs % info.dwAllocationGranularity;
+	base = MapViewOfFile (mapping, FILE_MAP_COPY, (DWORD)(aligned >> 32), (DWORD)aligned, len + (size_t)(ofs - aligned));
+	CloseHandle (mapping); // the view keeps the mapping alive
+	if (!base)
+		return NULL;
+
+	map->base = base;
+	map->size = len + (size_t)(ofs - aligned);
+	return (byte *)base + (ofs - aligned);
+}
+
+void Sys_UnmapFile (sysmapping_t *map)
+{
+	if (map->base)
+		UnmapViewOfFile (map->base);
+	map->base = NULL;
+	map->size = 0;
+}
+
+static qboolean	sys_watching; // only one allocation is tracked at a time
+
+void *Sys_WatchAlloc (size_t size, syswatch_t *watch)
+{
+	SYSTEM_INFO		info;
+	void			*base;
+
+	memset (watch, 0, sizeof (*watch));
+	GetSystemInfo (&info);
+	size = (size + info.dwPageSize - 1) & ~((size_t) info.dwPageSize - 1);
+
+	if (!sys_watching && !COM_CheckParm ("-nowritewatch"))
+	{
+		base = VirtualAlloc (NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE);
+		if (base)
+		{
+			watch->state = malloc (size / info.dwPageSize * sizeof (PVOID));
+			if (watch->state)
+			{
+				watch->base = (byte *) base;
+				watch->size = size;
+				watch->pagesize = info.dwPageSize;
+				sys_watching = true;
+				return base;
+			}
+			VirtualFree (base, 0, MEM_RELEASE);
+		}
+	}
+
+	watch->base = (byte *) calloc (1, size);
+	watch->size = size;
+	return watch->base;
+}
+
+qboolean Sys_WatchGetWrites (syswatch_t *watch, byte *pages)
+{
+	PVOID		*addresses = (PVOID *) watch->state;
+	qboolean	known = watch->armed;
+	ULONG_PTR	i, count;
+	ULONG		granularity;
+
+	if (!watch->pagesize)
+		return false;
+
+	count = watch->size / watch->pagesize;
+	watch->armed = GetWriteWatch (WRITE_WATCH_FLAG_RESET, watch->base, watch->size, addresses, &count, &granularity) == 0;
+	if (!watch->armed)
+		return false;
+
+	for (i = 0; i < count; i++)
+		pages[((byte *) addresses[i] - watch->base) / watch->pagesize] = 1;
+
+	return known;
+}
+
+void Sys_WatchFree (syswatch_t *watch)
+{
+	if (watch->pagesize)
+	{
+		VirtualFree (watch->base, 0, MEM_RELEASE);
+		free (watch->state);
+		sys_watching = false;
+	}
+	else
+		free (watch->base);
+	memset (watch, 0, sizeof (*watch));
+}
+
 #ifndef INVALID_FILE_ATTRIBUTES
 #define INVALID_FILE_ATTRIBUTES	((DWORD)-1)
 #endif
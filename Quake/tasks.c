@@ -0,0 +1,480 @@
+/*
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "quakedef.h"
+
+/*
+==============================================================================
+
+Job system. Every worker owns a deque of jobs: it pushes and pops its own
+jobs at the bottom and other workers steal from the top when they run out
+of work. Threads that aren't workers (main thread, save thread, etc.) share
+an extra deque that the workers steal from.
+
+Jobs belong to a taskgroup_t, which is a counter of unfinished jobs.
+A job can be made to depend on another group: it is held back until that
+group's counter drops to zero. Threads waiting on a group run jobs
+themselves in the meantime, so nested waits can't deadlock the pool.
+
+==============================================================================
+*/
+
+#define MAX_WORKERS			32
+#define TASK_DEQUE_SIZE		256		// must be a power of 2
+
+typedef struct
+{
+	taskfunc_t		func;
+	void			*data;
+	taskgroup_t		*group;
+} task_t;
+
+typedef struct
+{
+	SDL_SpinLock	lock;
+	volatile int	top, bottom;	// top == bottom means empty
+	task_t			tasks[TASK_DEQUE_SIZE];
+	SDL_atomic_t	executed;
+	SDL_atomic_t	stolen;
+} taskdeque_t;
+
+static SDL_mutex		*task_mutex;
+static SDL_cond			*task_available;
+static SDL_cond			*task_done;
+static SDL_atomic_t		task_queued;		// jobs sitting in the deques
+static SDL_atomic_t		task_sleeping;		// workers blocked on task_available
+static SDL_TLSID		task_tls;			// deque index + 1 for worker threads
+static taskdeque_t		task_deques[MAX_WORKERS + 1];	// [0] is shared by non-worker threads
+static SDL_Thread		*task_workers[MAX_WORKERS];
+static int				task_numworkers;
+static qboolean			task_shutdown;
+
+static SDL_atomic_t		task_inline;		// jobs run by Task_Submit itself
+
+/*
+=================
+Task_MyDeque
+=================
+*/
+static int Task_MyDeque (void)
+{
+	return task_tls ? (int)(intptr_t) SDL_TLSGet (task_tls) : 0;
+}
+
+/*
+=================
+Task_Push
+=================
+*/
+static qboolean Task_Push (int index, const task_t *task)
+{
+	taskdeque_t	*dq = &task_deques[index];
+	qboolean	ok = false;
+
+	SDL_AtomicLock (&dq->lock);
+	if (dq->bottom - dq->top < TASK_DEQUE_SIZE)
+	{
+		dq->tasks[dq->bottom & (TASK_DEQUE_SIZE - 1)] = *task;
+		dq->bottom++;
+		ok = true;
+	}
+	SDL_AtomicUnlock (&dq->lock);
+
+	return ok;
+}
+
+/*
+=================
+Task_Take
+
+Pops from the bottom of the deque (owner) or the top (thief)
+=================
+*/
+static qboolean Task_Take (int index, task_t *task, qboolean steal)
+{
+	taskdeque_t	*dq = &task_deques[index];
+	qboolean	ok = false;
+
+	if (dq->bottom == dq->top) // racy early out, rechecked under the lock
+		return false;
+
+	SDL_AtomicLock (&dq->lock);
+	if (dq->bottom != dq->top)
+	{
+		if (steal)
+			*task = dq->tasks[dq->top++ & (TASK_DEQUE_SIZE - 1)];
+		else
+			*task = dq->tasks[--dq->bottom & (TASK_DEQUE_SIZE - 1)];
+		ok = true;
+	}
+	SDL_AtomicUnlock (&dq->lock);
+
+	return ok;
+}
+
+/*
+=================
+Task_Find
+
+Looks for a job in our own deque first, then tries the others
+=================
+*/
+static qboolean Task_Find (int self, task_t *task)
+{
+	int i, victim;
+
+	if (Task_Take (self, task, self == 0))
+		goto found;
+
+	for (i = 1, victim = self; i <= task_numworkers; i++)
+	{
+		victim = (victim + 1) % (task_numworkers + 1);
+		if (Task_Take (victim, task, true))
+		{
+			SDL_AtomicAdd (&task_deques[self].stolen, 1);
+			goto found;
+		}
+	}
+
+	return false;
+
+found:
+	SDL_AtomicAdd (&task_queued, -1);
+	return true;
+}
+
+static void Task_Finish (taskgroup_t *group);
+
+/*
+=================
+Task_Enqueue
+=================
+*/
+static void Task_Enqueue (const task_t *task)
+{
+	int self = Task_MyDeque ();
+
+	if (!task_numworkers || (!Task_Push (self, task) && !Task_Push (0, task)))
+	{
+		// no workers or no room, run it right here
+		task->func (task->data);
+		SDL_AtomicAdd (&task_inline, 1);
+		Task_Finish (task->group);
+		return;
+	}
+
+	SDL_AtomicAdd (&task_queued, 1);
+	if (SDL_AtomicGet (&task_sleeping))
+	{
+		SDL_LockMutex (task_mutex);
+		SDL_CondSignal (task_available);
+		SDL_UnlockMutex (task_mutex);
+	}
+}
+
+/*
+=================
+Task_Finish
+
+Drops the group counter, and once it reaches zero wakes up waiters.
+The group may be gone as soon as the counter drops, so it isn't
+touched afterwards
+=================
+*/
+static void Task_Finish (taskgroup_t *group)
+{
+	if (SDL_AtomicAdd (&group->pending, -1) != 1)
+		return;
+
+	SDL_LockMutex (task_mutex);
+	SDL_CondBroadcast (task_done);
+	SDL_UnlockMutex (task_mutex);
+}
+
+/*
+=================
+Task_Run
+=================
+*/
+static void Task_Run (int self, const task_t *task)
+{
+	TRACE_BEGIN ("Task");
+	task->func (task->data);
+	TRACE_END ();
+	SDL_AtomicAdd (&task_deques[self].executed, 1);
+	Task_Finish (task->group);
+}
+
+/*
+=================
+Task_Worker
+=================
+*/
+static int SDLCALL Task_Worker (void *param)
+{
+	int		self = (int)(intptr_t) param;
+	task_t	task;
+
+	SDL_TLSSet (task_tls, param, NULL);
+
+#ifdef USE_TRACE
+	{
+		char name[32];
+		q_snprintf (name, sizeof (name), "worker %d", self);
+		TRACE_THREAD_NAME (name);
+	}
+#endif
+
+	for (;;)
+	{
+		if (Task_Find (self, &task))
+		{
+			Task_Run (self, &task);
+			continue;
+		}
+
+		SDL_LockMutex (task_mutex);
+		SDL_AtomicAdd (&task_sleeping, 1);
+		while (!task_shutdown && !SDL_AtomicGet (&task_queued))
+			SDL_CondWait (task_available, task_mutex);
+		SDL_AtomicAdd (&task_sleeping, -1);
+		if (task_shutdown)
+		{
+			SDL_UnlockMutex (task_mutex);
+			break;
+		}
+		SDL_UnlockMutex (task_mutex);
+	}
+
+	return 0;
+}
+
+/*
+=================
+Tasks_Stats_f
+=================
+*/
+static void Tasks_Stats_f (void)
+{
+	int i;
+
+	Con_Printf ("%d worker(s), %d queued, %d run inline\n",
+		task_numworkers, SDL_AtomicGet (&task_queued), SDL_AtomicGet (&task_inline));
+	for (i = 0; i <= task_numworkers; i++)
+		Con_Printf ("%-8s %2d: %8d executed, %8d stolen\n", i ? "worker" : "main",
+			i, SDL_AtomicGet (&task_deques[i].executed), SDL_AtomicGet (&task_deques[i].stolen));
+
+	if (Cmd_Argc () >= 2 && !q_strcasecmp (Cmd_Argv (1), "reset"))
+	{
+		SDL_AtomicSet (&task_inline, 0);
+		for (i = 0; i <= task_numworkers; i++)
+		{
+			SDL_AtomicSet (&task_deques[i].executed, 0);
+			SDL_AtomicSet (&task_deques[i].stolen, 0);
+		}
+	}
+}
+
+/*
+=================
+Tasks_Init
+=================
+*/
+void Tasks_Init (void)
+{
+	int i, count;
+
+	task_mutex = SDL_CreateMutex ();
+	task_available = SDL_CreateCond ();
+	task_done = SDL_CreateCond ();
+	task_tls = SDL_TLSCreate ();
+	if (!task_mutex || !task_available || !task_done || !task_tls)
+		Sys_Error ("Tasks_Init: %s", SDL_GetError ());
+
+	count = CLAMP (0, host_parms->numcpus - 1, MAX_WORKERS);
+	i = COM_CheckParm ("-workers");
+	if (i && i < com_argc - 1)
+		count = CLAMP (0, Q_atoi (com_argv[i + 1]), MAX_WORKERS);
+
+	for (i = 0; i < count; i++)
+	{
+		// publish the count before starting the thread so it can steal from all deques
+		task_numworkers = i + 1;
+		task_workers[i] = SDL_CreateThread (Task_Worker, "Worker", (void *)(intptr_t)(i + 1));
+		if (!task_workers[i])
+		{
+			Sys_Printf ("Tasks_Init: could not create worker thread: %s\n", SDL_GetError ());
+			task_numworkers = i;
+			break;
+		}
+	}
+	Sys_Printf ("Task workers: %d\n", task_numworkers);
+}
+
+/*
+=================
+Tasks_InitCommands
+
+Called once the command system is up
+=================
+*/
+void Tasks_InitCommands (void)
+{
+	Cmd_AddCommand ("tasks", Tasks_Stats_f);
+}
+
+/*
+=================
+Tasks_Shutdown
+=================
+*/
+void Tasks_Shutdown (void)
+{
+	int i;
+
+	if (!task_mutex)
+		return;
+
+	SDL_LockMutex (task_mutex);
+	task_shutdown = true;
+	SDL_CondBroadcast (task_available);
+	SDL_UnlockMutex (task_mutex);
+
+	for (i = 0; i < task_numworkers; i++)
+		SDL_WaitThread (task_workers[i], NULL);
+	task_numworkers = 0;
+}
+
+/*
+=================
+Tasks_NumWorkers
+=================
+*/
+int Tasks_NumWorkers (void)
+{
+	return task_numworkers;
+}
+
+/*
+=================
+Task_Submit
+=================
+*/
+void Task_Submit (taskgroup_t *group, taskfunc_t func, void *data)
+{
+	task_t task;
+
+	task.func = func;
+	task.data = data;
+	task.group = group;
+
+	SDL_AtomicAdd (&group->pending, 1);
+	Task_Enqueue (&task);
+}
+
+/*
+=================
+Task_Done
+=================
+*/
+qboolean Task_Done (taskgroup_t *group)
+{
+	return !SDL_AtomicGet (&group->pending);
+}
+
+/*
+=================
+Task_Wait
+=================
+*/
+void Task_Wait (taskgroup_t *group)
+{
+	int		self;
+	task_t	task;
+
+	if (!SDL_AtomicGet (&group->pending))
+		return;
+
+	self = Task_MyDeque ();
+	while (SDL_AtomicGet (&group->pending))
+	{
+		if (Task_Find (self, &task))
+		{
+			Task_Run (self, &task);
+			continue;
+		}
+
+		SDL_LockMutex (task_mutex);
+		if (SDL_AtomicGet (&group->pending) && !SDL_AtomicGet (&task_queued))
+			SDL_CondWait (task_done, task_mutex);
+		SDL_UnlockMutex (task_mutex);
+	}
+}
+
+/*
+=================
+Task_ParallelFor
+=================
+*/
+typedef struct
+{
+	taskindexfunc_t	func;
+	void			*data;
+	int				count;
+	int				grain;
+	SDL_atomic_t	next;
+} parallelfor_t;
+
+static void Task_ParallelForChunks (void *data)
+{
+	parallelfor_t	*pf = (parallelfor_t *) data;
+	int				i, start, end;
+
+	while ((start = SDL_AtomicAdd (&pf->next, pf->grain)) < pf->count)
+	{
+		end = q_min (start + pf->grain, pf->count);
+		for (i = start; i < end; i++)
+			pf->func (i, pf->data);
+	}
+}
+
+void Task_ParallelFor (int count, int grain, taskindexfunc_t func, void *data)
+{
+	parallelfor_t	pf;
+	taskgroup_t		group;
+	int				i, helpers;
+
+	if (count <= 0)
+		return;
+	if (grain < 1)
+		grain = 1;
+
+	pf.func = func;
+	pf.data = data;
+	pf.count = count;
+	pf.grain = grain;
+	SDL_AtomicSet (&pf.next, 0);
+	SDL_AtomicSet (&group.pending, 0);
+
+	helpers = q_min (task_numworkers, (count + grain - 1) / grain - 1);
+	for (i = 0; i < helpers; i++)
+		Task_Submit (&group, Task_ParallelForChunks, &pf);
+	Task_ParallelForChunks (&pf);
+	Task_Wait (&group);
+}
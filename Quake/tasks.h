@@ -0,0 +1,53 @@
+/*
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _TASKS_H_
+#define _TASKS_H_
+
+typedef void (*taskfunc_t) (void *data);
+typedef void (*taskindexfunc_t) (int index, void *data);
+
+// A counter of unfinished tasks that can be waited on as a whole
+typedef struct taskgroup_s
+{
+	SDL_atomic_t	pending;
+} taskgroup_t;
+
+void Tasks_Init (void);
+void Tasks_InitCommands (void);
+void Tasks_Shutdown (void);
+int Tasks_NumWorkers (void);
+
+// Queues func (data) for a worker thread.
+// Runs it right away if there are no workers or the queue is full.
+void Task_Submit (taskgroup_t *group, taskfunc_t func, void *data);
+
+// Returns true once all tasks in the group are done, after which
+// nothing in the task system touches the group anymore
+qboolean Task_Done (taskgroup_t *group);
+
+// Blocks until all tasks in the group are done,
+// running queued tasks on the calling thread in the meantime
+void Task_Wait (taskgroup_t *group);
+
+// Calls func (i, data) for every i in [0, count), spread over the workers
+// and the calling thread in chunks of grain indices. Returns when done.
+void Task_ParallelFor (int count, int grain, taskindexfunc_t func, void *data);
+
+#endif /* _TASKS_H_ */
@@ -0,0 +1,345 @@
+/*
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+/*
+==============================================================================
+
+Zone tracing.  Every thread that opens a zone gets its own ring buffer of
+finished zones, so recording takes no locks.  The rings keep the most
+recent TRACE_MAX_EVENTS zones per thread; trace_stop writes whatever they
+hold as "complete" events in the Chrome trace event format, which both
+chrome://tracing and ui.perfetto.dev open.
+
+Zones that are open when tracing starts or stops are dropped: every
+trace_start bumps a generation counter and threads reset their zone
+stack when they notice it.
+
+==============================================================================
+*/
+
+#ifdef USE_TRACE
+
+#define TRACE_MAX_EVENTS	65536	// per thread, must be a power of 2
+#define TRACE_MAX_DEPTH		32
+#define TRACE_MAX_THREADS	64
+
+typedef struct
+{
+	const char		*name;
+	Uint64			start;
+	Uint64			end;
+} traceevent_t;
+
+typedef struct
+{
+	char			name[32];
+	SDL_threadID	id;
+	int				generation;		// trace_generation the stack belongs to
+	int				depth;
+	const char		*stackname[TRACE_MAX_DEPTH];
+	Uint64			stackstart[TRACE_MAX_DEPTH];
+	SDL_atomic_t	numevents;		// total written since trace_start, the ring keeps the last ones
+	traceevent_t	*events;		// allocated by the first zone
+} tracethread_t;
+
+SDL_atomic_t			trace_active;
+
+static SDL_atomic_t		trace_generation;
+static SDL_TLSID		trace_tls;
+static SDL_SpinLock		trace_lock;
+static tracethread_t	*trace_threads[TRACE_MAX_THREADS];	// protected by trace_lock
+static int				trace_numthreads;
+static Uint64			trace_starttime;
+
+/*
+=================
+Trace_GetThread
+
+Returns the calling thread's trace state, creating it on first use
+=================
+*/
+static tracethread_t *Trace_GetThread (void)
+{
+	tracethread_t *t = (tracethread_t *) SDL_TLSGet (trace_tls);
+
+	if (t)
+		return t;
+
+	SDL_AtomicLock (&trace_lock);
+	if (trace_numthreads < TRACE_MAX_THREADS)
+	{
+		t = (tracethread_t *) calloc (1, sizeof (*t));
+		if (t)
+		{
+			t->id = SDL_ThreadID ();
+			q_snprintf (t->name, sizeof (t->name), "thread %lu", (unsigned long) t->id);
+			t->generation = SDL_AtomicGet (&trace_generation);
+			trace_threads[trace_numthreads++] = t;
+		}
+	}
+	SDL_AtomicUnlock (&trace_lock);
+
+	if (t)
+		SDL_TLSSet (trace_tls, t, NULL);
+
+	return t;
+}
+
+/*
+=================
+Trace_SetThreadName
+=================
+*/
+void Trace_SetThreadName (const char *name)
+{
+	tracethread_t *t = Trace_GetThread ();
+	if (t)
+		q_strlcpy (t->name, name, sizeof (t->name));
+}
+
+/*
+=================
+Trace_BeginZone
+=================
+*/
+void Trace_BeginZone (const char *name)
+{
+	tracethread_t *t = Trace_GetThread ();
+	int generation = SDL_AtomicGet (&trace_generation);
+
+	if (!t)
+		return;
+
+	if (!t->events)
+		t->events = (traceevent_t *) malloc (TRACE_MAX_EVENTS * sizeof (t->events[0]));
+
+	if (t->generation != generation)
+	{
+		t->generation = generation;
+		t->depth = 0;
+	}
+
+	if (t->depth < TRACE_MAX_DEPTH)
+	{
+		t->stackname[t->depth] = name;
+		t->stackstart[t->depth] = SDL_GetPerformanceCounter ();
+	}
+	t->depth++;
+}
+
+/*
+=================
+Trace_EndZone
+=================
+*/
+void Trace_EndZone (void)
+{
+	tracethread_t *t = Trace_GetThread ();
+	traceevent_t *ev;
+	int index;
+
+	if (!t || t->generation != SDL_AtomicGet (&trace_generation) || t->depth <= 0)
+		return;	// opened before trace_start
+
+	if (--t->depth >= TRACE_MAX_DEPTH || !t->events)
+		return;
+
+	index = SDL_AtomicGet (&t->numevents);
+	ev = &t->events[index & (TRACE_MAX_EVENTS - 1)];
+	ev->name = t->stackname[t->depth];
+	ev->start = t->stackstart[t->depth];
+	ev->end = SDL_GetPerformanceCounter ();
+	SDL_AtomicSet (&t->numevents, index + 1);
+}
+
+/*
+=================
+Trace_EndAllZones
+
+Closes the zones a longjmp skipped over
+=================
+*/
+void Trace_EndAllZones (void)
+{
+	tracethread_t *t = Trace_GetThread ();
+
+	while (t && t->depth > 0 && t->generation == SDL_AtomicGet (&trace_generation))
+		Trace_EndZone ();
+}
+
+/*
+=================
+Trace_WriteString
+=================
+*/
+static void Trace_WriteString (FILE *f, const char *str)
+{
+	fputc ('"', f);
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			fputc ('\\', f);
+		if ((unsigned char) *str >= 32)
+			fputc (*str, f);
+	}
+	fputc ('"', f);
+}
+
+/*
+=================
+Trace_Write
+=================
+*/
+static void Trace_Write (FILE *f)
+{
+	double		scale = 1e6 / SDL_GetPerformanceFrequency ();
+	qboolean	first = true;
+	int			i, j, count, total;
+
+	fprintf (f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	SDL_AtomicLock (&trace_lock);
+	for (i = 0; i < trace_numthreads; i++)
+	{
+		tracethread_t *t = trace_threads[i];
+
+		total = t->events ? SDL_AtomicGet (&t->numevents) : 0;
+		count = q_min (total, TRACE_MAX_EVENTS);
+		if (!count)
+			continue;
+
+		fprintf (f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", i + 1);
+		Trace_WriteString (f, t->name);
+		fprintf (f, "}}");
+		first = false;
+
+		for (j = total - count; j < total; j++)
+		{
+			const traceevent_t *ev = &t->events[j & (TRACE_MAX_EVENTS - 1)];
+			if (ev->start < trace_starttime)
+				continue;
+			fprintf (f, ",\n{\"ph\":\"X\",\"name\":");
+			Trace_WriteString (f, ev->name);
+			fprintf (f, ",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				i + 1, (ev->start - trace_starttime) * scale, (ev->end - ev->start) * scale);
+		}
+
+		if (total > count)
+			Con_Printf ("%s: kept the last %d of %d zones\n", t->name, count, total);
+	}
+	SDL_AtomicUnlock (&trace_lock);
+
+	fprintf (f, "\n]}\n");
+}
+
+/*
+=================
+Trace_Start_f
+=================
+*/
+static void Trace_Start_f (void)
+{
+	int i;
+
+	if (SDL_AtomicGet (&trace_active))
+	{
+		Con_Printf ("Already tracing\n");
+		return;
+	}
+
+	SDL_AtomicLock (&trace_lock);
+	for (i = 0; i < trace_numthreads; i++)
+		SDL_AtomicSet (&trace_threads[i]->numevents, 0);
+	SDL_AtomicUnlock (&trace_lock);
+
+	SDL_AtomicIncRef (&trace_generation);
+	trace_starttime = SDL_GetPerformanceCounter ();
+	SDL_AtomicSet (&trace_active, 1);
+
+	Con_Printf ("Tracing started\n");
+}
+
+/*
+=================
+Trace_Stop_f
+
+trace_stop [filename]
+=================
+*/
+static void Trace_Stop_f (void)
+{
+	char	relname[MAX_OSPATH];
+	char	name[MAX_OSPATH];
+	FILE	*f;
+
+	if (!SDL_AtomicGet (&trace_active))
+	{
+		Con_Printf ("Not tracing\n");
+		return;
+	}
+	SDL_AtomicSet (&trace_active, 0);
+
+	q_strlcpy (relname, Cmd_Argc () >= 2 ? Cmd_Argv (1) : "trace", sizeof (relname));
+	COM_AddExtension (relname, ".json", sizeof (relname));
+	q_snprintf (name, sizeof (name), "%s/%s", com_gamedir, relname);
+
+	f = Sys_fopen (name, "wb");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open %s\n", relname);
+		return;
+	}
+	Trace_Write (f);
+	fclose (f);
+
+	Con_SafePrintf ("Wrote ");
+	Con_LinkPrintf (name, "%s", relname);
+	Con_SafePrintf (" (%.1f s)\n", (SDL_GetPerformanceCounter () - trace_starttime) / (double) SDL_GetPerformanceFrequency ());
+}
+
+#endif /* USE_TRACE */
+
+/*
+=================
+Trace_Init
+
+Must run before other threads are started
+=================
+*/
+void Trace_Init (void)
+{
+#ifdef USE_TRACE
+	trace_tls = SDL_TLSCreate ();
+	Trace_SetThreadName ("main");
+#endif
+}
+
+/*
+=================
+Trace_InitCommands
+=================
+*/
+void Trace_InitCommands (void)
+{
+#ifdef USE_TRACE
+	Cmd_AddCommand ("trace_start", Trace_Start_f);
+	Cmd_AddCommand ("trace_stop", Trace_Stop_f);
+#endif
+}
@@ -0,0 +1,58 @@
+/*
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+// Timed zones for trace_start/trace_stop, which writes them out as a
+// Chrome/Perfetto trace.  Zones nest per thread and must be closed on the
+// thread that opened them; names must be string literals (or otherwise
+// outlive the trace).  Build with NO_TRACE to compile them out.
+
+#ifndef NO_TRACE
+#define USE_TRACE
+#endif
+
+void Trace_Init (void);
+void Trace_InitCommands (void);
+
+#ifdef USE_TRACE
+
+extern SDL_atomic_t trace_active;
+
+void Trace_SetThreadName (const char *name);
+void Trace_BeginZone (const char *name);
+void Trace_EndZone (void);
+void Trace_EndAllZones (void);
+
+#define TRACE_THREAD_NAME(name)	Trace_SetThreadName (name)
+#define TRACE_BEGIN(name)		do { if (SDL_AtomicGet (&trace_active)) Trace_BeginZone (name); } while (0)
+#define TRACE_END()				do { if (SDL_AtomicGet (&trace_active)) Trace_EndZone (); } while (0)
+#define TRACE_END_ALL()			do { if (SDL_AtomicGet (&trace_active)) Trace_EndAllZones (); } while (0)
+
+#else
+
+#define TRACE_THREAD_NAME(name)	((void)0)
+#define TRACE_BEGIN(name)		((void)0)
+#define TRACE_END()				((void)0)
+#define TRACE_END_ALL()			((void)0)
+
+#endif /* USE_TRACE */
+
+#endif /* _TRACE_H_ */
@@ -323,6 +323,66 @@ SV_AreaTriggerEdicts ( edict_t *ent, areanode_t *node, edict_t **list, int *list
 		SV_AreaTriggerEdicts ( ent, node->children[1], list, listcount, listspace );
 }
 
+/*
+====================
+SV_AreaEdictsRecursive
+====================
+*/
+static void SV_AreaEdictsRecursive (areanode_t *node, const vec3_t mins, const vec3_t maxs, edict_t **list, int *listcount, const int listspace)
+{
+	link_t		*l, *next, *start;
+	edict_t		*check;
+	int			i;
+
+	for (i = 0; i < 2; i++)
+	{
+		start = i ? &node->solid_edicts : &node->trigger_edicts;
+		for (l = start->next ; l != start ; l = next)
+		{
+			next = l->next;
+			check = EDICT_FROM_AREA(l);
+			if (mins[0] > check->v.absmax[0]
+			|| mins[1] > check->v.absmax[1]
+			|| mins[2] > check->v.absmax[2]
+			|| maxs[0] < check->v.absmin[0]
+			|| maxs[1] < check->v.absmin[1]
+			|| maxs[2] < check->v.absmin[2] )
+				continue;
+
+			if (*listcount == listspace)
+				return; // should never happen
+
+			list[*listcount] = check;
+			(*listcount)++;
+		}
+	}
+
+// recurse down both sides
+	if (node->axis == -1)
+		return;
+
+	if ( maxs[node->axis] > node->dist )
+		SV_AreaEdictsRecursive ( node->children[0], mins, maxs, list, listcount, listspace );
+	if ( mins[node->axis] < node->dist )
+		SV_AreaEdictsRecursive ( node->children[1], mins, maxs, list, listcount, listspace );
+}
+
+/*
+====================
+SV_AreaEdicts
+
+Fills list with the linked (solid or trigger) edicts whose abs box,
+as of their last SV_LinkEdict, intersects the given box.
+Returns the number of edicts found, in no particular order.
+====================
+*/
+int SV_AreaEdicts (const vec3_t mins, const vec3_t maxs, edict_t **list, int listspace)
+{
+	int listcount = 0;
+	SV_AreaEdictsRecursive (sv_areanodes, mins, maxs, list, &listcount, listspace);
+	return listcount;
+}
+
 /*
 ====================
 SV_TouchLinks
@@ -66,6 +66,11 @@ int SV_TruePointContents (vec3_t p);
 // does not check any entities at all
 // the non-true version remaps the water current contents to content_water
 
+int SV_AreaEdicts (const vec3_t mins, const vec3_t maxs, edict_t **list, int listspace);
+// fills list with the solid and trigger edicts whose abs box intersects mins/maxs
+// uses the abs box from the last SV_LinkEdict call, so entities moved without
+// relinking may be missed
+
 edict_t	*SV_TestEntityPosition (edict_t *ent);
 
 trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict);
@@ -697,6 +697,30 @@ cache_system_t *Cache_TryAlloc (int size, qboolean nobottom);
 
 cache_system_t	cache_head;
 
+static SDL_mutex	*cache_lock;
+
+/*
+===========
+Cache_Lock
+===========
+*/
+void Cache_Lock (void)
+{
+	if (cache_lock)
+		SDL_LockMutex (cache_lock);
+}
+
+/*
+===========
+Cache_Unlock
+===========
+*/
+void Cache_Unlock (void)
+{
+	if (cache_lock)
+		SDL_UnlockMutex (cache_lock);
+}
+
 /*
 ===========
 Cache_Move
@@ -706,6 +730,8 @@ void Cache_Move ( cache_system_t *c)
 {
 	cache_system_t		*new_cs;
 
+	Cache_Lock ();
+
 // we are clearing up space at the bottom, so only allocate it late
 	new_cs = Cache_TryAlloc (c->size, true);
 	if (new_cs)
@@ -724,6 +750,8 @@ void Cache_Move ( cache_system_t *c)
 
 		Cache_Free (c->user, true); // tough luck... //johnfitz -- added second argument
 	}
+
+	Cache_Unlock ();
 }
 
 /*
@@ -908,6 +936,10 @@ void Cache_Init (void)
 	cache_head.next = cache_head.prev = &cache_head;
 	cache_head.lru_next = cache_head.lru_prev = &cache_head;
 
+	cache_lock = SDL_CreateMutex ();
+	if (!cache_lock)
+		Sys_Error ("Cache_Init: %s", SDL_GetError ());
+
 	Cmd_AddCommand ("flush", Cache_Flush);
 }
 
@@ -927,12 +959,16 @@ void Cache_Free (cache_user_t *c, qboolean freetextures) //johnfitz -- added sec
 
 	cs = ((cache_system_t *)c->data) - 1;
 
+	Cache_Lock ();
+
 	cs->prev->next = cs->next;
 	cs->next->prev = cs->prev;
 	cs->next = cs->prev = NULL;
 
 	c->data = NULL;
 
+	Cache_Unlock ();
+
 	Cache_UnlinkLRU (cs);
 
 	//johnfitz -- if a model becomes uncached, free the gltextures.  This only works
@@ -983,6 +1019,8 @@ void *Cache_Alloc (cache_user_t *c, int size, const char *name)
 
 	size = (size + sizeof(cache_system_t) + 15) & ~15;
 
+	Cache_Lock ();
+
 // find memory for it
 	while (1)
 	{
@@ -1002,6 +1040,8 @@ void *Cache_Alloc (cache_user_t *c, int size, const char *name)
 		Cache_Free (cache_head.lru_prev->user, true); //johnfitz -- added second argument
 	}
 
+	Cache_Unlock ();
+
 	return Cache_Check (c);
 }
 
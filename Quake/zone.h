@@ -111,8 +111,15 @@ void Cache_Free (cache_user_t *c, qboolean freetextures); //johnfitz -- added se
 void *Cache_Alloc (cache_user_t *c, int size, const char *name);
 // Returns NULL if all purgable data was tossed and there still
 // wasn't enough room.
+// The data is visible to other threads as soon as this returns, so
+// callers sharing it with them hold Cache_Lock until it is filled in.
 
 void Cache_Report (void);
 
+void Cache_Lock (void);
+void Cache_Unlock (void);
+// Held by other threads while they read cached data directly, so that
+// it can't be moved or freed underneath them
+
 #endif	/* __ZZONE_H */
 